@@ -284,6 +284,8 @@ class CurlClient:
                 request.http_verb,
                 "-i",
                 f"-m {timeout}",
+                # Responses are parsed as HTTP/1.1, even if the node offers h2
+                "--http1.1",
             ]
 
             if request.allow_redirects:
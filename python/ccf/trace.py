@@ -0,0 +1,140 @@
+# Copyright (c) Microsoft Corporation. All rights reserved.
+# Licensed under the Apache 2.0 License.
+import argparse
+import json
+import struct
+
+from typing import BinaryIO, Iterator, List, NamedTuple
+
+# Layout of tracing::Span (src/ds/tracing.h)
+SPAN_FORMAT = "<QQQHB5x"
+SPAN_SIZE = struct.calcsize(SPAN_FORMAT)
+
+# Indexed by tracing::SpanKind
+SPAN_KINDS = [
+    "ringbuffer",
+    "queued",
+    "tls_read",
+    "http_parse",
+    "execute",
+    "commit",
+    "replicate",
+    "global_commit",
+]
+
+# Spans which wait on something else, rather than doing work on their thread.
+# They overlap with other work on the same thread, so are drawn as async
+# events, grouped by trace.
+WAIT_KINDS = {"ringbuffer", "queued", "global_commit"}
+
+
+class Span(NamedTuple):
+    trace_id: int
+    start_ns: int
+    end_ns: int
+    thread_id: int
+    kind: str
+
+
+def read_spans(f: BinaryIO) -> Iterator[Span]:
+    while True:
+        buffer = f.read(SPAN_SIZE)
+        if len(buffer) < SPAN_SIZE:
+            return
+        trace_id, start_ns, end_ns, thread_id, kind = struct.unpack(
+            SPAN_FORMAT, buffer
+        )
+        kind_name = SPAN_KINDS[kind] if kind < len(SPAN_KINDS) else f"kind_{kind}"
+        yield Span(trace_id, start_ns, end_ns, thread_id, kind_name)
+
+
+def to_chrome_trace(spans: List[Span], pid: int = 0) -> dict:
+    """
+    Converts spans to the Chrome trace event format, which can be loaded in
+    chrome://tracing or https://ui.perfetto.dev. Timestamps are relative to the
+    earliest span.
+    """
+    events: List[dict] = []
+    if not spans:
+        return {"traceEvents": events}
+
+    origin = min(s.start_ns for s in spans)
+
+    def us(ns):
+        return (ns - origin) / 1000
+
+    thread_ids = sorted({s.thread_id for s in spans})
+    for tid in thread_ids:
+        events.append(
+            {
+                "name": "thread_name",
+                "ph": "M",
+                "pid": pid,
+                "tid": tid,
+                "args": {"name": "main" if tid == 0 else f"worker {tid}"},
+            }
+        )
+
+    for s in sorted(spans, key=lambda s: (s.start_ns, -s.end_ns)):
+        args = {"trace_id": s.trace_id}
+        if s.kind in WAIT_KINDS:
+            common = {
+                "name": s.kind,
+                "cat": "wait",
+                "id": s.trace_id,
+                "pid": pid,
+                "tid": s.thread_id,
+            }
+            events.append({**common, "ph": "b", "ts": us(s.start_ns), "args": args})
+            events.append({**common, "ph": "e", "ts": us(s.end_ns)})
+        else:
+            events.append(
+                {
+                    "name": s.kind,
+                    "cat": "work",
+                    "ph": "X",
+                    "ts": us(s.start_ns),
+                    "dur": (s.end_ns - s.start_ns) / 1000,
+                    "pid": pid,
+                    "tid": s.thread_id,
+                    "args": args,
+                }
+            )
+
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Convert a node's request trace file (see cchost --trace-file) "
+        "to the Chrome trace format"
+    )
+    parser.add_argument("trace_file", type=str, help="Path to the trace file")
+    parser.add_argument(
+        "-o",
+        "--output",
+        type=str,
+        default="trace.json",
+        help="Path to which the Chrome trace JSON is written",
+    )
+    parser.add_argument(
+        "--trace-id",
+        type=int,
+        action="append",
+        help="Only include the spans of this trace (may be repeated)",
+    )
+    args = parser.parse_args()
+
+    with open(args.trace_file, "rb") as f:
+        spans = list(read_spans(f))
+
+    if args.trace_id:
+        wanted = set(args.trace_id)
+        spans = [s for s in spans if s.trace_id in wanted]
+
+    with open(args.output, "w") as f:
+        json.dump(to_chrome_trace(spans), f)
+
+    print(
+        f"Wrote {len(spans)} spans of {len({s.trace_id for s in spans})} traces to {args.output}"
+    )
@@ -2,6 +2,7 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "http/http2.h"
 #include "http/http_builder.h"
 #include "http/http_consts.h"
 #include "http/http_parser.h"
@@ -15,10 +16,15 @@
 #include <http/http_sig.h>
 #include <nlohmann/json.hpp>
 #include <optional>
+#include <queue>
 #include <thread>
+#include <tls/base64.h>
 #include <tls/key_pair.h>
+#include <unordered_map>
 
-class HttpRpcTlsClient : public TlsClient, public http::ResponseProcessor
+class HttpRpcTlsClient : public TlsClient,
+                         public http::ResponseProcessor,
+                         public http2::ResponseProcessor
 {
 public:
   struct PreparedRpc
@@ -46,6 +52,56 @@ protected:
   size_t next_send_id = 0;
   size_t next_recv_id = 0;
 
+  // With HTTP/2, requests are sent on concurrent streams, and responses may
+  // arrive in any order. Each response has the id of its request.
+  std::unique_ptr<http2::ClientSession> h2;
+  std::unordered_map<uint32_t, size_t> stream_request_ids;
+  std::queue<Response> h2_responses;
+
+  void start_http2()
+  {
+    h2 = std::make_unique<http2::ClientSession>(*this);
+    write_http2_output();
+  }
+
+  void write_http2_output()
+  {
+    if (h2->has_output())
+    {
+      write(h2->take_output());
+    }
+  }
+
+  void read_http2()
+  {
+    const auto next = read_all();
+    h2->recv(next.data(), next.size());
+
+    // Acknowledgements and window updates
+    write_http2_output();
+
+    if (h2->is_closed())
+    {
+      throw std::logic_error("HTTP/2 session closed");
+    }
+  }
+
+  std::vector<uint8_t> gen_http2_request(const http::Request& r)
+  {
+    http2::hpack::HeaderList fields = {
+      {":method", llhttp_method_name(r.get_method())},
+      {":scheme", "https"},
+      {":authority", fmt::format("{}:{}", host, port)},
+      {":path", r.get_path() + r.get_formatted_query()}};
+    for (const auto& [k, v] : r.get_headers())
+    {
+      fields.emplace_back(k, v);
+    }
+
+    return http2::prepare_request(
+      fields, r.get_content_data(), r.get_content_length());
+  }
+
   std::vector<uint8_t> gen_ws_upgrade_request()
   {
     auto r = http::Request("/", HTTP_GET);
@@ -57,7 +113,7 @@ protected:
     return r.build_request();
   }
 
-  std::vector<uint8_t> gen_http_request_internal(
+  http::Request make_http_request(
     const std::string& method,
     const CBuffer params,
     const std::string& content_type,
@@ -84,6 +140,24 @@ protected:
       http::sign_request(r, key_pair, key_id);
     }
 
+    return r;
+  }
+
+  std::vector<uint8_t> gen_http_request_internal(
+    const std::string& method,
+    const CBuffer params,
+    const std::string& content_type,
+    llhttp_method verb,
+    const char* auth_token = nullptr)
+  {
+    const auto r =
+      make_http_request(method, params, content_type, verb, auth_token);
+
+    if (h2 != nullptr)
+    {
+      return gen_http2_request(r);
+    }
+
     return r.build_request();
   }
 
@@ -122,7 +196,8 @@ protected:
 
   Response call_raw(const PreparedRpc& prep)
   {
-    return call_raw(prep.encoded);
+    send_request(prep);
+    return read_response();
   }
 
   std::optional<Response> last_response;
@@ -147,7 +222,12 @@ public:
     key_id(c.key_id),
     parser(*this),
     ws_parser(*this)
-  {}
+  {
+    if (c.h2 != nullptr)
+    {
+      start_http2();
+    }
+  }
 
   void upgrade_to_ws()
   {
@@ -158,6 +238,17 @@ public:
     is_ws = true;
   }
 
+  void use_http2()
+  {
+    static const char* protocols[] = {http2::alpn_id, nullptr};
+    alpn_protocols = protocols;
+    reconnect();
+
+    if (get_alpn_protocol() != http2::alpn_id)
+      throw std::logic_error("Failed to negotiate HTTP/2");
+    start_http2();
+  }
+
   void create_key_pair(const tls::Pem priv_key)
   {
     key_pair = tls::make_key_pair(priv_key);
@@ -194,6 +285,25 @@ public:
       auth_token);
   }
 
+  // Describes a request, to be sent later in a request to the batch endpoint
+  nlohmann::json gen_batched_request(
+    const std::string& method,
+    const CBuffer params,
+    const std::string& content_type,
+    llhttp_method verb = HTTP_POST,
+    const char* auth_token = nullptr)
+  {
+    const auto r =
+      make_http_request(method, params, content_type, verb, auth_token);
+
+    nlohmann::json j;
+    j["verb"] = llhttp_method_name(verb);
+    j["path"] = r.get_path() + r.get_formatted_query();
+    j["headers"] = r.get_headers();
+    j["body_base64"] = tls::b64_from_raw(params.p, params.n);
+    return j;
+  }
+
   Response call(
     const std::string& method,
     const nlohmann::json& params = nullptr,
@@ -257,8 +367,40 @@ public:
     return std::string(resp.body.begin(), resp.body.end());
   }
 
+  // Sends a prepared request, without waiting for its response
+  void send_request(const PreparedRpc& prep)
+  {
+    if (h2 == nullptr)
+    {
+      write(prep.encoded);
+      return;
+    }
+
+    // Wait for a stream if the server's concurrent stream limit is reached
+    while (!h2->can_send_request())
+    {
+      read_http2();
+    }
+
+    const auto stream_id = h2->send_prepared(prep.encoded);
+    stream_request_ids.emplace(stream_id, prep.id);
+    write_http2_output();
+  }
+
   Response read_response()
   {
+    if (h2 != nullptr)
+    {
+      while (h2_responses.empty())
+      {
+        read_http2();
+      }
+
+      auto response = std::move(h2_responses.front());
+      h2_responses.pop();
+      return response;
+    }
+
     last_response = std::nullopt;
 
     while (!last_response.has_value())
@@ -283,6 +425,21 @@ public:
 
   std::optional<Response> read_response_non_blocking()
   {
+    if (h2 != nullptr)
+    {
+      if (h2_responses.empty() && bytes_available())
+      {
+        read_http2();
+      }
+
+      if (h2_responses.empty())
+      {
+        return std::nullopt;
+      }
+
+      return read_response();
+    }
+
     if (bytes_available())
     {
       return read_response();
@@ -300,6 +457,37 @@ public:
       next_recv_id++, status, std::move(headers), std::move(body)};
   }
 
+  void handle_response(
+    uint32_t stream_id,
+    http2::hpack::HeaderList&& fields,
+    std::vector<uint8_t>&& body) override
+  {
+    auto it = stream_request_ids.find(stream_id);
+    if (it == stream_request_ids.end())
+    {
+      throw std::logic_error(
+        fmt::format("Response on unexpected stream {}", stream_id));
+    }
+    const auto id = it->second;
+    stream_request_ids.erase(it);
+
+    http_status status = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+    http::HeaderMap headers;
+    for (auto& [name, value] : fields)
+    {
+      if (name == ":status")
+      {
+        status = (http_status)std::stoi(value);
+      }
+      else
+      {
+        headers.emplace(std::move(name), std::move(value));
+      }
+    }
+
+    h2_responses.push({id, status, std::move(headers), std::move(body)});
+  }
+
   void set_prefix(const std::string& prefix_)
   {
     prefix = prefix_;
@@ -28,8 +28,15 @@ protected:
   std::string port;
   std::shared_ptr<tls::CA> node_ca;
   std::shared_ptr<tls::Cert> cert;
+  // Null-terminated list of the protocols offered via ALPN, if any
+  const char** alpn_protocols = nullptr;
   bool connected = false;
 
+  // Session established by the last handshake, which later connections (see
+  // reconnect() and the copy constructor) offer to resume, with the session
+  // ticket issued by the server
+  std::shared_ptr<mbedtls_ssl_session> session = nullptr;
+
   mbedtls::NetContext server_fd;
   mbedtls::Entropy entropy;
   mbedtls::CtrDrbg ctr_drbg;
@@ -71,6 +78,13 @@ protected:
       tmp_conf.get(), mbedtls_ctr_drbg_random, tmp_ctr_drbg.get());
     mbedtls_ssl_conf_authmode(tmp_conf.get(), MBEDTLS_SSL_VERIFY_REQUIRED);
 
+    if (alpn_protocols != nullptr)
+    {
+      err = mbedtls_ssl_conf_alpn_protocols(tmp_conf.get(), alpn_protocols);
+      if (err)
+        throw std::logic_error(tls::error_string(err));
+    }
+
     err = mbedtls_ssl_setup(tmp_ssl.get(), tmp_conf.get());
     if (err)
       throw std::logic_error(tls::error_string(err));
@@ -85,6 +99,13 @@ protected:
       mbedtls_net_recv,
       nullptr);
 
+    if (session != nullptr)
+    {
+      err = mbedtls_ssl_set_session(tmp_ssl.get(), session.get());
+      if (err)
+        throw std::logic_error(tls::error_string(err));
+    }
+
     while (true)
     {
       err = mbedtls_ssl_handshake(tmp_ssl.get());
@@ -97,6 +118,10 @@ protected:
     }
     connected = true;
 
+    auto tmp_session = mbedtls::make_unique<mbedtls::SSLSession>();
+    if (mbedtls_ssl_get_session(tmp_ssl.get(), tmp_session.get()) == 0)
+      session = std::move(tmp_session);
+
     server_fd = std::move(tmp_server_fd);
     entropy = std::move(tmp_entropy);
     ctr_drbg = std::move(tmp_ctr_drbg);
@@ -122,7 +147,9 @@ public:
     host(c.host),
     port(c.port),
     node_ca(c.node_ca),
-    cert(c.cert)
+    cert(c.cert),
+    alpn_protocols(c.alpn_protocols),
+    session(c.session)
   {
     init();
   }
@@ -139,6 +166,24 @@ public:
     return mbedtls_ssl_get_ciphersuite(ssl.get());
   }
 
+  std::string get_alpn_protocol()
+  {
+    const auto protocol = mbedtls_ssl_get_alpn_protocol(ssl.get());
+    return protocol == nullptr ? std::string() : std::string(protocol);
+  }
+
+  // Replaces the connection with a new one, eg. after changing the protocols
+  // offered via ALPN
+  void reconnect()
+  {
+    if (connected)
+    {
+      mbedtls_ssl_close_notify(ssl.get());
+      connected = false;
+    }
+    init();
+  }
+
   void write(CBuffer b)
   {
     for (size_t written = 0; written < b.n;)
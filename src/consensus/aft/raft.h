@@ -21,6 +21,7 @@
 #include "ds/logger.h"
 #include "ds/serialized.h"
 #include "ds/spin_lock.h"
+#include "ds/tracing.h"
 #include "impl/execution.h"
 #include "impl/request_message.h"
 #include "impl/state.h"
@@ -142,6 +143,14 @@ namespace aft
     // append entries
     bool public_only = false;
 
+    // When this is set, local entries only count towards commit once the host
+    // has reported them as flushed to disk. Persistence reports carry the
+    // number of truncations the host has applied, so that reports covering
+    // entries which have since been rolled back can be discarded.
+    bool require_ledger_persistence = false;
+    Index persisted_idx = 0;
+    size_t ledger_truncations = 0;
+
     // Randomness
     std::uniform_int_distribution<int> distrib;
     std::default_random_engine rand;
@@ -322,6 +331,7 @@ namespace aft
       std::lock_guard<SpinLock> guard(state->lock);
       state->current_view = term;
       state->last_idx = index;
+      persisted_idx = index;
       state->commit_idx = commit_idx_;
       state->view_history.initialise(terms);
       state->view_history.update(index, term);
@@ -337,6 +347,7 @@ namespace aft
       std::lock_guard<SpinLock> guard(state->lock);
 
       state->last_idx = index;
+      persisted_idx = index;
       state->commit_idx = index;
 
       state->view_history.initialise(term_history);
@@ -352,6 +363,53 @@ namespace aft
       return state->last_idx;
     }
 
+    void enable_ledger_persistence(size_t prior_truncations)
+    {
+      // prior_truncations is the number of ledger truncations issued to the
+      // host before this instance was created
+      std::lock_guard<SpinLock> guard(state->lock);
+      if (consensus_type == ConsensusType::BFT)
+      {
+        LOG_FAIL_FMT("Ledger persistence is not supported with BFT consensus");
+        return;
+      }
+
+      require_ledger_persistence = true;
+      ledger_truncations = prior_truncations;
+    }
+
+    void ledger_persisted(Index idx, size_t truncations)
+    {
+      std::lock_guard<SpinLock> guard(state->lock);
+      if (!require_ledger_persistence || truncations != ledger_truncations)
+      {
+        LOG_DEBUG_FMT(
+          "Ignoring ledger persistence report for {} ({} truncations, expected "
+          "{})",
+          idx,
+          truncations,
+          ledger_truncations);
+        return;
+      }
+
+      if (idx <= persisted_idx)
+      {
+        return;
+      }
+      persisted_idx = std::min(idx, state->last_idx);
+
+      // The local match index has advanced: a leader may now be able to
+      // commit, while a follower acknowledges the persisted entries
+      if (replica_state == Leader)
+      {
+        update_commit();
+      }
+      else if (replica_state == Follower && leader_id != NoNode)
+      {
+        send_append_entries_response(leader_id, AppendEntriesResponseType::OK);
+      }
+    }
+
     Index get_commit_idx()
     {
       std::lock_guard<SpinLock> guard(state->lock);
@@ -436,6 +494,8 @@ namespace aft
         entries,
       Term term)
     {
+      tracing::SpanTimer span(tracing::SpanKind::Replicate);
+
       if (consensus_type == ConsensusType::BFT && is_follower())
       {
         // Already under lock in the current BFT path
@@ -1317,7 +1377,7 @@ namespace aft
           // already there. This will only occur on BFT startup so not a perf
           // problem but still need to be resolved.
           state->last_idx = i - 1;
-          ledger->truncate(state->last_idx);
+          truncate_ledger(state->last_idx);
           send_append_entries_response(
             r.from_node, AppendEntriesResponseType::FAIL);
           return;
@@ -1345,7 +1405,7 @@ namespace aft
           {
             LOG_FAIL_FMT("Follower failed to apply log entry: {}", i);
             state->last_idx--;
-            ledger->truncate(state->last_idx);
+            truncate_ledger(state->last_idx);
             send_append_entries_response(
               r.from_node, AppendEntriesResponseType::FAIL);
             break;
@@ -1470,17 +1530,23 @@ namespace aft
     void send_append_entries_response(
       NodeId to, AppendEntriesResponseType answer)
     {
+      // Successful responses only acknowledge entries that can count towards
+      // commit, whereas failures report the actual end of the local log
+      const auto response_idx = answer == AppendEntriesResponseType::OK ?
+        local_match_idx() :
+        state->last_idx;
+
       LOG_DEBUG_FMT(
         "Send append entries response from {} to {} for index {}: {}",
         state->my_node_id,
         to,
-        state->last_idx,
+        response_idx,
         answer);
 
       AppendEntriesResponse response = {
         {raft_append_entries_response, state->my_node_id},
         state->current_view,
-        state->last_idx,
+        response_idx,
         answer};
 
       channels->send_authenticated(
@@ -2034,7 +2100,7 @@ namespace aft
       // Immediately commit if there are no other nodes.
       if (nodes.size() == 0)
       {
-        commit(state->last_idx);
+        commit(local_match_idx());
         return;
       }
 
@@ -2120,7 +2186,7 @@ namespace aft
         {
           if (node.first == state->my_node_id)
           {
-            match.push_back(state->last_idx);
+            match.push_back(local_match_idx());
           }
           else
           {
@@ -2257,6 +2323,22 @@ namespace aft
       }
     }
 
+    Index local_match_idx() const
+    {
+      if (require_ledger_persistence)
+      {
+        return std::min(persisted_idx, state->last_idx);
+      }
+      return state->last_idx;
+    }
+
+    void truncate_ledger(Index idx)
+    {
+      ledger->truncate(idx);
+      ledger_truncations++;
+      persisted_idx = std::min(persisted_idx, idx);
+    }
+
     void rollback(Index idx)
     {
       if (idx < state->commit_idx)
@@ -2272,7 +2354,7 @@ namespace aft
       snapshotter->rollback(idx);
       store->rollback(idx, state->current_view);
       LOG_DEBUG_FMT("Setting term in store to: {}", state->current_view);
-      ledger->truncate(idx);
+      truncate_ledger(idx);
       state->last_idx = idx;
       LOG_DEBUG_FMT("Rolled back at {}", idx);
 
@@ -137,6 +137,11 @@ namespace aft
       aft->periodic(elapsed);
     }
 
+    void ledger_persisted(SeqNo seqno, size_t truncations) override
+    {
+      aft->ledger_persisted(seqno, truncations);
+    }
+
     void enable_all_domains() override
     {
       aft->enable_all_domains();
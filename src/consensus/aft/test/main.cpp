@@ -119,6 +119,61 @@ DOCTEST_TEST_CASE("Single node commit" * doctest::test_suite("single"))
   }
 }
 
+DOCTEST_TEST_CASE(
+  "Single node commit with durable ledger" * doctest::test_suite("single"))
+{
+  auto kv_store = std::make_shared<Store>(0);
+  aft::NodeId node_id(0);
+  ms election_timeout(150);
+
+  TRaft r0(
+    ConsensusType::CFT,
+    std::make_unique<Adaptor>(kv_store),
+    std::make_unique<aft::LedgerStubProxy>(node_id),
+    std::make_shared<aft::ChannelStubProxy>(),
+    std::make_shared<aft::StubSnapshotter>(),
+    nullptr,
+    nullptr,
+    cert,
+    std::make_shared<aft::State>(node_id),
+    nullptr,
+    nullptr,
+    nullptr,
+    ms(10),
+    election_timeout,
+    ms(1000));
+  r0.enable_ledger_persistence(0);
+
+  aft::Configuration::Nodes config;
+  config[node_id] = {};
+  r0.add_configuration(0, config);
+
+  r0.periodic(election_timeout * 2);
+  DOCTEST_REQUIRE(r0.is_primary());
+
+  DOCTEST_INFO("Entries are only committed once persisted by the host");
+  for (size_t i = 1; i <= 5; ++i)
+  {
+    auto entry = std::make_shared<std::vector<uint8_t>>();
+    entry->push_back(1);
+    auto hooks = std::make_shared<kv::ConsensusHookPtrs>();
+
+    r0.replicate(kv::BatchVector{{i, entry, true, hooks}}, 1);
+    DOCTEST_REQUIRE(r0.get_last_idx() == i);
+    DOCTEST_REQUIRE(r0.get_commit_idx() == 0);
+  }
+
+  r0.ledger_persisted(3, 0);
+  DOCTEST_REQUIRE(r0.get_commit_idx() == 3);
+
+  DOCTEST_INFO("Reports issued before a ledger truncation are ignored");
+  r0.ledger_persisted(5, 1);
+  DOCTEST_REQUIRE(r0.get_commit_idx() == 3);
+
+  r0.ledger_persisted(5, 0);
+  DOCTEST_REQUIRE(r0.get_commit_idx() == 5);
+}
+
 DOCTEST_TEST_CASE(
   "Multiple nodes startup and election" * doctest::test_suite("multiple"))
 {
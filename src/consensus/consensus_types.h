@@ -15,11 +15,15 @@ namespace consensus
     size_t raft_election_timeout;
     size_t bft_view_change_timeout;
     size_t bft_status_interval;
+    // If true, entries only count towards commit once the host has reported
+    // them as flushed to disk (see consensus::ledger_persisted)
+    bool durable_ledger = false;
     MSGPACK_DEFINE(
       raft_request_timeout,
       raft_election_timeout,
       bft_view_change_timeout,
-      bft_status_interval);
+      bft_status_interval,
+      durable_ledger);
   };
 
 #pragma pack(push, 1)
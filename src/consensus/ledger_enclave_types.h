@@ -24,6 +24,16 @@ namespace consensus
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_entry),
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_no_entry),
 
+    /// Stream consecutive ledger entries, sent ahead in batches while the
+    /// bytes sent but not yet acknowledged are within a budget. The end of
+    /// the ledger is reported with ledger_no_entry. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_stream_start),
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_stream_ack),
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_stream_stop),
+
+    /// Batch of framed entries of a stream. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_entries),
+
     /// Modify the local ledger. Enclave -> Host
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_append),
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_truncate),
@@ -33,6 +43,10 @@ namespace consensus
     /// Create and commit a snapshot. Enclave -> Host
     DEFINE_RINGBUFFER_MSG_TYPE(snapshot),
     DEFINE_RINGBUFFER_MSG_TYPE(snapshot_commit),
+
+    /// Report that the local ledger has been flushed to disk up to an index.
+    /// Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_persisted),
   };
 }
 
@@ -47,6 +61,20 @@ DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_no_entry,
   consensus::Index,
   consensus::LedgerRequestPurpose);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_stream_start,
+  consensus::Index /* from */,
+  consensus::LedgerRequestPurpose,
+  size_t /* max bytes in flight */);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_stream_ack, size_t /* bytes applied */);
+DECLARE_RINGBUFFER_MESSAGE_NO_PAYLOAD(consensus::ledger_stream_stop);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_entries,
+  consensus::Index /* from */,
+  consensus::Index /* to */,
+  consensus::LedgerRequestPurpose,
+  serializer::ByteRange /* framed entries */);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_init, consensus::Index);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_append,
@@ -65,3 +93,7 @@ DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::snapshot_commit,
   consensus::Index /* snapshot idx */,
   consensus::Index /* evidence commit idx */);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_persisted,
+  consensus::Index /* persisted idx */,
+  size_t /* number of truncations applied so far */);
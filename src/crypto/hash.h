@@ -108,7 +108,33 @@ namespace crypto
     }
   };
 
-  typedef MBedHashProvider HashProvider;
+  // CPU features relevant to the choice of SHA-256 implementation, detected
+  // once at startup via CPUID.
+  struct CpuFeatures
+  {
+    bool sse41 = false;
+    bool sha_ni = false;
+    bool avx2 = false;
+
+    static const CpuFeatures& get();
+  };
+
+  // Implementations of one-shot SHA-256. All produce identical digests; they
+  // differ only in speed.
+  enum class Sha256Provider
+  {
+    MbedTLS,
+    OpenSSL,
+    // Native x86 SHA extensions (SHA-NI). Only available if the CPU supports
+    // them.
+    SHANI
+  };
+
+  DECLARE_JSON_ENUM(
+    Sha256Provider,
+    {{Sha256Provider::MbedTLS, "MbedTLS"},
+     {Sha256Provider::OpenSSL, "OpenSSL"},
+     {Sha256Provider::SHANI, "SHANI"}});
 
   class Sha256Hash
   {
@@ -117,13 +143,28 @@ namespace crypto
     Sha256Hash() : h{0} {}
     Sha256Hash(const CBuffer& data) : h{0}
     {
-      ::SHA256(data.p, data.rawSize(), h.data());
+      sha256(data, h.data());
     }
 
     std::array<uint8_t, SIZE> h;
 
     static void mbedtls_sha256(const CBuffer& data, uint8_t* h);
     static void openssl_sha256(const CBuffer& data, uint8_t* h);
+    static void shani_sha256(const CBuffer& data, uint8_t* h);
+
+    // Hash data with the currently selected provider
+    static void sha256(const CBuffer& data, uint8_t* h);
+
+    static bool is_provider_available(Sha256Provider provider);
+
+    // Selects the provider used by sha256() and by the Sha256Hash(CBuffer)
+    // constructor. Throws if the provider is not supported on this CPU.
+    static void set_provider(Sha256Provider provider);
+    static Sha256Provider get_provider();
+
+    // Provider selected by default. This is always OpenSSL, which itself uses
+    // SHA-NI or AVX2 when the CPU supports them.
+    static Sha256Provider get_default_provider();
 
     friend std::ostream& operator<<(
       std::ostream& os, const crypto::Sha256Hash& h)
@@ -164,6 +205,27 @@ namespace crypto
     return !(lhs == rhs);
   }
 
+  // Uses the selected Sha256Hash provider for SHA-256, and mbedTLS for all
+  // other digests
+  class DispatchHashProvider : public MBedHashProvider
+  {
+  public:
+    virtual HashBytes Hash(
+      const uint8_t* data, size_t size, MDType type) const override
+    {
+      if (type == MDType::SHA256)
+      {
+        HashBytes r(Sha256Hash::SIZE);
+        Sha256Hash::sha256({data, size}, r.data());
+        return r;
+      }
+
+      return MBedHashProvider::Hash(data, size, type);
+    }
+  };
+
+  typedef DispatchHashProvider HashProvider;
+
   // Incremental Hash Objects
   class ISha256HashBase
   {
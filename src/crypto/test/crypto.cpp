@@ -32,4 +32,60 @@ TEST_CASE("ExtendedIv0")
 
   KeyAesGcm k2(getRawKey());
   REQUIRE(k2.decrypt(h.get_iv(), h.tag, p, nullb, p.p));
-}
\ No newline at end of file
+}
+
+TEST_CASE("SHA-256 providers produce identical digests")
+{
+  const std::vector<Sha256Provider> providers = {
+    Sha256Provider::MbedTLS, Sha256Provider::OpenSSL, Sha256Provider::SHANI};
+
+  // Cover every padding case around the 64-byte block boundary, and a few
+  // multi-block messages
+  std::vector<size_t> sizes;
+  for (size_t i = 0; i <= 130; ++i)
+  {
+    sizes.push_back(i);
+  }
+  sizes.push_back(1 << 12);
+  sizes.push_back((1 << 16) + 7);
+
+  for (const auto size : sizes)
+  {
+    std::vector<uint8_t> data(size);
+    for (auto& c : data)
+    {
+      c = rand();
+    }
+
+    Sha256Hash expected;
+    Sha256Hash::mbedtls_sha256(data, expected.h.data());
+
+    for (const auto provider : providers)
+    {
+      if (!Sha256Hash::is_provider_available(provider))
+      {
+        continue;
+      }
+
+      Sha256Hash::set_provider(provider);
+      REQUIRE(Sha256Hash::get_provider() == provider);
+      REQUIRE(Sha256Hash(data) == expected);
+
+      HashProvider hp;
+      const auto bytes = hp.Hash(data.data(), data.size(), MDType::SHA256);
+      REQUIRE(std::equal(bytes.begin(), bytes.end(), expected.h.begin()));
+    }
+  }
+
+  Sha256Hash::set_provider(Sha256Hash::get_default_provider());
+}
+
+TEST_CASE("Unavailable SHA-256 provider cannot be selected")
+{
+  if (!Sha256Hash::is_provider_available(Sha256Provider::SHANI))
+  {
+    REQUIRE_THROWS(Sha256Hash::set_provider(Sha256Provider::SHANI));
+  }
+  REQUIRE(
+    Sha256Hash::is_provider_available(Sha256Hash::get_default_provider()));
+}
@@ -6,44 +6,48 @@
 #define PICOBENCH_IMPLEMENT_WITH_MAIN
 #include <picobench/picobench.hpp>
 
-enum HashImpl
-{
-  mbedtls,
-  openssl
-};
+using namespace crypto;
 
-template <HashImpl IMPL>
+template <Sha256Provider P>
 static void sha256_bench(picobench::state& s)
 {
+  if (!Sha256Hash::is_provider_available(P))
+  {
+    std::cout << "Skipping " << nlohmann::json(P).dump()
+              << ": not supported on this CPU" << std::endl;
+    return;
+  }
+  Sha256Hash::set_provider(P);
+
   std::vector<uint8_t> v(s.iterations());
   for (size_t i = 0; i < v.size(); ++i)
   {
     v.data()[i] = rand();
   }
 
-  crypto::Sha256Hash h;
+  Sha256Hash h;
 
   s.start_timer();
   for (size_t i = 0; i < 10; ++i)
   {
-    if constexpr (IMPL == HashImpl::mbedtls)
-    {
-      crypto::Sha256Hash::mbedtls_sha256(v, h.h.data());
-    }
-    else if constexpr (IMPL == HashImpl::openssl)
-    {
-      crypto::Sha256Hash::openssl_sha256(v, h.h.data());
-    }
+    Sha256Hash::sha256(v, h.h.data());
   }
   s.stop_timer();
+
+  Sha256Hash::set_provider(Sha256Hash::get_default_provider());
 }
 
-const std::vector<int> hash_sizes = {2 << 6, 2 << 8, 2 << 12, 2 << 16, 2 << 18};
+// From 32 bytes (a Merkle tree leaf) to 1MB (a large ledger entry or snapshot)
+const std::vector<int> hash_sizes = {
+  32, 64, 1 << 8, 1 << 10, 1 << 12, 1 << 16, 1 << 18, 1 << 20};
 
 PICOBENCH_SUITE("SHA-256");
 
-auto mbedtls_digest_sha256 = sha256_bench<HashImpl::mbedtls>;
+auto mbedtls_digest_sha256 = sha256_bench<Sha256Provider::MbedTLS>;
 PICOBENCH(mbedtls_digest_sha256).iterations(hash_sizes).baseline();
 
-auto openssl_digest_sha256 = sha256_bench<HashImpl::openssl>;
-PICOBENCH(openssl_digest_sha256).iterations(hash_sizes).baseline();
+auto openssl_digest_sha256 = sha256_bench<Sha256Provider::OpenSSL>;
+PICOBENCH(openssl_digest_sha256).iterations(hash_sizes);
+
+auto shani_digest_sha256 = sha256_bench<Sha256Provider::SHANI>;
+PICOBENCH(shani_digest_sha256).iterations(hash_sizes);
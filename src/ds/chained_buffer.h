@@ -0,0 +1,144 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/serializer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+namespace ds
+{
+  /// Queue of bytes, held in a chain of segments, for data streamed through a
+  /// session (e.g. TLS records read from or written to the host). Appending
+  /// never moves the data already buffered, and consuming from the front only
+  /// advances an offset into the first segment, or drops it once it is fully
+  /// consumed. Buffering a stream therefore costs time linear in its size,
+  /// however it is split into appends and reads.
+  ///
+  /// Owned vectors are appended as segments without being copied. Small
+  /// appends are copied into the spare capacity of the last segment, so that
+  /// they do not each allocate a segment.
+  class ChainedBuffer
+  {
+  private:
+    static constexpr size_t min_segment_size = 4096;
+
+    std::deque<std::vector<uint8_t>> segments;
+
+    // Offset of the first unconsumed byte in the first segment
+    size_t front_offset = 0;
+
+    // Number of unconsumed bytes
+    size_t total = 0;
+
+  public:
+    size_t size() const
+    {
+      return total;
+    }
+
+    bool empty() const
+    {
+      return total == 0;
+    }
+
+    void append(const uint8_t* data, size_t size)
+    {
+      if (size == 0)
+      {
+        return;
+      }
+      total += size;
+
+      if (!segments.empty())
+      {
+        auto& last = segments.back();
+        const auto n = std::min(size, last.capacity() - last.size());
+        last.insert(last.end(), data, data + n);
+        data += n;
+        size -= n;
+      }
+
+      if (size > 0)
+      {
+        auto& segment = segments.emplace_back();
+        segment.reserve(std::max(size, min_segment_size));
+        segment.assign(data, data + size);
+      }
+    }
+
+    void append(std::vector<uint8_t>&& data)
+    {
+      if (data.size() < min_segment_size)
+      {
+        append(data.data(), data.size());
+        return;
+      }
+
+      total += data.size();
+      segments.push_back(std::move(data));
+    }
+
+    /// Returns the contiguous data at the front of the buffer, which remains
+    /// valid until it is consumed or the buffer is cleared. Empty if the
+    /// buffer is empty.
+    serializer::ByteRange front() const
+    {
+      if (total == 0)
+      {
+        return {nullptr, 0};
+      }
+
+      const auto& first = segments.front();
+      return {first.data() + front_offset, first.size() - front_offset};
+    }
+
+    /// Drops up to size bytes from the front of the buffer
+    void consume(size_t size)
+    {
+      size = std::min(size, total);
+      total -= size;
+
+      while (size > 0)
+      {
+        const auto available = segments.front().size() - front_offset;
+        if (size < available)
+        {
+          front_offset += size;
+          return;
+        }
+
+        size -= available;
+        segments.pop_front();
+        front_offset = 0;
+      }
+    }
+
+    /// Copies up to size bytes from the front of the buffer to data, and
+    /// consumes them. Returns the number of bytes copied.
+    size_t read(uint8_t* data, size_t size)
+    {
+      size_t copied = 0;
+      while (copied < size && total > 0)
+      {
+        const auto f = front();
+        const auto n = std::min(size - copied, f.size);
+        ::memcpy(data + copied, f.data, n);
+        consume(n);
+        copied += n;
+      }
+      return copied;
+    }
+
+    void clear()
+    {
+      segments.clear();
+      front_offset = 0;
+      total = 0;
+    }
+  };
+}
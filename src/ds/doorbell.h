@@ -0,0 +1,119 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(INSIDE_ENCLAVE) || defined(VIRTUAL_ENCLAVE)
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#  include <time.h>
+#  include <unistd.h>
+#endif
+
+// Ideally this would be _mm_pause or similar, but finding cross-platform
+// headers that expose this neatly through OE (ie - non-standard std libs) is
+// awkward. Instead we resort to copying OE, and implementing this directly
+// ourselves.
+#define CCF_PAUSE() asm volatile("pause")
+
+// A reader that is idle marks itself as waiting on its ringbuffer (see
+// ringbuffer::Reader::prepare_wait()) and blocks on the waiting word. The next
+// writer clears the word and rings the doorbell, waking the reader up.
+//
+// Code running inside an SGX enclave cannot make syscalls, and instead waits
+// and rings through ocalls, which the host implements with the functions below.
+
+namespace ringbuffer::doorbell
+{
+#if !defined(INSIDE_ENCLAVE) || defined(VIRTUAL_ENCLAVE)
+  /// Blocks while the word is set, for at most timeout
+  inline void wait(
+    std::atomic<uint32_t>* word, std::chrono::microseconds timeout)
+  {
+    const auto s = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timespec ts;
+    ts.tv_sec = s.count();
+    ts.tv_nsec =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - s).count();
+
+    // Returns straight away if the word has already been cleared by a writer
+    syscall(
+      SYS_futex,
+      reinterpret_cast<uint32_t*>(word),
+      FUTEX_WAIT_PRIVATE,
+      1,
+      &ts,
+      nullptr,
+      0);
+  }
+
+  /// Wakes the reader blocked on the word, once a writer has cleared it
+  inline void ring(std::atomic<uint32_t>* word)
+  {
+    syscall(
+      SYS_futex,
+      reinterpret_cast<uint32_t*>(word),
+      FUTEX_WAKE_PRIVATE,
+      1,
+      nullptr,
+      nullptr,
+      0);
+  }
+#endif
+
+  /// Decides when an idle reader stops spinning and blocks. Spinning keeps
+  /// latency low under load, but burns a core while there is nothing to read.
+  /// The number of idle iterations spent spinning adapts to the traffic: it
+  /// doubles when a message arrives while spinning, as blocking would have
+  /// delayed it by a wakeup, and halves when the reader ends up blocking.
+  class SpinThenBlock
+  {
+  private:
+    const size_t min_spins;
+    const size_t max_spins;
+
+    size_t spin_limit;
+    size_t spins = 0;
+
+  public:
+    SpinThenBlock(size_t min_spins = 1 << 6, size_t max_spins = 1 << 16) :
+      min_spins(min_spins),
+      max_spins(max_spins),
+      spin_limit(max_spins)
+    {}
+
+    /// Called when the reader found nothing to do. Returns true if it should
+    /// block, false if it should spin once more.
+    bool idle()
+    {
+      if (spins++ < spin_limit)
+      {
+        return false;
+      }
+
+      spin_limit = std::max(spin_limit / 2, min_spins);
+      spins = 0;
+      return true;
+    }
+
+    /// Called when the reader found messages
+    void busy()
+    {
+      if (spins != 0)
+      {
+        spin_limit = std::min(spin_limit * 2, max_spins);
+        spins = 0;
+      }
+    }
+
+    size_t get_spin_limit() const
+    {
+      return spin_limit;
+    }
+  };
+}
@@ -0,0 +1,220 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/spin_lock.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace threading
+{
+  /// Recycles the storage of objects of type T, so that messages passed
+  /// between threads do not each go through the allocator. Freeing memory
+  /// allocated by another thread is the slowest path of most allocators, and
+  /// is the common case for messages.
+  ///
+  /// Each thread keeps a small list of free blocks, used for its allocations
+  /// and refilled by its deallocations. A thread which frees more than it
+  /// allocates passes the excess, in batches, to a pool shared by all threads,
+  /// from which a thread which allocates more than it frees takes them back.
+  /// Only moving a batch takes a lock.
+  ///
+  /// The storage of a pooled object is not returned to the allocator while
+  /// its pool is in use, up to a bounded number of free blocks. Objects freed
+  /// by a thread which is exiting, once its list is gone, are returned to the
+  /// allocator directly.
+  template <typename T>
+  class MessagePool
+  {
+  private:
+    struct FreeBlock
+    {
+      FreeBlock* next;
+    };
+
+    static_assert(sizeof(T) >= sizeof(FreeBlock));
+    static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+    struct FreeList
+    {
+      FreeBlock* head = nullptr;
+      size_t size = 0;
+
+      void push(void* p)
+      {
+        auto block = static_cast<FreeBlock*>(p);
+        block->next = head;
+        head = block;
+        ++size;
+      }
+
+      void* pop()
+      {
+        auto block = head;
+        head = block->next;
+        --size;
+        return block;
+      }
+
+      // Removes up to n blocks from the front of this list
+      FreeList split(size_t n)
+      {
+        FreeList front;
+        while (size > 0 && front.size < n)
+        {
+          front.push(pop());
+        }
+        return front;
+      }
+
+      void release()
+      {
+        while (size > 0)
+        {
+          ::operator delete(pop());
+        }
+      }
+    };
+
+    static constexpr size_t batch_size = 32;
+    static constexpr size_t max_local_blocks = 2 * batch_size;
+    static constexpr size_t max_shared_blocks = 64 * batch_size;
+
+    struct Shared
+    {
+      SpinLock lock;
+      std::vector<FreeList> batches;
+      // Blocks in all batches, which may not all be full
+      size_t blocks = 0;
+    };
+
+    // Never destroyed, so that objects freed during static destruction (such
+    // as messages still queued at exit) can be returned to it
+    static Shared& shared()
+    {
+      static Shared* s = new Shared;
+      return *s;
+    }
+
+    enum class LocalState : uint8_t
+    {
+      Uninitialised,
+      Alive,
+      Destroyed
+    };
+
+    struct Local
+    {
+      FreeList free;
+
+      ~Local()
+      {
+        local_state = LocalState::Destroyed;
+        while (free.size > 0)
+        {
+          give_batch(free.split(batch_size));
+        }
+      }
+    };
+
+    static inline thread_local Local local;
+
+    // Trivially destructible, so still readable while and after this
+    // thread's Local is destroyed
+    static inline thread_local LocalState local_state =
+      LocalState::Uninitialised;
+
+    static FreeList* get_local()
+    {
+      if (local_state == LocalState::Destroyed)
+      {
+        return nullptr;
+      }
+
+      local_state = LocalState::Alive;
+      return &local.free;
+    }
+
+    static void give_batch(FreeList&& batch)
+    {
+      auto& s = shared();
+      {
+        std::lock_guard<SpinLock> guard(s.lock);
+        if (s.blocks + batch.size <= max_shared_blocks)
+        {
+          s.blocks += batch.size;
+          s.batches.push_back(batch);
+          return;
+        }
+      }
+      batch.release();
+    }
+
+    static bool take_batch(FreeList& into)
+    {
+      auto& s = shared();
+      std::lock_guard<SpinLock> guard(s.lock);
+      if (s.batches.empty())
+      {
+        return false;
+      }
+
+      into = s.batches.back();
+      s.batches.pop_back();
+      s.blocks -= into.size;
+      return true;
+    }
+
+  public:
+    static void* allocate()
+    {
+      auto free = get_local();
+      if (free == nullptr)
+      {
+        return ::operator new(sizeof(T));
+      }
+
+      if (free->size == 0 && !take_batch(*free))
+      {
+        return ::operator new(sizeof(T));
+      }
+
+      return free->pop();
+    }
+
+    static void deallocate(void* p)
+    {
+      auto free = get_local();
+      if (free == nullptr)
+      {
+        ::operator delete(p);
+        return;
+      }
+
+      free->push(p);
+      if (free->size > max_local_blocks)
+      {
+        give_batch(free->split(batch_size));
+      }
+    }
+
+    /// Returns the number of free blocks held by the calling thread
+    static size_t local_free_blocks()
+    {
+      auto free = get_local();
+      return free == nullptr ? 0 : free->size;
+    }
+
+    /// Returns the number of free blocks in the pool shared by all threads
+    static size_t shared_free_blocks()
+    {
+      auto& s = shared();
+      std::lock_guard<SpinLock> guard(s.lock);
+      return s.blocks;
+    }
+  };
+}
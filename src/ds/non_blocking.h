@@ -7,6 +7,7 @@
 #include <deque>
 #define FMT_HEADER_ONLY
 #include <fmt/format.h>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -19,11 +20,29 @@ namespace ringbuffer
   // pending queue. These pending message must be flushed regularly, attempting
   // again to write to the ringbuffer.
 
+  // Messages queued by non-blocking writers
+  struct PendingStats
+  {
+    // Currently queued
+    size_t messages = 0;
+    size_t bytes = 0;
+
+    // Queued since the writers were created
+    size_t total_messages = 0;
+  };
+
   class NonBlockingWriter : public AbstractWriter
   {
   private:
     WriterPtr underlying_writer;
 
+    // Shared by all writers from the same factory, so that it outlives them
+    std::shared_ptr<size_t> total_pending;
+
+    // Called when a message is queued while none were pending, so that
+    // pending messages are flushed promptly. Shared as above.
+    std::shared_ptr<std::function<void()>> on_pending;
+
     struct PendingMessage
     {
       Message m;
@@ -42,7 +61,14 @@ namespace ringbuffer
     std::deque<PendingMessage> pending;
 
   public:
-    NonBlockingWriter(const WriterPtr& writer) : underlying_writer(writer) {}
+    NonBlockingWriter(
+      const WriterPtr& writer,
+      const std::shared_ptr<size_t>& total_pending = nullptr,
+      const std::shared_ptr<std::function<void()>>& on_pending = nullptr) :
+      underlying_writer(writer),
+      total_pending(total_pending),
+      on_pending(on_pending)
+    {}
 
     virtual WriteMarker prepare(
       ringbuffer::Message m,
@@ -64,7 +90,17 @@ namespace ringbuffer
         // Prepare failed, no space in buffer - so add to queue
       }
 
+      const bool first_pending = pending.empty();
       pending.emplace_back(m, std::vector<uint8_t>(total_size));
+      if (total_pending != nullptr)
+      {
+        ++*total_pending;
+      }
+
+      if (first_pending && on_pending != nullptr && *on_pending)
+      {
+        (*on_pending)();
+      }
 
       auto& msg = pending.back();
       msg.marker = (size_t)msg.buffer.data();
@@ -141,6 +177,15 @@ namespace ringbuffer
       return underlying_writer->write_bytes(marker, bytes, size);
     }
 
+    void add_pending_stats(PendingStats& stats) const
+    {
+      stats.messages += pending.size();
+      for (const auto& msg : pending)
+      {
+        stats.bytes += msg.buffer.size();
+      }
+    }
+
     // Returns true if flush completed and there are no more pending messages.
     // False means 0 or more pending messages were written, but some remain
     bool try_flush_pending()
@@ -187,11 +232,22 @@ namespace ringbuffer
     WriterSet writers_to_outside;
     WriterSet writers_to_inside;
 
+    std::shared_ptr<size_t> total_pending_to_outside =
+      std::make_shared<size_t>(0);
+    std::shared_ptr<size_t> total_pending_to_inside =
+      std::make_shared<size_t>(0);
+
+    std::shared_ptr<std::function<void()>> on_pending_to_inside =
+      std::make_shared<std::function<void()>>();
+
     std::shared_ptr<ringbuffer::NonBlockingWriter> add_writer(
       const std::shared_ptr<ringbuffer::AbstractWriter>& underlying,
-      WriterSet& writers)
+      WriterSet& writers,
+      const std::shared_ptr<size_t>& total_pending,
+      const std::shared_ptr<std::function<void()>>& on_pending = nullptr)
     {
-      auto new_writer = std::make_shared<NonBlockingWriter>(underlying);
+      auto new_writer = std::make_shared<NonBlockingWriter>(
+        underlying, total_pending, on_pending);
       writers.emplace_back(new_writer);
       return new_writer;
     }
@@ -218,6 +274,22 @@ namespace ringbuffer
       return all_empty;
     }
 
+    PendingStats get_pending_stats(
+      const WriterSet& writers, size_t total_pending) const
+    {
+      PendingStats stats;
+      stats.total_messages = total_pending;
+      for (const auto& writer : writers)
+      {
+        auto shared_ptr = writer.lock();
+        if (shared_ptr)
+        {
+          shared_ptr->add_pending_stats(stats);
+        }
+      }
+      return stats;
+    }
+
   public:
     NonBlockingWriterFactory(AbstractWriterFactory& impl) : factory_impl(impl)
     {}
@@ -226,7 +298,9 @@ namespace ringbuffer
     create_non_blocking_writer_to_outside()
     {
       return add_writer(
-        factory_impl.create_writer_to_outside(), writers_to_outside);
+        factory_impl.create_writer_to_outside(),
+        writers_to_outside,
+        total_pending_to_outside);
     }
 
     bool flush_all_outbound()
@@ -234,11 +308,19 @@ namespace ringbuffer
       return flush_all(writers_to_outside);
     }
 
+    PendingStats get_pending_outbound_stats() const
+    {
+      return get_pending_stats(writers_to_outside, *total_pending_to_outside);
+    }
+
     std::shared_ptr<ringbuffer::NonBlockingWriter>
     create_non_blocking_writer_to_inside()
     {
       return add_writer(
-        factory_impl.create_writer_to_inside(), writers_to_inside);
+        factory_impl.create_writer_to_inside(),
+        writers_to_inside,
+        total_pending_to_inside,
+        on_pending_to_inside);
     }
 
     bool flush_all_inbound()
@@ -246,6 +328,19 @@ namespace ringbuffer
       return flush_all(writers_to_inside);
     }
 
+    /// Sets a callback, made whenever a writer to the inside starts queueing
+    /// messages, so that they can be flushed without waiting for the next
+    /// regular flush
+    void set_inbound_pending_callback(std::function<void()> f)
+    {
+      *on_pending_to_inside = f;
+    }
+
+    PendingStats get_pending_inbound_stats() const
+    {
+      return get_pending_stats(writers_to_inside, *total_pending_to_inside);
+    }
+
     std::shared_ptr<ringbuffer::AbstractWriter> create_writer_to_outside()
       override
     {
@@ -6,9 +6,12 @@
 #include "ring_buffer.h"
 #include "serialized.h"
 
+#include <cstdlib>
 #define FMT_HEADER_ONLY
 #include <fmt/format.h>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace oversized
 {
@@ -16,12 +19,46 @@ namespace oversized
   {
     /// Part of a larger message. Can be sent both ways
     DEFINE_RINGBUFFER_MSG_TYPE(fragment),
+
+    /// Refers to a larger message written outside the ringbuffer, in memory
+    /// allocated by the writer and released by the reader. Can be sent both
+    /// ways
+    DEFINE_RINGBUFFER_MSG_TYPE(large_payload),
+  };
+
+  /// Allocates memory, shared by the host and the enclave, for messages too
+  /// large to be written to the ringbuffer in a single fragment. Ownership of
+  /// each allocation is passed from the writer to the reader, which releases
+  /// it once the message has been dispatched.
+  struct LargePayloadAllocator
+  {
+    uint8_t* (*allocate)(size_t size);
+    void (*deallocate)(uint8_t* data);
+
+    /// Checks that memory received from the other side is really shared, i.e.
+    /// outside of the enclave
+    bool (*is_shared)(const uint8_t* data, size_t size);
+
+    /// True if received payloads may still be written by the other side (e.g.
+    /// host memory read by the enclave). These are copied to private memory
+    /// before they are dispatched, so that handlers cannot see them change.
+    bool copy_received;
   };
 
+  /// Host memory, allocated from the host or from a virtual enclave
+  static constexpr LargePayloadAllocator host_heap = {
+    [](size_t size) { return static_cast<uint8_t*>(malloc(size)); },
+    [](uint8_t* data) { free(data); },
+    [](const uint8_t*, size_t) { return true; },
+    false};
+
   class FragmentReconstructor
   {
     messaging::RingbufferDispatcher& dispatcher;
 
+    // Null if large payloads are not accepted
+    const LargePayloadAllocator* large_payloads;
+
     struct PartialMessage
     {
       const ringbuffer::Message m;
@@ -34,8 +71,51 @@ namespace oversized
     std::unordered_map<size_t, PartialMessage> partial_messages;
 
   public:
-    FragmentReconstructor(messaging::RingbufferDispatcher& d) : dispatcher(d)
+    FragmentReconstructor(
+      messaging::RingbufferDispatcher& d,
+      const LargePayloadAllocator* large_payloads = nullptr) :
+      dispatcher(d),
+      large_payloads(large_payloads)
     {
+      if (large_payloads != nullptr)
+      {
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          d,
+          OversizedMessage::large_payload,
+          [this](const uint8_t* data, size_t size) {
+            auto m = serialized::read<ringbuffer::Message>(data, size);
+            auto payload = reinterpret_cast<uint8_t*>(
+              serialized::read<uintptr_t>(data, size));
+            auto payload_size = serialized::read<size_t>(data, size);
+
+            if (!this->large_payloads->is_shared(payload, payload_size))
+            {
+              throw ringbuffer::message_error(
+                m,
+                fmt::format(
+                  "Large payload of {} bytes for message {} is not in shared "
+                  "memory",
+                  payload_size,
+                  m));
+            }
+
+            // The payload is released once dispatched, even if its handler
+            // throws
+            std::unique_ptr<uint8_t, void (*)(uint8_t*)> owned(
+              payload, this->large_payloads->deallocate);
+            if (this->large_payloads->copy_received)
+            {
+              std::vector<uint8_t> copy(payload, payload + payload_size);
+              owned.reset();
+              dispatcher.dispatch(m, copy.data(), payload_size);
+            }
+            else
+            {
+              dispatcher.dispatch(m, owned.get(), payload_size);
+            }
+          });
+      }
+
       DISPATCHER_SET_MESSAGE_HANDLER(
         d,
         OversizedMessage::fragment,
@@ -97,6 +177,10 @@ namespace oversized
     ~FragmentReconstructor()
     {
       dispatcher.remove_message_handler(OversizedMessage::fragment);
+      if (large_payloads != nullptr)
+      {
+        dispatcher.remove_message_handler(OversizedMessage::large_payload);
+      }
 
       for (const auto& [_, partial] : partial_messages)
       {
@@ -133,12 +217,43 @@ namespace oversized
     // we're not currently within a [prepare, write_bytes*, finish] loop
     std::optional<FragmentProgress> fragment_progress;
 
+    // If set, oversized messages are written to memory allocated from it
+    // rather than split into fragments
+    const LargePayloadAllocator* large_payloads;
+
+    struct LargePayloadProgress
+    {
+      ringbuffer::Message m;
+      uint8_t* data;
+      size_t size;
+    };
+
+    // Set while writing an oversized message to a large payload
+    std::optional<LargePayloadProgress> large_payload_progress;
+
+    bool is_large_payload_marker(const WriteMarker& marker) const
+    {
+      if (!large_payload_progress.has_value() || !marker.has_value())
+      {
+        return false;
+      }
+
+      const auto begin = (size_t)large_payload_progress->data;
+      return marker.value() >= begin &&
+        marker.value() <= begin + large_payload_progress->size;
+    }
+
   public:
-    Writer(const ringbuffer::WriterPtr& writer, size_t f, size_t t = -1) :
+    Writer(
+      const ringbuffer::WriterPtr& writer,
+      size_t f,
+      size_t t = -1,
+      const LargePayloadAllocator* large_payloads = nullptr) :
       underlying_writer(writer),
       max_fragment_size(f),
       max_total_size(t),
-      fragment_progress({})
+      fragment_progress({}),
+      large_payloads(large_payloads)
     {
       if (max_fragment_size >= max_total_size)
         throw std::logic_error(fmt::format(
@@ -162,7 +277,7 @@ namespace oversized
       size_t* identifier = nullptr) override
     {
       // Ensure this is not called out of order
-      if (fragment_progress.has_value())
+      if (fragment_progress.has_value() || large_payload_progress.has_value())
       {
         throw std::logic_error("This Writer is already preparing a message");
       }
@@ -181,6 +296,24 @@ namespace oversized
           max_total_size));
       }
 
+      if (large_payloads != nullptr)
+      {
+        // Write the message to a large payload, whose ownership is passed to
+        // the reader in finish()
+        auto data = large_payloads->allocate(total_size);
+        if (data == nullptr)
+        {
+          throw std::logic_error(fmt::format(
+            "Failed to allocate large payload of {} bytes", total_size));
+        }
+
+        large_payload_progress = {m, data, total_size};
+
+        // NB: As for the NonBlockingWriter, there is an assumption that these
+        // markers will never conflict with those of the underlying writer
+        return {(size_t)data};
+      }
+
       // Need to split this message into multiple fragments
 
       if (!wait)
@@ -221,7 +354,18 @@ namespace oversized
 
     virtual void finish(const WriteMarker& marker) override
     {
-      if (fragment_progress.has_value())
+      if (large_payload_progress.has_value())
+      {
+        const auto payload = large_payload_progress.value();
+        large_payload_progress = {};
+
+        underlying_writer->write(
+          OversizedMessage::large_payload,
+          payload.m,
+          (uintptr_t)payload.data,
+          payload.size);
+      }
+      else if (fragment_progress.has_value())
       {
         // We were writing an oversized message, the given marker means nothing
         // to us
@@ -253,6 +397,23 @@ namespace oversized
         return {};
       }
 
+      if (is_large_payload_marker(marker))
+      {
+        auto dest = (uint8_t*)marker.value();
+        if (
+          dest + size >
+          large_payload_progress->data + large_payload_progress->size)
+        {
+          throw std::logic_error(fmt::format(
+            "Write of {} bytes extends beyond large payload of {} bytes",
+            size,
+            large_payload_progress->size));
+        }
+
+        std::memcpy(dest, bytes, size);
+        return {(size_t)(dest + size)};
+      }
+
       if (!fragment_progress.has_value())
       {
         // Writing a small message - nothing to do here
@@ -328,10 +489,16 @@ namespace oversized
 
     const WriterConfig config;
 
+    const LargePayloadAllocator* large_payloads;
+
   public:
-    WriterFactory(AbstractWriterFactory& impl, const WriterConfig& config_) :
+    WriterFactory(
+      AbstractWriterFactory& impl,
+      const WriterConfig& config_,
+      const LargePayloadAllocator* large_payloads = nullptr) :
       factory_impl(impl),
-      config(config_)
+      config(config_),
+      large_payloads(large_payloads)
     {}
 
     std::shared_ptr<oversized::Writer> create_oversized_writer_to_outside()
@@ -339,7 +506,8 @@ namespace oversized
       return std::make_shared<oversized::Writer>(
         factory_impl.create_writer_to_outside(),
         config.max_fragment_size,
-        config.max_total_size);
+        config.max_total_size,
+        large_payloads);
     }
 
     std::shared_ptr<oversized::Writer> create_oversized_writer_to_inside()
@@ -347,7 +515,8 @@ namespace oversized
       return std::make_shared<oversized::Writer>(
         factory_impl.create_writer_to_inside(),
         config.max_fragment_size,
-        config.max_total_size);
+        config.max_total_size,
+        large_payloads);
     }
 
     std::shared_ptr<ringbuffer::AbstractWriter> create_writer_to_outside()
@@ -0,0 +1,257 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ds
+{
+  // Maps templated paths (e.g. "log/{id}/receipt") to values of type T, and
+  // resolves concrete paths to all the templates they match, along with the
+  // values of the template parameters, in a single walk over the path.
+  //
+  // Templates are split into '/'-separated segments, each of which is a node
+  // in the trie. A segment is either a literal, looked up by exact match, or
+  // a pattern of literals and parameters. Each parameter matches one or more
+  // characters other than '/', and is matched greedily, as the regex
+  // "([^/]+)" would be.
+  template <typename T>
+  class PathTrie
+  {
+  public:
+    struct Match
+    {
+      const std::string* path_template;
+      const T* value;
+
+      // Parameter values, in the order in which they appear in the template,
+      // referring to the path passed to find()
+      std::vector<std::string_view> params;
+    };
+
+  private:
+    // Literals around the parameters of a segment, i.e. one more than there
+    // are parameters. For instance "v{major}.{minor}" is {"v", ".", ""}.
+    using SegmentPattern = std::vector<std::string>;
+
+    struct Node
+    {
+      std::map<std::string, std::unique_ptr<Node>, std::less<>> literals;
+      std::vector<std::pair<SegmentPattern, std::unique_ptr<Node>>> patterns;
+
+      // Templates ending at this node. Several templates may differ only in
+      // the names of their parameters.
+      std::map<std::string, T> values;
+    };
+
+    Node root;
+
+    static std::optional<SegmentPattern> parse_segment(
+      std::string_view segment, const std::string& path_template)
+    {
+      auto start = segment.find('{');
+      if (start == std::string_view::npos)
+      {
+        return std::nullopt;
+      }
+
+      SegmentPattern pattern;
+      size_t literal_start = 0;
+      while (start != std::string_view::npos)
+      {
+        const auto end = segment.find('}', start);
+        if (end == std::string_view::npos)
+        {
+          throw std::logic_error(fmt::format(
+            "Invalid templated path - missing closing '}}': {}",
+            path_template));
+        }
+
+        pattern.emplace_back(
+          segment.substr(literal_start, start - literal_start));
+        literal_start = end + 1;
+        start = segment.find('{', literal_start);
+      }
+      pattern.emplace_back(segment.substr(literal_start));
+
+      return pattern;
+    }
+
+    static bool ends_with(std::string_view s, std::string_view suffix)
+    {
+      return s.size() >= suffix.size() &&
+        s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // Matches the parameters of pattern from the i-th onwards against
+    // segment, from pos. Each parameter takes the longest value with which
+    // the rest of the segment still matches.
+    static bool match_params(
+      const SegmentPattern& pattern,
+      size_t i,
+      std::string_view segment,
+      size_t pos,
+      std::vector<std::string_view>& params)
+    {
+      const auto& next_literal = pattern[i + 1];
+      const bool last = i + 2 == pattern.size();
+
+      if (last)
+      {
+        if (
+          segment.size() < pos + next_literal.size() + 1 ||
+          !ends_with(segment, next_literal))
+        {
+          return false;
+        }
+
+        params.push_back(
+          segment.substr(pos, segment.size() - next_literal.size() - pos));
+        return true;
+      }
+
+      for (auto end = segment.rfind(next_literal);
+           end != std::string_view::npos && end > pos;
+           end = segment.rfind(next_literal, end - 1))
+      {
+        params.push_back(segment.substr(pos, end - pos));
+        if (match_params(
+              pattern, i + 1, segment, end + next_literal.size(), params))
+        {
+          return true;
+        }
+        params.pop_back();
+      }
+
+      return false;
+    }
+
+    static bool match_segment(
+      const SegmentPattern& pattern,
+      std::string_view segment,
+      std::vector<std::string_view>& params)
+    {
+      const auto& prefix = pattern.front();
+      if (segment.compare(0, prefix.size(), prefix) != 0)
+      {
+        return false;
+      }
+
+      return match_params(pattern, 0, segment, prefix.size(), params);
+    }
+
+    // Collects the matches of the remainder of path, from pos, under node.
+    // pos is npos once the last segment has been consumed.
+    static void find_from(
+      const Node& node,
+      std::string_view path,
+      size_t pos,
+      std::vector<std::string_view>& params,
+      std::vector<Match>& matches)
+    {
+      if (pos == std::string_view::npos)
+      {
+        for (const auto& [path_template, value] : node.values)
+        {
+          matches.push_back({&path_template, &value, params});
+        }
+        return;
+      }
+
+      const auto slash = path.find('/', pos);
+      const auto segment = path.substr(
+        pos, slash == std::string_view::npos ? slash : slash - pos);
+      const auto next =
+        slash == std::string_view::npos ? std::string_view::npos : slash + 1;
+
+      const auto it = node.literals.find(segment);
+      if (it != node.literals.end())
+      {
+        find_from(*it->second, path, next, params, matches);
+      }
+
+      for (const auto& [pattern, child] : node.patterns)
+      {
+        const auto params_size = params.size();
+        if (match_segment(pattern, segment, params))
+        {
+          find_from(*child, path, next, params, matches);
+        }
+        params.resize(params_size);
+      }
+    }
+
+  public:
+    // Returns the value for path_template, inserting a default-constructed
+    // value if there is none yet
+    T& insert(const std::string& path_template)
+    {
+      Node* node = &root;
+
+      std::string_view rest = path_template;
+      while (true)
+      {
+        const auto slash = rest.find('/');
+        const auto segment = rest.substr(0, slash);
+
+        auto pattern = parse_segment(segment, path_template);
+        if (pattern.has_value())
+        {
+          auto it = std::find_if(
+            node->patterns.begin(),
+            node->patterns.end(),
+            [&pattern](const auto& p) { return p.first == pattern.value(); });
+          if (it == node->patterns.end())
+          {
+            node->patterns.emplace_back(
+              std::move(pattern.value()), std::make_unique<Node>());
+            it = std::prev(node->patterns.end());
+          }
+          node = it->second.get();
+        }
+        else
+        {
+          auto it = node->literals.find(segment);
+          if (it == node->literals.end())
+          {
+            it = node->literals
+                   .emplace(std::string(segment), std::make_unique<Node>())
+                   .first;
+          }
+          node = it->second.get();
+        }
+
+        if (slash == std::string_view::npos)
+        {
+          break;
+        }
+        rest.remove_prefix(slash + 1);
+      }
+
+      return node->values[path_template];
+    }
+
+    // Appends every template matching path to matches. The parameter values
+    // of each match refer to path, which must outlive them.
+    void find(std::string_view path, std::vector<Match>& matches) const
+    {
+      std::vector<std::string_view> params;
+      find_from(root, path, 0, params, matches);
+    }
+
+    std::vector<Match> find(std::string_view path) const
+    {
+      std::vector<Match> matches;
+      find(path, matches);
+      return matches;
+    }
+  };
+}
@@ -0,0 +1,166 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ring_buffer_types.h"
+#include "thread_ids.h"
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+#include <memory>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+namespace ringbuffer
+{
+  using MessageSet = std::unordered_set<Message>;
+
+  // This writes each message to a ringbuffer owned by the calling thread, so
+  // that threads do not contend with each other when writing, and a thread
+  // writing a large message does not hold up the others. Each thread has its
+  // own underlying writer, created on its first write.
+  //
+  // Messages from a single thread are read in the order they were written, but
+  // messages from different threads may be interleaved in any order. Messages
+  // whose order matters across threads (for instance, ledger appends) are
+  // always written to the first ringbuffer, shared by all threads. A writer
+  // may instead be pinned to one thread's ringbuffer, for messages whose order
+  // matters but which are written by whichever thread runs their sender.
+
+  class PerThreadWriter : public AbstractWriter
+  {
+  private:
+    // Indexed by thread ID
+    const std::vector<AbstractWriterFactory*> factories;
+    const std::shared_ptr<const MessageSet> ordered;
+    // If set, the thread whose ringbuffer is used instead of the caller's
+    const std::optional<uint16_t> pinned;
+
+    // Writers to each thread's own ringbuffer, and to the shared ringbuffer.
+    // Each slot is only accessed by its thread.
+    std::vector<WriterPtr> own_writers;
+    std::vector<WriterPtr> shared_writers;
+
+    // The writer used by each thread for the message it is currently writing
+    std::vector<AbstractWriter*> current_writers;
+
+    uint16_t get_thread_id() const
+    {
+      const auto tid = threading::get_current_thread_id();
+      if (tid >= factories.size())
+      {
+        throw std::logic_error(fmt::format(
+          "No ringbuffer for thread {} (only {} ringbuffers)",
+          tid,
+          factories.size()));
+      }
+      return tid;
+    }
+
+    AbstractWriter& current()
+    {
+      auto writer = current_writers[get_thread_id()];
+      if (writer == nullptr)
+      {
+        throw std::logic_error("This thread is not writing a message");
+      }
+      return *writer;
+    }
+
+  public:
+    PerThreadWriter(
+      const std::vector<AbstractWriterFactory*>& factories,
+      const std::shared_ptr<const MessageSet>& ordered,
+      std::optional<uint16_t> pinned = std::nullopt) :
+      factories(factories),
+      ordered(ordered),
+      pinned(pinned),
+      own_writers(factories.size()),
+      shared_writers(factories.size()),
+      current_writers(factories.size(), nullptr)
+    {}
+
+    virtual WriteMarker prepare(
+      Message m,
+      size_t size,
+      bool wait = true,
+      size_t* identifier = nullptr) override
+    {
+      const auto tid = get_thread_id();
+      const auto shared = ordered->find(m) != ordered->end();
+
+      auto& writer = shared ? shared_writers[tid] : own_writers[tid];
+      if (writer == nullptr)
+      {
+        const auto own = pinned.value_or(tid);
+        writer = factories[shared ? 0 : own]->create_writer_to_outside();
+      }
+
+      current_writers[tid] = writer.get();
+      return writer->prepare(m, size, wait, identifier);
+    }
+
+    virtual void finish(const WriteMarker& marker) override
+    {
+      auto& writer = current();
+      current_writers[get_thread_id()] = nullptr;
+      writer.finish(marker);
+    }
+
+    virtual WriteMarker write_bytes(
+      const WriteMarker& marker, const uint8_t* bytes, size_t size) override
+    {
+      return current().write_bytes(marker, bytes, size);
+    }
+  };
+
+  // Creates writers to a ringbuffer per thread, given a factory for each
+  // thread's ringbuffer. The first is used by the main thread, for messages in
+  // the ordered set, and for all writes to the inside.
+  //
+  // NB: The identifiers of oversized message fragments are only unique within
+  // a ringbuffer, so the given factories should pass oversized messages as
+  // large payloads rather than fragments.
+  class PerThreadWriterFactory : public AbstractWriterFactory
+  {
+  private:
+    std::vector<AbstractWriterFactory*> factories;
+    std::shared_ptr<const MessageSet> ordered;
+
+  public:
+    PerThreadWriterFactory(
+      std::vector<AbstractWriterFactory*> factories_,
+      MessageSet ordered_ = {}) :
+      factories(std::move(factories_)),
+      ordered(std::make_shared<const MessageSet>(std::move(ordered_)))
+    {
+      if (factories.empty())
+      {
+        throw std::logic_error("Per-thread writers need at least one factory");
+      }
+    }
+
+    WriterPtr create_writer_to_outside() override
+    {
+      return std::make_shared<PerThreadWriter>(factories, ordered);
+    }
+
+    WriterPtr create_writer_to_outside_from(uint16_t thread_id) override
+    {
+      if (thread_id >= factories.size())
+      {
+        throw std::logic_error(fmt::format(
+          "No ringbuffer for thread {} (only {} ringbuffers)",
+          thread_id,
+          factories.size()));
+      }
+      return std::make_shared<PerThreadWriter>(factories, ordered, thread_id);
+    }
+
+    WriterPtr create_writer_to_inside() override
+    {
+      return factories[0]->create_writer_to_inside();
+    }
+  };
+}
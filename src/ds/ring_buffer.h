@@ -2,17 +2,13 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "doorbell.h"
 #include "ring_buffer_types.h"
 
+#include <chrono>
 #include <cstring>
 #include <functional>
 
-// Ideally this would be _mm_pause or similar, but finding cross-platform
-// headers that expose this neatly through OE (ie - non-standard std libs) is
-// awkward. Instead we resort to copying OE, and implementing this directly
-// ourselves.
-#define CCF_PAUSE() asm volatile("pause")
-
 // This file implements a Multiple-Producer Single-Consumer ringbuffer.
 
 // A single Reader instance owns an underlying memory buffer, and a single
@@ -91,12 +87,31 @@ namespace ringbuffer
     const size_t size;
   };
 
+  // Called by a writer which has written a message to a buffer whose reader is
+  // blocked waiting for messages, with the reader's waiting flag
+  using RingDoorbell = void (*)(std::atomic<uint32_t>*);
+
   struct BufferDef
   {
     uint8_t* data;
     size_t size;
 
     Offsets* offsets;
+
+    // If null, writers never ring the reader's doorbell, and readers of this
+    // buffer must poll it
+    RingDoorbell ring_doorbell = nullptr;
+
+    // If set, used as the reader's waiting mark instead of the one in offsets.
+    // Buffers read by a single reader share a mark, so that a blocked reader is
+    // woken by a write to any of them.
+    std::atomic<uint32_t>* reader_waiting = nullptr;
+
+    std::atomic<uint32_t>& waiting_mark() const
+    {
+      return reader_waiting != nullptr ? *reader_waiting :
+                                         offsets->reader_waiting;
+    }
   };
 
   class Reader
@@ -112,6 +127,14 @@ namespace ringbuffer
     {
       auto mask = bd.size - 1;
       auto hd = bd.offsets->head.load(std::memory_order_acquire);
+
+      // Only the reader updates the high-water mark
+      const auto occupancy =
+        bd.offsets->tail.load(std::memory_order_relaxed) - hd;
+      if (occupancy > bd.offsets->max_occupancy.load(std::memory_order_relaxed))
+      {
+        bd.offsets->max_occupancy.store(occupancy, std::memory_order_relaxed);
+      }
       auto hd_index = hd & mask;
       auto block = bd.size - hd_index;
       size_t advance = 0;
@@ -158,7 +181,70 @@ namespace ringbuffer
       return count;
     }
 
+    /// Marks this reader as waiting for messages, so that the next writer rings
+    /// its doorbell. Returns false, and clears the mark, if a message is
+    /// already available, in which case the caller should read it rather than
+    /// block.
+    bool prepare_wait()
+    {
+      bd.waiting_mark().store(1, std::memory_order_seq_cst);
+
+      if (has_message())
+      {
+        end_wait();
+        return false;
+      }
+
+      return true;
+    }
+
+    /// Clears the waiting mark, once the reader has been woken up or has timed
+    /// out
+    void end_wait()
+    {
+      bd.waiting_mark().store(0, std::memory_order_relaxed);
+    }
+
+    /// The word a blocked reader waits on, which is cleared by the writer
+    /// ringing the doorbell
+    std::atomic<uint32_t>* get_doorbell()
+    {
+      return &bd.waiting_mark();
+    }
+
+    /// Occupancy and contention counters, which may be read from any thread
+    BufferStats get_stats() const
+    {
+      const auto& o = *bd.offsets;
+      BufferStats stats;
+      stats.size = bd.size;
+      // The head is read first, so that it cannot be past the tail
+      const auto head = o.head.load(std::memory_order_acquire);
+      stats.occupancy = o.tail.load(std::memory_order_acquire) - head;
+      stats.max_occupancy = o.max_occupancy.load(std::memory_order_relaxed);
+      stats.failed_reservations =
+        o.failed_reservations.load(std::memory_order_relaxed);
+      stats.blocked_writes = o.blocked_writes.load(std::memory_order_relaxed);
+      stats.blocked_ns = o.blocked_ns.load(std::memory_order_relaxed);
+      return stats;
+    }
+
+    /// True if a message is available to read. A reader of several buffers
+    /// sharing a waiting mark checks the others with this once it has marked
+    /// itself as waiting through one of them.
+    bool has_message()
+    {
+      auto hd = bd.offsets->head.load(std::memory_order_acquire);
+      auto header = read64(hd & (bd.size - 1));
+
+      // A pending write is not a message yet: its writer checks the waiting
+      // mark once it has finished writing
+      return (length(header) & pending_write_flag) == 0u &&
+        message(header) != Const::msg_none;
+    }
+
   private:
+
     uint64_t read64(size_t index)
     {
       uint64_t r = *reinterpret_cast<volatile uint64_t*>(bd.data + index);
@@ -235,14 +321,30 @@ namespace ringbuffer
 
       if (!r.has_value())
       {
+        bd.offsets->failed_reservations.fetch_add(
+          1, std::memory_order_relaxed);
+
         if (wait)
         {
+          bd.offsets->blocked_writes.fetch_add(1, std::memory_order_relaxed);
+#if !defined(INSIDE_ENCLAVE) || defined(VIRTUAL_ENCLAVE)
+          const auto blocked_start = std::chrono::steady_clock::now();
+#endif
+
           // Retry until there is sufficient space.
           do
           {
             CCF_PAUSE();
             r = reserve(rsize);
           } while (!r.has_value());
+
+#if !defined(INSIDE_ENCLAVE) || defined(VIRTUAL_ENCLAVE)
+          const auto blocked_time =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - blocked_start);
+          bd.offsets->blocked_ns.fetch_add(
+            blocked_time.count(), std::memory_order_relaxed);
+#endif
         }
         else
         {
@@ -270,6 +372,25 @@ namespace ringbuffer
         const auto index = marker.value() - Const::header_size();
         auto size = read32(index);
         write32(index, size & length_mask);
+
+        if (bd.ring_doorbell != nullptr)
+        {
+          // Orders the write above before the load of the waiting mark,
+          // pairing with the store of the mark before the reader checks for
+          // messages in prepare_wait(): either the reader sees this message,
+          // or this writer sees the mark. Skipping the fence whenever the mark
+          // looks clear could miss a reader that has just set it, leaving it
+          // blocked until it times out. The fence adds about 5-10ns to each
+          // write (see "uncontended writes" in ring_buffer_bench).
+          atomic_thread_fence(std::memory_order_seq_cst);
+          auto& waiting = bd.waiting_mark();
+          if (
+            waiting.load(std::memory_order_relaxed) != 0 &&
+            waiting.exchange(0) != 0)
+          {
+            bd.ring_doorbell(&waiting);
+          }
+        }
       }
     }
 
@@ -23,6 +23,37 @@ namespace ringbuffer
     std::atomic<size_t> head_cache = {0};
     std::atomic<size_t> tail = {0};
     alignas(CACHELINE_SIZE) std::atomic<size_t> head = {0};
+
+    // Most bytes in use seen by the reader. Only written by the reader, along
+    // with head.
+    std::atomic<size_t> max_occupancy = {0};
+
+    // Set by a reader which is about to block until messages are written. The
+    // next writer to see it clears it and rings the reader's doorbell.
+    alignas(CACHELINE_SIZE) std::atomic<uint32_t> reader_waiting = {0};
+
+    // Only updated by writers which find the buffer full
+    alignas(CACHELINE_SIZE) std::atomic<size_t> failed_reservations = {0};
+    std::atomic<size_t> blocked_writes = {0};
+    std::atomic<uint64_t> blocked_ns = {0};
+  };
+
+  // Statistics of a buffer, accumulated since it was created
+  struct BufferStats
+  {
+    size_t size = 0;
+
+    // Bytes in use, and the most seen by the reader
+    size_t occupancy = 0;
+    size_t max_occupancy = 0;
+
+    // Reservations which failed because the buffer was full
+    size_t failed_reservations = 0;
+
+    // Writes which waited for space, and the time they spent waiting. Writers
+    // inside an SGX enclave cannot read the time, and do not add to it.
+    size_t blocked_writes = 0;
+    uint64_t blocked_ns = 0;
   };
 
   class message_error : public std::logic_error
@@ -134,6 +165,15 @@ namespace ringbuffer
 
     virtual WriterPtr create_writer_to_outside() = 0;
     virtual WriterPtr create_writer_to_inside() = 0;
+
+    // Creates a writer to the outside whose messages are read in the order
+    // they were written, even when written by different threads, as if all
+    // were written by the given thread. Factories whose writers already keep
+    // this order across threads ignore the thread.
+    virtual WriterPtr create_writer_to_outside_from(uint16_t)
+    {
+      return create_writer_to_outside();
+    }
   };
 
   /// Useful machinery
@@ -0,0 +1,103 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "../chained_buffer.h"
+
+#include <deque>
+#include <doctest/doctest.h>
+#include <random>
+
+TEST_CASE("Chained buffer holds appended bytes in order")
+{
+  ds::ChainedBuffer buffer;
+  std::deque<uint8_t> expected;
+  std::mt19937 rng(42);
+
+  uint8_t next = 0;
+  const auto make_data = [&](size_t size) {
+    std::vector<uint8_t> data(size);
+    for (auto& b : data)
+    {
+      b = next++;
+    }
+    return data;
+  };
+
+  for (size_t i = 0; i < 2000; ++i)
+  {
+    switch (rng() % 4)
+    {
+      case 0:
+      {
+        // Small and large copied appends
+        auto data = make_data(rng() % 2 ? rng() % 100 : rng() % 20000);
+        buffer.append(data.data(), data.size());
+        expected.insert(expected.end(), data.begin(), data.end());
+        break;
+      }
+
+      case 1:
+      {
+        // Moved appends
+        auto data = make_data(rng() % 2 ? rng() % 100 : rng() % 20000);
+        expected.insert(expected.end(), data.begin(), data.end());
+        buffer.append(std::move(data));
+        break;
+      }
+
+      case 2:
+      {
+        std::vector<uint8_t> out(rng() % 30000);
+        const auto n = buffer.read(out.data(), out.size());
+        REQUIRE(n == std::min(out.size(), expected.size()));
+        REQUIRE(std::equal(out.begin(), out.begin() + n, expected.begin()));
+        expected.erase(expected.begin(), expected.begin() + n);
+        break;
+      }
+
+      case 3:
+      {
+        const auto front = buffer.front();
+        REQUIRE(front.size <= expected.size());
+        REQUIRE((front.size > 0 || expected.empty()));
+        REQUIRE(std::equal(
+          front.data, front.data + front.size, expected.begin()));
+
+        const auto n = std::min<size_t>(rng() % 30000, front.size + 1);
+        buffer.consume(n);
+        expected.erase(
+          expected.begin(),
+          expected.begin() + std::min(n, expected.size()));
+        break;
+      }
+    }
+
+    REQUIRE(buffer.size() == expected.size());
+    REQUIRE(buffer.empty() == expected.empty());
+  }
+
+  std::vector<uint8_t> rest(buffer.size());
+  REQUIRE(buffer.read(rest.data(), rest.size()) == expected.size());
+  REQUIRE(std::equal(rest.begin(), rest.end(), expected.begin()));
+  REQUIRE(buffer.empty());
+  REQUIRE(buffer.front().size == 0);
+}
+
+TEST_CASE("Chained buffer does not copy large owned segments")
+{
+  ds::ChainedBuffer buffer;
+
+  std::vector<uint8_t> data(1 << 20, 42);
+  const auto p = data.data();
+  buffer.append(std::move(data));
+  REQUIRE(buffer.front().data == p);
+
+  buffer.consume(100);
+  REQUIRE(buffer.front().data == p + 100);
+  REQUIRE(buffer.size() == (1 << 20) - 100);
+
+  buffer.clear();
+  REQUIRE(buffer.empty());
+  buffer.consume(10);
+  uint8_t b;
+  REQUIRE(buffer.read(&b, 1) == 0);
+}
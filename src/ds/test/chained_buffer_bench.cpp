@@ -0,0 +1,147 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "ds/chained_buffer.h"
+
+#include <cstring>
+#include <picobench/picobench.hpp>
+#include <vector>
+
+// Simulates the buffering of TLSEndpoint, for a single request or response
+// body of s.iterations() MB. The TLS processing itself (mbedtls) is not
+// included: only the copies made on the way to and from it.
+
+// Size of an encrypted TLS record carrying 16KB of plaintext, with AES-GCM:
+// header, explicit IV and tag
+static constexpr size_t record_size = 16384 + 5 + 8 + 16;
+static constexpr size_t record_header_size = 5;
+static constexpr size_t plaintext_record_size = 16384;
+
+// Size of the chunks read from the socket by the host (see asynchost::TCP)
+static constexpr size_t host_read_size = 16384;
+
+static constexpr size_t mb = 1024 * 1024;
+
+inline void do_not_optimize(const void* p)
+{
+  asm volatile("" : : "g"(p) : "memory");
+}
+
+// Previous buffering, with vectors consumed from the front
+struct VectorBuffer
+{
+  std::vector<uint8_t> data;
+
+  void append(const uint8_t* d, size_t size)
+  {
+    data.insert(data.end(), d, d + size);
+  }
+
+  void append(std::vector<uint8_t>&& d)
+  {
+    data.insert(data.end(), d.begin(), d.end());
+  }
+
+  bool empty() const
+  {
+    return data.empty();
+  }
+
+  size_t read(uint8_t* out, size_t size)
+  {
+    const auto n = std::min(size, data.size());
+    ::memcpy(out, data.data(), n);
+    data.erase(data.begin(), data.begin() + n);
+    return n;
+  }
+
+  // Writes one record's worth of plaintext from the front
+  size_t write_record(uint8_t* record)
+  {
+    const auto n = std::min(plaintext_record_size, data.size());
+    ::memcpy(record, data.data(), n);
+    data.erase(data.begin(), data.begin() + n);
+    return n;
+  }
+};
+
+struct ChainedBuffer : public ds::ChainedBuffer
+{
+  size_t write_record(uint8_t* record)
+  {
+    const auto f = front();
+    const auto n = std::min(plaintext_record_size, f.size);
+    ::memcpy(record, f.data, n);
+    consume(n);
+    return n;
+  }
+};
+
+// The host passes the encrypted request to the enclave in chunks, each of
+// which is copied out of the ringbuffer and appended to pending_read. mbedtls
+// then reads each record's header, followed by the rest of the record.
+template <typename Buffer>
+static void request(picobench::state& s)
+{
+  const auto body_size = s.iterations() * mb;
+  const std::vector<uint8_t> chunk(host_read_size, 42);
+  std::vector<uint8_t> record(record_size);
+
+  Buffer pending_read;
+  size_t record_read = 0;
+
+  s.start_timer();
+  for (size_t received = 0; received < body_size; received += chunk.size())
+  {
+    std::vector<uint8_t> msg(chunk.begin(), chunk.end());
+    pending_read.append(std::move(msg));
+
+    while (!pending_read.empty())
+    {
+      const auto want = record_read < record_header_size ?
+        record_header_size - record_read :
+        record_size - record_read;
+      record_read += pending_read.read(record.data() + record_read, want);
+      if (record_read == record_size)
+      {
+        do_not_optimize(record.data());
+        record_read = 0;
+      }
+    }
+  }
+  s.stop_timer();
+}
+
+// The response is appended to pending_write, then encrypted a record at a
+// time by mbedtls, which copies the plaintext into its output buffer
+template <typename Buffer>
+static void response(picobench::state& s)
+{
+  std::vector<uint8_t> body(s.iterations() * mb, 42);
+  std::vector<uint8_t> record(plaintext_record_size);
+
+  Buffer pending_write;
+
+  s.start_timer();
+  pending_write.append(std::move(body));
+  while (!pending_write.empty())
+  {
+    pending_write.write_record(record.data());
+    do_not_optimize(record.data());
+  }
+  s.stop_timer();
+}
+
+const std::vector<int> body_sizes_mb = {1, 10, 50};
+
+PICOBENCH_SUITE("tls_request");
+auto request_vector = request<VectorBuffer>;
+PICOBENCH(request_vector).iterations(body_sizes_mb).samples(3).baseline();
+auto request_chained = request<ChainedBuffer>;
+PICOBENCH(request_chained).iterations(body_sizes_mb).samples(3);
+
+PICOBENCH_SUITE("tls_response");
+auto response_vector = response<VectorBuffer>;
+PICOBENCH(response_vector).iterations(body_sizes_mb).samples(1).baseline();
+auto response_chained = response<ChainedBuffer>;
+PICOBENCH(response_chained).iterations(body_sizes_mb).samples(1);
@@ -536,4 +536,120 @@ TEST_CASE("Non-blocking" * doctest::test_suite("oversized"))
       break;
     }
   }
-}
\ No newline at end of file
+}
+static size_t live_payloads = 0;
+static uint8_t* last_payload = nullptr;
+static bool payloads_shared = true;
+
+static constexpr oversized::LargePayloadAllocator counting_heap = {
+  [](size_t size) {
+    ++live_payloads;
+    last_payload = oversized::host_heap.allocate(size);
+    return last_payload;
+  },
+  [](uint8_t* data) {
+    --live_payloads;
+    oversized::host_heap.deallocate(data);
+  },
+  [](const uint8_t*, size_t) { return payloads_shared; },
+  false};
+
+// As above, but payloads remain writable by their sender once received
+static constexpr oversized::LargePayloadAllocator copying_heap = {
+  counting_heap.allocate,
+  counting_heap.deallocate,
+  counting_heap.is_shared,
+  true};
+
+TEST_CASE("Large payloads" * doctest::test_suite("oversized"))
+{
+  constexpr size_t buf_size = 1 << 8;
+  auto buffer = std::make_unique<ringbuffer::TestBuffer>(buf_size);
+  ringbuffer::Reader rr(buffer->bd);
+
+  constexpr auto fragment_max = buf_size / 8;
+  constexpr auto total_max = buf_size * 4;
+  oversized::Writer writer(
+    std::make_unique<ringbuffer::Writer>(rr),
+    fragment_max,
+    total_max,
+    &counting_heap);
+
+  std::vector<uint8_t> whole_message_ascending(total_max);
+  std::iota(whole_message_ascending.begin(), whole_message_ascending.end(), 0);
+
+  messaging::BufferProcessor bp("oversized");
+  oversized::FragmentReconstructor fr(bp.get_dispatcher(), &counting_heap);
+  REQUIRE(bp.get_dispatcher().has_handler(
+    oversized::OversizedMessage::large_payload));
+
+  std::vector<std::vector<uint8_t>> received;
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp, ascending, [&](const uint8_t* data, size_t size) {
+      received.emplace_back(data, data + size);
+    });
+
+  SUBCASE("Oversized messages are passed as large payloads")
+  {
+    for (size_t size : {fragment_max / 2, fragment_max + 1, total_max})
+    {
+      received.clear();
+      writer.write(
+        ascending,
+        serializer::ByteRange{whole_message_ascending.data(), size});
+
+      // Only small messages are written to the ringbuffer
+      REQUIRE(live_payloads == (size > fragment_max ? 1 : 0));
+
+      REQUIRE(bp.read_n(-1, rr) == 1);
+      REQUIRE(received.size() == 1);
+      REQUIRE(
+        received[0] ==
+        std::vector<uint8_t>(
+          whole_message_ascending.begin(),
+          whole_message_ascending.begin() + size));
+      REQUIRE(live_payloads == 0);
+    }
+  }
+
+  SUBCASE("Writable payloads are copied before they are dispatched")
+  {
+    messaging::BufferProcessor copying_bp("copying");
+    oversized::FragmentReconstructor copying_fr(
+      copying_bp.get_dispatcher(), &copying_heap);
+
+    // Handlers are given a private copy, and the payload is released first
+    DISPATCHER_SET_MESSAGE_HANDLER(
+      copying_bp, ascending, [&](const uint8_t* data, size_t size) {
+        REQUIRE(live_payloads == 0);
+        REQUIRE(data != last_payload);
+        received.emplace_back(data, data + size);
+      });
+
+    writer.write(
+      ascending,
+      serializer::ByteRange{whole_message_ascending.data(), total_max});
+
+    REQUIRE(copying_bp.read_n(-1, rr) == 1);
+    REQUIRE(received.size() == 1);
+    REQUIRE(received[0] == whole_message_ascending);
+    REQUIRE(live_payloads == 0);
+  }
+
+  SUBCASE("Payloads outside of shared memory are rejected and released")
+  {
+    writer.write(
+      ascending,
+      serializer::ByteRange{whole_message_ascending.data(), total_max});
+
+    payloads_shared = false;
+    REQUIRE_THROWS_AS(bp.read_n(-1, rr), ringbuffer::message_error);
+    payloads_shared = true;
+    REQUIRE(received.empty());
+    REQUIRE(live_payloads == 1);
+
+    // NB: The payload is leaked, as a reader cannot release memory that it
+    // does not own
+    live_payloads = 0;
+  }
+}
@@ -0,0 +1,156 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "../path_trie.h"
+
+#include <doctest/doctest.h>
+#include <random>
+#include <regex>
+#include <set>
+
+using Trie = ds::PathTrie<int>;
+
+std::vector<std::string> params_of(const Trie::Match& match)
+{
+  return {match.params.begin(), match.params.end()};
+}
+
+TEST_CASE("Literal and templated segments")
+{
+  Trie trie;
+  trie.insert("log/private") = 1;
+  trie.insert("log/private/{id}") = 2;
+  trie.insert("log/{table}/{id}") = 3;
+  trie.insert("{a}/{b}/{c}") = 4;
+
+  {
+    INFO("Templates only match paths with the same number of segments");
+    REQUIRE(trie.find("log").empty());
+    REQUIRE(trie.find("log/private/1/2").empty());
+    REQUIRE(trie.find("").empty());
+  }
+
+  {
+    INFO("Literal templates are found like any other");
+    const auto matches = trie.find("log/private");
+    REQUIRE(matches.size() == 1);
+    REQUIRE(*matches[0].value == 1);
+    REQUIRE(matches[0].params.empty());
+  }
+
+  {
+    INFO("Every matching template is found, in their order in the trie");
+    const auto matches = trie.find("log/private/42");
+    REQUIRE(matches.size() == 3);
+    REQUIRE(*matches[0].value == 2);
+    REQUIRE(*matches[0].path_template == "log/private/{id}");
+    REQUIRE(params_of(matches[0]) == std::vector<std::string>{"42"});
+    REQUIRE(*matches[1].value == 3);
+    REQUIRE(
+      params_of(matches[1]) == std::vector<std::string>{"private", "42"});
+    REQUIRE(*matches[2].value == 4);
+    REQUIRE(
+      params_of(matches[2]) ==
+      std::vector<std::string>{"log", "private", "42"});
+  }
+
+  {
+    INFO("Parameters match at least one character");
+    REQUIRE(trie.find("log/private/").size() == 0);
+    REQUIRE(trie.find("log//42").size() == 0);
+  }
+}
+
+TEST_CASE("Templates differing only by parameter names")
+{
+  Trie trie;
+  trie.insert("user/{id}") = 1;
+  trie.insert("user/{name}") = 2;
+  trie.insert("user/{id}") = 3;
+
+  const auto matches = trie.find("user/alice");
+  REQUIRE(matches.size() == 2);
+  REQUIRE(*matches[0].value == 3);
+  REQUIRE(*matches[1].value == 2);
+}
+
+TEST_CASE("Invalid templates")
+{
+  Trie trie;
+  REQUIRE_THROWS_AS(trie.insert("foo/{bar"), std::logic_error);
+  REQUIRE_THROWS_AS(trie.insert("foo/{bar/baz}"), std::logic_error);
+}
+
+// Reference: the regex into which EndpointRegistry::parse_path_template
+// turns a template
+std::optional<std::vector<std::string>> regex_match(
+  const std::string& path_template, const std::string& path)
+{
+  const auto regex_s =
+    std::regex_replace(path_template, std::regex("\\{[^}/]*\\}"), "([^/]+)");
+  std::smatch match;
+  if (!std::regex_match(path, match, std::regex(regex_s)))
+  {
+    return std::nullopt;
+  }
+
+  std::vector<std::string> params;
+  for (size_t i = 1; i < match.size(); ++i)
+  {
+    params.push_back(match[i].str());
+  }
+  return params;
+}
+
+TEST_CASE("Matches are those of the equivalent regex")
+{
+  std::mt19937 rng(42);
+  const std::vector<std::string> pieces = {"a", "b", "ab", "{x}", "/", "-"};
+  const std::vector<std::string> path_pieces = {"a", "b", "ab", "/", "-"};
+
+  const auto random_string = [&](const auto& from, size_t max_length) {
+    std::string s;
+    const auto length = 1 + rng() % max_length;
+    for (size_t i = 0; i < length; ++i)
+    {
+      s += from[rng() % from.size()];
+    }
+    return s;
+  };
+
+  std::vector<std::string> templates;
+  Trie trie;
+  while (templates.size() < 200)
+  {
+    const auto t = random_string(pieces, 6);
+    if (std::find(templates.begin(), templates.end(), t) == templates.end())
+    {
+      trie.insert(t) = templates.size();
+      templates.push_back(t);
+    }
+  }
+
+  for (size_t i = 0; i < 2000; ++i)
+  {
+    const auto path = random_string(path_pieces, 8);
+
+    std::map<std::string, std::vector<std::string>> expected;
+    for (const auto& t : templates)
+    {
+      const auto params = regex_match(t, path);
+      if (params.has_value())
+      {
+        expected[t] = params.value();
+      }
+    }
+
+    std::map<std::string, std::vector<std::string>> actual;
+    for (const auto& match : trie.find(path))
+    {
+      REQUIRE(templates[*match.value] == *match.path_template);
+      actual[*match.path_template] = params_of(match);
+    }
+
+    INFO(path);
+    REQUIRE(actual == expected);
+  }
+}
@@ -0,0 +1,198 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#define FMT_HEADER_ONLY
+#include "ds/path_trie.h"
+
+#include <picobench/picobench.hpp>
+#include <random>
+#include <regex>
+
+// Simulates the dispatch of requests to the templated endpoints of an
+// EndpointRegistry: finding the endpoint installed for a request's path and
+// verb, and extracting the values of its path parameters. Each sample
+// dispatches s.iterations() requests, spread over all the routes.
+
+enum Verb
+{
+  GET,
+  POST,
+  DELETE
+};
+
+struct Route
+{
+  std::string path_template;
+  std::vector<std::string> names;
+};
+
+struct Request
+{
+  std::string path;
+  Verb verb;
+};
+
+// Each resource has a family of routes, as a typical application would
+static std::vector<std::pair<std::string, Verb>> make_routes(
+  size_t route_count)
+{
+  std::vector<std::pair<std::string, Verb>> routes;
+  for (size_t r = 0; routes.size() < route_count; ++r)
+  {
+    routes.emplace_back(fmt::format("app/resource{}/{{id}}", r), GET);
+    routes.emplace_back(fmt::format("app/resource{}/{{id}}", r), POST);
+    routes.emplace_back(fmt::format("app/resource{}/{{id}}", r), DELETE);
+    routes.emplace_back(fmt::format("app/resource{}/{{id}}/receipt", r), GET);
+    routes.emplace_back(
+      fmt::format("app/resource{}/{{id}}/items/{{item}}", r), GET);
+  }
+  routes.resize(route_count);
+  return routes;
+}
+
+static std::vector<Request> make_requests(
+  const std::vector<std::pair<std::string, Verb>>& routes, size_t count)
+{
+  std::mt19937 rng(42);
+  std::vector<Request> requests;
+  for (size_t i = 0; i < count; ++i)
+  {
+    const auto& [path_template, verb] = routes[rng() % routes.size()];
+    auto path = std::regex_replace(
+      path_template, std::regex("\\{id\\}"), std::to_string(rng()));
+    path = std::regex_replace(path, std::regex("\\{item\\}"), "item");
+    requests.push_back({path, verb});
+  }
+  return requests;
+}
+
+// Previous dispatch, matching the regex of every template in turn
+struct RegexRouter
+{
+  struct Spec
+  {
+    std::regex template_regex;
+    std::vector<std::string> names;
+  };
+
+  std::map<std::string, std::map<Verb, Spec>> templated_endpoints;
+
+  void install(const std::string& path_template, Verb verb)
+  {
+    Spec spec;
+    const std::regex param("\\{([^}]*)\\}");
+    for (auto it = std::sregex_iterator(
+           path_template.begin(), path_template.end(), param);
+         it != std::sregex_iterator();
+         ++it)
+    {
+      spec.names.push_back((*it)[1].str());
+    }
+    spec.template_regex =
+      std::regex(std::regex_replace(path_template, param, "([^/]+)"));
+    templated_endpoints[path_template][verb] = std::move(spec);
+  }
+
+  size_t dispatch(
+    const Request& request, std::map<std::string, std::string>& params)
+  {
+    size_t matches = 0;
+    std::smatch match;
+    for (auto& [path_template, verb_endpoints] : templated_endpoints)
+    {
+      const auto it = verb_endpoints.find(request.verb);
+      if (
+        it != verb_endpoints.end() &&
+        std::regex_match(request.path, match, it->second.template_regex))
+      {
+        if (matches++ == 0)
+        {
+          for (size_t i = 0; i < it->second.names.size(); ++i)
+          {
+            params[it->second.names[i]] = match[i + 1].str();
+          }
+        }
+      }
+    }
+    return matches;
+  }
+};
+
+struct TrieRouter
+{
+  ds::PathTrie<std::map<Verb, std::vector<std::string>>> templated_paths;
+
+  void install(const std::string& path_template, Verb verb)
+  {
+    std::vector<std::string> names;
+    const std::regex param("\\{([^}]*)\\}");
+    for (auto it = std::sregex_iterator(
+           path_template.begin(), path_template.end(), param);
+         it != std::sregex_iterator();
+         ++it)
+    {
+      names.push_back((*it)[1].str());
+    }
+    templated_paths.insert(path_template)[verb] = std::move(names);
+  }
+
+  size_t dispatch(
+    const Request& request, std::map<std::string, std::string>& params)
+  {
+    size_t matches = 0;
+    for (const auto& match : templated_paths.find(request.path))
+    {
+      const auto it = match.value->find(request.verb);
+      if (it != match.value->end())
+      {
+        if (matches++ == 0)
+        {
+          for (size_t i = 0; i < it->second.size(); ++i)
+          {
+            params[it->second[i]] = std::string(match.params[i]);
+          }
+        }
+      }
+    }
+    return matches;
+  }
+};
+
+template <typename Router, size_t route_count>
+static void dispatch(picobench::state& s)
+{
+  const auto routes = make_routes(route_count);
+  const auto requests = make_requests(routes, s.iterations());
+
+  Router router;
+  for (const auto& [path_template, verb] : routes)
+  {
+    router.install(path_template, verb);
+  }
+
+  s.start_timer();
+  for (const auto& request : requests)
+  {
+    std::map<std::string, std::string> params;
+    if (router.dispatch(request, params) != 1)
+    {
+      throw std::logic_error(
+        fmt::format("Failed to dispatch {}", request.path));
+    }
+  }
+  s.stop_timer();
+}
+
+const std::vector<int> request_counts = {100, 1000};
+
+PICOBENCH_SUITE("dispatch_100_routes");
+auto regex_100 = dispatch<RegexRouter, 100>;
+PICOBENCH(regex_100).iterations(request_counts).samples(3).baseline();
+auto trie_100 = dispatch<TrieRouter, 100>;
+PICOBENCH(trie_100).iterations(request_counts).samples(3);
+
+PICOBENCH_SUITE("dispatch_500_routes");
+auto regex_500 = dispatch<RegexRouter, 500>;
+PICOBENCH(regex_500).iterations(request_counts).samples(3).baseline();
+auto trie_500 = dispatch<TrieRouter, 500>;
+PICOBENCH(trie_500).iterations(request_counts).samples(3);
@@ -2,10 +2,15 @@
 // Licensed under the Apache 2.0 License.
 #include "../ring_buffer.h"
 
+#include "../../enclave/ordered_messages.h"
+#include "../doorbell.h"
+#include "../non_blocking.h"
+#include "../per_thread_writer.h"
 #include "../serialized.h"
 
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
+#include <numeric>
 #include <thread>
 #include <vector>
 
@@ -17,6 +22,7 @@ enum : Message
   small_message,
   awkward_message,
   big_message,
+  ordered_message,
 };
 
 static constexpr auto awkward_size = 5;
@@ -507,3 +513,361 @@ TEST_CASE("Multiple threads can wait" * doctest::test_suite("ringbuffer"))
     }
   }
 }
+
+TEST_CASE("Waiting reader" * doctest::test_suite("ringbuffer"))
+{
+  auto buffer = std::make_unique<ringbuffer::TestBuffer>(256);
+  buffer->bd.ring_doorbell = &doorbell::ring;
+  Reader r(buffer->bd);
+  Writer w(r);
+  auto waiting = r.get_doorbell();
+
+  INFO("Reader does not wait if a message is available");
+  {
+    w.write(small_message, (uint8_t)1);
+    REQUIRE_FALSE(r.prepare_wait());
+    REQUIRE(waiting->load() == 0);
+    REQUIRE(r.read(-1, handle_message) == 1);
+  }
+
+  INFO("Writer clears the waiting flag");
+  {
+    REQUIRE(r.prepare_wait());
+    REQUIRE(waiting->load() == 1);
+    w.write(small_message, (uint8_t)1);
+    REQUIRE(waiting->load() == 0);
+    r.end_wait();
+    REQUIRE(r.read(-1, handle_message) == 1);
+  }
+
+  INFO("Writer without doorbell leaves the flag to the reader");
+  {
+    auto no_doorbell = std::make_unique<ringbuffer::TestBuffer>(256);
+    Reader r2(no_doorbell->bd);
+    Writer w2(r2);
+    REQUIRE(r2.prepare_wait());
+    w2.write(small_message, (uint8_t)1);
+    REQUIRE(r2.get_doorbell()->load() == 1);
+    r2.end_wait();
+    REQUIRE_FALSE(r2.prepare_wait());
+  }
+}
+
+TEST_CASE("Blocked reader is woken by writers" * doctest::test_suite("ringbuffer"))
+{
+  constexpr size_t thread_count = 4;
+  constexpr size_t max_n = 200;
+
+  auto buffer = std::make_unique<ringbuffer::TestBuffer>(64);
+  buffer->bd.ring_doorbell = &doorbell::ring;
+  Reader r(buffer->bd);
+
+  std::vector<std::thread> writer_threads;
+  for (size_t i = 0; i < thread_count; ++i)
+  {
+    writer_threads.push_back(std::thread([&r]() {
+      Writer w(r);
+      for (uint8_t j = 0u; j < max_n; ++j)
+      {
+        w.write(small_message, j);
+        // Leave the reader time to block
+        std::this_thread::sleep_for(std::chrono::microseconds(j % 7));
+      }
+    }));
+  }
+
+  // A wakeup lost by the doorbell would leave the reader blocked until the
+  // timeout
+  constexpr std::chrono::seconds timeout(5);
+  size_t reads = 0;
+  size_t waits = 0;
+  size_t timeouts = 0;
+  doorbell::SpinThenBlock idle_policy(1, 16);
+  while (reads < thread_count * max_n)
+  {
+    auto read_count = r.read(-1, handle_message);
+    reads += read_count;
+    if (read_count != 0)
+    {
+      idle_policy.busy();
+    }
+    else if (idle_policy.idle() && r.prepare_wait())
+    {
+      ++waits;
+      doorbell::wait(r.get_doorbell(), timeout);
+      if (r.get_doorbell()->load() != 0)
+      {
+        ++timeouts;
+      }
+      r.end_wait();
+    }
+  }
+
+  REQUIRE(reads == thread_count * max_n);
+  REQUIRE(timeouts == 0);
+
+  for (auto& thr : writer_threads)
+  {
+    thr.join();
+  }
+}
+
+TEST_CASE("Per-thread writers" * doctest::test_suite("ringbuffer"))
+{
+  constexpr size_t thread_count = 4;
+  constexpr uint8_t max_n = 200;
+
+  // Each thread writes to its own ringbuffer, all of which share the first
+  // one's waiting mark
+  auto inbound = std::make_unique<TestBuffer>(64);
+  std::vector<std::unique_ptr<TestBuffer>> buffers;
+  std::vector<std::unique_ptr<Circuit>> circuits;
+  std::vector<std::unique_ptr<WriterFactory>> factories;
+  std::vector<AbstractWriterFactory*> thread_factories;
+  for (size_t i = 0; i < thread_count; ++i)
+  {
+    auto& buffer = buffers.emplace_back(std::make_unique<TestBuffer>(64));
+    buffer->bd.ring_doorbell = &doorbell::ring;
+    buffer->bd.reader_waiting = &buffers.front()->offsets.reader_waiting;
+
+    auto& circuit = circuits.emplace_back(
+      std::make_unique<Circuit>(inbound->bd, buffer->bd));
+    auto& factory =
+      factories.emplace_back(std::make_unique<WriterFactory>(*circuit));
+    thread_factories.push_back(factory.get());
+  }
+
+  PerThreadWriterFactory per_thread_factory(
+    thread_factories, {ordered_message});
+  auto writer = per_thread_factory.create_writer_to_outside();
+
+  std::vector<std::thread> writer_threads;
+  for (uint16_t tid = 0; tid < thread_count; ++tid)
+  {
+    writer_threads.push_back(std::thread([&writer, tid]() {
+      threading::thread_id = tid;
+      for (uint8_t j = 0u; j < max_n; ++j)
+      {
+        writer->write(small_message, j);
+        writer->write(ordered_message, (uint8_t)tid, j);
+        // Leave the reader time to block
+        std::this_thread::sleep_for(std::chrono::microseconds(j % 7));
+      }
+    }));
+  }
+
+  // Messages read from each ringbuffer, and ordered messages read from each
+  // thread
+  std::vector<std::vector<uint8_t>> received(thread_count);
+  std::vector<std::vector<uint8_t>> received_ordered(thread_count);
+  size_t ordered_elsewhere = 0;
+
+  constexpr std::chrono::seconds timeout(5);
+  size_t reads = 0;
+  size_t timeouts = 0;
+  doorbell::SpinThenBlock idle_policy(1, 16);
+  auto& first = circuits.front()->read_from_inside();
+  while (reads < 2 * thread_count * max_n)
+  {
+    size_t read_count = 0;
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+      read_count += circuits[i]->read_from_inside().read(
+        -1, [&](Message m, const uint8_t* data, size_t size) {
+          if (m == small_message)
+          {
+            received[i].push_back(serialized::read<uint8_t>(data, size));
+          }
+          else if (i == 0)
+          {
+            const auto tid = serialized::read<uint8_t>(data, size);
+            received_ordered[tid].push_back(
+              serialized::read<uint8_t>(data, size));
+          }
+          else
+          {
+            ++ordered_elsewhere;
+          }
+        });
+    }
+    reads += read_count;
+
+    if (read_count != 0)
+    {
+      idle_policy.busy();
+    }
+    else if (idle_policy.idle() && first.prepare_wait())
+    {
+      // A write to any of the ringbuffers after this point clears the mark
+      bool has_message = false;
+      for (auto& circuit : circuits)
+      {
+        has_message |= circuit->read_from_inside().has_message();
+      }
+
+      if (!has_message)
+      {
+        doorbell::wait(first.get_doorbell(), timeout);
+        if (first.get_doorbell()->load() != 0)
+        {
+          ++timeouts;
+        }
+      }
+      first.end_wait();
+    }
+  }
+
+  for (auto& thr : writer_threads)
+  {
+    thr.join();
+  }
+
+  std::vector<uint8_t> expected(max_n);
+  std::iota(expected.begin(), expected.end(), 0);
+  for (size_t i = 0; i < thread_count; ++i)
+  {
+    REQUIRE(received[i] == expected);
+    REQUIRE(received_ordered[i] == expected);
+  }
+  REQUIRE(ordered_elsewhere == 0);
+  REQUIRE(timeouts == 0);
+}
+
+TEST_CASE(
+  "Append entries follow ledger appends" * doctest::test_suite("ringbuffer"))
+{
+  constexpr size_t thread_count = 3;
+
+  std::vector<std::unique_ptr<TestBuffer>> buffers;
+  std::vector<std::unique_ptr<Circuit>> circuits;
+  std::vector<std::unique_ptr<WriterFactory>> factories;
+  std::vector<AbstractWriterFactory*> thread_factories;
+  auto inbound = std::make_unique<TestBuffer>(64);
+  for (size_t i = 0; i < thread_count; ++i)
+  {
+    auto& buffer = buffers.emplace_back(std::make_unique<TestBuffer>(64));
+    auto& circuit = circuits.emplace_back(
+      std::make_unique<Circuit>(inbound->bd, buffer->bd));
+    auto& factory =
+      factories.emplace_back(std::make_unique<WriterFactory>(*circuit));
+    thread_factories.push_back(factory.get());
+  }
+
+  PerThreadWriterFactory per_thread_factory(
+    thread_factories, enclave::ordered_to_host);
+  auto writer = per_thread_factory.create_writer_to_outside();
+
+  // The entry is appended by one thread, and the append entries referring to
+  // it sent by another
+  std::thread([&writer]() {
+    threading::thread_id = 1;
+    writer->write(consensus::ledger_append, (uint8_t)42);
+  }).join();
+  std::thread([&writer]() {
+    threading::thread_id = 2;
+    writer->write(ccf::node_outbound, (uint8_t)42);
+  }).join();
+
+  // Even reading the sending thread's ringbuffer first, the append is read
+  // before the append entries
+  std::vector<Message> received;
+  for (auto i : {2, 1, 0})
+  {
+    circuits[i]->read_from_inside().read(
+      -1, [&](Message m, const uint8_t*, size_t) { received.push_back(m); });
+  }
+  REQUIRE(
+    received ==
+    std::vector<Message>{consensus::ledger_append, ccf::node_outbound});
+}
+
+TEST_CASE("Spin then block" * doctest::test_suite("ringbuffer"))
+{
+  doorbell::SpinThenBlock policy(4, 64);
+  REQUIRE(policy.get_spin_limit() == 64);
+
+  INFO("Blocking halves the spin limit, down to the minimum");
+  for (size_t expected : {32, 16, 8, 4, 4})
+  {
+    const auto limit = policy.get_spin_limit();
+    size_t spins = 0;
+    while (!policy.idle())
+    {
+      ++spins;
+    }
+    REQUIRE(spins == limit);
+    REQUIRE(policy.get_spin_limit() == expected);
+  }
+
+  INFO("Messages arriving while spinning double the limit");
+  policy.idle();
+  policy.busy();
+  REQUIRE(policy.get_spin_limit() == 8);
+  policy.busy();
+  REQUIRE(policy.get_spin_limit() == 8);
+}
+
+TEST_CASE("Buffer statistics" * doctest::test_suite("ringbuffer"))
+{
+  auto buffer = std::make_unique<TestBuffer>(64);
+  Reader r(buffer->bd);
+  Writer w(r);
+
+  auto stats = r.get_stats();
+  REQUIRE(stats.size == 64);
+  REQUIRE(stats.occupancy == 0);
+  REQUIRE(stats.max_occupancy == 0);
+
+  // Fill the buffer
+  size_t written = 0;
+  while (w.try_write(small_message, (uint8_t)written))
+  {
+    ++written;
+  }
+
+  stats = r.get_stats();
+  REQUIRE(stats.occupancy == 64);
+  REQUIRE(stats.failed_reservations == 1);
+  REQUIRE(stats.blocked_writes == 0);
+
+  // Non-blocking writers queue messages which do not fit
+  Circuit circuit(buffer->bd, buffer->bd);
+  WriterFactory basic_factory(circuit);
+  NonBlockingWriterFactory non_blocking_factory(basic_factory);
+  auto nbw = non_blocking_factory.create_writer_to_inside();
+  size_t pending_callbacks = 0;
+  non_blocking_factory.set_inbound_pending_callback(
+    [&pending_callbacks]() { ++pending_callbacks; });
+  nbw->write(small_message, (uint8_t)0);
+  nbw->write(small_message, (uint8_t)1);
+
+  // The callback is only made once the writer starts queueing
+  REQUIRE(pending_callbacks == 1);
+
+  auto pending = non_blocking_factory.get_pending_inbound_stats();
+  REQUIRE(pending.messages == 2);
+  REQUIRE(pending.bytes == 2);
+  REQUIRE(pending.total_messages == 2);
+  REQUIRE(r.get_stats().failed_reservations == 2);
+
+  // A blocking write waits until the reader makes space
+  std::thread writer([&w]() { w.write(small_message, (uint8_t)0); });
+  while (r.get_stats().blocked_writes == 0)
+  {
+    std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  REQUIRE(r.read(written, nop_handler) == written);
+  writer.join();
+
+  stats = r.get_stats();
+  REQUIRE(stats.max_occupancy == 64);
+  REQUIRE(stats.blocked_writes == 1);
+  REQUIRE(stats.blocked_ns > 0);
+
+  REQUIRE(non_blocking_factory.flush_all_inbound());
+  pending = non_blocking_factory.get_pending_inbound_stats();
+  REQUIRE(pending.messages == 0);
+  REQUIRE(pending.bytes == 0);
+  REQUIRE(pending.total_messages == 2);
+}
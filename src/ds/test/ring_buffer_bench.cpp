@@ -4,8 +4,14 @@
 #define PICOBENCH_DONT_BIND_TO_ONE_CORE
 #include "../ring_buffer.h"
 
+#include "../doorbell.h"
+#include "../oversized.h"
+#include "../per_thread_writer.h"
+#include "../serialized.h"
+
 #include <picobench/picobench.hpp>
 #include <thread>
+#include <time.h>
 
 using namespace ringbuffer;
 
@@ -182,3 +188,326 @@ auto spin_200 = specialize<32, 1, 4, spin_pause_handler<200>>;
 FIXED_PICO(spin_200);
 auto spin_400 = specialize<32, 1, 4, spin_pause_handler<400>>;
 FIXED_PICO(spin_400);
+
+enum class IdlePolicy
+{
+  // Spin for 5ms, then sleep for 50ms at a time
+  SleepPoll,
+  // Spin for an adaptive number of iterations, then block until the writer
+  // rings the doorbell
+  Doorbell
+};
+
+enum class Measure
+{
+  Latency,
+  ReaderCPU
+};
+
+static int64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+// Models the enclave's main loop during quiet periods: the reader idles while
+// nothing is written, then a single message is written. Each iteration is one
+// 20ms quiet period followed by a message. Either the latency from writing
+// each message to reading it, or the CPU time used by the reader (mostly
+// while idling) is measured.
+template <IdlePolicy P, Measure M>
+static void quiet_period(picobench::state& s)
+{
+  constexpr auto quiet_time = std::chrono::milliseconds(20);
+  constexpr auto spin_time = std::chrono::milliseconds(5);
+  constexpr auto block_time = std::chrono::milliseconds(50);
+
+  auto buffer = std::make_unique<ringbuffer::TestBuffer>(DefaultBufSize);
+  if (P == IdlePolicy::Doorbell)
+  {
+    buffer->bd.ring_doorbell = &doorbell::ring;
+  }
+  Reader r(buffer->bd);
+
+  const size_t messages = s.iterations();
+  int64_t total_latency = 0;
+  int64_t reader_cpu = 0;
+
+  std::thread reader([&]() {
+    size_t reads = 0;
+    doorbell::SpinThenBlock idle_policy;
+    std::optional<std::chrono::steady_clock::time_point> idle_start;
+
+    while (reads < messages)
+    {
+      auto read = r.read(-1, [&](Message, const uint8_t* data, size_t size) {
+        total_latency += now_ns() - serialized::read<int64_t>(data, size);
+      });
+      reads += read;
+
+      if (read != 0)
+      {
+        idle_start.reset();
+        idle_policy.busy();
+      }
+      else if (P == IdlePolicy::SleepPoll)
+      {
+        const auto now = std::chrono::steady_clock::now();
+        if (!idle_start.has_value())
+        {
+          idle_start = now;
+        }
+
+        if (now - idle_start.value() > spin_time)
+        {
+          std::this_thread::sleep_for(block_time);
+        }
+        else
+        {
+          CCF_PAUSE();
+        }
+      }
+      else if (idle_policy.idle())
+      {
+        if (r.prepare_wait())
+        {
+          doorbell::wait(r.get_doorbell(), block_time);
+          r.end_wait();
+        }
+      }
+      else
+      {
+        CCF_PAUSE();
+      }
+    }
+
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    reader_cpu = ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
+  });
+
+  Writer w(r);
+  for (size_t i = 0; i < messages; ++i)
+  {
+    std::this_thread::sleep_for(quiet_time);
+    w.write(msg_type, now_ns());
+  }
+  reader.join();
+
+  s.add_custom_duration(M == Measure::Latency ? total_latency : reader_cpu);
+}
+
+const std::vector<int> quiet_periods = {20};
+
+PICOBENCH_SUITE("latency after 20ms quiet periods");
+auto sleep_poll_latency = quiet_period<IdlePolicy::SleepPoll, Measure::Latency>;
+PICOBENCH(sleep_poll_latency).iterations(quiet_periods).samples(3).baseline();
+auto doorbell_latency = quiet_period<IdlePolicy::Doorbell, Measure::Latency>;
+PICOBENCH(doorbell_latency).iterations(quiet_periods).samples(3);
+
+PICOBENCH_SUITE("reader CPU time over 20ms quiet periods");
+auto sleep_poll_cpu = quiet_period<IdlePolicy::SleepPoll, Measure::ReaderCPU>;
+PICOBENCH(sleep_poll_cpu).iterations(quiet_periods).samples(3).baseline();
+auto doorbell_cpu = quiet_period<IdlePolicy::Doorbell, Measure::ReaderCPU>;
+PICOBENCH(doorbell_cpu).iterations(quiet_periods).samples(3);
+
+// Writes messages with no reader waiting, with or without a doorbell. With
+// one, each write is followed by a full fence before the reader's waiting mark
+// is checked. Messages are read once all have been written, untimed.
+template <bool Doorbell>
+static void uncontended_writes(picobench::state& s)
+{
+  constexpr size_t message_size = 64;
+  const size_t messages = s.iterations();
+
+  auto buffer = std::make_unique<TestBuffer>(1 << 22);
+  if (Doorbell)
+  {
+    buffer->bd.ring_doorbell = &doorbell::ring;
+  }
+  Reader r(buffer->bd);
+  Writer w(r);
+
+  std::vector<uint8_t> payload(message_size);
+  s.start_timer();
+  for (size_t i = 0; i < messages; ++i)
+  {
+    w.write(msg_type, serializer::ByteRange{payload.data(), message_size});
+  }
+  s.stop_timer();
+
+  if (r.read(-1, nop_handler) != messages)
+  {
+    throw std::logic_error("Unexpected message count");
+  }
+}
+
+PICOBENCH_SUITE("uncontended writes (64b per-message)");
+auto without_doorbell = uncontended_writes<false>;
+FIXED_PICO(without_doorbell).baseline();
+auto with_doorbell = uncontended_writes<true>;
+FIXED_PICO(with_doorbell);
+
+enum class LargePayload
+{
+  Fragments,
+  SideChannel
+};
+
+// Sends messages of a given size, from 64KB to 16MB, through a ringbuffer
+// smaller than the largest of them. Without an allocator, each message is
+// split into fragments which the reader copies back together. With one, the
+// payload is passed by ownership.
+// Each iteration is one KB, so the reported time is per KB of payload.
+template <LargePayload P>
+static void large_payload(picobench::state& s)
+{
+  constexpr size_t messages = 8;
+  constexpr size_t max_fragment_size = 64 * 1024;
+  constexpr size_t max_total_size = 16 * 1024 * 1024;
+  const size_t payload_size = s.iterations() * 1024;
+
+  auto buffer = std::make_unique<TestBuffer>(1 << 20);
+  Reader r(buffer->bd);
+
+  messaging::BufferProcessor bp;
+  oversized::FragmentReconstructor fr(
+    bp.get_dispatcher(),
+    P == LargePayload::Fragments ? nullptr : &oversized::host_heap);
+  size_t received = 0;
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp, msg_type, [&](const uint8_t* data, size_t size) {
+      if (size != payload_size || data[size - 1] != (uint8_t)received)
+      {
+        throw std::logic_error("Unexpected payload");
+      }
+      ++received;
+    });
+
+  oversized::Writer w(
+    std::make_unique<Writer>(r),
+    max_fragment_size,
+    max_total_size,
+    P == LargePayload::Fragments ? nullptr : &oversized::host_heap);
+
+  s.start_timer();
+  std::thread writer([&]() {
+    for (size_t i = 0; i < messages; ++i)
+    {
+      std::vector<uint8_t> payload(payload_size, (uint8_t)i);
+      w.write(msg_type, payload);
+    }
+  });
+
+  while (received < messages)
+  {
+    if (bp.read_n(-1, r) == 0)
+    {
+      CCF_PAUSE();
+    }
+  }
+  writer.join();
+  s.stop_timer();
+}
+
+// Payload sizes in KB
+const std::vector<int> large_payload_sizes = {64, 256, 1024, 4096, 16384};
+
+PICOBENCH_SUITE("large payloads");
+auto fragments = large_payload<LargePayload::Fragments>;
+PICOBENCH(fragments).iterations(large_payload_sizes).samples(5).baseline();
+auto side_channel = large_payload<LargePayload::SideChannel>;
+PICOBENCH(side_channel).iterations(large_payload_sizes).samples(5);
+
+// Simulates enclave worker threads writing responses to the host, either all
+// to a single ringbuffer or each to its own. Both use the same total
+// ringbuffer capacity. The reader takes turns reading from each ringbuffer, as
+// the host does.
+template <bool PerThread, size_t WriterCount>
+static void responses(picobench::state& s)
+{
+  constexpr size_t buf_size_per_writer = 1 << 14;
+  constexpr size_t response_size = 256;
+  const size_t messages_per_writer = s.iterations() / WriterCount;
+
+  auto inbound = std::make_unique<TestBuffer>(buf_size_per_writer);
+  std::vector<std::unique_ptr<TestBuffer>> buffers;
+  std::vector<std::unique_ptr<Circuit>> circuits;
+  std::vector<std::unique_ptr<WriterFactory>> factories;
+  std::vector<AbstractWriterFactory*> thread_factories;
+  for (size_t i = 0; i < (PerThread ? WriterCount : 1); ++i)
+  {
+    auto& buffer = buffers.emplace_back(std::make_unique<TestBuffer>(
+      PerThread ? buf_size_per_writer : buf_size_per_writer * WriterCount));
+    auto& circuit = circuits.emplace_back(
+      std::make_unique<Circuit>(inbound->bd, buffer->bd));
+    auto& factory =
+      factories.emplace_back(std::make_unique<WriterFactory>(*circuit));
+    thread_factories.push_back(factory.get());
+  }
+
+  WriterPtr writer;
+  std::unique_ptr<PerThreadWriterFactory> per_thread_factory;
+  if constexpr (PerThread)
+  {
+    per_thread_factory =
+      std::make_unique<PerThreadWriterFactory>(thread_factories);
+    writer = per_thread_factory->create_writer_to_outside();
+  }
+  else
+  {
+    writer = factories.front()->create_writer_to_outside();
+  }
+
+  std::vector<uint8_t> response(response_size);
+  std::iota(response.begin(), response.end(), 0);
+
+  s.start_timer();
+  std::vector<std::thread> writer_threads;
+  for (uint16_t tid = 0; tid < WriterCount; ++tid)
+  {
+    writer_threads.emplace_back([&, tid]() {
+      threading::thread_id = tid;
+      for (size_t i = 0; i < messages_per_writer; ++i)
+      {
+        writer->write(msg_type, response);
+      }
+    });
+  }
+
+  size_t reads = 0;
+  while (reads < messages_per_writer * WriterCount)
+  {
+    size_t read = 0;
+    for (auto& circuit : circuits)
+    {
+      read += circuit->read_from_inside().read(256, nop_handler);
+    }
+    if (read == 0)
+    {
+      CCF_PAUSE();
+    }
+    reads += read;
+  }
+
+  for (auto& thr : writer_threads)
+  {
+    thr.join();
+  }
+  s.stop_timer();
+}
+
+const std::vector<int> response_counts = {64000};
+
+PICOBENCH_SUITE("responses from 8 worker threads");
+auto shared_ring_8 = responses<false, 8>;
+PICOBENCH(shared_ring_8).iterations(response_counts).samples(5).baseline();
+auto per_thread_8 = responses<true, 8>;
+PICOBENCH(per_thread_8).iterations(response_counts).samples(5);
+
+PICOBENCH_SUITE("responses from 16 worker threads");
+auto shared_ring_16 = responses<false, 16>;
+PICOBENCH(shared_ring_16).iterations(response_counts).samples(5).baseline();
+auto per_thread_16 = responses<true, 16>;
+PICOBENCH(per_thread_16).iterations(response_counts).samples(5);
@@ -2,7 +2,16 @@
 // Licensed under the Apache 2.0 License.
 #include "../thread_messaging.h"
 
+#include "../per_thread_writer.h"
+#include "../ring_buffer.h"
+
 #include <doctest/doctest.h>
+#include <mutex>
+#include <numeric>
+#include <pthread.h>
+#include <set>
+#include <thread>
+#include <time.h>
 
 struct Foo
 {
@@ -59,4 +68,508 @@ TEST_CASE("Unpopped messages are freed")
   CHECK(Foo::count == 0);
 
   CHECK(happened);
-}
\ No newline at end of file
+}
+static void ignore(std::unique_ptr<threading::Tmsg<Foo>> msg) {}
+
+TEST_CASE("Queue depth")
+{
+  threading::ThreadMessaging tm(1);
+  REQUIRE(tm.get_queue_depths() == std::vector<size_t>{0});
+
+  for (size_t i = 0; i < 3; ++i)
+  {
+    tm.add_task<Foo>(0, std::make_unique<threading::Tmsg<Foo>>(&ignore));
+  }
+  REQUIRE(tm.get_queue_depths() == std::vector<size_t>{3});
+
+  tm.run_one();
+  REQUIRE(tm.get_queue_depths() == std::vector<size_t>{2});
+
+  while (tm.run_one())
+  {
+  }
+  REQUIRE(tm.get_queue_depths() == std::vector<size_t>{0});
+}
+
+struct Counter
+{
+  std::atomic<size_t>* count;
+};
+
+static void increment(std::unique_ptr<threading::Tmsg<Counter>> msg)
+{
+  ++*msg->data.count;
+}
+
+TEST_CASE("Timer tasks run once their delay has elapsed")
+{
+  threading::ThreadMessaging tm(1);
+  std::atomic<size_t> count = 0;
+
+  auto add_after = [&](std::chrono::milliseconds ms) {
+    auto msg = std::make_unique<threading::Tmsg<Counter>>(&increment);
+    msg->data.count = &count;
+    return tm.add_task_after(std::move(msg), ms);
+  };
+
+  add_after(std::chrono::milliseconds(5));
+  auto cancelled = add_after(std::chrono::milliseconds(10));
+  add_after(std::chrono::milliseconds(1000));
+  add_after(std::chrono::hours(48));
+  REQUIRE(tm.cancel_timer_task(cancelled));
+  REQUIRE_FALSE(tm.cancel_timer_task(cancelled));
+
+  auto tick = [&](std::chrono::milliseconds elapsed) {
+    tm.tick(elapsed);
+    while (tm.run_one())
+    {
+    }
+  };
+
+  tick(std::chrono::milliseconds(4));
+  REQUIRE(count == 0);
+  tick(std::chrono::milliseconds(1));
+  REQUIRE(count == 1);
+  tick(std::chrono::milliseconds(900));
+  REQUIRE(count == 1);
+  tick(std::chrono::hours(1));
+  REQUIRE(count == 2);
+  tick(std::chrono::hours(47));
+  REQUIRE(count == 3);
+}
+
+TEST_CASE("Message storage is recycled, across threads")
+{
+  using Msg = threading::Tmsg<Counter>;
+
+  {
+    auto msg = std::make_unique<Msg>(&increment);
+    void* p = msg.get();
+    msg.reset();
+    msg = std::make_unique<Msg>(&increment);
+    CHECK(msg.get() == p);
+  }
+
+  // Messages allocated by this thread and freed by another are reused by this
+  // thread once the other has freed more than it keeps for itself
+  constexpr size_t n = 1000;
+  std::vector<std::unique_ptr<Msg>> msgs;
+  std::set<void*> freed;
+  for (size_t i = 0; i < n; ++i)
+  {
+    msgs.push_back(std::make_unique<Msg>(&increment));
+    freed.insert(msgs.back().get());
+  }
+
+  size_t kept = 0;
+  std::thread t([&msgs, &kept]() {
+    msgs.clear();
+    kept = threading::MessagePool<Msg>::local_free_blocks();
+  });
+  t.join();
+  REQUIRE(kept < n / 10);
+
+  for (size_t i = 0; i < n / 2; ++i)
+  {
+    msgs.push_back(std::make_unique<Msg>(&increment));
+    REQUIRE(freed.find(msgs.back().get()) != freed.end());
+  }
+}
+
+TEST_CASE("Message storage pooled across threads is bounded")
+{
+  using Msg = threading::Tmsg<Counter>;
+
+  // Empties the shared pool
+  std::vector<std::unique_ptr<Msg>> msgs;
+  while (threading::MessagePool<Msg>::shared_free_blocks() > 0)
+  {
+    msgs.push_back(std::make_unique<Msg>(&increment));
+  }
+
+  // Messages freed by an exiting thread once its free list is destroyed do
+  // not go to the shared pool
+  struct Holder
+  {
+    std::vector<std::unique_ptr<Msg>> msgs;
+    size_t* before = nullptr;
+    size_t* after = nullptr;
+
+    ~Holder()
+    {
+      *before = threading::MessagePool<Msg>::shared_free_blocks();
+      msgs.clear();
+      *after = threading::MessagePool<Msg>::shared_free_blocks();
+    }
+  };
+  size_t before = 0;
+  size_t after = 0;
+  std::thread exiting([&before, &after]() {
+    // Constructed before the thread's free list, so destroyed after it
+    thread_local Holder holder;
+    holder.before = &before;
+    holder.after = &after;
+    for (size_t i = 0; i < 10; ++i)
+    {
+      holder.msgs.push_back(std::make_unique<Msg>(&increment));
+    }
+  });
+  exiting.join();
+  REQUIRE(before == after);
+
+  // Far more blocks than the shared pool keeps are freed by another thread
+  constexpr size_t n = 100000;
+  while (msgs.size() < n)
+  {
+    msgs.push_back(std::make_unique<Msg>(&increment));
+  }
+  std::thread t([&msgs]() { msgs.clear(); });
+  t.join();
+  const auto shared = threading::MessagePool<Msg>::shared_free_blocks();
+  REQUIRE(shared > 0);
+  REQUIRE(shared < n / 10);
+}
+
+struct Traced
+{
+  std::atomic<tracing::TraceId>* seen;
+};
+
+static void record_trace(std::unique_ptr<threading::Tmsg<Traced>> msg)
+{
+  msg->data.seen->store(tracing::Tracer::current_trace());
+}
+
+TEST_CASE("Messages carry the trace of their sender")
+{
+  tracing::Tracer::set_sampling_interval(1);
+  tracing::Tracer::take_spans();
+
+  threading::ThreadMessaging tm(1);
+  std::atomic<tracing::TraceId> seen = 0;
+
+  auto send = [&]() {
+    auto msg = std::make_unique<threading::Tmsg<Traced>>(&record_trace);
+    msg->data.seen = &seen;
+    tm.add_task(0, std::move(msg));
+  };
+
+  const auto id = tracing::Tracer::start_trace();
+  {
+    tracing::TraceScope scope(id);
+    send();
+  }
+  // Run outside of the sender's trace
+  REQUIRE(tm.run_one());
+  REQUIRE(seen == id);
+  REQUIRE(tracing::Tracer::current_trace() == 0);
+
+  auto spans = tracing::Tracer::take_spans();
+  REQUIRE(spans.size() == 1);
+  REQUIRE(spans[0].trace_id == id);
+  REQUIRE(spans[0].kind == tracing::SpanKind::Queued);
+  REQUIRE(spans[0].start_ns <= spans[0].end_ns);
+
+  // Untraced messages run outside of any trace
+  send();
+  REQUIRE(tm.run_one());
+  REQUIRE(seen == 0);
+  REQUIRE(tracing::Tracer::take_spans().empty());
+
+  tracing::Tracer::set_sampling_interval(0);
+}
+
+static std::chrono::nanoseconds thread_cpu_time(std::thread& t)
+{
+  clockid_t clock;
+  pthread_getcpuclockid(t.native_handle(), &clock);
+  timespec ts;
+  clock_gettime(clock, &ts);
+  return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+TEST_CASE("Idle threads park until given a task")
+{
+  using namespace std::chrono_literals;
+
+  const auto thread_count = threading::ThreadMessaging::thread_count.load();
+  threading::ThreadMessaging::thread_count = 2;
+
+  threading::ThreadMessaging tm(2);
+  std::thread worker([&tm]() {
+    threading::thread_id = 1;
+    tm.run();
+  });
+
+  // Once parked, the worker uses next to no CPU time while idle
+  std::this_thread::sleep_for(100ms);
+  const auto idle_start = thread_cpu_time(worker);
+  std::this_thread::sleep_for(500ms);
+  CHECK(thread_cpu_time(worker) - idle_start < 50ms);
+
+  // Each task wakes the worker up, well before it would wake up by itself
+  std::atomic<size_t> count = 0;
+  for (size_t i = 0; i < 10; ++i)
+  {
+    std::this_thread::sleep_for(20ms);
+
+    auto msg = std::make_unique<threading::Tmsg<Counter>>(&increment);
+    msg->data.count = &count;
+    const auto start = std::chrono::steady_clock::now();
+    tm.add_task(1, std::move(msg));
+    while (count.load() == i)
+    {
+      std::this_thread::yield();
+    }
+    CHECK(std::chrono::steady_clock::now() - start < 25ms);
+  }
+
+  // Finishing wakes the worker up too
+  tm.set_finished();
+  worker.join();
+
+  threading::ThreadMessaging::thread_count = thread_count;
+}
+
+struct StrandTask
+{
+  std::shared_ptr<threading::Strand> strand;
+  size_t index;
+
+  // Per strand
+  std::vector<size_t>* order;
+  std::atomic<bool>* running;
+
+  std::mutex* lock;
+  std::set<uint16_t>* threads;
+  size_t* completed;
+};
+
+static void run_strand_task(std::unique_ptr<threading::Tmsg<StrandTask>> msg)
+{
+  auto& d = msg->data;
+  CHECK(d.strand->is_current());
+  CHECK(!d.running->exchange(true));
+
+  d.order->push_back(d.index);
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+  d.running->store(false);
+
+  std::lock_guard<std::mutex> guard(*d.lock);
+  d.threads->insert(threading::get_current_thread_id());
+  ++*d.completed;
+}
+
+TEST_CASE("Strands run in order, on any worker thread")
+{
+  using namespace std::chrono_literals;
+
+  constexpr uint16_t workers = 3;
+  const auto thread_count = threading::ThreadMessaging::thread_count.load();
+  threading::ThreadMessaging::thread_count = workers + 1;
+
+  threading::ThreadMessaging tm(workers + 1);
+  std::vector<std::thread> threads;
+  for (uint16_t i = 1; i <= workers; ++i)
+  {
+    threads.emplace_back([&tm, i]() {
+      threading::thread_id = i;
+      tm.run();
+    });
+  }
+
+  // All strands prefer the first worker, which cannot run them all
+  constexpr size_t num_strands = 8;
+  constexpr size_t tasks_per_strand = 50;
+  std::vector<std::shared_ptr<threading::Strand>> strands;
+  std::vector<std::vector<size_t>> orders(num_strands);
+  std::vector<std::atomic<bool>> running(num_strands);
+  std::mutex lock;
+  std::set<uint16_t> ran_on;
+  size_t completed = 0;
+  for (size_t i = 0; i < num_strands; ++i)
+  {
+    strands.push_back(std::make_shared<threading::Strand>(1));
+  }
+
+  for (size_t t = 0; t < tasks_per_strand; ++t)
+  {
+    for (size_t i = 0; i < num_strands; ++i)
+    {
+      auto msg =
+        std::make_unique<threading::Tmsg<StrandTask>>(&run_strand_task);
+      msg->data = {
+        strands[i], t, &orders[i], &running[i], &lock, &ran_on, &completed};
+      tm.add_task(strands[i], std::move(msg));
+    }
+  }
+
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (std::chrono::steady_clock::now() < deadline)
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (completed == num_strands * tasks_per_strand)
+      {
+        break;
+      }
+    }
+    std::this_thread::sleep_for(1ms);
+  }
+
+  tm.set_finished();
+  for (auto& t : threads)
+  {
+    t.join();
+  }
+
+  REQUIRE(completed == num_strands * tasks_per_strand);
+
+  for (const auto& order : orders)
+  {
+    std::vector<size_t> expected(tasks_per_strand);
+    std::iota(expected.begin(), expected.end(), 0);
+    REQUIRE(order == expected);
+  }
+
+  // Idle workers stole some of the strands
+  REQUIRE(ran_on.size() > 1);
+
+  threading::ThreadMessaging::thread_count = thread_count;
+}
+
+struct WritingTask
+{
+  std::shared_ptr<threading::Strand> strand;
+  ringbuffer::WriterPtr writer;
+  size_t index;
+
+  std::mutex* lock;
+  std::set<uint16_t>* threads;
+  size_t* completed;
+};
+
+static void run_writing_task(std::unique_ptr<threading::Tmsg<WritingTask>> msg)
+{
+  auto& d = msg->data;
+  d.writer->write(ringbuffer::Const::msg_min, d.index);
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+  std::lock_guard<std::mutex> guard(*d.lock);
+  d.threads->insert(threading::get_current_thread_id());
+  ++*d.completed;
+}
+
+TEST_CASE("Strands write in order as they move between threads")
+{
+  using namespace std::chrono_literals;
+
+  constexpr uint16_t workers = 3;
+  const auto thread_count = threading::ThreadMessaging::thread_count.load();
+  threading::ThreadMessaging::thread_count = workers + 1;
+
+  // A ringbuffer per thread, as in the enclave
+  std::vector<std::unique_ptr<ringbuffer::TestBuffer>> buffers;
+  std::vector<std::unique_ptr<ringbuffer::Circuit>> circuits;
+  std::vector<std::unique_ptr<ringbuffer::WriterFactory>> factories;
+  std::vector<ringbuffer::AbstractWriterFactory*> thread_factories;
+  auto inbound = std::make_unique<ringbuffer::TestBuffer>(64);
+  for (size_t i = 0; i <= workers; ++i)
+  {
+    auto& buffer =
+      buffers.emplace_back(std::make_unique<ringbuffer::TestBuffer>(1 << 14));
+    auto& circuit = circuits.emplace_back(
+      std::make_unique<ringbuffer::Circuit>(inbound->bd, buffer->bd));
+    auto& factory = factories.emplace_back(
+      std::make_unique<ringbuffer::WriterFactory>(*circuit));
+    thread_factories.push_back(factory.get());
+  }
+  ringbuffer::PerThreadWriterFactory per_thread_factory(thread_factories);
+
+  threading::ThreadMessaging tm(workers + 1);
+  std::vector<std::thread> threads;
+  for (uint16_t i = 1; i <= workers; ++i)
+  {
+    threads.emplace_back([&tm, i]() {
+      threading::thread_id = i;
+      tm.run();
+    });
+  }
+
+  // All strands prefer the first worker, which cannot run them all, so they
+  // are stolen by the others. Each writes through a writer pinned to the
+  // first worker's ringbuffer.
+  constexpr size_t num_strands = 4;
+  constexpr size_t tasks_per_strand = 50;
+  std::vector<std::shared_ptr<threading::Strand>> strands;
+  std::vector<ringbuffer::WriterPtr> writers;
+  std::mutex lock;
+  std::set<uint16_t> ran_on;
+  size_t completed = 0;
+  for (size_t i = 0; i < num_strands; ++i)
+  {
+    strands.push_back(std::make_shared<threading::Strand>(1));
+    writers.push_back(per_thread_factory.create_writer_to_outside_from(1));
+  }
+
+  for (size_t t = 0; t < tasks_per_strand; ++t)
+  {
+    for (size_t i = 0; i < num_strands; ++i)
+    {
+      auto msg =
+        std::make_unique<threading::Tmsg<WritingTask>>(&run_writing_task);
+      msg->data = {
+        strands[i],
+        writers[i],
+        i * tasks_per_strand + t,
+        &lock,
+        &ran_on,
+        &completed};
+      tm.add_task(strands[i], std::move(msg));
+    }
+  }
+
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (std::chrono::steady_clock::now() < deadline)
+  {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (completed == num_strands * tasks_per_strand)
+      {
+        break;
+      }
+    }
+    std::this_thread::sleep_for(1ms);
+  }
+
+  tm.set_finished();
+  for (auto& t : threads)
+  {
+    t.join();
+  }
+
+  REQUIRE(completed == num_strands * tasks_per_strand);
+  REQUIRE(ran_on.size() > 1);
+
+  // Whichever thread wrote them, each strand's messages are read in order,
+  // from the pinned ringbuffer
+  std::vector<std::vector<size_t>> received(num_strands);
+  for (size_t i = 0; i <= workers; ++i)
+  {
+    circuits[i]->read_from_inside().read(
+      -1, [&](ringbuffer::Message, const uint8_t* data, size_t size) {
+        REQUIRE(i == 1);
+        const auto index = serialized::read<size_t>(data, size);
+        received[index / tasks_per_strand].push_back(index % tasks_per_strand);
+      });
+  }
+
+  for (const auto& order : received)
+  {
+    std::vector<size_t> expected(tasks_per_strand);
+    std::iota(expected.begin(), expected.end(), 0);
+    REQUIRE(order == expected);
+  }
+
+  threading::ThreadMessaging::thread_count = thread_count;
+}
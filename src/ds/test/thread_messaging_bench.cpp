@@ -0,0 +1,607 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#define PICOBENCH_DONT_BIND_TO_ONE_CORE
+#include "../thread_messaging.h"
+
+#include <picobench/picobench.hpp>
+#include <map>
+#include <pthread.h>
+#include <random>
+#include <cstdlib>
+#include <thread>
+
+std::atomic<uint16_t> threading::ThreadMessaging::thread_count = 2;
+
+static constexpr uint16_t worker_tid = 1;
+
+enum class Idle
+{
+  Spin,
+  Park
+};
+
+struct Done
+{
+  std::atomic<bool>* done;
+};
+
+static void set_done(std::unique_ptr<threading::Tmsg<Done>> msg)
+{
+  msg->data.done->store(true);
+}
+
+// Runs a worker thread's tasks for the lifetime of this object
+struct Worker
+{
+  threading::ThreadMessaging tm;
+  std::atomic<bool> stop = false;
+  std::thread thread;
+
+  Worker(Idle idle, std::optional<int> cpu = std::nullopt) : tm(2)
+  {
+    thread = std::thread([this, idle]() {
+      threading::thread_id = worker_tid;
+      if (idle == Idle::Park)
+      {
+        tm.run();
+      }
+      else
+      {
+        // Busy-spins while idle, as run() did before idle threads parked
+        while (!stop.load())
+        {
+          tm.run_one();
+        }
+      }
+    });
+
+    if (cpu.has_value())
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu.value(), &set);
+      pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+    }
+  }
+
+  ~Worker()
+  {
+    stop.store(true);
+    tm.set_finished();
+    thread.join();
+  }
+
+  void run_task()
+  {
+    std::atomic<bool> done = false;
+    auto msg = std::make_unique<threading::Tmsg<Done>>(&set_done);
+    msg->data.done = &done;
+    tm.add_task(worker_tid, std::move(msg));
+
+    while (!done.load())
+    {
+      std::this_thread::yield();
+    }
+  }
+};
+
+// Each iteration waits for Gap, then posts a task to the worker and waits for
+// it to run. The larger the gap, the more likely the worker is to have parked,
+// and the difference with the spinning baseline is the time taken to wake it.
+template <Idle I, size_t GapUs>
+static void enqueue_to_execute(picobench::state& s)
+{
+  Worker worker(I);
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    if constexpr (GapUs != 0)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(GapUs));
+    }
+    worker.run_task();
+  }
+  s.stop_timer();
+}
+
+const std::vector<int> task_counts = {200};
+
+PICOBENCH_SUITE("enqueue to execute, back to back");
+auto spin_0 = enqueue_to_execute<Idle::Spin, 0>;
+PICOBENCH(spin_0).iterations(task_counts).samples(5).baseline();
+auto park_0 = enqueue_to_execute<Idle::Park, 0>;
+PICOBENCH(park_0).iterations(task_counts).samples(5);
+
+PICOBENCH_SUITE("enqueue to execute, every 100us");
+auto spin_100 = enqueue_to_execute<Idle::Spin, 100>;
+PICOBENCH(spin_100).iterations(task_counts).samples(5).baseline();
+auto park_100 = enqueue_to_execute<Idle::Park, 100>;
+PICOBENCH(park_100).iterations(task_counts).samples(5);
+
+PICOBENCH_SUITE("enqueue to execute, every 1ms");
+auto spin_1000 = enqueue_to_execute<Idle::Spin, 1000>;
+PICOBENCH(spin_1000).iterations(task_counts).samples(5).baseline();
+auto park_1000 = enqueue_to_execute<Idle::Park, 1000>;
+PICOBENCH(park_1000).iterations(task_counts).samples(5);
+
+PICOBENCH_SUITE("enqueue to execute, every 10ms");
+auto spin_10000 = enqueue_to_execute<Idle::Spin, 10000>;
+PICOBENCH(spin_10000).iterations({50}).samples(3).baseline();
+auto park_10000 = enqueue_to_execute<Idle::Park, 10000>;
+PICOBENCH(park_10000).iterations({50}).samples(3);
+
+// Measures the cost of an idle worker to other work on the same core: each
+// iteration is a fixed amount of computation on a thread sharing a core with
+// the idle worker.
+template <Idle I>
+static void colocated_work(picobench::state& s)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(0, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+  {
+    Worker worker(I, 0);
+
+    // Let the worker go idle
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // Each sample runs for long enough for the scheduler to share the core
+    // fairly between the two threads
+    volatile uint64_t acc = 0;
+    s.start_timer();
+    for (size_t i = 0; i < s.iterations(); ++i)
+    {
+      for (size_t j = 0; j < 1'000'000; ++j)
+      {
+        acc = acc + j * i;
+      }
+    }
+    s.stop_timer();
+  }
+
+  CPU_ZERO(&set);
+  for (size_t i = 0; i < std::thread::hardware_concurrency(); ++i)
+  {
+    CPU_SET(i, &set);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+PICOBENCH_SUITE("work next to an idle worker");
+auto spinning_worker = colocated_work<Idle::Spin>;
+PICOBENCH(spinning_worker).iterations({100}).samples(3).baseline();
+auto parked_worker = colocated_work<Idle::Park>;
+PICOBENCH(parked_worker).iterations({100}).samples(3);
+
+enum class Scheduling
+{
+  Pinned,
+  Stealing
+};
+
+struct Request
+{
+  std::chrono::steady_clock::time_point queued;
+  std::chrono::microseconds* latency;
+  std::atomic<size_t>* completed;
+};
+
+static constexpr auto request_work = std::chrono::microseconds(20);
+
+static void handle_request(std::unique_ptr<threading::Tmsg<Request>> msg)
+{
+  const auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < request_work)
+  {
+    CCF_PAUSE();
+  }
+
+  *msg->data.latency = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - msg->data.queued);
+  ++*msg->data.completed;
+}
+
+// Sessions are assigned to workers by session ID, as TLSEndpoint does. With a
+// skewed client distribution, most requests come from a few hot sessions
+// which happen to share a worker. Pinned sessions only run on their worker,
+// while strands are stolen by idle workers. Each iteration is one request, and
+// the latency percentiles of all requests are printed after each run.
+template <Scheduling S, uint16_t Workers>
+static void skewed_sessions(picobench::state& s)
+{
+  constexpr size_t num_sessions = 32;
+  constexpr size_t hot_sessions = 2;
+
+  threading::ThreadMessaging::thread_count = Workers + 1;
+  threading::ThreadMessaging tm(Workers + 1);
+  std::vector<std::thread> workers;
+  for (uint16_t i = 1; i <= Workers; ++i)
+  {
+    workers.emplace_back([&tm, i]() {
+      threading::thread_id = i;
+      tm.run();
+    });
+  }
+
+  std::vector<std::shared_ptr<threading::Strand>> strands;
+  for (size_t i = 0; i < num_sessions; ++i)
+  {
+    strands.push_back(std::make_shared<threading::Strand>(
+      (i % Workers) + 1));
+  }
+
+  // 90% of requests are from the hot sessions, which all map to the first
+  // worker
+  std::vector<size_t> sessions(s.iterations());
+  for (auto& session : sessions)
+  {
+    session = (rand() % 10 != 0) ? (rand() % hot_sessions) * Workers :
+                                   rand() % num_sessions;
+  }
+
+  std::vector<std::chrono::microseconds> latencies(s.iterations());
+  std::atomic<size_t> completed = 0;
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    auto msg = std::make_unique<threading::Tmsg<Request>>(&handle_request);
+    msg->data = {std::chrono::steady_clock::now(), &latencies[i], &completed};
+
+    auto& strand = strands[sessions[i]];
+    if constexpr (S == Scheduling::Pinned)
+    {
+      tm.add_task(strand->get_affinity(), std::move(msg));
+    }
+    else
+    {
+      tm.add_task(strand, std::move(msg));
+    }
+  }
+  while (completed.load() != s.iterations())
+  {
+    std::this_thread::yield();
+  }
+  s.stop_timer();
+
+  tm.set_finished();
+  for (auto& w : workers)
+  {
+    w.join();
+  }
+  threading::ThreadMessaging::thread_count = 2;
+
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << fmt::format(
+                 "{} sessions on {} workers, {} requests: p50 {}us, p99 {}us",
+                 S == Scheduling::Pinned ? "Pinned" : "Stealing",
+                 Workers,
+                 s.iterations(),
+                 latencies[latencies.size() / 2].count(),
+                 latencies[latencies.size() * 99 / 100].count())
+            << std::endl;
+}
+
+const std::vector<int> request_counts = {10000};
+
+PICOBENCH_SUITE("skewed sessions on 4 workers");
+auto pinned_4 = skewed_sessions<Scheduling::Pinned, 4>;
+PICOBENCH(pinned_4).iterations(request_counts).samples(3).baseline();
+auto stealing_4 = skewed_sessions<Scheduling::Stealing, 4>;
+PICOBENCH(stealing_4).iterations(request_counts).samples(3);
+
+PICOBENCH_SUITE("skewed sessions on 8 workers");
+auto pinned_8 = skewed_sessions<Scheduling::Pinned, 8>;
+PICOBENCH(pinned_8).iterations(request_counts).samples(3).baseline();
+auto stealing_8 = skewed_sessions<Scheduling::Stealing, 8>;
+PICOBENCH(stealing_8).iterations(request_counts).samples(3);
+
+// The ordered map of timers which Task used before the timing wheel, with the
+// same interface
+class OrderedTimers
+{
+  using TimerEntry = threading::Task::TimerEntry;
+
+  struct TimerEntryCompare
+  {
+    bool operator()(const TimerEntry& lhs, const TimerEntry& rhs) const
+    {
+      if (lhs.time_offset != rhs.time_offset)
+      {
+        return lhs.time_offset < rhs.time_offset;
+      }
+
+      return lhs.counter < rhs.counter;
+    }
+  };
+
+  std::chrono::milliseconds time_offset = std::chrono::milliseconds(0);
+  uint64_t time_entry_counter = 0;
+  std::map<
+    TimerEntry,
+    std::unique_ptr<threading::ThreadMsg>,
+    TimerEntryCompare>
+    timer_map;
+
+public:
+  TimerEntry add_task_after(
+    std::unique_ptr<threading::ThreadMsg> item, std::chrono::milliseconds ms)
+  {
+    TimerEntry entry = {time_offset + ms, time_entry_counter++};
+    timer_map.emplace(entry, std::move(item));
+    return entry;
+  }
+
+  bool cancel_timer_task(TimerEntry timer_entry)
+  {
+    return timer_map.erase(timer_entry) != 0;
+  }
+
+  void tick(std::chrono::milliseconds elapsed)
+  {
+    time_offset += elapsed;
+    while (!timer_map.empty() &&
+           timer_map.begin()->first.time_offset <= time_offset)
+    {
+      auto it = timer_map.begin();
+      auto msg = std::move(it->second);
+      timer_map.erase(it);
+      auto cb = msg->cb;
+      cb(std::move(msg));
+    }
+  }
+};
+
+enum class Timers
+{
+  Ordered,
+  Wheel
+};
+
+template <Timers T>
+using TimersImpl = std::conditional_t<
+  T == Timers::Ordered,
+  OrderedTimers,
+  threading::Task>;
+
+static constexpr size_t outstanding_timers = 100'000;
+
+static void count_timer(std::unique_ptr<threading::Tmsg<size_t*>> msg)
+{
+  ++*msg->data;
+}
+
+template <typename Impl>
+static threading::Task::TimerEntry add_timer(
+  Impl& impl, size_t* fired, std::chrono::milliseconds ms)
+{
+  auto msg = std::make_unique<threading::Tmsg<size_t*>>(&count_timer);
+  msg->data = fired;
+  return impl.add_task_after(std::move(msg), ms);
+}
+
+// Timeouts which are almost always cancelled before they expire, such as
+// request or election timeouts. Each iteration cancels one of the outstanding
+// timers and adds another.
+template <Timers T>
+static void timer_churn(picobench::state& s)
+{
+  TimersImpl<T> impl;
+  size_t fired = 0;
+  std::mt19937 rng(42);
+  auto delay = [&rng]() { return std::chrono::milliseconds(rng() % 10'000); };
+
+  std::vector<threading::Task::TimerEntry> entries;
+  for (size_t i = 0; i < outstanding_timers; ++i)
+  {
+    entries.push_back(add_timer(impl, &fired, delay()));
+  }
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    auto& entry = entries[rng() % entries.size()];
+    impl.cancel_timer_task(entry);
+    entry = add_timer(impl, &fired, delay());
+  }
+  s.stop_timer();
+}
+
+// Each iteration advances time by 1ms, expiring the timers due then, and
+// replaces each with a new one so that the number outstanding stays constant
+template <Timers T>
+static void timer_expiry(picobench::state& s)
+{
+  TimersImpl<T> impl;
+  size_t fired = 0;
+  std::mt19937 rng(42);
+  auto delay = [&rng]() { return std::chrono::milliseconds(rng() % 10'000); };
+
+  for (size_t i = 0; i < outstanding_timers; ++i)
+  {
+    add_timer(impl, &fired, delay());
+  }
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    const auto before = fired;
+    impl.tick(std::chrono::milliseconds(1));
+    for (size_t j = before; j < fired; ++j)
+    {
+      add_timer(impl, &fired, delay());
+    }
+  }
+  s.stop_timer();
+}
+
+const std::vector<int> timer_op_counts = {100'000};
+
+PICOBENCH_SUITE("timers, add and cancel with 100k outstanding");
+auto ordered_churn = timer_churn<Timers::Ordered>;
+PICOBENCH(ordered_churn).iterations(timer_op_counts).samples(5).baseline();
+auto wheel_churn = timer_churn<Timers::Wheel>;
+PICOBENCH(wheel_churn).iterations(timer_op_counts).samples(5);
+
+PICOBENCH_SUITE("timers, expiry with 100k outstanding");
+auto ordered_expiry = timer_expiry<Timers::Ordered>;
+PICOBENCH(ordered_expiry).iterations({10'000}).samples(5).baseline();
+auto wheel_expiry = timer_expiry<Timers::Wheel>;
+PICOBENCH(wheel_expiry).iterations({10'000}).samples(5);
+
+static std::atomic<size_t> heap_allocations = 0;
+
+void* operator new(size_t size)
+{
+  ++heap_allocations;
+  if (auto p = std::malloc(size))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+// A message which bypasses the message pool, as all messages did before
+template <typename Payload>
+struct UnpooledTmsg : public threading::Tmsg<Payload>
+{
+  using threading::Tmsg<Payload>::Tmsg;
+
+  static void* operator new(size_t size)
+  {
+    return ::operator new(size);
+  }
+
+  static void operator delete(void* p)
+  {
+    ::operator delete(p);
+  }
+};
+
+enum class Allocation
+{
+  Unpooled,
+  Pooled
+};
+
+struct Hop
+{
+  threading::ThreadMessaging* tm;
+  size_t remaining;
+  std::atomic<size_t>* completed;
+};
+
+static constexpr size_t hops_per_request = 4;
+
+// Each hop of a request is a new message to the other worker, as a request
+// passes from the session's thread to the consensus thread and back
+template <Allocation A>
+static void hop(std::unique_ptr<threading::Tmsg<Hop>> msg)
+{
+  auto& data = msg->data;
+  if (data.remaining == 0)
+  {
+    ++*data.completed;
+    return;
+  }
+
+  const uint16_t next = threading::get_current_thread_id() == 1 ? 2 : 1;
+  std::unique_ptr<threading::Tmsg<Hop>> next_msg;
+  if constexpr (A == Allocation::Pooled)
+  {
+    next_msg = std::make_unique<threading::Tmsg<Hop>>(&hop<A>);
+  }
+  else
+  {
+    next_msg = std::make_unique<UnpooledTmsg<Hop>>(&hop<A>);
+  }
+  next_msg->data = {data.tm, data.remaining - 1, data.completed};
+  data.tm->add_task(next, std::move(next_msg));
+}
+
+// Each iteration is one request, posted by this thread and passed back and
+// forth between two workers. Requests are posted in windows, so that messages
+// are freed while others are being allocated.
+template <Allocation A>
+static void message_hops(picobench::state& s)
+{
+  constexpr size_t window = 64;
+
+  threading::ThreadMessaging::thread_count = 3;
+  threading::ThreadMessaging tm(3);
+  std::vector<std::thread> workers;
+  for (uint16_t i = 1; i <= 2; ++i)
+  {
+    workers.emplace_back([&tm, i]() {
+      threading::thread_id = i;
+      tm.run();
+    });
+  }
+
+  std::atomic<size_t> completed = 0;
+  const auto allocations_before = heap_allocations.load();
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    while (i - completed.load() >= window)
+    {
+      std::this_thread::yield();
+    }
+
+    std::unique_ptr<threading::Tmsg<Hop>> msg;
+    if constexpr (A == Allocation::Pooled)
+    {
+      msg = std::make_unique<threading::Tmsg<Hop>>(&hop<A>);
+    }
+    else
+    {
+      msg = std::make_unique<UnpooledTmsg<Hop>>(&hop<A>);
+    }
+    msg->data = {&tm, hops_per_request - 1, &completed};
+    tm.add_task(1, std::move(msg));
+  }
+  while (completed.load() != s.iterations())
+  {
+    std::this_thread::yield();
+  }
+  s.stop_timer();
+
+  const auto allocations = heap_allocations.load() - allocations_before;
+
+  tm.set_finished();
+  for (auto& w : workers)
+  {
+    w.join();
+  }
+  threading::ThreadMessaging::thread_count = 2;
+
+  std::cout << fmt::format(
+                 "{}: {} requests of {} messages, {:.3f} allocations per "
+                 "request",
+                 A == Allocation::Pooled ? "Pooled" : "Unpooled",
+                 s.iterations(),
+                 hops_per_request,
+                 (double)allocations / s.iterations())
+            << std::endl;
+}
+
+PICOBENCH_SUITE("message hops between threads");
+auto unpooled_hops = message_hops<Allocation::Unpooled>;
+PICOBENCH(unpooled_hops).iterations({100'000}).samples(5).baseline();
+auto pooled_hops = message_hops<Allocation::Pooled>;
+PICOBENCH(pooled_hops).iterations({100'000}).samples(5);
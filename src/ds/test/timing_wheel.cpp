@@ -0,0 +1,143 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "../timing_wheel.h"
+
+#include <doctest/doctest.h>
+#include <map>
+#include <random>
+#include <vector>
+
+using Wheel = threading::TimingWheel<uint64_t>;
+
+TEST_CASE("Values are released in order of expiry")
+{
+  Wheel wheel;
+  std::mt19937_64 rng(42);
+
+  // Reference: values by expiry, then by order of insertion
+  std::multimap<uint64_t, uint64_t> expected;
+
+  // Expiries across the spans of all levels, including the overflow list
+  const std::vector<uint64_t> spans = {
+    1ul << 4, 1ul << 12, 1ul << 20, 1ul << 28, 1ul << 34};
+
+  uint64_t id = 0;
+  for (auto span : spans)
+  {
+    for (size_t i = 0; i < 200; ++i)
+    {
+      const auto expiry = rng() % span;
+      wheel.add(id, expiry, uint64_t(id));
+      expected.emplace(expiry, id);
+      ++id;
+    }
+  }
+  REQUIRE(wheel.size() == expected.size());
+
+  // Cancel a few values
+  size_t cancelled = 0;
+  for (auto it = expected.begin(); it != expected.end();)
+  {
+    if (rng() % 10 == 0)
+    {
+      REQUIRE(wheel.cancel(it->second, it->first));
+      REQUIRE_FALSE(wheel.cancel(it->second, it->first));
+      it = expected.erase(it);
+      ++cancelled;
+    }
+    else
+    {
+      ++it;
+    }
+  }
+  REQUIRE(cancelled > 0);
+  REQUIRE(wheel.size() == expected.size());
+
+  // Advance to each expiry, or straight past it, in turn
+  std::vector<uint64_t> released;
+  const auto record = [&released](uint64_t v) { released.push_back(v); };
+
+  auto it = expected.begin();
+  while (it != expected.end())
+  {
+    const auto to = it->first + rng() % 3;
+    released.clear();
+    wheel.advance(to, record);
+    REQUIRE(wheel.get_now() == to);
+
+    for (auto v : released)
+    {
+      REQUIRE(it != expected.end());
+      REQUIRE(it->first <= to);
+      REQUIRE(v == it->second);
+      ++it;
+    }
+    REQUIRE((it == expected.end() || it->first > to));
+  }
+  REQUIRE(wheel.size() == 0);
+}
+
+TEST_CASE("Values with the same expiry are released in order of insertion")
+{
+  Wheel wheel;
+  wheel.advance(1000, [](uint64_t) {});
+
+  // Added at different times, so that they reach the first level at
+  // different times
+  wheel.add(0, 100'000, 0);
+  wheel.advance(50'000, [](uint64_t) {});
+  wheel.add(1, 100'000, 1);
+  wheel.advance(99'990, [](uint64_t) {});
+  wheel.add(2, 100'000, 2);
+
+  std::vector<uint64_t> released;
+  wheel.advance(100'000, [&released](uint64_t v) { released.push_back(v); });
+  REQUIRE(released == std::vector<uint64_t>{0, 1, 2});
+}
+
+TEST_CASE("Values can be added and cancelled while releasing")
+{
+  Wheel wheel;
+  wheel.add(0, 10, 0);
+  wheel.add(1, 10, 1);
+  wheel.add(2, 20, 2);
+
+  std::vector<uint64_t> released;
+  wheel.advance(15, [&](uint64_t v) {
+    released.push_back(v);
+    if (v == 0)
+    {
+      // Cancels a value due at the same time, and one due later
+      REQUIRE(wheel.cancel(1, 10));
+      REQUIRE(wheel.cancel(2, 20));
+
+      // Already due, so released on the next advance
+      wheel.add(3, 5, 3);
+      wheel.add(4, 12, 4);
+    }
+  });
+  REQUIRE(released == std::vector<uint64_t>{0, 4});
+
+  released.clear();
+  wheel.advance(15, [&](uint64_t v) { released.push_back(v); });
+  REQUIRE(released == std::vector<uint64_t>{3});
+  REQUIRE(wheel.size() == 0);
+}
+
+TEST_CASE("Invalid use")
+{
+  Wheel wheel;
+  wheel.add(0, 10, 0);
+  REQUIRE_THROWS_AS(wheel.add(0, 20, 0), std::logic_error);
+
+  REQUIRE_FALSE(wheel.cancel(0, 20));
+  REQUIRE_FALSE(wheel.cancel(1, 10));
+
+  wheel.clear();
+  REQUIRE(wheel.size() == 0);
+  REQUIRE_FALSE(wheel.cancel(0, 10));
+
+  size_t count = 0;
+  wheel.advance(100, [&count](uint64_t) { ++count; });
+  REQUIRE(count == 0);
+}
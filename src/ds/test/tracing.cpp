@@ -0,0 +1,130 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "../tracing.h"
+
+#include <doctest/doctest.h>
+#include <set>
+
+using namespace tracing;
+
+static uint64_t fake_time = 0;
+
+static uint64_t fake_clock()
+{
+  return fake_time;
+}
+
+struct TracingFixture
+{
+  TracingFixture()
+  {
+    Tracer::set_clock(&fake_clock);
+    Tracer::set_sampling_interval(1);
+    Tracer::take_spans();
+  }
+
+  ~TracingFixture()
+  {
+    Tracer::set_sampling_interval(0);
+    Tracer::global_commit(UINT64_MAX);
+    Tracer::take_spans();
+  }
+};
+
+TEST_CASE_FIXTURE(TracingFixture, "Sampling")
+{
+  Tracer::set_sampling_interval(0);
+  REQUIRE(Tracer::start_trace() == 0);
+
+  Tracer::set_sampling_interval(3);
+  size_t sampled = 0;
+  std::set<TraceId> ids;
+  for (size_t i = 0; i < 30; ++i)
+  {
+    const auto id = Tracer::start_trace();
+    if (id != 0)
+    {
+      ++sampled;
+      ids.insert(id);
+    }
+  }
+  REQUIRE(sampled == 10);
+  REQUIRE(ids.size() == 10);
+}
+
+TEST_CASE_FIXTURE(TracingFixture, "Spans are recorded for the current trace")
+{
+  {
+    // Not traced
+    SpanTimer span(SpanKind::Execute);
+  }
+  REQUIRE(Tracer::take_spans().empty());
+
+  const auto id = Tracer::start_trace();
+  REQUIRE(id != 0);
+  {
+    TraceScope scope(id);
+    REQUIRE(Tracer::current_trace() == id);
+
+    fake_time = 100;
+    SpanTimer execute(SpanKind::Execute);
+    {
+      fake_time = 110;
+      SpanTimer commit(SpanKind::Commit);
+      fake_time = 120;
+    }
+    fake_time = 130;
+  }
+  REQUIRE(Tracer::current_trace() == 0);
+
+  const auto spans = Tracer::take_spans();
+  REQUIRE(spans.size() == 2);
+  REQUIRE(spans[0].trace_id == id);
+  REQUIRE(spans[0].kind == SpanKind::Commit);
+  REQUIRE(spans[0].start_ns == 110);
+  REQUIRE(spans[0].end_ns == 120);
+  REQUIRE(spans[1].kind == SpanKind::Execute);
+  REQUIRE(spans[1].start_ns == 100);
+  REQUIRE(spans[1].end_ns == 130);
+}
+
+TEST_CASE_FIXTURE(TracingFixture, "Global commit")
+{
+  const auto a = Tracer::start_trace();
+  const auto b = Tracer::start_trace();
+  const auto c = Tracer::start_trace();
+
+  fake_time = 1000;
+  {
+    TraceScope scope(a);
+    Tracer::await_global_commit(5);
+  }
+  {
+    TraceScope scope(b);
+    Tracer::await_global_commit(6);
+  }
+  {
+    TraceScope scope(c);
+    Tracer::await_global_commit(7);
+  }
+
+  // Not traced
+  Tracer::await_global_commit(8);
+
+  fake_time = 2000;
+  Tracer::global_commit(5);
+  auto spans = Tracer::take_spans();
+  REQUIRE(spans.size() == 1);
+  REQUIRE(spans[0].trace_id == a);
+  REQUIRE(spans[0].kind == SpanKind::GlobalCommit);
+  REQUIRE(spans[0].start_ns == 1000);
+  REQUIRE(spans[0].end_ns == 2000);
+
+  // c's transaction is rolled back, and its version reused
+  Tracer::rollback(6);
+  fake_time = 3000;
+  Tracer::global_commit(10);
+  spans = Tracer::take_spans();
+  REQUIRE(spans.size() == 1);
+  REQUIRE(spans[0].trace_id == b);
+}
@@ -3,12 +3,23 @@
 #pragma once
 
 #include "ds/ccf_assert.h"
+#include "ds/doorbell.h"
 #include "ds/logger.h"
+#include "ds/message_pool.h"
+#include "ds/spin_lock.h"
 #include "ds/thread_ids.h"
+#include "ds/timing_wheel.h"
+#include "ds/tracing.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace threading
 {
@@ -17,9 +28,28 @@ namespace threading
     void (*cb)(std::unique_ptr<ThreadMsg>);
     std::atomic<ThreadMsg*> next = nullptr;
 
+    // The trace of the work which sent this message, which becomes the
+    // current trace while it runs
+    tracing::TraceId trace_id = tracing::Tracer::current_trace();
+    uint64_t sent_ns = trace_id == 0 ? 0 : tracing::Tracer::now();
+
     ThreadMsg(void (*_cb)(std::unique_ptr<ThreadMsg>)) : cb(_cb) {}
 
     virtual ~ThreadMsg() = default;
+
+    static void run(ThreadMsg* msg)
+    {
+      if (msg->trace_id == 0)
+      {
+        msg->cb(std::unique_ptr<ThreadMsg>(msg));
+        return;
+      }
+
+      tracing::TraceScope scope(msg->trace_id);
+      tracing::Tracer::record(
+        tracing::SpanKind::Queued, msg->sent_ns, tracing::Tracer::now());
+      msg->cb(std::unique_ptr<ThreadMsg>(msg));
+    }
   };
 
   template <typename Payload>
@@ -34,15 +64,57 @@ namespace threading
     {}
 
     virtual ~Tmsg() = default;
+
+    // Messages are usually freed by a different thread from the one which
+    // allocated them, so their storage is recycled through a pool rather than
+    // returned to the allocator. Types derived from Tmsg are not pooled.
+    static void* operator new(size_t size)
+    {
+      if (size != sizeof(Tmsg))
+      {
+        return ::operator new(size);
+      }
+      return MessagePool<Tmsg>::allocate();
+    }
+
+    static void operator delete(void* p, size_t size)
+    {
+      if (size != sizeof(Tmsg))
+      {
+        ::operator delete(p);
+        return;
+      }
+      MessagePool<Tmsg>::deallocate(p);
+    }
   };
 
   class ThreadMessaging;
+  class Strand;
 
   class Task
   {
     std::atomic<ThreadMsg*> item_head = nullptr;
     ThreadMsg* local_msg = nullptr;
 
+    // The number of queued messages is the difference between these. Only the
+    // task's own thread counts the messages it has run, so that does not need
+    // to be an atomic increment.
+    std::atomic<size_t> added = 0;
+    std::atomic<size_t> completed = 0;
+
+    // Set while the task's thread is parked. The next call to add_task clears
+    // it and wakes the thread up. This is the task's own word, unless another
+    // is given to ThreadMessaging::set_park_word().
+    std::atomic<uint32_t> own_park_word = 0;
+    std::atomic<uint32_t>* park_word = &own_park_word;
+
+    // Tasks which may be run by another thread, if this one is busy. The
+    // owning thread runs the oldest first, while idle threads steal the newest,
+    // which would otherwise wait the longest.
+    std::deque<ThreadMsg*> stealable;
+    SpinLock stealable_lock;
+    std::atomic<size_t> stealable_size = 0;
+
   public:
     Task() = default;
 
@@ -61,19 +133,57 @@ namespace threading
 
       ThreadMsg* current = local_msg;
       local_msg = local_msg->next;
+      completed.store(
+        completed.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
 
-      current->cb(std::unique_ptr<ThreadMsg>(current));
+      ThreadMsg::run(current);
       return true;
     }
 
-    void add_task(ThreadMsg* item)
+    size_t get_queue_depth() const
     {
+      const auto c = completed.load(std::memory_order_relaxed);
+      const auto a = added.load(std::memory_order_relaxed);
+      return (a > c ? a - c : 0) +
+        stealable_size.load(std::memory_order_relaxed);
+    }
+
+    /// Returns true if the task's thread was parked, and should be woken up
+    bool add_task(ThreadMsg* item)
+    {
+      added.fetch_add(1, std::memory_order_relaxed);
+
       ThreadMsg* tmp_head;
       do
       {
         tmp_head = item_head.load();
         item->next = tmp_head;
       } while (!item_head.compare_exchange_strong(tmp_head, item));
+
+      // Either this sees the mark set by a parking thread, or that thread sees
+      // the new item (see prepare_park())
+      return park_word->load() != 0 && park_word->exchange(0) != 0;
+    }
+
+    /// Marks the task's thread as parked, unless there is something to run.
+    /// Returns true if the thread can block on the park word.
+    bool prepare_park()
+    {
+      park_word->store(1);
+      if (
+        local_msg != nullptr || item_head.load() != nullptr ||
+        stealable_size.load() != 0)
+      {
+        park_word->store(0);
+        return false;
+      }
+      return true;
+    }
+
+    void end_park()
+    {
+      park_word->store(0, std::memory_order_relaxed);
     }
 
     struct TimerEntry
@@ -88,65 +198,28 @@ namespace threading
       uint64_t counter;
     };
 
-    struct TimerEntryCompare
-    {
-      bool operator()(const TimerEntry& lhs, const TimerEntry& rhs) const
-      {
-        if (lhs.time_offset != rhs.time_offset)
-        {
-          return lhs.time_offset < rhs.time_offset;
-        }
-
-        return lhs.counter < rhs.counter;
-      }
-    };
-
     TimerEntry add_task_after(
       std::unique_ptr<ThreadMsg> item, std::chrono::milliseconds ms)
     {
       TimerEntry entry = {time_offset + ms, time_entry_counter++};
-      if (timer_map.empty() || entry.time_offset <= next_time_offset)
-      {
-        next_time_offset = entry.time_offset;
-      }
-
-      timer_map.emplace(entry, std::move(item));
+      timers.add(entry.counter, entry.time_offset.count(), std::move(item));
       return entry;
     }
 
     bool cancel_timer_task(TimerEntry timer_entry)
     {
-      auto num_erased = timer_map.erase(timer_entry);
-      CCF_ASSERT(num_erased <= 1, "Too many items erased");
-      if (!timer_map.empty() && timer_entry.time_offset <= next_time_offset)
-      {
-        next_time_offset = timer_map.begin()->first.time_offset;
-      }
-      return num_erased != 0;
+      return timers.cancel(
+        timer_entry.counter, timer_entry.time_offset.count());
     }
 
     void tick(std::chrono::milliseconds elapsed)
     {
       time_offset += elapsed;
 
-      bool updated = false;
-
-      while (!timer_map.empty() && next_time_offset <= time_offset &&
-             timer_map.begin()->first.time_offset <= time_offset)
-      {
-        updated = true;
-        auto it = timer_map.begin();
-
-        auto& cb = it->second->cb;
-        auto msg = std::move(it->second);
-        timer_map.erase(it);
+      timers.advance(time_offset.count(), [](std::unique_ptr<ThreadMsg> msg) {
+        auto cb = msg->cb;
         cb(std::move(msg));
-      }
-
-      if (updated)
-      {
-        next_time_offset = timer_map.begin()->first.time_offset;
-      }
+      });
     }
 
     std::chrono::milliseconds get_current_time_offset()
@@ -157,9 +230,7 @@ namespace threading
   private:
     std::chrono::milliseconds time_offset = std::chrono::milliseconds(0);
     uint64_t time_entry_counter = 0;
-    std::map<TimerEntry, std::unique_ptr<ThreadMsg>, TimerEntryCompare>
-      timer_map;
-    std::chrono::milliseconds next_time_offset;
+    TimingWheel<std::unique_ptr<ThreadMsg>> timers;
 
     void reverse_local_messages()
     {
@@ -198,6 +269,51 @@ namespace threading
         local_msg = local_msg->next;
         delete current;
       }
+
+      for (auto msg : stealable)
+      {
+        delete msg;
+      }
+      stealable.clear();
+      stealable_size.store(0);
+    }
+
+    friend ThreadMessaging;
+    friend Strand;
+  };
+
+  /// Runs the tasks added to it one at a time, in the order in which they were
+  /// added. The strand is queued on its affinity thread when it has tasks to
+  /// run, but may be stolen by an idle worker thread, which then runs a batch
+  /// of its tasks. This is used to run the tasks of a session, which must not
+  /// run concurrently, on whichever thread is free.
+  class Strand
+  {
+    const uint16_t affinity;
+    Task tasks;
+
+    // Set while the strand is queued, or running on some thread
+    std::atomic<bool> scheduled = false;
+
+    static inline thread_local const Strand* current = nullptr;
+
+  public:
+    Strand(uint16_t affinity_) : affinity(affinity_) {}
+
+    ~Strand()
+    {
+      tasks.drop();
+    }
+
+    uint16_t get_affinity() const
+    {
+      return affinity;
+    }
+
+    /// True if called from one of this strand's tasks
+    bool is_current() const
+    {
+      return current == this;
     }
 
     friend ThreadMessaging;
@@ -205,9 +321,37 @@ namespace threading
 
   class ThreadMessaging
   {
+  public:
+    using WaitFn = void (*)(std::atomic<uint32_t>*, std::chrono::microseconds);
+    using RingFn = void (*)(std::atomic<uint32_t>*);
+
+  private:
     std::atomic<bool> finished;
     std::vector<Task> tasks;
 
+    // How an idle thread blocks on its park word, and how it is woken up.
+    // Threads never park if these are not set, which is the case by default
+    // inside an SGX enclave, where blocking requires an ocall.
+#if !defined(INSIDE_ENCLAVE) || defined(VIRTUAL_ENCLAVE)
+    WaitFn wait_doorbell = &ringbuffer::doorbell::wait;
+    RingFn ring_doorbell = &ringbuffer::doorbell::ring;
+#else
+    WaitFn wait_doorbell = nullptr;
+    RingFn ring_doorbell = nullptr;
+#endif
+
+    // Once it has spun for as long as its idle policy allows, an idle thread
+    // yields this many times before parking
+    static constexpr size_t max_yields = 16;
+
+    // Bound on the time spent parked, in case a wakeup is missed (e.g. because
+    // the park word is in host memory)
+    static constexpr std::chrono::milliseconds max_park_time{50};
+
+    // Number of tasks a strand runs before it is queued again, behind the
+    // other tasks queued on its affinity thread
+    static constexpr size_t max_strand_batch = 16;
+
   public:
     static ThreadMessaging thread_messaging;
     static std::atomic<uint16_t> thread_count;
@@ -234,16 +378,87 @@ namespace threading
     void set_finished(bool v = true)
     {
       finished.store(v);
+
+      if (v)
+      {
+        for (auto& task : tasks)
+        {
+          wake(task);
+        }
+      }
     }
 
+    /// Sets how idle threads block, and are woken up
+    void set_doorbell(WaitFn wait, RingFn ring)
+    {
+      wait_doorbell = wait;
+      ring_doorbell = ring;
+    }
+
+    /// Sets the word which the thread running tid blocks on while it is
+    /// parked. This may be shared with another of the thread's doorbells, for
+    /// instance the main thread's inbound ringbuffer, so that the thread can
+    /// block on both.
+    void set_park_word(uint16_t tid, std::atomic<uint32_t>* word)
+    {
+      tasks[tid].park_word = word;
+    }
+
+    /// Runs tasks on the calling thread until finished. An idle thread spins
+    /// for a while, then yields its core, and finally parks until it is given
+    /// a task.
     void run()
     {
-      Task& task = get_task(get_current_thread_id());
+      const auto tid = get_current_thread_id();
+      Task& task = get_task(tid);
+      ringbuffer::doorbell::SpinThenBlock idle_policy;
 
       while (!is_finished())
       {
-        task.run_next_task();
+        if (run_next(task) || steal(tid))
+        {
+          idle_policy.busy();
+        }
+        else if (idle_policy.idle())
+        {
+          park(task);
+        }
+        else
+        {
+          CCF_PAUSE();
+        }
+      }
+    }
+
+    /// Marks the calling thread as parked, for a thread that blocks on its
+    /// park word itself rather than in run(). Returns false if the thread has
+    /// tasks to run, or messaging is finished.
+    bool prepare_park()
+    {
+      Task& task = get_task(get_current_thread_id());
+      if (!task.prepare_park())
+      {
+        return false;
+      }
+
+      if (is_finished())
+      {
+        task.end_park();
+        return false;
       }
+
+      return true;
+    }
+
+    // Number of messages queued for each thread
+    std::vector<size_t> get_queue_depths()
+    {
+      std::vector<size_t> depths;
+      for (uint16_t i = 0; i < std::max<uint16_t>(thread_count, 1); ++i)
+      {
+        depths.push_back(tasks[i].get_queue_depth());
+      }
+      return depths;
     }
 
     inline Task& get_task(uint16_t tid)
@@ -260,7 +475,7 @@ namespace threading
     bool run_one()
     {
       Task& task = get_task(get_current_thread_id());
-      return task.run_next_task();
+      return run_next(task);
     }
 
     template <typename Payload>
@@ -268,7 +483,38 @@ namespace threading
     {
       Task& task = get_task(tid);
 
-      task.add_task(reinterpret_cast<ThreadMsg*>(msg.release()));
+      if (task.add_task(reinterpret_cast<ThreadMsg*>(msg.release())))
+      {
+        ring(task);
+      }
+    }
+
+    /// Queues a task to run on tid, unless another worker thread is idle
+    /// first, in which case it may run there instead
+    template <typename Payload>
+    void add_stealable_task(uint16_t tid, std::unique_ptr<Tmsg<Payload>> msg)
+    {
+      add_stealable(get_task(tid), reinterpret_cast<ThreadMsg*>(msg.release()));
+    }
+
+    /// Queues a task to run on the strand, after the tasks previously added to
+    /// it
+    template <typename Payload>
+    void add_task(
+      const std::shared_ptr<Strand>& strand, std::unique_ptr<Tmsg<Payload>> msg)
+    {
+      strand->tasks.add_task(reinterpret_cast<ThreadMsg*>(msg.release()));
+
+      // Either this schedules the strand, or the thread running it sees the
+      // new task after descheduling it (see run_strand())
+      if (!strand->scheduled.exchange(true))
+      {
+        auto run = std::make_unique<Tmsg<RunStrand>>(&run_strand_cb, strand);
+        run->data.self = this;
+        // The strand's tasks each carry their own trace
+        run->trace_id = 0;
+        add_stealable(get_task(strand->affinity), run.release());
+      }
     }
 
     template <typename Payload>
@@ -313,7 +559,10 @@ namespace threading
       {
         auto& task = get_task(i);
         auto msg = std::make_unique<Tmsg<TickMsg>>(&tick_cb, elapsed, task);
-        task.add_task(msg.release());
+        if (task.add_task(msg.release()))
+        {
+          ring(task);
+        }
       }
     }
 
@@ -342,5 +591,222 @@ namespace threading
     {
       return finished.load();
     }
+
+    void ring(Task& task)
+    {
+      if (ring_doorbell != nullptr)
+      {
+        ring_doorbell(task.park_word);
+      }
+    }
+
+    void wake(Task& task)
+    {
+      if (task.park_word->exchange(0) != 0)
+      {
+        ring(task);
+      }
+    }
+
+    struct RunStrand
+    {
+      RunStrand(std::shared_ptr<Strand> strand_) : strand(std::move(strand_))
+      {}
+
+      std::shared_ptr<Strand> strand;
+      ThreadMessaging* self = nullptr;
+    };
+
+    static void run_strand_cb(std::unique_ptr<Tmsg<RunStrand>> msg)
+    {
+      msg->data.self->run_strand(std::move(msg));
+    }
+
+    void run_strand(std::unique_ptr<Tmsg<RunStrand>> msg)
+    {
+      auto& strand = *msg->data.strand;
+
+      Strand::current = &strand;
+      size_t ran = 0;
+      while (ran < max_strand_batch && strand.tasks.run_next_task())
+      {
+        ++ran;
+      }
+      Strand::current = nullptr;
+
+      // Only the thread running the strand touches its local messages
+      if (strand.tasks.local_msg == nullptr)
+      {
+        strand.scheduled.store(false);
+        if (
+          strand.tasks.item_head.load() == nullptr ||
+          strand.scheduled.exchange(true))
+        {
+          return;
+        }
+      }
+
+      // Tasks are left, so queue the strand again
+      add_stealable(get_task(strand.affinity), msg.release());
+    }
+
+    void add_stealable(Task& task, ThreadMsg* msg)
+    {
+      size_t queued;
+      {
+        std::lock_guard<SpinLock> guard(task.stealable_lock);
+        task.stealable.push_back(msg);
+        queued = task.stealable_size.fetch_add(1) + 1;
+      }
+
+      if (task.park_word->load() != 0 && task.park_word->exchange(0) != 0)
+      {
+        ring(task);
+      }
+      else if (queued > 1)
+      {
+        // The thread is busy, and tasks are building up: wake up a parked
+        // worker thread to steal some
+        wake_one_worker();
+      }
+    }
+
+    ThreadMsg* pop_stealable(Task& task, bool oldest)
+    {
+      if (task.stealable_size.load(std::memory_order_relaxed) == 0)
+      {
+        return nullptr;
+      }
+
+      std::lock_guard<SpinLock> guard(task.stealable_lock);
+      if (task.stealable.empty())
+      {
+        return nullptr;
+      }
+
+      ThreadMsg* msg;
+      if (oldest)
+      {
+        msg = task.stealable.front();
+        task.stealable.pop_front();
+      }
+      else
+      {
+        msg = task.stealable.back();
+        task.stealable.pop_back();
+      }
+      task.stealable_size.fetch_sub(1);
+      return msg;
+    }
+
+    static bool run_msg(ThreadMsg* msg)
+    {
+      if (msg == nullptr)
+      {
+        return false;
+      }
+
+      ThreadMsg::run(msg);
+      return true;
+    }
+
+    // Runs the thread's next task, preferring those which only it can run
+    bool run_next(Task& task)
+    {
+      return task.run_next_task() || run_msg(pop_stealable(task, true));
+    }
+
+    uint16_t num_workers() const
+    {
+      const auto count = std::min<size_t>(thread_count, tasks.size());
+      return count > 1 ? count - 1 : 0;
+    }
+
+    // Worker threads steal from each other, starting with the next one, but
+    // never from the main thread
+    bool steal(uint16_t tid)
+    {
+      const auto workers = num_workers();
+      if (tid == MAIN_THREAD_ID || workers < 2)
+      {
+        return false;
+      }
+
+      for (uint16_t i = 1; i < workers; ++i)
+      {
+        const uint16_t victim = 1 + (tid - 1 + i) % workers;
+        if (run_msg(pop_stealable(tasks[victim], false)))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool can_steal(uint16_t tid)
+    {
+      const auto workers = num_workers();
+      if (tid == MAIN_THREAD_ID)
+      {
+        return false;
+      }
+
+      for (uint16_t i = 1; i <= workers; ++i)
+      {
+        if (i != tid && tasks[i].stealable_size.load() != 0)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void wake_one_worker()
+    {
+      const auto workers = num_workers();
+      for (uint16_t i = 1; i <= workers; ++i)
+      {
+        auto& task = tasks[i];
+        if (task.park_word->load() != 0 && task.park_word->exchange(0) != 0)
+        {
+          ring(task);
+          return;
+        }
+      }
+    }
+
+    void park(Task& task)
+    {
+#if !defined(INSIDE_ENCLAVE) || defined(VIRTUAL_ENCLAVE)
+      // Inside an SGX enclave, yielding would exit the enclave as parking does,
+      // so threads park straight away
+      for (size_t i = 0; i < max_yields; ++i)
+      {
+        if (
+          task.get_queue_depth() != 0 || can_steal(get_current_thread_id()) ||
+          is_finished())
+        {
+          return;
+        }
+        std::this_thread::yield();
+      }
+#endif
+
+      if (wait_doorbell == nullptr)
+      {
+        return;
+      }
+
+      if (task.prepare_park())
+      {
+        // Either this sees a task queued for stealing, or the thread queueing
+        // it sees that this thread is parked
+        if (!is_finished() && !can_steal(get_current_thread_id()))
+        {
+          wait_doorbell(task.park_word, max_park_time);
+        }
+        task.end_park();
+      }
+    }
   };
 };
@@ -0,0 +1,302 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace threading
+{
+  /// Hierarchical timing wheel, holding values which expire at a given time
+  /// (in ticks, e.g. milliseconds). Adding and cancelling a value take
+  /// constant time, regardless of the number of outstanding values. Advancing
+  /// time skips over empty slots, so its cost depends on the number of values
+  /// released rather than on the number of ticks elapsed.
+  ///
+  /// Each level has slots_per_level slots, and each slot of a level spans all
+  /// the slots of the level below. A value is held by the lowest level whose
+  /// slots distinguish its expiry from the current time. As time advances
+  /// into a slot of a higher level, its values are moved down to the level
+  /// below, until they reach the first level, whose slots are single ticks.
+  /// Values expiring beyond the span of the highest level wait in an overflow
+  /// list until it wraps around.
+  ///
+  /// Values expiring at the same time are released in the order in which they
+  /// were added.
+  template <typename T>
+  class TimingWheel
+  {
+  private:
+    static constexpr size_t bits_per_level = 8;
+    static constexpr size_t slots_per_level = 1 << bits_per_level;
+    static constexpr size_t slot_mask = slots_per_level - 1;
+    static constexpr size_t num_levels = 4;
+
+    struct List;
+
+    struct Node
+    {
+      uint64_t id;
+      uint64_t expiry;
+      T value;
+
+      List* list = nullptr;
+      Node* prev = nullptr;
+      Node* next = nullptr;
+    };
+
+    struct List
+    {
+      Node* head = nullptr;
+      Node* tail = nullptr;
+
+      bool empty() const
+      {
+        return head == nullptr;
+      }
+
+      void push_back(Node* node)
+      {
+        node->list = this;
+        node->prev = tail;
+        node->next = nullptr;
+        if (tail != nullptr)
+        {
+          tail->next = node;
+        }
+        else
+        {
+          head = node;
+        }
+        tail = node;
+      }
+
+      void remove(Node* node)
+      {
+        if (node->prev != nullptr)
+        {
+          node->prev->next = node->next;
+        }
+        else
+        {
+          head = node->next;
+        }
+
+        if (node->next != nullptr)
+        {
+          node->next->prev = node->prev;
+        }
+        else
+        {
+          tail = node->prev;
+        }
+
+        node->list = nullptr;
+        node->prev = nullptr;
+        node->next = nullptr;
+      }
+    };
+
+    std::array<std::array<List, slots_per_level>, num_levels> levels;
+    List overflow;
+
+    // Values which expired when they were added, released on the next advance
+    List due;
+
+    // Values by ID. Nodes in an unordered_map are never moved.
+    std::unordered_map<uint64_t, Node> nodes;
+
+    // All values expiring at or before this time have been released
+    uint64_t now = 0;
+
+    static size_t level_shift(size_t level)
+    {
+      return level * bits_per_level;
+    }
+
+    // The list for a value expiring at or after now. A value expiring now
+    // is put in the current slot of the first level, which is only released
+    // after the values moved down from higher levels.
+    List& list_for(uint64_t expiry)
+    {
+      for (size_t level = 0; level < num_levels; ++level)
+      {
+        const auto above = level_shift(level + 1);
+        if ((expiry >> above) == (now >> above))
+        {
+          return levels[level][(expiry >> level_shift(level)) & slot_mask];
+        }
+      }
+
+      return overflow;
+    }
+
+    // Moves the values in a list to the lists they now belong to, in order
+    void redistribute(List& list)
+    {
+      // Values in the overflow list may go back to it
+      auto pending = std::exchange(list, {});
+      while (!pending.empty())
+      {
+        auto node = pending.head;
+        pending.remove(node);
+        list_for(node->expiry).push_back(node);
+      }
+    }
+
+    static uint64_t level_base(uint64_t t, size_t level)
+    {
+      const auto above = level_shift(level + 1);
+      return (t >> above) << above;
+    }
+
+    // Returns the next time after now at which a non-empty slot is reached.
+    // Values in a slot of the first level all expire when it is reached, and
+    // the values in a slot of a higher level are moved down when it is
+    // reached.
+    uint64_t next_event() const
+    {
+      // Any non-empty slot in a level is reached before the end of the
+      // current slot of the level above, and so before any non-empty slot of
+      // the levels above
+      for (size_t level = 0; level < num_levels; ++level)
+      {
+        const auto shift = level_shift(level);
+        const auto& slots = levels[level];
+        for (size_t i = ((now >> shift) & slot_mask) + 1; i < slots_per_level;
+             ++i)
+        {
+          if (!slots[i].empty())
+          {
+            return level_base(now, level) + (uint64_t(i) << shift);
+          }
+        }
+      }
+
+      if (!overflow.empty())
+      {
+        return level_base(now, num_levels - 1) +
+          (uint64_t(1) << level_shift(num_levels));
+      }
+
+      return UINT64_MAX;
+    }
+
+    template <typename F>
+    void release(List& list, F&& f)
+    {
+      // Values may be added or cancelled by f
+      while (!list.empty())
+      {
+        auto node = list.head;
+        list.remove(node);
+
+        auto value = std::move(node->value);
+        nodes.erase(node->id);
+        f(std::move(value));
+      }
+    }
+
+  public:
+    TimingWheel() = default;
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    /// Adds a value expiring at the given time. Each ID must be unique among
+    /// the outstanding values.
+    void add(uint64_t id, uint64_t expiry, T&& value)
+    {
+      auto [it, inserted] =
+        nodes.emplace(id, Node{id, expiry, std::move(value)});
+      if (!inserted)
+      {
+        throw std::logic_error("Timing wheel ID is already in use");
+      }
+
+      auto& list = expiry <= now ? due : list_for(expiry);
+      list.push_back(&it->second);
+    }
+
+    /// Removes the value with the given ID and expiry, without releasing it.
+    /// Returns false if there is no such value, e.g. because it has already
+    /// been released.
+    bool cancel(uint64_t id, uint64_t expiry)
+    {
+      auto it = nodes.find(id);
+      if (it == nodes.end() || it->second.expiry != expiry)
+      {
+        return false;
+      }
+
+      auto& node = it->second;
+      node.list->remove(&node);
+      nodes.erase(it);
+      return true;
+    }
+
+    /// Advances the current time to to, calling f with each value expiring
+    /// at or before that time, in order of expiry
+    template <typename F>
+    void advance(uint64_t to, F&& f)
+    {
+      release(due, f);
+
+      while (now < to)
+      {
+        const auto next = next_event();
+        if (next > to)
+        {
+          now = to;
+          break;
+        }
+
+        now = next;
+
+        // Entering a new slot of a higher level moves its values down,
+        // starting from the highest level so that values can move down
+        // several levels
+        for (size_t level = num_levels; level > 0; --level)
+        {
+          const auto shift = level_shift(level);
+          if ((now & ((uint64_t(1) << shift) - 1)) == 0)
+          {
+            redistribute(
+              level == num_levels ? overflow :
+                                    levels[level][(now >> shift) & slot_mask]);
+          }
+        }
+
+        release(levels[0][now & slot_mask], f);
+      }
+    }
+
+    uint64_t get_now() const
+    {
+      return now;
+    }
+
+    size_t size() const
+    {
+      return nodes.size();
+    }
+
+    /// Drops all values, without releasing them
+    void clear()
+    {
+      for (auto& level : levels)
+      {
+        for (auto& slot : level)
+        {
+          slot = {};
+        }
+      }
+      overflow = {};
+      due = {};
+      nodes.clear();
+    }
+  };
+}
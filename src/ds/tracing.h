@@ -0,0 +1,302 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/spin_lock.h"
+#include "ds/thread_ids.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Sampled request tracing. One in every N requests received by the node is
+// given a trace ID, which is carried by each thread message sent while
+// handling it (see threading::ThreadMsg), and each stage of its processing
+// records a timestamped span under that ID.
+//
+// Spans are buffered in the enclave, sent to the host on each tick and
+// appended to the host's trace file, in the binary layout of Span. They can
+// be converted to the Chrome trace format (chrome://tracing, Perfetto) with
+// python/ccf/trace.py.
+
+namespace tracing
+{
+  /// 0 if the current work is not traced
+  using TraceId = uint64_t;
+
+  /// The stages of a request. Spans of a trace recorded by the same thread
+  /// may nest, e.g. HttpParse contains the Execute span of each request
+  /// parsed, which contains Commit, which contains Replicate.
+  enum class SpanKind : uint8_t
+  {
+    /// From the host reading data from the socket, to the enclave taking it
+    /// from the ringbuffer
+    Ringbuffer = 0,
+    /// From a thread message being sent, to it starting to run
+    Queued,
+    /// Decrypting data read from the TLS session
+    TlsRead,
+    /// Parsing HTTP, and dispatching each complete request
+    HttpParse,
+    /// Executing the request in its frontend
+    Execute,
+    /// Committing the request's transaction to the store
+    Commit,
+    /// Passing the transaction to consensus, for replication
+    Replicate,
+    /// From committing the transaction, to it being globally committed
+    GlobalCommit,
+  };
+
+  /// Binary layout of a span, in the host's trace file
+  struct Span
+  {
+    TraceId trace_id;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint16_t thread_id;
+    SpanKind kind;
+    uint8_t reserved[5] = {};
+  };
+  static_assert(sizeof(Span) == 32);
+
+  class Tracer
+  {
+  public:
+    using Clock = uint64_t (*)();
+
+  private:
+    // Spans are dropped, rather than buffered, beyond this many
+    static constexpr size_t max_buffered_spans = 1 << 16;
+
+    static inline std::atomic<size_t> sampling_interval = 0;
+    static inline std::atomic<uint64_t> requests = 0;
+
+    static inline thread_local TraceId current = 0;
+
+#if !defined(INSIDE_ENCLAVE) || defined(VIRTUAL_ENCLAVE)
+    static uint64_t steady_clock_ns()
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+    }
+
+    static inline Clock clock = &steady_clock_ns;
+#else
+    static inline Clock clock = nullptr;
+#endif
+
+    static inline SpinLock lock;
+    static inline std::vector<Span> spans;
+    static inline size_t dropped_spans = 0;
+
+    struct Committing
+    {
+      TraceId trace_id;
+      uint64_t start_ns;
+    };
+
+    // Traced transactions waiting to be globally committed, by version
+    static inline std::map<uint64_t, Committing> committing;
+    static inline std::atomic<size_t> num_committing = 0;
+
+    friend class TraceScope;
+
+  public:
+    /// Traces one request in every interval, or none if interval is 0
+    static void set_sampling_interval(size_t interval)
+    {
+      sampling_interval.store(interval);
+    }
+
+    static bool enabled()
+    {
+      return sampling_interval.load(std::memory_order_relaxed) != 0;
+    }
+
+    /// Timestamps must come from the host's steady clock, in nanoseconds, to
+    /// be comparable with those recorded by the host. This is the default
+    /// outside SGX, while SGX enclaves derive it from the time given by the
+    /// host.
+    static void set_clock(Clock c)
+    {
+      clock = c;
+    }
+
+    static uint64_t now()
+    {
+      return clock == nullptr ? 0 : clock();
+    }
+
+    /// Called for each new request. Returns a new trace ID if the request is
+    /// sampled, or 0.
+    static TraceId start_trace()
+    {
+      const auto interval = sampling_interval.load(std::memory_order_relaxed);
+      if (interval == 0)
+      {
+        return 0;
+      }
+
+      const auto n = requests.fetch_add(1, std::memory_order_relaxed);
+      return n % interval == 0 ? n + 1 : 0;
+    }
+
+    /// The trace of the work running on this thread
+    static TraceId current_trace()
+    {
+      return current;
+    }
+
+    static void record(
+      SpanKind kind,
+      uint64_t start_ns,
+      uint64_t end_ns,
+      TraceId trace_id = current)
+    {
+      if (trace_id == 0)
+      {
+        return;
+      }
+
+      Span span;
+      span.trace_id = trace_id;
+      span.start_ns = start_ns;
+      span.end_ns = end_ns;
+      span.thread_id = threading::get_current_thread_id();
+      span.kind = kind;
+
+      std::lock_guard<SpinLock> guard(lock);
+      if (spans.size() >= max_buffered_spans)
+      {
+        ++dropped_spans;
+        return;
+      }
+      spans.push_back(span);
+    }
+
+    /// Returns the spans recorded since the last call
+    static std::vector<Span> take_spans()
+    {
+      std::vector<Span> taken;
+      std::lock_guard<SpinLock> guard(lock);
+      taken.swap(spans);
+      return taken;
+    }
+
+    static size_t get_dropped_spans()
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      return dropped_spans;
+    }
+
+    /// Records a GlobalCommit span for the current trace once version is
+    /// globally committed
+    static void await_global_commit(uint64_t version)
+    {
+      if (current == 0)
+      {
+        return;
+      }
+
+      std::lock_guard<SpinLock> guard(lock);
+      committing[version] = {current, now()};
+      num_committing.store(committing.size());
+    }
+
+    /// Called when all versions up to version are globally committed
+    static void global_commit(uint64_t version)
+    {
+      if (num_committing.load(std::memory_order_relaxed) == 0)
+      {
+        return;
+      }
+
+      const auto end = now();
+      std::vector<std::pair<uint64_t, Committing>> committed;
+      {
+        std::lock_guard<SpinLock> guard(lock);
+        auto it = committing.begin();
+        while (it != committing.end() && it->first <= version)
+        {
+          committed.push_back(*it);
+          it = committing.erase(it);
+        }
+        num_committing.store(committing.size());
+      }
+
+      for (const auto& [_, c] : committed)
+      {
+        record(SpanKind::GlobalCommit, c.start_ns, end, c.trace_id);
+      }
+    }
+
+    /// Called when versions after version are rolled back, and so will not
+    /// be committed
+    static void rollback(uint64_t version)
+    {
+      if (num_committing.load(std::memory_order_relaxed) == 0)
+      {
+        return;
+      }
+
+      std::lock_guard<SpinLock> guard(lock);
+      committing.erase(committing.upper_bound(version), committing.end());
+      num_committing.store(committing.size());
+    }
+  };
+
+  /// Makes trace_id the current trace of this thread, for the lifetime of
+  /// this object
+  class TraceScope
+  {
+  private:
+    TraceId previous;
+
+  public:
+    TraceScope(TraceId trace_id) : previous(Tracer::current)
+    {
+      Tracer::current = trace_id;
+    }
+
+    ~TraceScope()
+    {
+      Tracer::current = previous;
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+  };
+
+  /// Records a span of the current trace, if any, covering the lifetime of
+  /// this object
+  class SpanTimer
+  {
+  private:
+    const SpanKind kind;
+    const TraceId trace_id;
+    const uint64_t start_ns;
+
+  public:
+    SpanTimer(SpanKind kind) :
+      kind(kind),
+      trace_id(Tracer::current_trace()),
+      start_ns(trace_id == 0 ? 0 : Tracer::now())
+    {}
+
+    ~SpanTimer()
+    {
+      if (trace_id != 0)
+      {
+        Tracer::record(kind, start_ns, Tracer::now(), trace_id);
+      }
+    }
+
+    SpanTimer(const SpanTimer&) = delete;
+    SpanTimer& operator=(const SpanTimer&) = delete;
+  };
+}
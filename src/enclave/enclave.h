@@ -2,36 +2,119 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 #include "app_interface.h"
+#include "consensus/ledger_enclave_types.h"
 #include "crypto/hash.h"
+#include "ds/doorbell.h"
 #include "ds/logger.h"
 #include "ds/oversized.h"
+#include "ds/per_thread_writer.h"
+#include "ds/tracing.h"
 #include "enclave_time.h"
+#include "http/ws_rpc_context.h"
 #include "interface.h"
 #include "node/entities.h"
 #include "node/historical_queries.h"
 #include "node/network_state.h"
 #include "node/node_state.h"
 #include "node/node_types.h"
+#include "node/rpc/commit_notifier.h"
 #include "node/rpc/forwarder.h"
 #include "node/rpc/node_frontend.h"
+#include "ordered_messages.h"
 #include "rpc_map.h"
 #include "rpc_sessions.h"
 
+#include <numeric>
 #include <openssl/engine.h>
 
+#include "oe_shim.h"
+
+#ifndef VIRTUAL_ENCLAVE
+#  include "ccf_t.h"
+#endif
+
 namespace enclave
 {
+#ifdef VIRTUAL_ENCLAVE
+  static constexpr auto& large_payloads = oversized::host_heap;
+#else
+  // Messages too large for a single ringbuffer fragment are passed in host
+  // memory, which is allocated and released through ocalls. The host may
+  // write to it at any time, so payloads received from the host are copied
+  // into the enclave before they are processed.
+  static constexpr oversized::LargePayloadAllocator large_payloads = {
+    [](size_t size) { return static_cast<uint8_t*>(oe_host_malloc(size)); },
+    [](uint8_t* data) { oe_host_free(data); },
+    [](const uint8_t* data, size_t size) {
+      if (!oe_is_outside_enclave(data, size))
+      {
+        return false;
+      }
+      oe_lfence();
+      return true;
+    },
+    true};
+#endif
+
+  // Blocks the enclave's main thread until the host writes to the ringbuffer
+  static void wait_for_host(
+    std::atomic<uint32_t>* doorbell, std::chrono::microseconds timeout)
+  {
+#ifdef VIRTUAL_ENCLAVE
+    ringbuffer::doorbell::wait(doorbell, timeout);
+#else
+    host_wait_doorbell(doorbell, timeout.count());
+#endif
+  }
+
+  // Wakes up the host when it is blocked waiting for messages from the enclave
+  static void ring_host_doorbell(std::atomic<uint32_t>* doorbell)
+  {
+#ifdef VIRTUAL_ENCLAVE
+    ringbuffer::doorbell::ring(doorbell);
+#else
+    host_ring_doorbell(doorbell);
+#endif
+  }
+
   class Enclave
   {
   private:
     ringbuffer::Circuit circuit;
     ringbuffer::WriterFactory basic_writer_factory;
-    oversized::WriterFactory writer_factory;
+    oversized::WriterFactory main_writer_factory;
+
+    // Each worker thread writes to the host through its own ringbuffer
+    struct WorkerRingbuffer
+    {
+      ringbuffer::Circuit circuit;
+      ringbuffer::WriterFactory basic_writer_factory;
+      oversized::WriterFactory writer_factory;
+
+      WorkerRingbuffer(
+        const ringbuffer::BufferDef& to_enclave,
+        const ringbuffer::BufferDef& from_worker,
+        const oversized::WriterConfig& writer_config) :
+        circuit(to_enclave, from_worker),
+        basic_writer_factory(circuit),
+        writer_factory(basic_writer_factory, writer_config, &large_payloads)
+      {}
+    };
+    std::vector<std::unique_ptr<WorkerRingbuffer>> worker_ringbuffers;
+    ringbuffer::PerThreadWriterFactory writer_factory;
+
+    // Idle worker threads park on a word in host memory, which the host blocks
+    // on when the thread waits
+    std::atomic<uint32_t>* worker_park_words = nullptr;
+
     ccf::NetworkState network;
     ccf::ShareManager share_manager;
     std::shared_ptr<ccf::NodeToNode> n2n_channels;
     std::shared_ptr<RPCMap> rpc_map;
     std::shared_ptr<RPCSessions> rpcsessions;
+    std::shared_ptr<ccf::AdmissionController> admission;
+    std::shared_ptr<ccf::AuthnTablesVersion> authn_tables_version;
+    std::shared_ptr<ccf::CommitNotifier> commit_notifier;
     std::unique_ptr<ccf::NodeState> node;
     std::shared_ptr<ccf::Forwarder<ccf::NodeToNode>> cmd_forwarder;
     ringbuffer::WriterPtr to_host = nullptr;
@@ -61,6 +144,154 @@ namespace enclave
       }
     } context;
 
+    static std::vector<std::unique_ptr<WorkerRingbuffer>>
+    make_worker_ringbuffers(const EnclaveConfig& ec)
+    {
+      const ringbuffer::BufferDef to_enclave{ec.to_enclave_buffer_start,
+                                             ec.to_enclave_buffer_size,
+                                             ec.to_enclave_buffer_offsets,
+                                             nullptr,
+                                             nullptr};
+
+      std::vector<std::unique_ptr<WorkerRingbuffer>> ringbuffers;
+      for (size_t i = 0; i < ec.num_from_workers_buffers; ++i)
+      {
+        // The host blocks on the main ringbuffer's waiting mark, so that it is
+        // woken by a write from any thread
+        const ringbuffer::BufferDef from_worker{
+          ec.from_workers_buffer_start + i * ec.from_workers_buffer_size,
+          ec.from_workers_buffer_size,
+          ec.from_workers_buffer_offsets + i,
+          &ring_host_doorbell,
+          &ec.from_enclave_buffer_offsets->reader_waiting};
+        ringbuffers.push_back(std::make_unique<WorkerRingbuffer>(
+          to_enclave, from_worker, ec.writer_config));
+      }
+      return ringbuffers;
+    }
+
+    // Idle threads park until they are given a task. The main thread parks on
+    // the doorbell of the ringbuffer from the host, so that it is woken up by
+    // either the host or another thread.
+    void init_thread_parking()
+    {
+      auto& tm = threading::ThreadMessaging::thread_messaging;
+      tm.set_doorbell(&wait_for_host, &ring_host_doorbell);
+      tm.set_park_word(
+        threading::MAIN_THREAD_ID, circuit.read_from_outside().get_doorbell());
+
+#ifndef VIRTUAL_ENCLAVE
+      const auto num_workers = worker_ringbuffers.size();
+      worker_park_words = static_cast<std::atomic<uint32_t>*>(
+        oe_host_malloc(num_workers * sizeof(std::atomic<uint32_t>)));
+      if (num_workers != 0 && worker_park_words == nullptr)
+      {
+        throw std::runtime_error("Could not allocate worker park words");
+      }
+      for (size_t i = 0; i < num_workers; ++i)
+      {
+        auto word = new (&worker_park_words[i]) std::atomic<uint32_t>(0);
+        tm.set_park_word(i + 1, word);
+      }
+#endif
+    }
+
+#ifndef VIRTUAL_ENCLAVE
+    static inline uint64_t host_time_base_ns = 0;
+
+    static uint64_t host_clock_ns()
+    {
+      return host_time_base_ns +
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          enclave::get_enclave_time())
+          .count();
+    }
+#endif
+
+    void init_tracing(const EnclaveConfig& ec)
+    {
+      tracing::Tracer::set_sampling_interval(ec.trace_sampling_interval);
+#ifndef VIRTUAL_ENCLAVE
+      // There is no clock inside SGX, so span timestamps come from the time
+      // regularly updated by the host, at its resolution
+      host_time_base_ns = ec.host_time_base_ns;
+      tracing::Tracer::set_clock(&host_clock_ns);
+#endif
+    }
+
+    void send_trace_spans()
+    {
+      if (!tracing::Tracer::enabled())
+      {
+        return;
+      }
+
+      const auto spans = tracing::Tracer::take_spans();
+      if (!spans.empty())
+      {
+        RINGBUFFER_WRITE_MESSAGE(
+          AdminMessage::trace_spans,
+          to_host,
+          serializer::ByteRange{
+            reinterpret_cast<const uint8_t*>(spans.data()),
+            spans.size() * sizeof(tracing::Span)});
+      }
+    }
+
+    // Samples the load from which the frontends decide which requests to
+    // shed: the tasks queued for the worker threads (or the main thread, if
+    // there are none), and the transactions not yet committed
+    void update_admission()
+    {
+      const auto depths =
+        threading::ThreadMessaging::thread_messaging.get_queue_depths();
+      const size_t first = depths.size() > 1 ? 1 : 0;
+      const auto queued =
+        std::accumulate(depths.begin() + first, depths.end(), (size_t)0);
+
+      auto& store = *network.tables;
+      const auto commit_lag = std::max<kv::Version>(
+        store.current_version() - store.commit_version(), 0);
+
+      admission->update(queued / (depths.size() - first), commit_lag);
+    }
+
+    // Pushes the status of the transactions that websocket sessions have
+    // subscribed to, once the commit watermark has passed them, as a single
+    // frame per session
+    void notify_commits()
+    {
+      auto consensus = network.tables->get_consensus();
+      if (consensus == nullptr)
+      {
+        return;
+      }
+
+      const auto [view, seqno] = consensus->get_committed_txid();
+      commit_notifier->notify(
+        view,
+        seqno,
+        [&consensus](int64_t s) { return consensus->get_view(s); },
+        [this](size_t session_id, const ccf::CommitNotification& n) {
+          const auto j = nlohmann::json(n).dump();
+          const std::vector<uint8_t> body(j.begin(), j.end());
+          return rpcsessions->reply_async(
+            session_id, ws::serialise(HTTP_STATUS_OK, body, n.seqno, n.view));
+        });
+    }
+
+    // Indexed by thread ID, the main thread first
+    std::vector<ringbuffer::AbstractWriterFactory*> get_thread_writer_factories()
+    {
+      std::vector<ringbuffer::AbstractWriterFactory*> factories = {
+        &main_writer_factory};
+      for (auto& worker : worker_ringbuffers)
+      {
+        factories.push_back(&worker->writer_factory);
+      }
+      return factories;
+    }
+
   public:
     Enclave(
       const EnclaveConfig& ec,
@@ -71,17 +302,29 @@ namespace enclave
       circuit(
         ringbuffer::BufferDef{ec.to_enclave_buffer_start,
                               ec.to_enclave_buffer_size,
-                              ec.to_enclave_buffer_offsets},
+                              ec.to_enclave_buffer_offsets,
+                              nullptr,
+                              nullptr},
         ringbuffer::BufferDef{ec.from_enclave_buffer_start,
                               ec.from_enclave_buffer_size,
-                              ec.from_enclave_buffer_offsets}),
+                              ec.from_enclave_buffer_offsets,
+                              &ring_host_doorbell,
+                              nullptr}),
       basic_writer_factory(circuit),
-      writer_factory(basic_writer_factory, ec.writer_config),
+      main_writer_factory(
+        basic_writer_factory, ec.writer_config, &large_payloads),
+      worker_ringbuffers(make_worker_ringbuffers(ec)),
+      writer_factory(get_thread_writer_factories(), ordered_to_host),
       network(consensus_type_),
       share_manager(network),
       n2n_channels(std::make_shared<ccf::NodeToNodeImpl>(writer_factory)),
       rpc_map(std::make_shared<RPCMap>()),
       rpcsessions(std::make_shared<RPCSessions>(writer_factory, rpc_map)),
+      admission(std::make_shared<ccf::AdmissionController>(
+        ccf::AdmissionController::Config{ec.admission_max_queue_depth,
+                                         ec.admission_max_commit_lag})),
+      authn_tables_version(std::make_shared<ccf::AuthnTablesVersion>()),
+      commit_notifier(std::make_shared<ccf::CommitNotifier>()),
       cmd_forwarder(std::make_shared<ccf::Forwarder<ccf::NodeToNode>>(
         rpcsessions, n2n_channels, rpc_map, consensus_type_)),
       context(ccf::historical::StateCache(
@@ -90,6 +333,21 @@ namespace enclave
       logger::config::msg() = AdminMessage::log_msg;
       logger::config::writer() = writer_factory.create_writer_to_outside();
 
+      init_thread_parking();
+      init_tracing(ec);
+
+      rpcsessions->set_commit_notifier(commit_notifier);
+
+      // Caller identities cached for sessions are discarded whenever the
+      // tables they are resolved from change
+      ccf::track_authn_tables(*network.tables, authn_tables_version);
+
+      if (ec.tls_ticket_key_rotation_s != 0)
+      {
+        rpcsessions->enable_session_tickets(
+          std::chrono::seconds(ec.tls_ticket_key_rotation_s));
+      }
+
       // From
       // https://software.intel.com/content/www/us/en/develop/articles/how-to-use-the-rdrand-engine-in-openssl-for-random-number-generation.html
       if (
@@ -109,6 +367,18 @@ namespace enclave
         writer_factory, network, rpcsessions, share_manager, curve_id);
       context.node_state = node.get();
 
+      node->set_ringbuffer_stats_source([this]() {
+        std::map<std::string, ringbuffer::BufferStats> stats = {
+          {"to_enclave", circuit.read_from_outside().get_stats()},
+          {"from_enclave", circuit.read_from_inside().get_stats()}};
+        for (size_t i = 0; i < worker_ringbuffers.size(); ++i)
+        {
+          stats[fmt::format("from_worker_{}", i + 1)] =
+            worker_ringbuffers[i]->circuit.read_from_inside().get_stats();
+        }
+        return stats;
+      });
+
       rpc_map->register_frontend<ccf::ActorsType::members>(
         std::make_unique<ccf::MemberRpcFrontend>(
           network, *node, share_manager));
@@ -125,7 +395,11 @@ namespace enclave
           signature_intervals.sig_tx_interval,
           signature_intervals.sig_ms_interval);
         fe->set_cmd_forwarder(cmd_forwarder);
+        fe->set_admission_controller(admission);
+        fe->set_authn_tables_version(authn_tables_version);
+        fe->set_commit_notifier(commit_notifier);
       }
+      node->set_admission_controller(admission);
 
       node->initialize(
         consensus_config,
@@ -143,6 +417,10 @@ namespace enclave
         ENGINE_finish(rdrand_engine);
         ENGINE_free(rdrand_engine);
       }
+
+#ifndef VIRTUAL_ENCLAVE
+      oe_host_free(worker_park_words);
+#endif
     }
 
     bool create_new_node(
@@ -214,7 +492,8 @@ namespace enclave
         messaging::BufferProcessor bp("Enclave");
 
         // reconstruct oversized messages sent to the enclave
-        oversized::FragmentReconstructor fr(bp.get_dispatcher());
+        oversized::FragmentReconstructor fr(
+          bp.get_dispatcher(), &large_payloads);
 
         DISPATCHER_SET_MESSAGE_HANDLER(
           bp, AdminMessage::stop, [&bp](const uint8_t*, size_t) {
@@ -233,6 +512,7 @@ namespace enclave
               bp.get_dispatcher().convert_message_counts(message_counts);
             RINGBUFFER_WRITE_MESSAGE(
               AdminMessage::work_stats, to_host, j.dump());
+            send_trace_spans();
 
             const auto time_now =
               std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -246,6 +526,8 @@ namespace enclave
 
               node->tick(elapsed_ms);
               threading::ThreadMessaging::thread_messaging.tick(elapsed_ms);
+              update_admission();
+              notify_commits();
               // When recovering, no signature should be emitted while the
               // public ledger is being read
               if (!node->is_reading_public_ledger())
@@ -287,18 +569,6 @@ namespace enclave
               ringbuffer::read_message<consensus::ledger_entry>(data, size);
             switch (purpose)
             {
-              case consensus::LedgerRequestPurpose::Recovery:
-              {
-                if (
-                  node->is_reading_public_ledger() ||
-                  node->is_verifying_snapshot())
-                  node->recover_public_ledger_entry(body);
-                else if (node->is_reading_private_ledger())
-                  node->recover_private_ledger_entry(body);
-                else
-                  LOG_FAIL_FMT("Cannot recover ledger entry: Unexpected state");
-                break;
-              }
               case consensus::LedgerRequestPurpose::HistoricalQuery:
               {
                 context.historical_state_cache.handle_ledger_entry(index, body);
@@ -311,6 +581,22 @@ namespace enclave
             }
           });
 
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          bp,
+          consensus::ledger_entries,
+          [this](const uint8_t* data, size_t size) {
+            const auto [from, to, purpose, framed] =
+              ringbuffer::read_message<consensus::ledger_entries>(data, size);
+            if (purpose == consensus::LedgerRequestPurpose::Recovery)
+            {
+              node->recover_ledger_entries(from, framed.data, framed.size);
+            }
+            else
+            {
+              LOG_FAIL_FMT("Unhandled purpose: {}", purpose);
+            }
+          });
+
         DISPATCHER_SET_MESSAGE_HANDLER(
           bp,
           consensus::ledger_no_entry,
@@ -321,7 +607,11 @@ namespace enclave
             {
               case consensus::LedgerRequestPurpose::Recovery:
               {
-                if (node->is_verifying_snapshot())
+                if (!node->expects_ledger_entry(index))
+                {
+                  LOG_DEBUG_FMT("Ignoring end of stopped ledger stream");
+                }
+                else if (node->is_verifying_snapshot())
                 {
                   node->verify_snapshot_end(ccf_config);
                 }
@@ -343,7 +633,17 @@ namespace enclave
             }
           });
 
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          bp,
+          consensus::ledger_persisted,
+          [this](const uint8_t* data, size_t size) {
+            const auto [idx, truncations] =
+              ringbuffer::read_message<consensus::ledger_persisted>(data, size);
+            node->ledger_persisted(idx, truncations);
+          });
+
         rpcsessions->register_message_handlers(bp.get_dispatcher());
+        rpcsessions->start_ticket_key_rotation();
 
         if (start_type == StartType::Join)
         {
@@ -367,7 +667,11 @@ namespace enclave
         // processed in a single iteration
         static constexpr size_t max_messages = 256;
 
-        size_t consecutive_idles = 0u;
+        // Bound on the time spent blocked, in case a wakeup is missed
+        constexpr std::chrono::milliseconds max_block_time(50);
+
+        auto& from_host = circuit.read_from_outside();
+        ringbuffer::doorbell::SpinThenBlock idle_policy;
         while (!bp.get_finished())
         {
           // First, read some messages from the ringbuffer
@@ -385,31 +689,29 @@ namespace enclave
           // messages were executed, idle
           if (read == 0 && thread_msg == 0)
           {
-            const auto time_now = enclave::get_enclave_time();
-            static std::chrono::microseconds idling_start_time;
-
-            if (consecutive_idles == 0)
-            {
-              idling_start_time = time_now;
-            }
-
-            // Handle initial idles by pausing, eventually sleep (in host)
-            constexpr std::chrono::milliseconds timeout(5);
-            if ((time_now - idling_start_time) > timeout)
+            // Handle initial idles by pausing, eventually block (in host)
+            // until the host rings the doorbell
+            if (idle_policy.idle())
             {
-              std::this_thread::sleep_for(timeout * 10);
+              // Thread messages for the main thread ring the same doorbell,
+              // so there must be none before blocking
+              if (from_host.prepare_wait())
+              {
+                if (threading::ThreadMessaging::thread_messaging.prepare_park())
+                {
+                  wait_for_host(from_host.get_doorbell(), max_block_time);
+                }
+                from_host.end_wait();
+              }
             }
             else
             {
               CCF_PAUSE();
             }
-
-            consecutive_idles++;
           }
           else
           {
-            // If some messages were read, reset consecutive idles count
-            consecutive_idles = 0;
+            idle_policy.busy();
           }
         }
 
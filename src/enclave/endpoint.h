@@ -2,6 +2,8 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include <cstdint>
+#include <stdexcept>
 #include <vector>
 
 namespace enclave
@@ -13,5 +15,12 @@ namespace enclave
 
     virtual void recv(const uint8_t* data, size_t size) = 0;
     virtual void send(std::vector<uint8_t>&& data) = 0;
+
+    // Sends the response to the request received on a stream, for sessions
+    // which multiplex requests (HTTP/2)
+    virtual void send_stream(uint32_t, std::vector<uint8_t>&&)
+    {
+      throw std::logic_error("Session does not multiplex requests");
+    }
   };
 }
@@ -13,6 +13,11 @@ namespace enclave
   public:
     virtual ~AbstractRPCResponder() {}
     virtual bool reply_async(size_t id, std::vector<uint8_t>&& data) = 0;
+
+    // Requests received on the streams of a multiplexed session are replied
+    // to via an id of their own, which is valid until removed or replied to
+    virtual size_t add_stream(size_t session_id, uint32_t stream_id) = 0;
+    virtual void remove_stream(size_t id) = 0;
   };
 
   class AbstractForwarder
@@ -7,6 +7,7 @@
 #include "consensus/consensus_types.h"
 #include "consensus_type.h"
 #include "ds/buffer.h"
+#include "ds/json.h"
 #include "ds/logger.h"
 #include "ds/oversized.h"
 #include "ds/ring_buffer_types.h"
@@ -20,6 +21,19 @@
 
 #include <chrono>
 
+namespace ringbuffer
+{
+  DECLARE_JSON_TYPE(BufferStats);
+  DECLARE_JSON_REQUIRED_FIELDS(
+    BufferStats,
+    size,
+    occupancy,
+    max_occupancy,
+    failed_reservations,
+    blocked_writes,
+    blocked_ns);
+}
+
 struct EnclaveConfig
 {
   uint8_t* to_enclave_buffer_start;
@@ -30,8 +44,32 @@ struct EnclaveConfig
   size_t from_enclave_buffer_size;
   ringbuffer::Offsets* from_enclave_buffer_offsets;
 
+  // One ringbuffer from each worker thread to the host, each of
+  // from_workers_buffer_size bytes, laid out contiguously from
+  // from_workers_buffer_start
+  size_t num_from_workers_buffers = 0;
+  uint8_t* from_workers_buffer_start = nullptr;
+  size_t from_workers_buffer_size = 0;
+  ringbuffer::Offsets* from_workers_buffer_offsets = nullptr;
+
   oversized::WriterConfig writer_config = {};
 
+  // Trace one in every trace_sampling_interval requests received, or none if
+  // 0 (see ds/tracing.h)
+  size_t trace_sampling_interval = 0;
+
+  // Seconds between rotations of the keys of TLS session tickets, or 0 to
+  // disable session tickets
+  size_t tls_ticket_key_rotation_s = 0;
+
+  // Load above which RPC interfaces shed requests: mean tasks queued per
+  // worker thread, and transactions not yet committed (0 to ignore either)
+  size_t admission_max_queue_depth = 0;
+  size_t admission_max_commit_lag = 0;
+
+  // The host's steady clock, in nanoseconds, at host time 0
+  uint64_t host_time_base_ns = 0;
+
 #ifdef DEBUG_CONFIG
   struct DebugConfig
   {
@@ -123,7 +161,11 @@ enum AdminMessage : ringbuffer::Message
   DEFINE_RINGBUFFER_MSG_TYPE(tick),
 
   /// Notify the host of work done since last message. Enclave -> Host
-  DEFINE_RINGBUFFER_MSG_TYPE(work_stats)
+  DEFINE_RINGBUFFER_MSG_TYPE(work_stats),
+
+  /// Spans of sampled request traces, recorded since the last message, as an
+  /// array of tracing::Span. Enclave -> Host
+  DEFINE_RINGBUFFER_MSG_TYPE(trace_spans)
 };
 
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
@@ -139,3 +181,5 @@ DECLARE_RINGBUFFER_MESSAGE_NO_PAYLOAD(AdminMessage::stop);
 DECLARE_RINGBUFFER_MESSAGE_NO_PAYLOAD(AdminMessage::stopped);
 DECLARE_RINGBUFFER_MESSAGE_NO_PAYLOAD(AdminMessage::tick);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(AdminMessage::work_stats, std::string);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  AdminMessage::trace_spans, serializer::ByteRange);
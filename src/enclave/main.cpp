@@ -108,6 +108,26 @@ extern "C"
         return false;
       }
 
+      // There is a ringbuffer to the host for each worker thread
+      if (ec.num_from_workers_buffers != num_worker_threads)
+      {
+        return false;
+      }
+
+      if (
+        ec.num_from_workers_buffers != 0 &&
+        (ec.from_workers_buffer_size >
+           std::numeric_limits<size_t>::max() / ec.num_from_workers_buffers ||
+         !oe_is_outside_enclave(
+           ec.from_workers_buffer_start,
+           ec.num_from_workers_buffers * ec.from_workers_buffer_size) ||
+         !oe_is_outside_enclave(
+           ec.from_workers_buffer_offsets,
+           ec.num_from_workers_buffers * sizeof(ringbuffer::Offsets))))
+      {
+        return false;
+      }
+
       oe_lfence();
     }
 
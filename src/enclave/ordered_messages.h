@@ -0,0 +1,24 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "consensus/ledger_enclave_types.h"
+#include "ds/per_thread_writer.h"
+#include "node/node_types.h"
+
+namespace enclave
+{
+  // Messages to the host whose relative order matters even when they are
+  // written by different threads, which are always written to the main
+  // ringbuffer. Node-to-node messages are included since the host affixes
+  // ledger entries to outbound append entries, so these must not overtake
+  // the ledger appends they refer to.
+  static const ringbuffer::MessageSet ordered_to_host = {
+    consensus::ledger_append,
+    consensus::ledger_truncate,
+    consensus::ledger_commit,
+    consensus::ledger_init,
+    consensus::snapshot,
+    consensus::snapshot_commit,
+    ccf::node_outbound};
+}
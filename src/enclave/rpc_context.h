@@ -9,7 +9,9 @@
 #include "node/entities.h"
 #include "node/rpc/error.h"
 
+#include <functional>
 #include <llhttp/llhttp.h>
+#include <optional>
 #include <variant>
 #include <vector>
 
@@ -106,6 +108,8 @@ namespace ccf
       verb = RESTVerb(http::http_method_from_str(s.c_str()));
     }
   }
+
+  class AuthnIdentityCache;
 }
 
 namespace enclave
@@ -119,6 +123,10 @@ namespace enclave
     std::vector<uint8_t> caller_cert = {};
     bool is_forwarding = false;
 
+    // Caller identities resolved on this session, if they may be cached. Not
+    // set for forwarded RPCs, which each have their own SessionContext.
+    std::shared_ptr<ccf::AuthnIdentityCache> authn_cache = nullptr;
+
     //
     // Only set in the case of a forwarded RPC
     //
@@ -133,6 +141,11 @@ namespace enclave
 
   using PathParams = std::map<std::string, std::string>;
 
+  // Produces the successive chunks of a response body, then nothing once the
+  // body is complete
+  using ResponseBodyStream =
+    std::function<std::optional<std::vector<uint8_t>>()>;
+
   class RpcContext
   {
   public:
@@ -179,6 +192,28 @@ namespace enclave
     virtual void set_response_body(std::vector<uint8_t>&& body) = 0;
     virtual void set_response_body(std::string&& body) = 0;
 
+    // Streams the response body from the given producer, which is only
+    // called after the response head has been sent, once the endpoint's
+    // transaction has completed, so it must not refer to that transaction.
+    // Where the response cannot be streamed to the client (e.g. forwarded
+    // requests), the whole body is read from the producer immediately.
+    virtual void set_response_body_stream(ResponseBodyStream&& stream)
+    {
+      std::vector<uint8_t> body;
+      for (auto chunk = stream(); chunk.has_value(); chunk = stream())
+      {
+        body.insert(body.end(), chunk->begin(), chunk->end());
+      }
+      set_response_body(std::move(body));
+    }
+
+    // The stream set by set_response_body_stream(), if the body is to be sent
+    // after the head returned by serialise_response()
+    virtual ResponseBodyStream take_response_body_stream()
+    {
+      return nullptr;
+    }
+
     virtual void set_response_status(int status) = 0;
     virtual int get_response_status() const = 0;
 
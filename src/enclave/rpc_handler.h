@@ -14,6 +14,13 @@ namespace kv
   class Tx;
 }
 
+namespace ccf
+{
+  class AdmissionController;
+  class AuthnTablesVersion;
+  class CommitNotifier;
+}
+
 namespace enclave
 {
   class RpcHandler
@@ -26,6 +33,13 @@ namespace enclave
       size_t sig_tx_interval, size_t sig_ms_interval) = 0;
     virtual void set_cmd_forwarder(
       std::shared_ptr<AbstractForwarder> cmd_forwarder_) = 0;
+    virtual void set_admission_controller(
+      std::shared_ptr<ccf::AdmissionController>)
+    {}
+    virtual void set_authn_tables_version(
+      std::shared_ptr<ccf::AuthnTablesVersion>)
+    {}
+    virtual void set_commit_notifier(std::shared_ptr<ccf::CommitNotifier>) {}
     virtual void tick(std::chrono::milliseconds) {}
     virtual void open(std::optional<tls::Pem*> identity = std::nullopt) = 0;
     virtual bool is_open(kv::Tx& tx) = 0;
@@ -4,14 +4,18 @@
 
 #include "ds/logger.h"
 #include "ds/serialized.h"
+#include "ds/tracing.h"
 #include "forwarder_types.h"
 #include "http/http_endpoint.h"
+#include "node/rpc/commit_notifier.h"
 #include "rpc_handler.h"
 #include "tls/cert.h"
 #include "tls/client.h"
 #include "tls/context.h"
 #include "tls/server.h"
+#include "tls/session_tickets.h"
 
+#include <chrono>
 #include <limits>
 #include <unordered_map>
 
@@ -30,6 +34,14 @@ namespace enclave
     std::shared_ptr<RPCMap> rpc_map;
     std::shared_ptr<tls::Cert> cert;
 
+    // Session tickets issued to clients, if enabled, whose keys are rotated
+    // every ticket_key_rotation
+    std::shared_ptr<tls::SessionTickets> tickets = nullptr;
+    std::chrono::seconds ticket_key_rotation = std::chrono::seconds::zero();
+
+    // Forgets the subscriptions of sessions as they close
+    std::shared_ptr<ccf::CommitNotifier> commit_notifier = nullptr;
+
     SpinLock lock;
     std::unordered_map<size_t, std::shared_ptr<Endpoint>> sessions;
 
@@ -38,6 +50,12 @@ namespace enclave
     std::atomic<size_t> next_client_session_id =
       std::numeric_limits<size_t>::max() / 2;
 
+    // Replies to requests received on the streams of HTTP/2 sessions, which
+    // are addressed to an id from the upper half of the lower range, mapping
+    // to the session and stream
+    std::unordered_map<size_t, std::pair<size_t, uint32_t>> streams;
+    size_t next_stream_reply_id = std::numeric_limits<size_t>::max() / 4;
+
   public:
     RPCSessions(
       ringbuffer::AbstractWriterFactory& writer_factory,
@@ -58,6 +76,64 @@ namespace enclave
       // tls::auth_optional).
       cert = std::make_shared<tls::Cert>(
         nullptr, cert_, pk, nullb, tls::auth_optional);
+
+      // Sessions resumed from tickets would skip the new certificate
+      if (tickets != nullptr)
+      {
+        tickets->reset();
+      }
+    }
+
+    void enable_session_tickets(std::chrono::seconds key_rotation)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      ticket_key_rotation = key_rotation;
+      tickets = std::make_shared<tls::SessionTickets>(key_rotation);
+    }
+
+    void set_commit_notifier(std::shared_ptr<ccf::CommitNotifier> n)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      commit_notifier = n;
+    }
+
+    struct RotateTicketKeysMsg
+    {
+      RotateTicketKeysMsg(RPCSessions& self_) : self(self_) {}
+
+      RPCSessions& self;
+    };
+
+    // Must be called from the thread on which the rotation should run
+    void start_ticket_key_rotation()
+    {
+      if (tickets == nullptr)
+      {
+        return;
+      }
+
+      auto rotate_msg = std::make_unique<threading::Tmsg<RotateTicketKeysMsg>>(
+        [](std::unique_ptr<threading::Tmsg<RotateTicketKeysMsg>> msg) {
+          auto& self = msg->data.self;
+          self.tickets->rotate();
+          LOG_DEBUG_FMT("Rotated TLS session ticket keys");
+
+          threading::ThreadMessaging::thread_messaging.add_task_after(
+            std::move(msg), self.ticket_key_rotation);
+        },
+        *this);
+
+      threading::ThreadMessaging::thread_messaging.add_task_after(
+        std::move(rotate_msg), ticket_key_rotation);
+    }
+
+    tls::SessionTickets::Stats get_session_ticket_stats()
+    {
+      if (tickets == nullptr)
+      {
+        return {};
+      }
+      return tickets->get_stats();
     }
 
     void accept(size_t id)
@@ -83,10 +159,10 @@ namespace enclave
       }
 
       LOG_DEBUG_FMT("Accepting a session inside the enclave: {}", id);
-      auto ctx = std::make_unique<tls::Server>(cert);
+      auto ctx = std::make_unique<tls::Server>(cert, false, tickets);
 
       auto session = std::make_shared<ServerEndpointImpl>(
-        rpc_map, id, writer_factory, std::move(ctx));
+        rpc_map, id, writer_factory, std::move(ctx), *this);
       sessions.insert(std::make_pair(id, std::move(session)));
     }
 
@@ -97,6 +173,23 @@ namespace enclave
       auto search = sessions.find(id);
       if (search == sessions.end())
       {
+        auto stream = streams.find(id);
+        if (stream != streams.end())
+        {
+          const auto [session_id, stream_id] = stream->second;
+          streams.erase(stream);
+
+          search = sessions.find(session_id);
+          if (search != sessions.end())
+          {
+            LOG_DEBUG_FMT(
+              "Replying to stream {} of session {}", stream_id, session_id);
+
+            search->second->send_stream(stream_id, std::move(data));
+            return true;
+          }
+        }
+
         LOG_FAIL_FMT("Replying to unknown session {}", id);
         return false;
       }
@@ -107,11 +200,42 @@ namespace enclave
       return true;
     }
 
+    size_t add_stream(size_t session_id, uint32_t stream_id) override
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      const auto id = next_stream_reply_id++;
+      streams.emplace(id, std::make_pair(session_id, stream_id));
+      return id;
+    }
+
+    void remove_stream(size_t id) override
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      streams.erase(id);
+    }
+
     void remove_session(size_t id)
     {
       std::lock_guard<SpinLock> guard(lock);
       LOG_DEBUG_FMT("Closing a session inside the enclave: {}", id);
       sessions.erase(id);
+
+      if (commit_notifier != nullptr)
+      {
+        commit_notifier->unsubscribe(id);
+      }
+
+      for (auto it = streams.begin(); it != streams.end();)
+      {
+        if (it->second.first == id)
+        {
+          it = streams.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
     }
 
     std::shared_ptr<ClientEndpoint> create_client(
@@ -144,7 +268,7 @@ namespace enclave
 
       DISPATCHER_SET_MESSAGE_HANDLER(
         disp, tls::tls_inbound, [this](const uint8_t* data, size_t size) {
-          auto [id, body] =
+          auto [id, read_ns, body] =
             ringbuffer::read_message<tls::tls_inbound>(data, size);
 
           auto search = sessions.find(id);
@@ -155,6 +279,12 @@ namespace enclave
             return;
           }
 
+          // Each sampled read starts a trace, which follows the data through
+          // the session's tasks
+          tracing::TraceScope trace(tracing::Tracer::start_trace());
+          tracing::Tracer::record(
+            tracing::SpanKind::Ringbuffer, read_ns, tracing::Tracer::now());
+
           search->second->recv(body.data, body.size);
         });
 
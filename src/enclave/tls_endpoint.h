@@ -2,10 +2,12 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "ds/chained_buffer.h"
 #include "ds/logger.h"
 #include "ds/messaging.h"
 #include "ds/ring_buffer.h"
 #include "ds/thread_messaging.h"
+#include "ds/tracing.h"
 #include "endpoint.h"
 #include "tls/context.h"
 #include "tls/msg_types.h"
@@ -21,6 +23,13 @@ namespace enclave
     size_t session_id;
     size_t execution_thread;
 
+    // All of the session's work runs on this strand, preferably on the
+    // execution thread, but on another worker thread if that one is busy.
+    // Since the strand may move between threads, to_host is pinned to the
+    // execution thread's ringbuffer, so that the host reads the session's
+    // records in the order they were written.
+    std::shared_ptr<threading::Strand> strand;
+
     enum Status
     {
       handshake,
@@ -48,10 +57,11 @@ namespace enclave
     }
 
   private:
-    std::vector<uint8_t> pending_write;
-    std::vector<uint8_t> pending_read;
+    // Encrypted data, to be written to and read from the host
+    ds::ChainedBuffer pending_write;
+    ds::ChainedBuffer pending_read;
     // Decrypted data, read through mbedtls
-    std::vector<uint8_t> read_buffer;
+    ds::ChainedBuffer read_buffer;
 
     std::unique_ptr<tls::Context> ctx;
     Status status;
@@ -61,7 +71,6 @@ namespace enclave
       size_t session_id_,
       ringbuffer::AbstractWriterFactory& writer_factory_,
       std::unique_ptr<tls::Context> ctx_) :
-      to_host(writer_factory_.create_writer_to_outside()),
       session_id(session_id_),
       ctx(move(ctx_)),
       status(handshake)
@@ -75,6 +84,8 @@ namespace enclave
       {
         execution_thread = threading::MAIN_THREAD_ID;
       }
+      to_host = writer_factory_.create_writer_to_outside_from(execution_thread);
+      strand = std::make_shared<threading::Strand>(execution_thread);
       ctx->set_bio(this, send_callback, recv_callback, dbg_callback);
     }
 
@@ -93,6 +104,16 @@ namespace enclave
       return ctx->host();
     }
 
+    std::string alpn_protocol()
+    {
+      if (status != ready)
+      {
+        return {};
+      }
+
+      return ctx->alpn_protocol();
+    }
+
     std::vector<uint8_t> peer_cert()
     {
       if (status != ready)
@@ -117,6 +138,8 @@ namespace enclave
     // used by caller.
     size_t read(uint8_t* data, size_t size, bool exact = false)
     {
+      tracing::SpanTimer span(tracing::SpanKind::TlsRead);
+
       LOG_TRACE_FMT("Requesting up to {} bytes", size);
 
       // This will return empty if the connection isn't
@@ -133,17 +156,11 @@ namespace enclave
 
       size_t offset = 0;
 
-      if (read_buffer.size() > 0)
+      if (!read_buffer.empty())
       {
         LOG_TRACE_FMT(
           "Have existing read_buffer of size: {}", read_buffer.size());
-        offset = std::min(size, read_buffer.size());
-        ::memcpy(data, read_buffer.data(), offset);
-
-        if (offset < read_buffer.size())
-          read_buffer.erase(read_buffer.begin(), read_buffer.begin() + offset);
-        else
-          read_buffer.clear();
+        offset = read_buffer.read(data, size);
 
         if (offset == size)
           return size;
@@ -184,7 +201,7 @@ namespace enclave
 
           // May have read something but not enough - copy it into read_buffer
           // for next call
-          read_buffer.insert(read_buffer.end(), data, data + offset);
+          read_buffer.append(data, offset);
           return 0;
         }
 
@@ -209,7 +226,7 @@ namespace enclave
       {
         LOG_TRACE_FMT(
           "Asked for exactly {}, received {}, retrying", size, total);
-        read_buffer.insert(read_buffer.end(), data, data + total);
+        read_buffer.append(data, total);
         return read(data, size, exact);
       }
 
@@ -218,11 +235,21 @@ namespace enclave
 
     void recv_buffered(const uint8_t* data, size_t size)
     {
-      if (threading::get_current_thread_id() != execution_thread)
+      if (!strand->is_current())
+      {
+        throw std::exception();
+      }
+      pending_read.append(data, size);
+      do_handshake();
+    }
+
+    void recv_buffered(std::vector<uint8_t>&& data)
+    {
+      if (!strand->is_current())
       {
         throw std::exception();
       }
-      pending_read.insert(pending_read.end(), data, data + size);
+      pending_read.append(std::move(data));
       do_handshake();
     }
 
@@ -235,7 +262,7 @@ namespace enclave
     static void send_raw_cb(std::unique_ptr<threading::Tmsg<SendRecvMsg>> msg)
     {
       reinterpret_cast<TLSEndpoint*>(msg->data.self.get())
-        ->send_raw_thread(msg->data.data);
+        ->send_raw_thread(std::move(msg->data.data));
     }
 
     void send_raw(std::vector<uint8_t>&& data)
@@ -245,15 +272,15 @@ namespace enclave
       msg->data.data = std::move(data);
 
       threading::ThreadMessaging::thread_messaging.add_task(
-        execution_thread, std::move(msg));
+        strand, std::move(msg));
     }
 
-    void send_raw_thread(const std::vector<uint8_t>& data)
+    void send_raw_thread(std::vector<uint8_t>&& data)
     {
-      if (threading::get_current_thread_id() != execution_thread)
+      if (!strand->is_current())
       {
         throw std::runtime_error(
-          "Called send_raw_thread from incorrect thread");
+          "Called send_raw_thread outside the session strand");
       }
       // Writes as much of the data as possible. If the data cannot all
       // be written now, we store the remainder. We
@@ -262,33 +289,52 @@ namespace enclave
 
       if (status == handshake)
       {
-        pending_write.insert(pending_write.end(), data.begin(), data.end());
+        pending_write.append(std::move(data));
         return;
       }
 
       if (status != ready)
         return;
 
-      pending_write.insert(pending_write.end(), data.begin(), data.end());
+      pending_write.append(std::move(data));
 
       flush();
     }
 
     void send_buffered(const std::vector<uint8_t>& data)
     {
-      if (threading::get_current_thread_id() != execution_thread)
+      if (!strand->is_current())
+      {
+        throw std::runtime_error(
+          "Called send_buffered outside the session strand");
+      }
+
+      pending_write.append(data.data(), data.size());
+    }
+
+    void send_buffered(std::vector<uint8_t>&& data)
+    {
+      if (!strand->is_current())
       {
-        throw std::runtime_error("Called send_buffered from incorrect thread");
+        throw std::runtime_error(
+          "Called send_buffered outside the session strand");
       }
 
-      pending_write.insert(pending_write.end(), data.begin(), data.end());
+      pending_write.append(std::move(data));
+    }
+
+    // Bytes waiting to be encrypted and written to the host
+    size_t pending_write_size() const
+    {
+      return pending_write.size();
     }
 
     void flush()
     {
-      if (threading::get_current_thread_id() != execution_thread)
+      if (!strand->is_current())
       {
-        throw std::runtime_error("Called flush from incorrect thread");
+        throw std::runtime_error(
+          "Called flush outside the session strand");
       }
 
       do_handshake();
@@ -296,13 +342,15 @@ namespace enclave
       if (status != ready)
         return;
 
-      while (pending_write.size() > 0)
+      while (!pending_write.empty())
       {
-        auto r = write_some(pending_write);
+        // Written a record at a time, from the front segment
+        const auto front = pending_write.front();
+        auto r = write_some(front.data, front.size);
 
         if (r > 0)
         {
-          pending_write.erase(pending_write.begin(), pending_write.begin() + r);
+          pending_write.consume(r);
         }
         else if (r == 0)
         {
@@ -333,14 +381,15 @@ namespace enclave
       msg->data.self = this->shared_from_this();
 
       threading::ThreadMessaging::thread_messaging.add_task(
-        execution_thread, std::move(msg));
+        strand, std::move(msg));
     }
 
     void close_thread()
     {
-      if (threading::get_current_thread_id() != execution_thread)
+      if (!strand->is_current())
       {
-        throw std::runtime_error("Called close_thread from incorrect thread");
+        throw std::runtime_error(
+          "Called close_thread outside the session strand");
       }
 
       switch (status)
@@ -459,9 +508,9 @@ namespace enclave
       }
     }
 
-    int write_some(const std::vector<uint8_t>& data)
+    int write_some(const uint8_t* data, size_t size)
     {
-      auto r = ctx->write(data.data(), data.size());
+      auto r = ctx->write(data, size);
 
       switch (r)
       {
@@ -537,27 +586,16 @@ namespace enclave
 
     int handle_recv(uint8_t* buf, size_t len)
     {
-      if (threading::get_current_thread_id() != execution_thread)
+      if (!strand->is_current())
       {
-        throw std::runtime_error("Called handle_recv from incorrect thread");
+        throw std::runtime_error(
+          "Called handle_recv outside the session strand");
       }
-      if (pending_read.size() > 0)
+      if (!pending_read.empty())
       {
-        // Use the pending data vector. This is populated when the host
+        // Use the pending data buffer. This is populated when the host
         // writes a chunk larger than the size requested by the enclave.
-        size_t rd = std::min(len, pending_read.size());
-        ::memcpy(buf, pending_read.data(), rd);
-
-        if (rd >= pending_read.size())
-        {
-          pending_read.clear();
-        }
-        else
-        {
-          pending_read.erase(pending_read.begin(), pending_read.begin() + rd);
-        }
-
-        return (int)rd;
+        return (int)pending_read.read(buf, len);
       }
 
       return MBEDTLS_ERR_SSL_WANT_READ;
@@ -0,0 +1,49 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "proxy.h"
+
+namespace asynchost
+{
+  // Runs the behaviour on the uv loop after send() is called, from any thread.
+  // Several calls to send() may result in a single call to the behaviour.
+  template <typename Behaviour>
+  class Async : public with_uv_handle<uv_async_t>
+  {
+  public:
+    Behaviour behaviour;
+
+    void send()
+    {
+      uv_async_send(&uv_handle);
+    }
+
+  private:
+    friend class close_ptr<Async<Behaviour>>;
+
+    template <typename... Args>
+    Async(Args&&... args) : behaviour(std::forward<Args>(args)...)
+    {
+      int rc;
+
+      if ((rc = uv_async_init(uv_default_loop(), &uv_handle, on_async)) < 0)
+      {
+        LOG_FAIL_FMT("uv_async_init failed: {}", uv_strerror(rc));
+        throw std::logic_error("uv_async_init failed");
+      }
+
+      uv_handle.data = this;
+    }
+
+    static void on_async(uv_async_t* handle)
+    {
+      static_cast<Async*>(handle->data)->on_async();
+    }
+
+    void on_async()
+    {
+      behaviour.on_async();
+    }
+  };
+}
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "crypto/hash.h"
+#include "ds/doorbell.h"
 #include "ds/logger.h"
 #include "enclave/interface.h"
 #include "tls/key_pair.h"
@@ -21,6 +22,23 @@
 // OE_ENCLAVE_FLAG combinations
 constexpr static uint32_t ENCLAVE_FLAG_VIRTUAL = -1;
 
+#ifndef VIRTUAL_ENCLAVE
+// OCalls through which the enclave blocks until the host writes to the
+// ringbuffer, and wakes up the host when it writes to the ringbuffer. A virtual
+// enclave makes these syscalls directly.
+extern "C" void host_wait_doorbell(void* doorbell, uint64_t timeout_us)
+{
+  ringbuffer::doorbell::wait(
+    static_cast<std::atomic<uint32_t>*>(doorbell),
+    std::chrono::microseconds(timeout_us));
+}
+
+extern "C" void host_ring_doorbell(void* doorbell)
+{
+  ringbuffer::doorbell::ring(static_cast<std::atomic<uint32_t>*>(doorbell));
+}
+#endif
+
 namespace host
 {
   /**
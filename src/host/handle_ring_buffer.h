@@ -2,41 +2,172 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "../ds/doorbell.h"
 #include "../ds/files.h"
+#include "../ds/json.h"
 #include "../ds/logger.h"
+#include "../ds/non_blocking.h"
 #include "../enclave/interface.h"
+#include "async.h"
 #include "timer.h"
 
 #include <chrono>
+#include <condition_variable>
 #include <ctime>
 #include <iomanip>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <string>
 #include <sys/types.h>
+#include <thread>
 #include <unistd.h>
+#include <vector>
+
+namespace ringbuffer
+{
+  DECLARE_JSON_TYPE(PendingStats);
+  DECLARE_JSON_REQUIRED_FIELDS(PendingStats, messages, bytes, total_messages);
+}
 
 namespace asynchost
 {
+  // Blocks on the ringbuffers' doorbell, on a dedicated thread, while the uv
+  // loop is not polling the ringbuffers. Once the enclave has written to one of
+  // them (or after max_block_time), calls wake_loop() and waits to be armed
+  // again. The ringbuffers share the first one's waiting mark.
+  class RingbufferDoorbellWaiter
+  {
+  private:
+    // Bound on the time spent blocked, after which the loop is woken up
+    // anyway, to retry any pending writes to the enclave
+    static constexpr std::chrono::milliseconds max_block_time{100};
+
+    std::vector<ringbuffer::Reader*> readers;
+    std::function<void()> wake_loop;
+
+    std::mutex lock;
+    std::condition_variable cv;
+    bool armed = false;
+    bool stopped = false;
+    std::thread thread;
+
+    void run()
+    {
+      while (true)
+      {
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          cv.wait(guard, [this]() { return armed || stopped; });
+          if (stopped)
+          {
+            return;
+          }
+        }
+
+        auto& r = *readers.front();
+        if (prepare_wait())
+        {
+          ringbuffer::doorbell::wait(r.get_doorbell(), max_block_time);
+          r.end_wait();
+        }
+
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          armed = false;
+        }
+        wake_loop();
+      }
+    }
+
+    bool prepare_wait()
+    {
+      // Once the shared mark is set, a write to any of the ringbuffers clears
+      // it, so the others only need to be checked for messages
+      auto& r = *readers.front();
+      if (!r.prepare_wait())
+      {
+        return false;
+      }
+
+      for (auto it = std::next(readers.begin()); it != readers.end(); ++it)
+      {
+        if ((*it)->has_message())
+        {
+          r.end_wait();
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+  public:
+    RingbufferDoorbellWaiter(
+      const std::vector<ringbuffer::Reader*>& readers,
+      std::function<void()> wake_loop) :
+      readers(readers),
+      wake_loop(wake_loop),
+      thread([this]() { run(); })
+    {}
+
+    ~RingbufferDoorbellWaiter()
+    {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        stopped = true;
+      }
+      cv.notify_one();
+      thread.join();
+    }
+
+    void arm()
+    {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        armed = true;
+      }
+      cv.notify_one();
+    }
+  };
+
   class HandleRingbufferImpl
   {
   private:
     // Maximum number of outbound ringbuffer messages which will be processed in
-    // a single iteration
+    // a single iteration, from each ringbuffer
     static constexpr size_t max_messages = 256;
 
     messaging::BufferProcessor& bp;
-    ringbuffer::Reader& r;
     ringbuffer::NonBlockingWriterFactory& nbwf;
 
+    // The enclave's main thread and each of its worker threads write to their
+    // own ringbuffer. Each iteration starts from the ringbuffer after the one
+    // it started from last time, so that a busy thread cannot starve the
+    // others.
+    std::vector<ringbuffer::Reader*> readers;
+    size_t first_reader = 0;
+
+    // Once the doorbell is enabled, polling stops after a number of idle polls
+    // (adapted to the traffic), until the enclave rings the doorbell
+    std::unique_ptr<RingbufferDoorbellWaiter> doorbell_waiter = nullptr;
+    std::function<void()> stop_polling = nullptr;
+    ringbuffer::doorbell::SpinThenBlock idle_policy{2, 64};
+    bool polling = true;
+
   public:
     HandleRingbufferImpl(
       messaging::BufferProcessor& bp,
-      ringbuffer::Reader& r,
+      const std::vector<ringbuffer::Reader*>& readers,
       ringbuffer::NonBlockingWriterFactory& nbwf) :
       bp(bp),
-      r(r),
-      nbwf(nbwf)
+      nbwf(nbwf),
+      readers(readers)
     {
+      if (readers.empty())
+      {
+        throw std::logic_error("No ringbuffer to read from the enclave");
+      }
+
       // Register message handler for log message from enclave
       DISPATCHER_SET_MESSAGE_HANDLER(
         bp, AdminMessage::log_msg, [](const uint8_t* data, size_t size) {
@@ -65,15 +196,103 @@ namespace asynchost
         });
     }
 
+    ~HandleRingbufferImpl()
+    {
+      nbwf.set_inbound_pending_callback(nullptr);
+    }
+
+    // While polling is stopped, messages queued for the enclave once the
+    // ringbuffer to it is full would otherwise only be flushed once the
+    // waiter times out, so polling is resumed straight away
+    void enable_doorbell(
+      std::function<void()> wake_loop,
+      std::function<void()> stop_polling_,
+      std::function<void()> resume_polling)
+    {
+      doorbell_waiter =
+        std::make_unique<RingbufferDoorbellWaiter>(readers, wake_loop);
+      stop_polling = stop_polling_;
+      nbwf.set_inbound_pending_callback([this, resume_polling]() {
+        if (!polling)
+        {
+          polling = true;
+          resume_polling();
+        }
+      });
+    }
+
     void on_timer()
     {
+      polling = true;
+
       // Regularly read (and process) some outbound ringbuffer messages...
-      bp.read_n(max_messages, r);
+      size_t read = 0;
+      for (size_t i = 0; i < readers.size(); ++i)
+      {
+        read += bp.read_n(
+          max_messages, *readers[(first_reader + i) % readers.size()]);
+      }
+      first_reader = (first_reader + 1) % readers.size();
 
       // ...flush any pending inbound messages...
-      nbwf.flush_all_inbound();
+      const auto all_flushed = nbwf.flush_all_inbound();
+
+      if (doorbell_waiter == nullptr)
+      {
+        return;
+      }
+
+      // ...and, if there has been nothing to do for a while, stop polling until
+      // the enclave writes to the ringbuffer
+      if (read != 0 || !all_flushed)
+      {
+        idle_policy.busy();
+      }
+      else if (idle_policy.idle())
+      {
+        polling = false;
+        stop_polling();
+        doorbell_waiter->arm();
+      }
     }
   };
 
   using HandleRingbuffer = proxy_ptr<Timer<HandleRingbufferImpl>>;
+
+  // Resumes polling the ringbuffer when the enclave rings the doorbell
+  class RingbufferDoorbellImpl
+  {
+  private:
+    Timer<HandleRingbufferImpl>* handle_ringbuffer;
+
+  public:
+    RingbufferDoorbellImpl(Timer<HandleRingbufferImpl>* handle_ringbuffer) :
+      handle_ringbuffer(handle_ringbuffer)
+    {}
+
+    void on_async()
+    {
+      handle_ringbuffer->start();
+    }
+  };
+
+  using RingbufferDoorbell = proxy_ptr<Async<RingbufferDoorbellImpl>>;
+
+  // Lets the uv loop stop polling the ringbuffer from the enclave while it is
+  // idle. The waiter thread holds a reference to the doorbell's uv handle, and
+  // is itself owned by the polling timer, so the doorbell is only closed once
+  // the timer has been destroyed.
+  inline RingbufferDoorbell start_ringbuffer_doorbell(
+    HandleRingbuffer& handle_ringbuffer)
+  {
+    auto timer = handle_ringbuffer.operator->();
+    RingbufferDoorbell doorbell(timer);
+
+    timer->behaviour.enable_doorbell(
+      [doorbell]() mutable { doorbell->send(); },
+      [timer]() { timer->stop(); },
+      [timer]() { timer->start(); });
+
+    return doorbell;
+  }
 }
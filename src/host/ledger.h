@@ -3,17 +3,29 @@
 #pragma once
 
 #include "consensus/ledger_enclave_types.h"
+#include "ds/json.h"
 #include "ds/logger.h"
 #include "ds/messaging.h"
 #include "ds/nonstd.h"
+#include "ds/serializer.h"
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
 #include <filesystem>
+#include <functional>
 #include <list>
 #include <map>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <sys/mman.h>
 #include <sys/types.h>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
@@ -22,6 +34,8 @@ namespace fs = std::filesystem;
 namespace asynchost
 {
   static constexpr size_t ledger_max_read_cache_files_default = 5;
+  static constexpr size_t ledger_max_entry_cache_bytes_default =
+    16 * 1024 * 1024; // 16MB
 
   static constexpr auto ledger_committed_suffix = "committed";
   static constexpr auto ledger_start_idx_delimiter = "_";
@@ -124,9 +138,113 @@ namespace asynchost
     size_t total_len = 0;
     std::vector<uint32_t> positions;
 
+    // Entries are written by a single thread, while others may read them.
+    // The positions and length of the file are guarded by meta_lock, which is
+    // only held briefly, and readers read entries with pread(), from the part
+    // of the file known to have been flushed from the stdio buffer
+    // (flushed_len). Truncations are counted, so that readers can discard
+    // entries truncated while they were read.
+    mutable std::mutex meta_lock;
+    mutable size_t flushed_len = 0;
+    size_t truncations = 0;
+
     bool completed = false;
     bool committed = false;
 
+    // Committed files are immutable, so are read through a read-only mapping,
+    // created on first read and released with the file
+    const uint8_t* mapping = nullptr;
+    size_t mapping_size = 0;
+
+    const uint8_t* get_mapping()
+    {
+      if (mapping == nullptr)
+      {
+        auto m = mmap(
+          nullptr, total_len, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if (m == MAP_FAILED)
+        {
+          throw std::logic_error(fmt::format(
+            "Failed to map ledger file {}: {}", file_name, strerror(errno)));
+        }
+
+        // Lagging followers catch up by reading committed files in order
+        madvise(m, total_len, MADV_SEQUENTIAL);
+
+        mapping = static_cast<const uint8_t*>(m);
+        mapping_size = total_len;
+      }
+      return mapping;
+    }
+
+    size_t get_last_idx_unsafe() const
+    {
+      return start_idx + positions.size() - 1;
+    }
+
+    size_t framed_entries_size_unsafe(size_t from, size_t to) const
+    {
+      if ((from < start_idx) || (to < from) || (to > get_last_idx_unsafe()))
+      {
+        return 0;
+      }
+
+      if (to == get_last_idx_unsafe())
+      {
+        return total_len - positions.at(from - start_idx);
+      }
+      else
+      {
+        return positions.at(to - start_idx + 1) -
+          positions.at(from - start_idx);
+      }
+    }
+
+    // Reads the size bytes at offset, which are part of the entries published
+    // when truncations_ was read. Returns nothing if the file has been
+    // truncated since.
+    std::optional<std::vector<uint8_t>> read_published(
+      size_t offset, size_t size, size_t end, size_t truncations_) const
+    {
+      bool flushed;
+      {
+        std::lock_guard<std::mutex> guard(meta_lock);
+        flushed = end <= flushed_len;
+      }
+      if (!flushed)
+      {
+        flush();
+      }
+
+      std::vector<uint8_t> data(size);
+      size_t done = 0;
+      while (done < size)
+      {
+        const auto n =
+          pread(fileno(file), data.data() + done, size - done, offset + done);
+        if (n <= 0)
+        {
+          break;
+        }
+        done += n;
+      }
+
+      std::lock_guard<std::mutex> guard(meta_lock);
+      if (truncations != truncations_)
+      {
+        return std::nullopt;
+      }
+      if (done != size)
+      {
+        throw std::logic_error(fmt::format(
+          "Failed to read {} bytes at {} from ledger file {}",
+          size,
+          offset,
+          file_name));
+      }
+      return data;
+    }
+
   public:
     // Used when creating a new (empty) ledger file
     LedgerFile(const std::string& dir, size_t start_idx) :
@@ -145,6 +263,7 @@ namespace asynchost
       // Header reserved for the offset to the position table
       fseeko(file, sizeof(positions_offset_header_t), SEEK_SET);
       total_len = sizeof(positions_offset_header_t);
+      flushed_len = total_len;
     }
 
     // Used when recovering an existing ledger file
@@ -231,10 +350,16 @@ namespace asynchost
         }
         completed = false;
       }
+      flushed_len = total_len;
     }
 
     ~LedgerFile()
     {
+      if (mapping != nullptr)
+      {
+        munmap(const_cast<uint8_t*>(mapping), mapping_size);
+      }
+
       if (file)
       {
         fclose(file);
@@ -248,11 +373,13 @@ namespace asynchost
 
     size_t get_last_idx() const
     {
-      return start_idx + positions.size() - 1;
+      std::lock_guard<std::mutex> guard(meta_lock);
+      return get_last_idx_unsafe();
     }
 
     size_t get_current_size() const
     {
+      std::lock_guard<std::mutex> guard(meta_lock);
       return total_len;
     }
 
@@ -266,11 +393,11 @@ namespace asynchost
       return completed;
     }
 
+    // Only called by the writing thread, which is the only one to modify
+    // positions and total_len, so can read them without meta_lock
     size_t write_entry(const uint8_t* data, size_t size, bool committable)
     {
       fseeko(file, total_len, SEEK_SET);
-      positions.push_back(total_len);
-      size_t new_idx = get_last_idx();
 
       uint32_t frame = (uint32_t)size;
       if (fwrite(&frame, frame_header_size, 1, file) != 1)
@@ -290,27 +417,22 @@ namespace asynchost
           fmt::format("Failed to flush entry to ledger: {}", strerror(errno)));
       }
 
+      // The entry is only visible to readers once written
+      std::lock_guard<std::mutex> guard(meta_lock);
+      positions.push_back(total_len);
       total_len += (size + frame_header_size);
+      if (committable)
+      {
+        flushed_len = total_len;
+      }
 
-      return new_idx;
+      return get_last_idx_unsafe();
     }
 
     size_t framed_entries_size(size_t from, size_t to) const
     {
-      if ((from < start_idx) || (to < from) || (to > get_last_idx()))
-      {
-        return 0;
-      }
-
-      if (to == get_last_idx())
-      {
-        return total_len - positions.at(from - start_idx);
-      }
-      else
-      {
-        return positions.at(to - start_idx + 1) -
-          positions.at(from - start_idx);
-      }
+      std::lock_guard<std::mutex> guard(meta_lock);
+      return framed_entries_size_unsafe(from, to);
     }
 
     size_t entry_size(size_t idx) const
@@ -319,46 +441,62 @@ namespace asynchost
       return (framed_size != 0) ? framed_size - frame_header_size : 0;
     }
 
+    // Entries can be read while the file is written to, without waiting for
+    // the write
     std::optional<std::vector<uint8_t>> read_entry(size_t idx) const
     {
-      if ((idx < start_idx) || (idx > get_last_idx()))
+      size_t offset, size, trunc;
       {
-        return std::nullopt;
-      }
-
-      auto len = entry_size(idx);
-      std::vector<uint8_t> entry(len);
-      fseeko(file, positions.at(idx - start_idx) + frame_header_size, SEEK_SET);
+        std::lock_guard<std::mutex> guard(meta_lock);
+        if ((idx < start_idx) || (idx > get_last_idx_unsafe()))
+        {
+          return std::nullopt;
+        }
 
-      if (fread(entry.data(), len, 1, file) != 1)
-      {
-        throw std::logic_error(
-          fmt::format("Failed to read entry {} from file", idx));
+        offset = positions.at(idx - start_idx) + frame_header_size;
+        size = framed_entries_size_unsafe(idx, idx) - frame_header_size;
+        trunc = truncations;
       }
 
-      return entry;
+      return read_published(offset, size, offset + size, trunc);
     }
 
     std::optional<std::vector<uint8_t>> read_framed_entries(
       size_t from, size_t to) const
     {
-      if ((from < start_idx) || (to > get_last_idx()) || (to < from))
+      size_t offset, size, trunc;
       {
-        LOG_FAIL_FMT("Unknown entries range: {} - {}", from, to);
-        return std::nullopt;
+        std::lock_guard<std::mutex> guard(meta_lock);
+        if ((from < start_idx) || (to > get_last_idx_unsafe()) || (to < from))
+        {
+          LOG_FAIL_FMT("Unknown entries range: {} - {}", from, to);
+          return std::nullopt;
+        }
+
+        offset = positions.at(from - start_idx);
+        size = framed_entries_size_unsafe(from, to);
+        trunc = truncations;
       }
 
-      auto framed_size = framed_entries_size(from, to);
-      std::vector<uint8_t> framed_entries(framed_size);
-      fseeko(file, positions.at(from - start_idx), SEEK_SET);
+      return read_published(offset, size, offset + size, trunc);
+    }
 
-      if (fread(framed_entries.data(), framed_size, 1, file) != 1)
+    // Returns a view of the framed entries, which remains valid as long as this
+    // file is alive. Only committed files can be read without a copy.
+    std::optional<serializer::ByteRange> read_framed_entries_view(
+      size_t from, size_t to)
+    {
+      if (
+        !committed || (from < start_idx) || (to > get_last_idx()) ||
+        (to < from))
       {
-        throw std::logic_error(fmt::format(
-          "Failed to read entry range {} - {} from file", from, to));
+        return std::nullopt;
       }
 
-      return framed_entries;
+      std::lock_guard<std::mutex> guard(meta_lock);
+      return serializer::ByteRange{get_mapping() +
+                                     positions.at(from - start_idx),
+                                   framed_entries_size_unsafe(from, to)};
     }
 
     bool truncate(size_t idx)
@@ -388,8 +526,13 @@ namespace asynchost
       }
 
       completed = false;
-      total_len = positions.at(idx - start_idx + 1);
-      positions.resize(idx - start_idx + 1);
+      {
+        std::lock_guard<std::mutex> guard(meta_lock);
+        truncations++;
+        total_len = positions.at(idx - start_idx + 1);
+        positions.resize(idx - start_idx + 1);
+        flushed_len = std::min(flushed_len, total_len);
+      }
 
       if (fflush(file) != 0)
       {
@@ -447,6 +590,35 @@ namespace asynchost
       completed = true;
     }
 
+    // May be called by readers, while the file is written to
+    void flush() const
+    {
+      size_t published;
+      {
+        std::lock_guard<std::mutex> guard(meta_lock);
+        published = total_len;
+      }
+
+      if (fflush(file) != 0)
+      {
+        throw std::logic_error(
+          fmt::format("Failed to flush ledger file: {}", strerror(errno)));
+      }
+
+      std::lock_guard<std::mutex> guard(meta_lock);
+      flushed_len = std::max(flushed_len, std::min(published, total_len));
+    }
+
+    // Only covers data already flushed from the stdio buffer
+    void sync()
+    {
+      if (fdatasync(fileno(file)) != 0)
+      {
+        throw std::logic_error(
+          fmt::format("Failed to sync ledger file: {}", strerror(errno)));
+      }
+    }
+
     bool commit(size_t idx)
     {
       if (!completed || committed || (idx != get_last_idx()))
@@ -492,11 +664,195 @@ namespace asynchost
     }
   };
 
+  // Read-only view of ledger data, which shares ownership of the underlying
+  // storage (e.g. a mapped ledger file), so that the data can be copied
+  // straight to its destination
+  struct LedgerReadView
+  {
+    std::shared_ptr<const void> storage = nullptr;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    static LedgerReadView owning(std::vector<uint8_t>&& v)
+    {
+      auto storage = std::make_shared<std::vector<uint8_t>>(std::move(v));
+      return {storage, storage->data(), storage->size()};
+    }
+  };
+  using LedgerReadViews = std::vector<LedgerReadView>;
+
+  inline std::vector<uint8_t> flatten(const LedgerReadViews& views)
+  {
+    size_t size = 0;
+    for (const auto& v : views)
+    {
+      size += v.size;
+    }
+
+    std::vector<uint8_t> data;
+    data.reserve(size);
+    for (const auto& v : views)
+    {
+      data.insert(data.end(), v.data, v.data + v.size);
+    }
+    return data;
+  }
+
+  struct LedgerEntryCacheStats
+  {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+  };
+
+  DECLARE_JSON_TYPE(LedgerEntryCacheStats);
+  DECLARE_JSON_REQUIRED_FIELDS(
+    LedgerEntryCacheStats, hits, misses, entries, bytes);
+
+  struct LedgerSyncStats
+  {
+    size_t syncs = 0;
+    size_t entries = 0;
+    size_t total_us = 0;
+    size_t max_us = 0;
+  };
+
+  DECLARE_JSON_TYPE(LedgerSyncStats);
+  DECLARE_JSON_REQUIRED_FIELDS(
+    LedgerSyncStats, syncs, entries, total_us, max_us);
+
+  // Byte-capped cache of the most recently written framed entries, so that
+  // entries replicated to followers shortly after being written are not read
+  // back from the ledger files, once per follower. Only a contiguous suffix of
+  // the ledger is cached: the oldest entries are evicted first.
+  class LedgerEntryCache
+  {
+  private:
+    static constexpr size_t frame_header_size = sizeof(uint32_t);
+
+    const size_t max_bytes;
+
+    // Index of the first entry in entries
+    size_t start_idx = 1;
+    std::deque<std::vector<uint8_t>> entries;
+    size_t total_bytes = 0;
+
+    LedgerEntryCacheStats stats;
+
+    size_t end_idx() const
+    {
+      return start_idx + entries.size();
+    }
+
+    void evict_front()
+    {
+      total_bytes -= entries.front().size();
+      entries.pop_front();
+      start_idx++;
+    }
+
+  public:
+    LedgerEntryCache(size_t max_bytes) : max_bytes(max_bytes) {}
+
+    void clear(size_t next_idx)
+    {
+      entries.clear();
+      total_bytes = 0;
+      start_idx = next_idx;
+    }
+
+    void append(size_t idx, const uint8_t* data, size_t size)
+    {
+      const auto framed_size = size + frame_header_size;
+      if (idx != end_idx() || framed_size > max_bytes)
+      {
+        // Entries must be contiguous. Entries too large to be cached reset the
+        // cache, which restarts after them.
+        clear(idx + 1);
+        if (framed_size > max_bytes)
+        {
+          return;
+        }
+      }
+
+      std::vector<uint8_t> framed(framed_size);
+      uint32_t frame = (uint32_t)size;
+      std::memcpy(framed.data(), &frame, frame_header_size);
+      std::memcpy(framed.data() + frame_header_size, data, size);
+
+      total_bytes += framed_size;
+      entries.emplace_back(std::move(framed));
+
+      while (total_bytes > max_bytes)
+      {
+        evict_front();
+      }
+    }
+
+    void truncate(size_t idx)
+    {
+      while (!entries.empty() && end_idx() - 1 > idx)
+      {
+        total_bytes -= entries.back().size();
+        entries.pop_back();
+      }
+
+      if (entries.empty())
+      {
+        start_idx = idx + 1;
+      }
+    }
+
+    bool contains(size_t from, size_t to) const
+    {
+      return !entries.empty() && from >= start_idx && to < end_idx() &&
+        from <= to;
+    }
+
+    std::optional<std::vector<uint8_t>> read_framed_entries(
+      size_t from, size_t to)
+    {
+      if (!contains(from, to))
+      {
+        stats.misses++;
+        return std::nullopt;
+      }
+
+      stats.hits++;
+
+      size_t framed_size = 0;
+      for (auto idx = from; idx <= to; ++idx)
+      {
+        framed_size += entries[idx - start_idx].size();
+      }
+
+      std::vector<uint8_t> framed_entries;
+      framed_entries.reserve(framed_size);
+      for (auto idx = from; idx <= to; ++idx)
+      {
+        const auto& e = entries[idx - start_idx];
+        framed_entries.insert(framed_entries.end(), e.begin(), e.end());
+      }
+
+      return framed_entries;
+    }
+
+    LedgerEntryCacheStats get_stats() const
+    {
+      auto s = stats;
+      s.entries = entries.size();
+      s.bytes = total_bytes;
+      return s;
+    }
+  };
+
   class Ledger
   {
   private:
     static constexpr size_t max_chunk_threshold_size =
       std::numeric_limits<uint32_t>::max(); // 4GB
+    static constexpr size_t frame_header_size = sizeof(uint32_t);
 
     ringbuffer::WriterPtr to_enclave;
 
@@ -514,6 +870,10 @@ namespace asynchost
     size_t max_read_cache_files;
     std::list<std::shared_ptr<LedgerFile>> files_read_cache;
 
+    // Cache of the most recently written entries, shared by all readers of
+    // framed entries (e.g. append entries to each follower)
+    LedgerEntryCache entry_cache;
+
     const size_t chunk_threshold;
     size_t last_idx = 0;
     size_t committed_idx = 0;
@@ -521,6 +881,93 @@ namespace asynchost
     // True if a new file should be created when writing an entry
     bool require_new_file;
 
+    // In durable mode, written entries are flushed to disk with fdatasync()
+    // before being reported to the enclave as persisted. Unless sync_on_write
+    // is set, entries are synced in batches by periodic calls to sync() (group
+    // commit) rather than as each committable entry is written.
+    bool durable = false;
+    bool sync_on_write = false;
+    bool sync_pending = false;
+    bool dir_sync_pending = false;
+    size_t synced_idx = 0;
+    LedgerSyncStats sync_stats;
+
+    // Number of truncations requested by the enclave, reported alongside the
+    // persisted index so that the enclave can discard stale reports
+    size_t truncations = 0;
+
+    // Serialises file I/O, and the file state above, between the thread
+    // writing to the ledger and readers of ledger files
+    std::mutex io_lock;
+
+    // Guards the entry cache and the queued entries below, so that readers
+    // served from memory do not wait for file I/O. Acquired after io_lock.
+    std::mutex state_lock;
+
+    // Asynchronous writes: once the I/O thread is started, modifications are
+    // queued by the caller (i.e. the uv loop) and applied in order by the I/O
+    // thread, so that disk I/O does not stall the caller. Queued entries are
+    // visible to readers straight away, served from memory. Persistence
+    // reports and errors are posted back to the caller, via
+    // process_completions().
+    struct LedgerWriteOp
+    {
+      enum class Type
+      {
+        Append,
+        Truncate,
+        Commit,
+        Init,
+        Sync
+      };
+
+      Type type;
+      size_t idx = 0;
+      bool committable = false;
+      bool force_chunk = false;
+      std::vector<uint8_t> data = {};
+    };
+
+    std::thread io_thread;
+    std::mutex queue_lock;
+    std::condition_variable io_cv;
+    std::deque<LedgerWriteOp> io_queue;
+    bool io_stop = false;
+    std::function<void()> notify_completions = nullptr;
+    std::vector<std::pair<size_t, size_t>> persisted_reports;
+    std::exception_ptr io_error = nullptr;
+
+    // Last and committed index once all queued operations are applied. Only
+    // accessed by the caller.
+    size_t queued_last_idx = 0;
+    size_t queued_committed_idx = 0;
+
+    // True if operations that need a sync have been queued since the last
+    // queued sync. Only accessed by the caller.
+    bool queued_sync_pending = false;
+
+    // Entries appended by queued operations and not yet written, in index
+    // order from queued_start_idx, pointing into io_queue. Entries before
+    // queued_start_idx are read from the ledger. Guarded by state_lock.
+    std::deque<const std::vector<uint8_t>*> queued_entries;
+    size_t queued_start_idx = 1;
+
+    // Entries streamed to the enclave (e.g. during recovery) are read and
+    // sent ahead in batches, rather than requested one by one, so that the
+    // enclave does not wait for the host after each entry. A batch is sent
+    // whenever the bytes sent but not yet acknowledged by the enclave are
+    // below the budget requested by the enclave. Only accessed by the caller.
+    static constexpr size_t max_stream_batch_bytes = 1024 * 1024; // 1MB
+
+    struct LedgerStream
+    {
+      size_t next_idx;
+      consensus::LedgerRequestPurpose purpose;
+      size_t max_in_flight_bytes;
+      size_t in_flight_bytes = 0;
+    };
+    std::optional<LedgerStream> stream = std::nullopt;
+
     auto get_it_contains_idx(size_t idx) const
     {
       if (idx == 0)
@@ -628,44 +1075,689 @@ namespace asynchost
       return files.back();
     }
 
-  public:
-    Ledger(
-      const std::string& ledger_dir,
-      ringbuffer::AbstractWriterFactory& writer_factory,
-      size_t chunk_threshold,
-      size_t max_read_cache_files = ledger_max_read_cache_files_default,
-      std::vector<std::string> read_ledger_dirs = {}) :
-      to_enclave(writer_factory.create_writer_to_inside()),
-      ledger_dir(ledger_dir),
-      read_ledger_dirs(read_ledger_dirs),
-      max_read_cache_files(max_read_cache_files),
-      chunk_threshold(chunk_threshold)
+    void sync_ledger_dir()
     {
-      if (chunk_threshold == 0 || chunk_threshold > max_chunk_threshold_size)
+      // Makes the creation and deletion of ledger files durable
+      auto fd = open(ledger_dir.c_str(), O_RDONLY | O_DIRECTORY);
+      if (fd == -1)
       {
         throw std::logic_error(fmt::format(
-          "Error: Ledger chunk threshold should be between 1-{}",
-          max_chunk_threshold_size));
+          "Failed to open ledger directory {}: {}",
+          ledger_dir,
+          strerror(errno)));
       }
 
-      // Recover last idx from read-only ledger directories
-      for (const auto& read_dir : read_ledger_dirs)
+      auto rc = fsync(fd);
+      close(fd);
+      if (rc != 0)
       {
-        LOG_DEBUG_FMT("Recovering read-only ledger directory \"{}\"", read_dir);
-        if (!fs::is_directory(read_dir))
+        throw std::logic_error(fmt::format(
+          "Failed to sync ledger directory {}: {}",
+          ledger_dir,
+          strerror(errno)));
+      }
+    }
+
+    void init_unsafe(size_t idx)
+    {
+      // Used to initialise the ledger when starting from a non-empty state,
+      // i.e. snapshot. It is assumed that idx is included in a committed ledger
+      // file
+
+      // As it is possible that some ledger files containing indices later than
+      // snapshot index already exist (e.g. to verify the snapshot evidence),
+      // delete those so that ledger can restart neatly.
+      bool has_deleted = false;
+      for (auto const& f : fs::directory_iterator(ledger_dir))
+      {
+        auto file_name = f.path().filename();
+        if (get_start_idx_from_file_name(file_name) > idx)
         {
-          throw std::logic_error(fmt::format(
-            "\"{}\" read-only ledger is not a directory", read_dir));
+          LOG_INFO_FMT(
+            "Deleting {} file as it is later than init index {}",
+            file_name,
+            idx);
+          fs::remove(f);
+          has_deleted = true;
         }
+      }
 
-        for (auto const& f : fs::directory_iterator(read_dir))
-        {
-          auto last_idx_ = get_last_idx_from_file_name(f.path().filename());
-          if (!last_idx_.has_value())
-          {
-            LOG_DEBUG_FMT(
-              "Read-only ledger file {} is ignored as not committed",
-              f.path().filename());
+      if (has_deleted)
+      {
+        files.clear();
+        require_new_file = true;
+      }
+
+      LOG_DEBUG_FMT("Setting last known index to {}", idx);
+      last_idx = idx;
+      synced_idx = idx;
+
+      std::lock_guard<std::mutex> guard(state_lock);
+      entry_cache.clear(last_idx + 1);
+    }
+
+    // Part of a read from the ledger: either a view of data already in memory
+    // or of a mapped committed file, or a range of entries of an uncommitted
+    // file, only read once io_lock is released so that readers do not wait
+    // for the writer
+    struct ReadPart
+    {
+      std::optional<LedgerReadView> view = std::nullopt;
+      std::shared_ptr<LedgerFile> file = nullptr;
+      size_t from = 0;
+      size_t to = 0;
+    };
+    using ReadParts = std::vector<ReadPart>;
+
+    // Must be called without io_lock
+    static std::optional<LedgerReadViews> complete_read(
+      std::optional<ReadParts>&& parts)
+    {
+      if (!parts.has_value())
+      {
+        return std::nullopt;
+      }
+
+      LedgerReadViews views;
+      for (auto& part : parts.value())
+      {
+        if (part.view.has_value())
+        {
+          views.push_back(std::move(part.view.value()));
+          continue;
+        }
+
+        auto v = part.file->read_framed_entries(part.from, part.to);
+        if (!v.has_value())
+        {
+          return std::nullopt;
+        }
+        views.push_back(LedgerReadView::owning(std::move(v.value())));
+      }
+      return views;
+    }
+
+    // Returns the view of a committed entry, or the file the entry should be
+    // read from, without io_lock
+    std::optional<ReadPart> read_entry_unsafe(size_t idx)
+    {
+      auto f = get_file_from_idx(idx);
+      if (f == nullptr)
+      {
+        return std::nullopt;
+      }
+
+      if (f->is_committed())
+      {
+        auto framed = f->read_framed_entries_view(idx, idx);
+        if (!framed.has_value() || framed->size < frame_header_size)
+        {
+          return std::nullopt;
+        }
+        return ReadPart{LedgerReadView{f,
+                                       framed->data + frame_header_size,
+                                       framed->size - frame_header_size}};
+      }
+
+      return ReadPart{std::nullopt, f, idx, idx};
+    }
+
+    std::optional<ReadParts> read_framed_entries_unsafe(size_t from, size_t to)
+    {
+      // Entries recently written are served from memory. Only lagging readers
+      // fall back to reading from ledger files.
+      auto cached = entry_cache.read_framed_entries(from, to);
+      if (cached.has_value())
+      {
+        return ReadParts{{LedgerReadView::owning(std::move(*cached))}};
+      }
+
+      ReadParts parts;
+      size_t idx = from;
+      while (idx <= to)
+      {
+        auto f_from = get_file_from_idx(idx);
+        if (f_from == nullptr)
+        {
+          return std::nullopt;
+        }
+        auto to_ = std::min(f_from->get_last_idx(), to);
+
+        // Committed files are read in place, others are copied later
+        if (f_from->is_committed())
+        {
+          auto v = f_from->read_framed_entries_view(idx, to_);
+          if (!v.has_value())
+          {
+            return std::nullopt;
+          }
+          parts.push_back({LedgerReadView{f_from, v->data, v->size}});
+        }
+        else
+        {
+          parts.push_back({std::nullopt, f_from, idx, to_});
+        }
+        idx = to_ + 1;
+      }
+
+      return parts;
+    }
+
+    // Returns the last index of the largest batch of entries starting at
+    // from, within a single file, whose framed size is at most max_bytes. A
+    // batch holds at least one entry.
+    size_t framed_batch_end(size_t from, size_t max_bytes)
+    {
+      std::lock_guard<std::mutex> guard(io_lock);
+      auto f = get_file_from_idx(from);
+      if (f == nullptr)
+      {
+        // e.g. entry not yet written by the I/O thread
+        return from;
+      }
+
+      size_t lo = from;
+      size_t hi = f->get_last_idx();
+      while (lo < hi)
+      {
+        const auto mid = lo + (hi - lo + 1) / 2;
+        if (f->framed_entries_size(from, mid) <= max_bytes)
+        {
+          lo = mid;
+        }
+        else
+        {
+          hi = mid - 1;
+        }
+      }
+      return lo;
+    }
+
+    // Sends batches of the stream until its budget is used up, or the end of
+    // the ledger is reached
+    void pump_stream()
+    {
+      while (stream.has_value() &&
+             stream->in_flight_bytes < stream->max_in_flight_bytes)
+      {
+        const auto from = stream->next_idx;
+        const auto purpose = stream->purpose;
+        const auto max_bytes = std::min(
+          max_stream_batch_bytes,
+          stream->max_in_flight_bytes - stream->in_flight_bytes);
+
+        std::optional<LedgerReadViews> views = std::nullopt;
+        size_t to = from;
+        if (from <= get_last_idx())
+        {
+          to = std::min(framed_batch_end(from, max_bytes), get_last_idx());
+          views = read_framed_entries_views(from, to);
+        }
+
+        if (!views.has_value() || views->empty())
+        {
+          LOG_DEBUG_FMT("End of ledger stream at {}", from);
+          RINGBUFFER_WRITE_MESSAGE(
+            consensus::ledger_no_entry, to_enclave, from, purpose);
+          stream.reset();
+          return;
+        }
+
+        // A batch from a committed file is sent straight from the file
+        auto batch = views->size() == 1 ?
+          views->front() :
+          LedgerReadView::owning(flatten(views.value()));
+        RINGBUFFER_WRITE_MESSAGE(
+          consensus::ledger_entries,
+          to_enclave,
+          from,
+          to,
+          purpose,
+          serializer::ByteRange{batch.data, batch.size});
+
+        stream->in_flight_bytes += batch.size;
+        stream->next_idx = to + 1;
+      }
+    }
+
+    // Only called by the writing thread. io_lock is held to update the state
+    // of the ledger, but not while the entry is written, so that readers of
+    // other entries do not wait for the write.
+    size_t write_entry_to_file(
+      const uint8_t* data, size_t size, bool committable, bool force_chunk)
+    {
+      std::shared_ptr<LedgerFile> f;
+      {
+        std::lock_guard<std::mutex> guard(io_lock);
+        if (require_new_file)
+        {
+          files.push_back(
+            std::make_shared<LedgerFile>(ledger_dir, last_idx + 1));
+          require_new_file = false;
+          dir_sync_pending = durable;
+        }
+        f = get_latest_file();
+      }
+
+      const auto idx = f->write_entry(data, size, committable);
+
+      LOG_DEBUG_FMT(
+        "Wrote entry at {} [committable: {}, forced: {}]",
+        idx,
+        committable,
+        force_chunk);
+
+      const bool complete_chunk = committable &&
+        (force_chunk || f->get_current_size() >= chunk_threshold);
+      if (complete_chunk)
+      {
+        f->complete();
+        if (durable)
+        {
+          // Subsequent syncs only cover the latest file
+          f->sync();
+        }
+        LOG_DEBUG_FMT("Ledger chunk completed at {}", idx);
+      }
+
+      std::lock_guard<std::mutex> guard(io_lock);
+      last_idx = idx;
+      {
+        std::lock_guard<std::mutex> guard(state_lock);
+        entry_cache.append(last_idx, data, size);
+      }
+
+      // Only committable entries need to be reported as persisted, as
+      // consensus never commits to other entries
+      if (durable && committable)
+      {
+        sync_pending = true;
+      }
+
+      if (complete_chunk)
+      {
+        require_new_file = true;
+      }
+
+      return last_idx;
+    }
+
+    void truncate_unsafe(size_t idx)
+    {
+      LOG_DEBUG_FMT("Ledger truncate: {}/{}", idx, last_idx);
+
+      // All truncation requests are counted, even no-ops, so that the count
+      // matches the enclave's
+      truncations++;
+      if (durable)
+      {
+        // Report the new truncation count, even if no entries are removed
+        sync_pending = true;
+      }
+
+      if (idx >= last_idx || idx < committed_idx)
+      {
+        return;
+      }
+
+      require_new_file = true;
+      {
+        std::lock_guard<std::mutex> guard(state_lock);
+        entry_cache.truncate(idx);
+      }
+
+      auto f_from = get_it_contains_idx(idx + 1);
+      auto f_to = get_it_contains_idx(last_idx);
+      auto f_end = std::next(f_to);
+
+      for (auto it = f_from; it != f_end;)
+      {
+        // Truncate the first file to the truncation index while the more recent
+        // files are deleted entirely
+        auto truncate_idx = (it == f_from) ? idx : (*it)->get_start_idx() - 1;
+        if ((*it)->truncate(truncate_idx))
+        {
+          auto it_ = it;
+          it++;
+          files.erase(it_);
+          dir_sync_pending = durable;
+        }
+        else
+        {
+          // A new file will not be required on the next written entry if the
+          // file is _not_ deleted entirely
+          require_new_file = false;
+          it++;
+        }
+      }
+
+      last_idx = idx;
+      synced_idx = std::min(synced_idx, idx);
+    }
+
+    void commit_unsafe(size_t idx)
+    {
+      LOG_DEBUG_FMT("Ledger commit: {}/{}", idx, last_idx);
+
+      if (idx <= committed_idx)
+      {
+        return;
+      }
+
+      auto f_from = (committed_idx == 0) ? get_it_contains_idx(1) :
+                                           get_it_contains_idx(committed_idx);
+      auto f_to = get_it_contains_idx(idx);
+      auto f_end = std::next(f_to);
+
+      for (auto it = f_from; it != f_end;)
+      {
+        // Commit all previous file to their latest index while the latest
+        // file is committed to the committed index
+        auto commit_idx = (it == f_to) ? idx : (*it)->get_last_idx();
+        if (
+          (*it)->commit(commit_idx) &&
+          (it != f_to || (idx == (*it)->get_last_idx())))
+        {
+          auto it_ = it;
+          it++;
+          files.erase(it_);
+        }
+        else
+        {
+          it++;
+        }
+      }
+
+      committed_idx = idx;
+    }
+
+    void sync_unlocked()
+    {
+      // Only the writing thread modifies ledger files, so readers do not need
+      // to be excluded for the (slow) sync itself
+      std::shared_ptr<LedgerFile> f;
+      bool sync_dir = false;
+      size_t persisted_idx;
+      size_t persisted_truncations;
+      size_t entries;
+      {
+        std::lock_guard<std::mutex> guard(io_lock);
+        if (!durable || !sync_pending)
+        {
+          return;
+        }
+
+        f = get_latest_file();
+        if (f != nullptr)
+        {
+          f->flush();
+        }
+        sync_dir = dir_sync_pending;
+        dir_sync_pending = false;
+        sync_pending = false;
+
+        persisted_idx = last_idx;
+        persisted_truncations = truncations;
+        entries = last_idx - synced_idx;
+        synced_idx = last_idx;
+      }
+
+      const auto start = std::chrono::steady_clock::now();
+
+      if (f != nullptr)
+      {
+        f->sync();
+      }
+
+      if (sync_dir)
+      {
+        sync_ledger_dir();
+      }
+
+      const auto elapsed_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+
+      {
+        std::lock_guard<std::mutex> guard(state_lock);
+        sync_stats.syncs++;
+        sync_stats.entries += entries;
+        sync_stats.total_us += elapsed_us;
+        sync_stats.max_us = std::max<size_t>(sync_stats.max_us, elapsed_us);
+      }
+
+      LOG_TRACE_FMT(
+        "Ledger synced up to {} in {}us", persisted_idx, elapsed_us);
+
+      report_persisted(persisted_idx, persisted_truncations);
+    }
+
+    void report_persisted(size_t idx, size_t truncations_)
+    {
+      if (io_thread.joinable())
+      {
+        {
+          std::lock_guard<std::mutex> guard(queue_lock);
+          persisted_reports.emplace_back(idx, truncations_);
+        }
+        notify_completions();
+      }
+      else
+      {
+        RINGBUFFER_WRITE_MESSAGE(
+          consensus::ledger_persisted, to_enclave, idx, truncations_);
+      }
+    }
+
+    // Returns the queued operation, which remains valid until it is applied
+    const LedgerWriteOp& enqueue(LedgerWriteOp&& op)
+    {
+      const LedgerWriteOp* queued_op;
+      {
+        std::lock_guard<std::mutex> guard(queue_lock);
+        queued_op = &io_queue.emplace_back(std::move(op));
+      }
+      io_cv.notify_one();
+      return *queued_op;
+    }
+
+    void apply(const LedgerWriteOp& op)
+    {
+      switch (op.type)
+      {
+        case LedgerWriteOp::Type::Append:
+        {
+          write_entry_to_file(
+            op.data.data(), op.data.size(), op.committable, op.force_chunk);
+          if (sync_on_write)
+          {
+            sync_unlocked();
+          }
+          break;
+        }
+        case LedgerWriteOp::Type::Truncate:
+        {
+          {
+            std::lock_guard<std::mutex> guard(io_lock);
+            truncate_unsafe(op.idx);
+          }
+          if (sync_on_write)
+          {
+            sync_unlocked();
+          }
+          break;
+        }
+        case LedgerWriteOp::Type::Commit:
+        {
+          std::lock_guard<std::mutex> guard(io_lock);
+          commit_unsafe(op.idx);
+          break;
+        }
+        case LedgerWriteOp::Type::Init:
+        {
+          std::lock_guard<std::mutex> guard(io_lock);
+          init_unsafe(op.idx);
+          break;
+        }
+        case LedgerWriteOp::Type::Sync:
+        {
+          sync_unlocked();
+          break;
+        }
+      }
+    }
+
+    void io_thread_loop()
+    {
+      while (true)
+      {
+        const LedgerWriteOp* op;
+        {
+          std::unique_lock<std::mutex> guard(queue_lock);
+          io_cv.wait(guard, [this]() { return io_stop || !io_queue.empty(); });
+          if (io_queue.empty())
+          {
+            return;
+          }
+          // References to deque elements remain valid as new operations are
+          // pushed to the back
+          op = &io_queue.front();
+        }
+
+        try
+        {
+          apply(*op);
+        }
+        catch (...)
+        {
+          {
+            std::lock_guard<std::mutex> guard(queue_lock);
+            io_error = std::current_exception();
+          }
+          notify_completions();
+        }
+
+        // Entries are only dequeued once written, so that readers find each
+        // either in the queue or in the ledger
+        {
+          std::lock_guard<std::mutex> guard(state_lock);
+          if (!queued_entries.empty() && queued_entries.front() == &op->data)
+          {
+            queued_entries.pop_front();
+            queued_start_idx++;
+          }
+        }
+
+        std::lock_guard<std::mutex> guard(queue_lock);
+        io_queue.pop_front();
+      }
+    }
+
+    // Requires state_lock
+    std::optional<LedgerReadView> read_queued_entry_unsafe(size_t idx) const
+    {
+      if (idx - queued_start_idx >= queued_entries.size())
+      {
+        return std::nullopt;
+      }
+      return LedgerReadView::owning(
+        std::vector<uint8_t>(*queued_entries[idx - queued_start_idx]));
+    }
+
+    // Reads entries before queued_start_idx from the ledger, from the entry
+    // cache or, if read_files is set, from ledger files, and later entries
+    // from the queue. Requires state_lock, and io_lock if read_files is set.
+    // Ranges of uncommitted files are left to complete_read().
+    std::optional<ReadParts> read_queued_framed_entries_unsafe(
+      size_t from, size_t to, bool read_files)
+    {
+      ReadParts parts;
+      if (from < queued_start_idx)
+      {
+        const auto to_ = std::min(to, queued_start_idx - 1);
+        if (read_files)
+        {
+          auto written = read_framed_entries_unsafe(from, to_);
+          if (!written.has_value())
+          {
+            return std::nullopt;
+          }
+          parts = std::move(written.value());
+        }
+        else if (entry_cache.contains(from, to_))
+        {
+          parts.push_back({LedgerReadView::owning(
+            std::move(entry_cache.read_framed_entries(from, to_).value()))});
+        }
+        else
+        {
+          return std::nullopt;
+        }
+      }
+
+      if (to >= queued_start_idx)
+      {
+        if (to - queued_start_idx >= queued_entries.size())
+        {
+          return std::nullopt;
+        }
+
+        std::vector<uint8_t> entries;
+        for (auto idx = std::max(from, queued_start_idx); idx <= to; ++idx)
+        {
+          const auto& data = *queued_entries[idx - queued_start_idx];
+          uint32_t frame = (uint32_t)data.size();
+          auto frame_ = reinterpret_cast<const uint8_t*>(&frame);
+          entries.insert(entries.end(), frame_, frame_ + sizeof(frame));
+          entries.insert(entries.end(), data.begin(), data.end());
+        }
+        parts.push_back({LedgerReadView::owning(std::move(entries))});
+      }
+
+      return parts;
+    }
+
+  public:
+    Ledger(
+      const std::string& ledger_dir,
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      size_t chunk_threshold,
+      size_t max_read_cache_files = ledger_max_read_cache_files_default,
+      std::vector<std::string> read_ledger_dirs = {},
+      size_t max_entry_cache_bytes = ledger_max_entry_cache_bytes_default) :
+      to_enclave(writer_factory.create_writer_to_inside()),
+      ledger_dir(ledger_dir),
+      read_ledger_dirs(read_ledger_dirs),
+      max_read_cache_files(max_read_cache_files),
+      entry_cache(max_entry_cache_bytes),
+      chunk_threshold(chunk_threshold)
+    {
+      if (chunk_threshold == 0 || chunk_threshold > max_chunk_threshold_size)
+      {
+        throw std::logic_error(fmt::format(
+          "Error: Ledger chunk threshold should be between 1-{}",
+          max_chunk_threshold_size));
+      }
+
+      // Recover last idx from read-only ledger directories
+      for (const auto& read_dir : read_ledger_dirs)
+      {
+        LOG_DEBUG_FMT("Recovering read-only ledger directory \"{}\"", read_dir);
+        if (!fs::is_directory(read_dir))
+        {
+          throw std::logic_error(fmt::format(
+            "\"{}\" read-only ledger is not a directory", read_dir));
+        }
+
+        for (auto const& f : fs::directory_iterator(read_dir))
+        {
+          auto last_idx_ = get_last_idx_from_file_name(f.path().filename());
+          if (!last_idx_.has_value())
+          {
+            LOG_DEBUG_FMT(
+              "Read-only ledger file {} is ignored as not committed",
+              f.path().filename());
             continue;
           }
 
@@ -789,193 +1881,327 @@ namespace asynchost
         "Recovered ledger entries up to {}, committed to {}",
         last_idx,
         committed_idx);
+
+      entry_cache.clear(last_idx + 1);
     }
 
     Ledger(const Ledger& that) = delete;
 
-    void init(size_t idx)
+    ~Ledger()
     {
-      // Used to initialise the ledger when starting from a non-empty state,
-      // i.e. snapshot. It is assumed that idx is included in a committed ledger
-      // file
+      if (io_thread.joinable())
+      {
+        // Queued operations are applied before the I/O thread exits
+        {
+          std::lock_guard<std::mutex> guard(queue_lock);
+          io_stop = true;
+        }
+        io_cv.notify_one();
+        io_thread.join();
+      }
+    }
 
-      // As it is possible that some ledger files containing indices later than
-      // snapshot index already exist (e.g. to verify the snapshot evidence),
-      // delete those so that ledger can restart neatly.
-      bool has_deleted = false;
-      for (auto const& f : fs::directory_iterator(ledger_dir))
+    void start_io_thread(std::function<void()> notify_completions_)
+    {
+      // From now on, modifications to the ledger are queued and applied in
+      // order by a dedicated I/O thread. notify_completions_ is called from
+      // that thread whenever process_completions() should be called.
+      notify_completions = notify_completions_;
+      queued_last_idx = last_idx;
+      queued_committed_idx = committed_idx;
+      queued_start_idx = last_idx + 1;
+      io_thread = std::thread(&Ledger::io_thread_loop, this);
+    }
+
+    void process_completions()
+    {
+      std::vector<std::pair<size_t, size_t>> reports;
+      std::exception_ptr error = nullptr;
       {
-        auto file_name = f.path().filename();
-        if (get_start_idx_from_file_name(file_name) > idx)
+        std::lock_guard<std::mutex> guard(queue_lock);
+        std::swap(reports, persisted_reports);
+        std::swap(error, io_error);
+      }
+
+      if (error != nullptr)
+      {
+        std::rethrow_exception(error);
+      }
+
+      for (const auto& [idx, truncations_] : reports)
+      {
+        RINGBUFFER_WRITE_MESSAGE(
+          consensus::ledger_persisted, to_enclave, idx, truncations_);
+      }
+    }
+
+    size_t get_io_queue_size()
+    {
+      std::lock_guard<std::mutex> guard(queue_lock);
+      return io_queue.size();
+    }
+
+    void init(size_t idx)
+    {
+      if (io_thread.joinable())
+      {
+        queued_last_idx = idx;
         {
-          LOG_INFO_FMT(
-            "Deleting {} file as it is later than init index {}",
-            file_name,
-            idx);
-          fs::remove(f);
-          has_deleted = true;
+          std::lock_guard<std::mutex> guard(state_lock);
+          queued_entries.clear();
+          queued_start_idx = idx + 1;
         }
+        enqueue({LedgerWriteOp::Type::Init, idx});
+        return;
       }
 
-      if (has_deleted)
+      std::lock_guard<std::mutex> guard(io_lock);
+      init_unsafe(idx);
+    }
+
+    void set_durable(bool sync_on_write_)
+    {
+      // Entries already on disk when durability is enabled are considered
+      // persisted
+      std::lock_guard<std::mutex> guard(io_lock);
+      durable = true;
+      sync_on_write = sync_on_write_;
+      synced_idx = last_idx;
+    }
+
+    // Syncs the entries written since the last sync. Once the I/O thread is
+    // started, the sync is queued, and only if anything needs syncing.
+    void sync()
+    {
+      if (io_thread.joinable())
       {
-        files.clear();
-        require_new_file = true;
+        if (queued_sync_pending)
+        {
+          queued_sync_pending = false;
+          enqueue({LedgerWriteOp::Type::Sync});
+        }
+        return;
       }
 
-      LOG_DEBUG_FMT("Setting last known index to {}", idx);
-      last_idx = idx;
+      sync_unlocked();
+    }
+
+    LedgerSyncStats get_sync_stats()
+    {
+      std::lock_guard<std::mutex> guard(state_lock);
+      return sync_stats;
     }
 
     size_t get_last_idx() const
     {
-      return last_idx;
+      return io_thread.joinable() ? queued_last_idx : last_idx;
+    }
+
+    std::optional<LedgerReadView> read_entry_view(size_t idx)
+    {
+      if (io_thread.joinable())
+      {
+        // Entries not yet written by the I/O thread are served from the queue
+        std::lock_guard<std::mutex> guard(state_lock);
+        if (idx >= queued_start_idx)
+        {
+          return read_queued_entry_unsafe(idx);
+        }
+      }
+
+      ReadPart part;
+      {
+        std::lock_guard<std::mutex> io_guard(io_lock);
+        std::lock_guard<std::mutex> guard(state_lock);
+        if (io_thread.joinable() && idx >= queued_start_idx)
+        {
+          // Truncated and queued again meanwhile
+          return read_queued_entry_unsafe(idx);
+        }
+        auto p = read_entry_unsafe(idx);
+        if (!p.has_value())
+        {
+          return std::nullopt;
+        }
+        if (p->view.has_value())
+        {
+          return p->view;
+        }
+        part = std::move(p.value());
+      }
+
+      // The file may be written to meanwhile, but only past this entry
+      auto entry = part.file->read_entry(idx);
+      if (!entry.has_value())
+      {
+        return std::nullopt;
+      }
+      return LedgerReadView::owning(std::move(entry.value()));
     }
 
     std::optional<std::vector<uint8_t>> read_entry(size_t idx)
     {
-      auto f = get_file_from_idx(idx);
-      if (f == nullptr)
+      auto view = read_entry_view(idx);
+      if (!view.has_value())
       {
         return std::nullopt;
       }
-      return f->read_entry(idx);
+      return std::vector<uint8_t>(view->data, view->data + view->size);
     }
 
-    std::optional<std::vector<uint8_t>> read_framed_entries(
+    std::optional<LedgerReadViews> read_framed_entries_views(
       size_t from, size_t to)
     {
-      if ((from <= 0) || (to > last_idx) || (to < from))
+      if ((from <= 0) || (to > get_last_idx()) || (to < from))
       {
         return std::nullopt;
       }
 
-      std::vector<uint8_t> entries;
-      size_t idx = from;
-      while (idx <= to)
+      std::optional<ReadParts> parts;
+      if (!io_thread.joinable())
       {
-        auto f_from = get_file_from_idx(idx);
-        if (f_from == nullptr)
         {
-          return std::nullopt;
+          std::lock_guard<std::mutex> io_guard(io_lock);
+          std::lock_guard<std::mutex> guard(state_lock);
+          parts = read_framed_entries_unsafe(from, to);
         }
-        auto to_ = std::min(f_from->get_last_idx(), to);
-        auto v = f_from->read_framed_entries(idx, to_);
-        if (!v.has_value())
+        return complete_read(std::move(parts));
+      }
+
+      // Entries not yet written by the I/O thread are served from the queue,
+      // and recent ones from the entry cache, without waiting for file I/O
+      {
+        std::lock_guard<std::mutex> guard(state_lock);
+        parts = read_queued_framed_entries_unsafe(from, to, false);
+        if (parts.has_value())
         {
-          return std::nullopt;
+          return complete_read(std::move(parts));
         }
-        entries.insert(
-          entries.end(),
-          std::make_move_iterator(v->begin()),
-          std::make_move_iterator(v->end()));
-        idx = to_ + 1;
       }
 
-      return entries;
+      // Others are read from ledger files, which the I/O thread may be
+      // writing to. Files are only looked up under io_lock, and read after
+      // it is released.
+      {
+        std::lock_guard<std::mutex> io_guard(io_lock);
+        std::lock_guard<std::mutex> guard(state_lock);
+        parts = read_queued_framed_entries_unsafe(from, to, true);
+      }
+      return complete_read(std::move(parts));
+    }
+
+    std::optional<std::vector<uint8_t>> read_framed_entries(
+      size_t from, size_t to)
+    {
+      auto views = read_framed_entries_views(from, to);
+      if (!views.has_value())
+      {
+        return std::nullopt;
+      }
+      return flatten(views.value());
     }
 
     size_t write_entry(
       const uint8_t* data, size_t size, bool committable, bool force_chunk)
     {
-      if (require_new_file)
+      if (io_thread.joinable())
       {
-        files.push_back(std::make_shared<LedgerFile>(ledger_dir, last_idx + 1));
-        require_new_file = false;
+        // The entry is queued for readers before the I/O thread can write it
+        std::lock_guard<std::mutex> guard(state_lock);
+        const auto& op = enqueue({LedgerWriteOp::Type::Append,
+                                  ++queued_last_idx,
+                                  committable,
+                                  force_chunk,
+                                  {data, data + size}});
+        queued_entries.push_back(&op.data);
+        queued_sync_pending |= durable && committable && !sync_on_write;
+        return queued_last_idx;
       }
-      auto f = get_latest_file();
-      last_idx = f->write_entry(data, size, committable);
-
-      LOG_DEBUG_FMT(
-        "Wrote entry at {} [committable: {}, forced: {}]",
-        last_idx,
-        committable,
-        force_chunk);
 
-      if (
-        committable &&
-        (force_chunk || f->get_current_size() >= chunk_threshold))
+      const auto idx =
+        write_entry_to_file(data, size, committable, force_chunk);
+      if (sync_on_write)
       {
-        f->complete();
-        require_new_file = true;
-        LOG_DEBUG_FMT("Ledger chunk completed at {}", last_idx);
+        sync_unlocked();
       }
-
-      return last_idx;
+      return idx;
     }
 
     void truncate(size_t idx)
     {
-      LOG_DEBUG_FMT("Ledger truncate: {}/{}", idx, last_idx);
-
-      if (idx >= last_idx || idx < committed_idx)
+      if (io_thread.joinable())
       {
+        if (idx < queued_last_idx && idx >= queued_committed_idx)
+        {
+          queued_last_idx = idx;
+
+          // Entries after idx, queued or written, are no longer read
+          std::lock_guard<std::mutex> guard(state_lock);
+          queued_start_idx = std::min(queued_start_idx, idx + 1);
+          queued_entries.resize(idx + 1 - queued_start_idx);
+        }
+        enqueue({LedgerWriteOp::Type::Truncate, idx});
+        queued_sync_pending |= durable && !sync_on_write;
         return;
       }
 
-      require_new_file = true;
-
-      auto f_from = get_it_contains_idx(idx + 1);
-      auto f_to = get_it_contains_idx(last_idx);
-      auto f_end = std::next(f_to);
-
-      for (auto it = f_from; it != f_end;)
       {
-        // Truncate the first file to the truncation index while the more recent
-        // files are deleted entirely
-        auto truncate_idx = (it == f_from) ? idx : (*it)->get_start_idx() - 1;
-        if ((*it)->truncate(truncate_idx))
-        {
-          auto it_ = it;
-          it++;
-          files.erase(it_);
-        }
-        else
-        {
-          // A new file will not be required on the next written entry if the
-          // file is _not_ deleted entirely
-          require_new_file = false;
-          it++;
-        }
+        std::lock_guard<std::mutex> guard(io_lock);
+        truncate_unsafe(idx);
+      }
+      if (sync_on_write)
+      {
+        sync_unlocked();
       }
-
-      last_idx = idx;
     }
 
     void commit(size_t idx)
     {
-      LOG_DEBUG_FMT("Ledger commit: {}/{}", idx, last_idx);
-
-      if (idx <= committed_idx)
+      if (io_thread.joinable())
       {
+        queued_committed_idx = std::max(queued_committed_idx, idx);
+        enqueue({LedgerWriteOp::Type::Commit, idx});
         return;
       }
 
-      auto f_from = (committed_idx == 0) ? get_it_contains_idx(1) :
-                                           get_it_contains_idx(committed_idx);
-      auto f_to = get_it_contains_idx(idx);
-      auto f_end = std::next(f_to);
+      std::lock_guard<std::mutex> guard(io_lock);
+      commit_unsafe(idx);
+    }
 
-      for (auto it = f_from; it != f_end;)
+    /// Starts streaming entries to the enclave from index from, replacing
+    /// any stream in progress. At most max_in_flight_bytes of framed entries
+    /// are sent ahead of being acknowledged, although a single larger entry
+    /// is always sent.
+    void start_stream(
+      size_t from,
+      consensus::LedgerRequestPurpose purpose,
+      size_t max_in_flight_bytes)
+    {
+      stream = LedgerStream{from, purpose, max_in_flight_bytes};
+      pump_stream();
+    }
+
+    /// Called when the enclave has consumed bytes of the streamed batches
+    void ack_stream(size_t bytes)
+    {
+      if (!stream.has_value())
       {
-        // Commit all previous file to their latest index while the latest
-        // file is committed to the committed index
-        auto commit_idx = (it == f_to) ? idx : (*it)->get_last_idx();
-        if (
-          (*it)->commit(commit_idx) &&
-          (it != f_to || (idx == (*it)->get_last_idx())))
-        {
-          auto it_ = it;
-          it++;
-          files.erase(it_);
-        }
-        else
-        {
-          it++;
-        }
+        return;
       }
 
-      committed_idx = idx;
+      stream->in_flight_bytes -= std::min(bytes, stream->in_flight_bytes);
+      pump_stream();
+    }
+
+    void stop_stream()
+    {
+      stream.reset();
+    }
+
+    LedgerEntryCacheStats get_entry_cache_stats()
+    {
+      std::lock_guard<std::mutex> guard(state_lock);
+      return entry_cache.get_stats();
     }
 
     void register_message_handlers(
@@ -1012,17 +2238,46 @@ namespace asynchost
           commit(idx);
         });
 
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_stream_start,
+        [this](const uint8_t* data, size_t size) {
+          auto [from, purpose, max_in_flight_bytes] =
+            ringbuffer::read_message<consensus::ledger_stream_start>(
+              data, size);
+          start_stream(from, purpose, max_in_flight_bytes);
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_stream_ack,
+        [this](const uint8_t* data, size_t size) {
+          auto [bytes] =
+            ringbuffer::read_message<consensus::ledger_stream_ack>(data, size);
+          ack_stream(bytes);
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_stream_stop,
+        [this](const uint8_t*, size_t) { stop_stream(); });
+
       DISPATCHER_SET_MESSAGE_HANDLER(
         disp, consensus::ledger_get, [&](const uint8_t* data, size_t size) {
           auto [idx, purpose] =
             ringbuffer::read_message<consensus::ledger_get>(data, size);
 
-          auto entry = read_entry(idx);
+          // The entry is copied straight from the ledger file
+          auto entry = read_entry_view(idx);
 
           if (entry.has_value())
           {
             RINGBUFFER_WRITE_MESSAGE(
-              consensus::ledger_entry, to_enclave, idx, purpose, entry.value());
+              consensus::ledger_entry,
+              to_enclave,
+              idx,
+              purpose,
+              serializer::ByteRange{entry->data, entry->size});
           }
           else
           {
@@ -0,0 +1,40 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "async.h"
+#include "ledger.h"
+
+namespace asynchost
+{
+  // Processes the completions (persistence reports, errors) posted by the
+  // ledger's I/O thread, on the uv loop
+  class LedgerCompletionsImpl
+  {
+  private:
+    Ledger& ledger;
+
+  public:
+    LedgerCompletionsImpl(Ledger& ledger) : ledger(ledger) {}
+
+    void on_async()
+    {
+      ledger.process_completions();
+    }
+  };
+
+  using LedgerCompletions = proxy_ptr<Async<LedgerCompletionsImpl>>;
+
+  // Moves writes to the ledger off the uv loop, onto a dedicated I/O thread
+  inline LedgerCompletions start_ledger_io_thread(Ledger& ledger)
+  {
+    LedgerCompletions completions(ledger);
+
+    // The I/O thread holds a reference to the uv handle, so that the handle is
+    // only closed once the ledger (and its thread) has been destroyed
+    ledger.start_io_thread(
+      [completions]() mutable { completions->send(); });
+
+    return completions;
+  }
+}
@@ -0,0 +1,27 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ledger.h"
+#include "timer.h"
+
+namespace asynchost
+{
+  // Group commit: all entries written to the durable ledger within one timer
+  // period are flushed to disk by a single sync
+  class LedgerSyncImpl
+  {
+  private:
+    Ledger& ledger;
+
+  public:
+    LedgerSyncImpl(Ledger& ledger) : ledger(ledger) {}
+
+    void on_timer()
+    {
+      ledger.sync();
+    }
+  };
+
+  using LedgerSync = proxy_ptr<Timer<LedgerSyncImpl>>;
+}
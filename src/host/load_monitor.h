@@ -5,6 +5,9 @@
 #include "ds/messaging.h"
 #include "timer.h"
 
+#include <functional>
+#include <map>
+
 namespace asynchost
 {
   class LoadMonitorImpl
@@ -19,6 +22,10 @@ namespace asynchost
     std::fstream enclave_output_file;
     nlohmann::json enclave_counts;
 
+    // Additional host statistics, recorded alongside message counts
+    using StatsSource = std::function<nlohmann::json()>;
+    std::map<std::string, StatsSource> stats_sources;
+
   public:
     LoadMonitorImpl(messaging::BufferProcessor& bp) :
       dispatcher(bp.get_dispatcher())
@@ -69,6 +76,11 @@ namespace asynchost
         });
     }
 
+    void register_stats_source(const std::string& name, StatsSource source)
+    {
+      stats_sources[name] = source;
+    }
+
     void on_timer()
     {
       const auto message_counts = dispatcher.retrieve_message_counts();
@@ -87,6 +99,11 @@ namespace asynchost
           j["ringbuffer_messages"] =
             dispatcher.convert_message_counts(message_counts);
 
+          for (const auto& [name, source] : stats_sources)
+          {
+            j[name] = source();
+          }
+
           const auto line = j.dump();
           host_output_file.write(line.data(), line.size());
           host_output_file << std::endl;
@@ -96,6 +113,11 @@ namespace asynchost
           j["ringbuffer_messages"] = enclave_counts;
           enclave_counts = nlohmann::json::object();
 
+          for (const auto& [name, _] : stats_sources)
+          {
+            j.erase(name);
+          }
+
           const auto line = j.dump();
           enclave_output_file.write(line.data(), line.size());
           enclave_output_file << std::endl;
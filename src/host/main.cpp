@@ -9,6 +9,8 @@
 #include "ds/stacktrace_utils.h"
 #include "enclave.h"
 #include "handle_ring_buffer.h"
+#include "ledger_io.h"
+#include "ledger_sync.h"
 #include "load_monitor.h"
 #include "node_connections.h"
 #include "rpc_connections.h"
@@ -16,6 +18,7 @@
 #include "snapshot.h"
 #include "ticker.h"
 #include "time_updater.h"
+#include "trace_writer.h"
 #include "version.h"
 
 #include <CLI11/CLI11.hpp>
@@ -160,6 +163,44 @@ int main(int argc, char** argv)
     ->capture_default_str()
     ->transform(CLI::AsSizeValue(true)); // 1000 is kb
 
+  size_t ledger_entry_cache_bytes =
+    asynchost::ledger_max_entry_cache_bytes_default;
+  app
+    .add_option(
+      "--ledger-entry-cache-bytes",
+      ledger_entry_cache_bytes,
+      "Size (bytes) of the in-memory cache of recently written ledger "
+      "entries, used to replicate entries without reading them back from disk")
+    ->capture_default_str()
+    ->transform(CLI::AsSizeValue(true)); // 1000 is kb
+
+  bool ledger_durable = false;
+  auto ledger_durable_opt = app.add_flag(
+    "--ledger-durable",
+    ledger_durable,
+    "Flush ledger entries to disk (fdatasync) before they count towards "
+    "commit. Requires --ledger-io-thread");
+
+  size_t ledger_group_commit_ms = 1;
+  app
+    .add_option(
+      "--ledger-group-commit-ms",
+      ledger_group_commit_ms,
+      "With --ledger-durable, period (ms) over which written ledger entries "
+      "are batched into a single sync. If 0, each committable entry is synced "
+      "as it is written")
+    ->capture_default_str();
+
+  bool ledger_io_thread = false;
+  auto ledger_io_thread_opt = app.add_flag(
+    "--ledger-io-thread",
+    ledger_io_thread,
+    "Write to the ledger from a dedicated thread, rather than from the main "
+    "host thread");
+
+  // Syncs would otherwise block the main host thread
+  ledger_durable_opt->needs(ledger_io_thread_opt);
+
   size_t snapshot_tx_interval = 10'000;
   app
     .add_option(
@@ -217,6 +258,55 @@ int main(int argc, char** argv)
       "--sig-ms-interval", sig_ms_interval, "Milliseconds between signatures")
     ->capture_default_str();
 
+  size_t trace_sampling_interval = 0;
+  app
+    .add_option(
+      "--trace-sampling-interval",
+      trace_sampling_interval,
+      "Trace one in every N requests, through the host, enclave threads and "
+      "consensus. 0 disables tracing.")
+    ->capture_default_str();
+
+  size_t tls_ticket_key_rotation_s = 3600;
+  app
+    .add_option(
+      "--tls-ticket-key-rotation-s",
+      tls_ticket_key_rotation_s,
+      "Seconds between rotations of the enclave-held keys of TLS session "
+      "tickets, with which clients resume their sessions. Tickets remain "
+      "valid for two rotations. 0 disables session tickets.")
+    ->capture_default_str();
+
+  size_t admission_max_queue_depth = 64;
+  app
+    .add_option(
+      "--admission-max-queue-depth",
+      admission_max_queue_depth,
+      "Mean number of tasks queued per enclave worker thread above which the "
+      "node is overloaded, and RPC interfaces shed requests with a 503 "
+      "(governance and /commit requests are not shed). 0 ignores queue "
+      "depth.")
+    ->capture_default_str();
+
+  size_t admission_max_commit_lag = 10000;
+  app
+    .add_option(
+      "--admission-max-commit-lag",
+      admission_max_commit_lag,
+      "Number of transactions not yet committed above which the node is "
+      "overloaded, and RPC interfaces shed requests with a 503. 0 ignores "
+      "commit lag.")
+    ->capture_default_str();
+
+  std::string trace_file("trace.bin");
+  app
+    .add_option(
+      "--trace-file",
+      trace_file,
+      "Path to which request trace spans are written, if tracing is enabled. "
+      "See python/ccf/trace.py to convert them to the Chrome trace format.")
+    ->capture_default_str();
+
   size_t circuit_size_shift = 22;
   app
     .add_option(
@@ -551,16 +641,45 @@ int main(int argc, char** argv)
 
   std::vector<uint8_t> to_enclave_buffer(buffer_size);
   ringbuffer::Offsets to_enclave_offsets;
-  ringbuffer::BufferDef to_enclave_def{
-    to_enclave_buffer.data(), to_enclave_buffer.size(), &to_enclave_offsets};
+  ringbuffer::BufferDef to_enclave_def{to_enclave_buffer.data(),
+                                       to_enclave_buffer.size(),
+                                       &to_enclave_offsets,
+                                       &ringbuffer::doorbell::ring,
+                                       nullptr};
 
   std::vector<uint8_t> from_enclave_buffer(buffer_size);
   ringbuffer::Offsets from_enclave_offsets;
   ringbuffer::BufferDef from_enclave_def{from_enclave_buffer.data(),
                                          from_enclave_buffer.size(),
-                                         &from_enclave_offsets};
+                                         &from_enclave_offsets,
+                                         nullptr,
+                                         nullptr};
 
   ringbuffer::Circuit circuit(to_enclave_def, from_enclave_def);
+
+  // Each enclave worker thread has its own ringbuffer to the host, so that
+  // worker threads do not contend with each other when writing. They share the
+  // main ringbuffer's waiting mark, as they are read by the same thread.
+  std::vector<uint8_t> from_workers_buffer(num_worker_threads * buffer_size);
+  std::vector<ringbuffer::Offsets> from_workers_offsets(num_worker_threads);
+  std::vector<ringbuffer::Reader> from_workers;
+  for (size_t i = 0; i < num_worker_threads; ++i)
+  {
+    from_workers.emplace_back(
+      ringbuffer::BufferDef{from_workers_buffer.data() + i * buffer_size,
+                            (size_t)buffer_size,
+                            &from_workers_offsets[i],
+                            nullptr,
+                            &from_enclave_offsets.reader_waiting});
+  }
+
+  // Outbound messages are read from the main ringbuffer first
+  std::vector<ringbuffer::Reader*> from_enclave_readers = {
+    &circuit.read_from_inside()};
+  for (auto& r : from_workers)
+  {
+    from_enclave_readers.push_back(&r);
+  }
   messaging::BufferProcessor bp("Host");
 
   // To prevent deadlock, all blocking writes from the host to the ringbuffer
@@ -571,10 +690,12 @@ int main(int argc, char** argv)
   // Factory for creating writers which will handle writing of large messages
   oversized::WriterConfig writer_config{(size_t)(1 << max_fragment_size),
                                         (size_t)(1 << max_msg_size)};
-  oversized::WriterFactory writer_factory(non_blocking_factory, writer_config);
+  oversized::WriterFactory writer_factory(
+    non_blocking_factory, writer_config, &oversized::host_heap);
 
   // reconstruct oversized messages sent to the host
-  oversized::FragmentReconstructor fr(bp.get_dispatcher());
+  oversized::FragmentReconstructor fr(
+    bp.get_dispatcher(), &oversized::host_heap);
 
   {
     // provide regular ticks to the enclave
@@ -592,9 +713,37 @@ int main(int argc, char** argv)
     // regularly record some load statistics
     asynchost::LoadMonitor load_monitor(500ms, bp);
 
+    // record the spans of sampled request traces
+    std::optional<asynchost::TraceWriter> trace_writer;
+    if (trace_sampling_interval != 0)
+    {
+      trace_writer.emplace(bp.get_dispatcher(), trace_file);
+    }
+
     // handle outbound messages from the enclave
     asynchost::HandleRingbuffer handle_ringbuffer(
-      1ms, bp, circuit.read_from_inside(), non_blocking_factory);
+      1ms, bp, from_enclave_readers, non_blocking_factory);
+
+    // stop polling for outbound messages while the enclave is idle, until it
+    // rings the doorbell
+    auto ringbuffer_doorbell =
+      asynchost::start_ringbuffer_doorbell(handle_ringbuffer);
+
+    // report the occupancy of the ringbuffers, and of the queue of messages
+    // waiting for space in the ringbuffer to the enclave
+    load_monitor->behaviour.register_stats_source(
+      "ringbuffers", [&circuit, &from_workers, &non_blocking_factory]() {
+        auto j = nlohmann::json::object();
+        j["to_enclave"] = circuit.read_from_outside().get_stats();
+        j["to_enclave_pending"] =
+          non_blocking_factory.get_pending_inbound_stats();
+        j["from_enclave"] = circuit.read_from_inside().get_stats();
+        for (size_t i = 0; i < from_workers.size(); ++i)
+        {
+          j[fmt::format("from_worker_{}", i + 1)] = from_workers[i].get_stats();
+        }
+        return j;
+      });
 
     // graceful shutdown on sigterm
     asynchost::Sigterm sigterm(writer_factory);
@@ -604,8 +753,38 @@ int main(int argc, char** argv)
       writer_factory,
       ledger_chunk_bytes,
       asynchost::ledger_max_read_cache_files_default,
-      read_only_ledger_dirs);
+      read_only_ledger_dirs,
+      ledger_entry_cache_bytes);
     ledger.register_message_handlers(bp.get_dispatcher());
+    load_monitor->behaviour.register_stats_source(
+      "ledger_entry_cache", [&ledger]() {
+        return nlohmann::json(ledger.get_entry_cache_stats());
+      });
+
+    // regularly flush batches of written entries to disk (group commit)
+    asynchost::LedgerSync ledger_sync(nullptr);
+    if (ledger_durable)
+    {
+      ledger.set_durable(ledger_group_commit_ms == 0);
+      if (ledger_group_commit_ms != 0)
+      {
+        ledger_sync = asynchost::LedgerSync(
+          std::chrono::milliseconds(ledger_group_commit_ms), ledger);
+      }
+      load_monitor->behaviour.register_stats_source(
+        "ledger_sync",
+        [&ledger]() { return nlohmann::json(ledger.get_sync_stats()); });
+    }
+
+    // apply ledger writes off the uv loop, which only processes completions
+    asynchost::LedgerCompletions ledger_completions(nullptr);
+    if (ledger_io_thread)
+    {
+      ledger_completions = asynchost::start_ledger_io_thread(ledger);
+      load_monitor->behaviour.register_stats_source("ledger_io", [&ledger]() {
+        return nlohmann::json{{"queued", ledger.get_io_queue_size()}};
+      });
+    }
 
     asynchost::SnapshotManager snapshots(snapshot_dir, ledger);
     snapshots.register_message_handlers(bp.get_dispatcher());
@@ -656,8 +835,20 @@ int main(int argc, char** argv)
     enclave_config.from_enclave_buffer_start = from_enclave_buffer.data();
     enclave_config.from_enclave_buffer_size = from_enclave_buffer.size();
     enclave_config.from_enclave_buffer_offsets = &from_enclave_offsets;
+    enclave_config.num_from_workers_buffers = num_worker_threads;
+    enclave_config.from_workers_buffer_start = from_workers_buffer.data();
+    enclave_config.from_workers_buffer_size = buffer_size;
+    enclave_config.from_workers_buffer_offsets = from_workers_offsets.data();
 
     enclave_config.writer_config = writer_config;
+    enclave_config.trace_sampling_interval = trace_sampling_interval;
+    enclave_config.tls_ticket_key_rotation_s = tls_ticket_key_rotation_s;
+    enclave_config.admission_max_queue_depth = admission_max_queue_depth;
+    enclave_config.admission_max_commit_lag = admission_max_commit_lag;
+    enclave_config.host_time_base_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        time_updater->behaviour.get_creation_time().time_since_epoch())
+        .count();
 #ifdef DEBUG_CONFIG
     enclave_config.debug_config = {memory_reserve_startup};
 #endif
@@ -666,7 +857,8 @@ int main(int argc, char** argv)
     ccf_config.consensus_config = {raft_timeout,
                                    raft_election_timeout,
                                    bft_view_change_timeout,
-                                   bft_status_interval};
+                                   bft_status_interval,
+                                   ledger_durable};
     ccf_config.signature_intervals = {sig_tx_interval, sig_ms_interval};
     ccf_config.node_info_network = {rpc_address.hostname,
                                     public_rpc_address.hostname,
@@ -8,6 +8,7 @@
 #include "node/node_types.h"
 #include "tcp.h"
 
+#include <deque>
 #include <unordered_map>
 
 namespace asynchost
@@ -183,6 +184,17 @@ namespace asynchost
     ringbuffer::WriterPtr to_enclave;
     std::set<ccf::NodeId> reconnect_queue;
 
+    // Append entries whose entries were not yet in the ledger, for each node,
+    // in order. These are retried as later append entries arrive, and on each
+    // tick, which is the only time their ticks are counted.
+    struct DeferredMessage
+    {
+      std::vector<uint8_t> data;
+      size_t ticks = 0;
+    };
+    std::unordered_map<ccf::NodeId, std::deque<DeferredMessage>> deferred;
+    static constexpr size_t max_deferred_ticks = 50;
+
   public:
     NodeConnections(
       messaging::Dispatcher<ringbuffer::Message>& disp,
@@ -220,70 +232,19 @@ namespace asynchost
       DISPATCHER_SET_MESSAGE_HANDLER(
         disp, ccf::node_outbound, [this](const uint8_t* data, size_t size) {
           auto to = serialized::read<ccf::NodeId>(data, size);
-          auto node = find(to, true);
-
-          if (!node)
-            return;
 
-          auto data_to_send = data;
-          auto size_to_send = size;
-
-          // If the message is a consensus append entries message, affix the
-          // corresponding ledger entries
-          auto msg_type = serialized::read<ccf::NodeMsgType>(data, size);
-          if (
-            msg_type == ccf::NodeMsgType::consensus_msg &&
-            (serialized::peek<aft::RaftMsgType>(data, size) ==
-             aft::raft_append_entries))
+          // Append entries to a node with deferred append entries queue behind
+          // them, so that the node receives them in order. Other messages
+          // carry no ledger entries, so are never held up.
+          auto d = deferred.find(to);
+          if (d != deferred.end() && is_append_entries(data, size))
           {
-            // Parse the indices to be sent to the recipient.
-            auto p = data;
-            auto psize = size;
-
-            serialized::overlay<consensus::ConsensusHeader<ccf::Node2NodeMsg>>(
-              p, psize);
-
-            const auto& ae =
-              serialized::overlay<consensus::AppendEntriesIndex>(p, psize);
-
-            // Find the total frame size, and write it along with the header.
-            uint32_t frame = (uint32_t)size_to_send;
-            std::optional<std::vector<uint8_t>> framed_entries = std::nullopt;
-
-            framed_entries =
-              ledger.read_framed_entries(ae.prev_idx + 1, ae.idx);
-            if (framed_entries.has_value())
-            {
-              frame += (uint32_t)framed_entries->size();
-              node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
-              node.value()->write(size_to_send, data_to_send);
-
-              frame = (uint32_t)framed_entries->size();
-              node.value()->write(frame, framed_entries->data());
-            }
-            else
-            {
-              // Header-only AE
-              node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
-              node.value()->write(size_to_send, data_to_send);
-            }
-
-            LOG_DEBUG_FMT(
-              "send AE to node {} [{}]: {}, {}",
-              to,
-              frame,
-              ae.idx,
-              ae.prev_idx);
+            d->second.push_back({std::vector<uint8_t>(data, data + size)});
+            send_deferred(to, false);
           }
-          else
+          else if (!send(to, data, size))
           {
-            // Write as framed data to the recipient.
-            uint32_t frame = (uint32_t)size_to_send;
-
-            LOG_DEBUG_FMT("node send to {} [{}]", to, frame);
-
-            node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
-            node.value()->write(size_to_send, data_to_send);
+            deferred[to].push_back({std::vector<uint8_t>(data, data + size)});
           }
         });
     }
@@ -311,9 +272,147 @@ namespace asynchost
           s->second->reconnect();
         }
       }
+
+      for (auto it = deferred.begin(); it != deferred.end();)
+      {
+        const auto to = it->first;
+        ++it;
+        send_deferred(to, true);
+      }
     }
 
   private:
+    static bool is_append_entries(const uint8_t* data, size_t size)
+    {
+      return serialized::read<ccf::NodeMsgType>(data, size) ==
+        ccf::NodeMsgType::consensus_msg &&
+        serialized::peek<aft::RaftMsgType>(data, size) ==
+        aft::raft_append_entries;
+    }
+
+    // Sends a message to a node, affixing the ledger entries of append
+    // entries. Returns false, without sending, if the entries of an append
+    // entries have not yet been written to the ledger.
+    bool send(ccf::NodeId to, const uint8_t* data, size_t size)
+    {
+      auto node = find(to, true);
+
+      if (!node)
+        return true;
+
+      auto data_to_send = data;
+      auto size_to_send = size;
+
+      // If the message is a consensus append entries message, affix the
+      // corresponding ledger entries
+      auto msg_type = serialized::read<ccf::NodeMsgType>(data, size);
+      if (
+        msg_type == ccf::NodeMsgType::consensus_msg &&
+        (serialized::peek<aft::RaftMsgType>(data, size) ==
+         aft::raft_append_entries))
+      {
+        // Parse the indices to be sent to the recipient.
+        auto p = data;
+        auto psize = size;
+
+        serialized::overlay<consensus::ConsensusHeader<ccf::Node2NodeMsg>>(
+          p, psize);
+
+        const auto& ae =
+          serialized::overlay<consensus::AppendEntriesIndex>(p, psize);
+
+        // Find the total frame size, and write it along with the header.
+        // Entries are copied straight from the ledger (e.g. from mapped
+        // committed files) to the socket.
+        uint32_t frame = (uint32_t)size_to_send;
+        auto framed_entries =
+          ledger.read_framed_entries_views(ae.prev_idx + 1, ae.idx);
+        if (framed_entries.has_value())
+        {
+          for (const auto& view : framed_entries.value())
+          {
+            frame += (uint32_t)view.size;
+          }
+          node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
+          node.value()->write(size_to_send, data_to_send);
+
+          for (const auto& view : framed_entries.value())
+          {
+            node.value()->write(view.size, view.data);
+          }
+        }
+        else if (ae.idx > ae.prev_idx)
+        {
+          // The entries are not in the ledger yet. A header-only AE would
+          // claim entries it does not carry, so this is sent later instead.
+          LOG_DEBUG_FMT(
+            "Deferring AE to node {}: entries {} to {} not yet in ledger",
+            to,
+            ae.prev_idx + 1,
+            ae.idx);
+          return false;
+        }
+        else
+        {
+          // Header-only AE
+          node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
+          node.value()->write(size_to_send, data_to_send);
+        }
+
+        LOG_DEBUG_FMT(
+          "send AE to node {} [{}]: {}, {}", to, frame, ae.idx, ae.prev_idx);
+      }
+      else
+      {
+        // Write as framed data to the recipient.
+        uint32_t frame = (uint32_t)size_to_send;
+
+        LOG_DEBUG_FMT("node send to {} [{}]", to, frame);
+
+        node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
+        node.value()->write(size_to_send, data_to_send);
+      }
+
+      return true;
+    }
+
+    // Sends the node's deferred append entries, in order, until one must
+    // still be deferred. If tick is set, this counts a tick for that one.
+    // Append entries whose entries have not reached the ledger after
+    // max_deferred_ticks (eg - because they were rolled back) are dropped,
+    // since consensus sends them again.
+    void send_deferred(ccf::NodeId to, bool tick)
+    {
+      auto it = deferred.find(to);
+      if (it == deferred.end())
+      {
+        return;
+      }
+
+      auto& queue = it->second;
+      while (!queue.empty())
+      {
+        auto& msg = queue.front();
+        if (!send(to, msg.data.data(), msg.data.size()))
+        {
+          if (!tick || ++msg.ticks <= max_deferred_ticks)
+          {
+            break;
+          }
+          LOG_FAIL_FMT(
+            "Dropping AE to node {}: entries not in ledger after {} ticks",
+            to,
+            max_deferred_ticks);
+        }
+        queue.pop_front();
+      }
+
+      if (queue.empty())
+      {
+        deferred.erase(it);
+      }
+    }
+
     bool add_node(
       ccf::NodeId node, const std::string& host, const std::string& service)
     {
@@ -2,6 +2,7 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "../ds/tracing.h"
 #include "../tls/msg_types.h"
 #include "tcp.h"
 
@@ -43,6 +44,7 @@ namespace asynchost
           tls::tls_inbound,
           parent.to_enclave,
           (size_t)id,
+          tracing::Tracer::now(),
           serializer::ByteRange{data, len});
       }
 
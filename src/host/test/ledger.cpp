@@ -686,7 +686,15 @@ TEST_CASE("Limit number of open files")
   size_t chunk_threshold = 30;
   size_t chunk_count = 5;
   size_t max_read_cache_size = 2;
-  Ledger ledger(ledger_dir, wf, chunk_threshold, max_read_cache_size);
+  // Disable the recent entries cache so that all reads go to ledger files
+  size_t max_entry_cache_bytes = 0;
+  Ledger ledger(
+    ledger_dir,
+    wf,
+    chunk_threshold,
+    max_read_cache_size,
+    {},
+    max_entry_cache_bytes);
   TestEntrySubmitter entry_submitter(ledger);
 
   size_t initial_number_fd = number_open_fd();
@@ -965,8 +973,9 @@ TEST_CASE("Delete committed file from main directory")
   size_t chunk_threshold = 30;
   size_t chunk_count = 5;
 
-  // Worst-case scenario: do not keep any committed file in cache
+  // Worst-case scenario: do not keep any committed file or entry in cache
   size_t max_read_cache_size = 0;
+  size_t max_entry_cache_bytes = 0;
 
   size_t entries_per_chunk = 0;
   size_t last_idx = 0;
@@ -980,7 +989,8 @@ TEST_CASE("Delete committed file from main directory")
     wf,
     chunk_threshold,
     max_read_cache_size,
-    {ledger_dir_read_only});
+    {ledger_dir_read_only},
+    max_entry_cache_bytes);
   TestEntrySubmitter entry_submitter(ledger);
 
   INFO("Write many entries on ledger");
@@ -1017,6 +1027,488 @@ TEST_CASE("Delete committed file from main directory")
   }
 }
 
+TEST_CASE("Recent entries cache")
+{
+  fs::remove_all(ledger_dir);
+
+  size_t chunk_threshold = 30;
+  size_t framed_entry_size = frame_header_size + sizeof(TestLedgerEntry);
+  size_t cached_entries = 5;
+  Ledger ledger(
+    ledger_dir,
+    wf,
+    chunk_threshold,
+    ledger_max_read_cache_files_default,
+    {},
+    cached_entries * framed_entry_size);
+  TestEntrySubmitter entry_submitter(ledger);
+
+  size_t entries_written = 10;
+  for (size_t i = 0; i < entries_written; i++)
+  {
+    entry_submitter.write(true);
+  }
+  auto last_idx = entry_submitter.get_last_idx();
+
+  auto stats = ledger.get_entry_cache_stats();
+  REQUIRE(stats.entries == cached_entries);
+  REQUIRE(stats.bytes == cached_entries * framed_entry_size);
+
+  INFO("Most recent entries are read from the cache");
+  {
+    read_entries_range_from_ledger(
+      ledger, last_idx - cached_entries + 1, last_idx);
+    read_entries_range_from_ledger(ledger, last_idx, last_idx);
+    stats = ledger.get_entry_cache_stats();
+    REQUIRE(stats.hits == 2);
+    REQUIRE(stats.misses == 0);
+  }
+
+  INFO("Older entries are read from ledger files");
+  {
+    read_entries_range_from_ledger(ledger, last_idx - cached_entries, last_idx);
+    read_entries_range_from_ledger(ledger, 1, 2);
+    stats = ledger.get_entry_cache_stats();
+    REQUIRE(stats.hits == 2);
+    REQUIRE(stats.misses == 2);
+  }
+
+  INFO("Truncation evicts truncated entries from the cache");
+  {
+    entry_submitter.truncate(last_idx - 2);
+    last_idx = entry_submitter.get_last_idx();
+    stats = ledger.get_entry_cache_stats();
+    REQUIRE(stats.entries == cached_entries - 2);
+
+    entry_submitter.write(true);
+    last_idx = entry_submitter.get_last_idx();
+    auto hits_before = ledger.get_entry_cache_stats().hits;
+    read_entries_range_from_ledger(
+      ledger, last_idx - cached_entries + 2, last_idx);
+    REQUIRE(ledger.get_entry_cache_stats().hits == hits_before + 1);
+  }
+
+  INFO("Cache is disabled when its capacity is 0");
+  {
+    fs::remove_all(ledger_dir);
+    Ledger ledger(
+      ledger_dir,
+      wf,
+      chunk_threshold,
+      ledger_max_read_cache_files_default,
+      {},
+      0);
+    TestEntrySubmitter entry_submitter(ledger);
+    entry_submitter.write(true);
+    read_entries_range_from_ledger(ledger, 1, 1);
+
+    stats = ledger.get_entry_cache_stats();
+    REQUIRE(stats.entries == 0);
+    REQUIRE(stats.hits == 0);
+    REQUIRE(stats.misses == 1);
+  }
+}
+
+// Returns the (persisted idx, truncations) reports sent by the ledger to the
+// enclave since the last call
+std::vector<std::pair<size_t, size_t>> read_persistence_reports()
+{
+  std::vector<std::pair<size_t, size_t>> reports;
+  ringbuffer::Reader r(in_buffer->bd);
+  r.read(-1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+    if (m == consensus::ledger_persisted)
+    {
+      auto [idx, truncations] =
+        ringbuffer::read_message<consensus::ledger_persisted>(data, size);
+      reports.emplace_back(idx, truncations);
+    }
+  });
+  return reports;
+}
+
+TEST_CASE("Durable ledger")
+{
+  fs::remove_all(ledger_dir);
+  read_persistence_reports();
+
+  size_t chunk_threshold = 30;
+  using Reports = std::vector<std::pair<size_t, size_t>>;
+
+  INFO("Not durable: entries are never reported as persisted");
+  {
+    Ledger ledger(ledger_dir, wf, chunk_threshold);
+    TestEntrySubmitter entry_submitter(ledger);
+    entry_submitter.write(true);
+    ledger.sync();
+    REQUIRE(read_persistence_reports().empty());
+  }
+
+  INFO("Group commit: entries are reported as persisted on sync");
+  {
+    fs::remove_all(ledger_dir);
+    Ledger ledger(ledger_dir, wf, chunk_threshold);
+    ledger.set_durable(false);
+    TestEntrySubmitter entry_submitter(ledger);
+
+    entry_submitter.write(false);
+    ledger.sync();
+    REQUIRE(read_persistence_reports().empty());
+
+    entry_submitter.write(false);
+    entry_submitter.write(true);
+    entry_submitter.write(false);
+    REQUIRE(read_persistence_reports().empty());
+    ledger.sync();
+    REQUIRE(read_persistence_reports() == Reports{{4, 0}});
+
+    // Nothing new to sync
+    ledger.sync();
+    REQUIRE(read_persistence_reports().empty());
+
+    // Batch spans a completed chunk
+    size_t entries_per_chunk = get_entries_per_chunk(chunk_threshold);
+    for (size_t i = 0; i < entries_per_chunk; i++)
+    {
+      entry_submitter.write(true);
+    }
+    auto last_idx = entry_submitter.get_last_idx();
+    ledger.sync();
+    REQUIRE(read_persistence_reports() == Reports{{last_idx, 0}});
+
+    auto stats = ledger.get_sync_stats();
+    REQUIRE(stats.syncs == 2);
+    REQUIRE(stats.entries == last_idx);
+
+    INFO("Truncations are reported, even if no entries are removed");
+    entry_submitter.truncate(last_idx - 1);
+    entry_submitter.truncate(last_idx - 1);
+    ledger.sync();
+    REQUIRE(read_persistence_reports() == Reports{{last_idx - 1, 2}});
+  }
+
+  INFO("Sync on write: each committable entry is reported as persisted");
+  {
+    fs::remove_all(ledger_dir);
+    Ledger ledger(ledger_dir, wf, chunk_threshold);
+    ledger.set_durable(true);
+    TestEntrySubmitter entry_submitter(ledger);
+
+    entry_submitter.write(false);
+    REQUIRE(read_persistence_reports().empty());
+    entry_submitter.write(true);
+    entry_submitter.write(true);
+    REQUIRE(read_persistence_reports() == Reports{{2, 0}, {3, 0}});
+    REQUIRE(ledger.get_sync_stats().syncs == 2);
+
+    entry_submitter.truncate(1);
+    REQUIRE(read_persistence_reports() == Reports{{1, 1}});
+  }
+}
+
+TEST_CASE("Asynchronous writes")
+{
+  fs::remove_all(ledger_dir);
+  read_persistence_reports();
+
+  size_t chunk_threshold = 30;
+  size_t entries_per_chunk = get_entries_per_chunk(chunk_threshold);
+  std::atomic<size_t> notifications = 0;
+  size_t last_idx = 0;
+
+  {
+    // Entries are not cached, so that written entries are read from files
+    Ledger ledger(
+      ledger_dir,
+      wf,
+      chunk_threshold,
+      ledger_max_read_cache_files_default,
+      {},
+      0);
+    ledger.set_durable(true);
+    ledger.start_io_thread([&notifications]() { notifications++; });
+    TestEntrySubmitter entry_submitter(ledger);
+
+    INFO("Entries can be read as soon as they are written");
+    for (size_t i = 0; i < 3 * entries_per_chunk; i++)
+    {
+      entry_submitter.write(true);
+      read_entries_range_from_ledger(ledger, 1, entry_submitter.get_last_idx());
+    }
+
+    INFO("Truncation applies to queued and written entries");
+    entry_submitter.truncate(entries_per_chunk);
+    entry_submitter.write(true);
+    last_idx = entry_submitter.get_last_idx();
+    read_entries_range_from_ledger(ledger, 1, last_idx);
+    read_entry_from_ledger(ledger, last_idx);
+    REQUIRE(ledger.get_last_idx() == last_idx);
+
+    INFO("Persistence reports are posted back to the caller");
+    while (ledger.get_io_queue_size() > 0)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(notifications > 0);
+    REQUIRE(read_persistence_reports().empty());
+    ledger.process_completions();
+    auto reports = read_persistence_reports();
+    REQUIRE(!reports.empty());
+    REQUIRE(reports.back() == std::make_pair(last_idx, (size_t)1));
+  }
+
+  INFO("Queued writes are applied before the ledger is destroyed");
+  {
+    Ledger ledger(ledger_dir, wf, chunk_threshold);
+    REQUIRE(ledger.get_last_idx() == last_idx);
+    read_entries_range_from_ledger(ledger, 1, last_idx);
+  }
+}
+
+TEST_CASE("Reads do not wait for writes")
+{
+  fs::remove_all(ledger_dir);
+  read_persistence_reports();
+
+  // Entries are not cached, and are all written to the same file
+  size_t chunk_threshold = 1024 * 1024;
+  Ledger ledger(
+    ledger_dir,
+    wf,
+    chunk_threshold,
+    ledger_max_read_cache_files_default,
+    {},
+    0);
+  ledger.start_io_thread([]() {});
+  TestEntrySubmitter entry_submitter(ledger);
+
+  size_t entries = 3;
+  for (size_t i = 0; i < entries; i++)
+  {
+    entry_submitter.write(true);
+  }
+  while (ledger.get_io_queue_size() > 0)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto written_size = [&]() {
+    size_t size = 0;
+    for (auto const& f : fs::directory_iterator(ledger_dir))
+    {
+      size += fs::file_size(f.path());
+    }
+    return size;
+  };
+  const auto size_before = written_size();
+
+  INFO("Written entries are read while a large entry is being written");
+  std::vector<uint8_t> large_entry(128 * 1024 * 1024, 0x42);
+  ledger.write_entry(large_entry.data(), large_entry.size(), true, false);
+  while (written_size() == size_before)
+  {
+    std::this_thread::yield();
+  }
+  for (size_t i = 1; i <= entries; i++)
+  {
+    REQUIRE(ledger.read_entry(i).has_value());
+  }
+  REQUIRE(ledger.read_framed_entries(1, entries).has_value());
+  REQUIRE(written_size() < size_before + large_entry.size());
+
+  INFO("The large entry can be read once written");
+  while (ledger.get_io_queue_size() > 0)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  REQUIRE(ledger.read_entry(entries + 1) == large_entry);
+}
+
+TEST_CASE("Committed files are read in place")
+{
+  fs::remove_all(ledger_dir);
+
+  size_t chunk_threshold = 30;
+  size_t chunk_count = 3;
+  size_t max_read_cache_files = 1;
+  Ledger ledger(ledger_dir, wf, chunk_threshold, max_read_cache_files, {}, 0);
+  TestEntrySubmitter entry_submitter(ledger);
+
+  size_t entries_per_chunk =
+    initialise_ledger(entry_submitter, chunk_threshold, chunk_count);
+  // Last chunk is committed but not complete
+  entry_submitter.write(true);
+  auto last_idx = entry_submitter.get_last_idx();
+  ledger.commit(chunk_count * entries_per_chunk);
+
+  INFO("Views cover committed files and the uncommitted tail");
+  {
+    auto views = ledger.read_framed_entries_views(1, last_idx);
+    REQUIRE(views.has_value());
+    REQUIRE(views->size() == chunk_count + 1);
+    verify_framed_entries_range(flatten(views.value()), 1, last_idx);
+  }
+
+  INFO("Views remain valid after their file is evicted from the read cache");
+  {
+    auto first = ledger.read_framed_entries_views(1, entries_per_chunk);
+    auto entry = ledger.read_entry_view(1);
+    REQUIRE(entry.has_value());
+
+    read_entries_range_from_ledger(
+      ledger, 2 * entries_per_chunk + 1, 3 * entries_per_chunk);
+
+    verify_framed_entries_range(flatten(first.value()), 1, entries_per_chunk);
+    REQUIRE(
+      TestLedgerEntry(std::vector<uint8_t>(
+                        entry->data, entry->data + entry->size))
+        .value() == 1);
+  }
+
+  INFO("Entries can be read one by one from committed files");
+  {
+    for (size_t idx = 1; idx <= last_idx; idx++)
+    {
+      read_entry_from_ledger(ledger, idx);
+    }
+  }
+}
+
+struct StreamedEntries
+{
+  // (from, to) of each batch, in order
+  std::vector<std::pair<size_t, size_t>> batches;
+  std::vector<uint8_t> framed;
+  std::optional<size_t> end = std::nullopt;
+};
+
+StreamedEntries read_streamed_entries()
+{
+  StreamedEntries streamed;
+  auto handler = [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+    if (m == consensus::ledger_entries)
+    {
+      auto [from, to, purpose, framed] =
+        ringbuffer::read_message<consensus::ledger_entries>(data, size);
+      REQUIRE(purpose == consensus::LedgerRequestPurpose::Recovery);
+      streamed.batches.emplace_back(from, to);
+      streamed.framed.insert(
+        streamed.framed.end(), framed.data, framed.data + framed.size);
+    }
+    else if (m == consensus::ledger_no_entry)
+    {
+      auto [idx, purpose] =
+        ringbuffer::read_message<consensus::ledger_no_entry>(data, size);
+      streamed.end = idx;
+    }
+  };
+
+  // A read stops where the buffer wraps around
+  ringbuffer::Reader r(in_buffer->bd);
+  r.read(-1, handler);
+  r.read(-1, handler);
+  return streamed;
+}
+
+TEST_CASE("Streaming entries")
+{
+  fs::remove_all(ledger_dir);
+  read_streamed_entries();
+
+  size_t chunk_threshold = 30;
+  size_t chunk_count = 3;
+  Ledger ledger(ledger_dir, wf, chunk_threshold);
+  TestEntrySubmitter entry_submitter(ledger);
+
+  size_t entries_per_chunk =
+    initialise_ledger(entry_submitter, chunk_threshold, chunk_count);
+  entry_submitter.write(true);
+  auto last_idx = entry_submitter.get_last_idx();
+  ledger.commit(entries_per_chunk);
+
+  const auto framed_entry_size = frame_header_size + sizeof(TestLedgerEntry);
+  const auto purpose = consensus::LedgerRequestPurpose::Recovery;
+
+  INFO("Batches are sent ahead within the budget, until the end");
+  {
+    const size_t budget = 2 * framed_entry_size;
+    ledger.start_stream(1, purpose, budget);
+
+    std::vector<uint8_t> framed;
+    std::optional<size_t> end = std::nullopt;
+    size_t next_idx = 1;
+    while (!end.has_value())
+    {
+      auto streamed = read_streamed_entries();
+      REQUIRE(streamed.framed.size() <= budget);
+      for (const auto& [from, to] : streamed.batches)
+      {
+        REQUIRE(from == next_idx);
+        REQUIRE(to >= from);
+        next_idx = to + 1;
+      }
+      framed.insert(
+        framed.end(), streamed.framed.begin(), streamed.framed.end());
+      end = streamed.end;
+
+      ledger.ack_stream(streamed.framed.size());
+    }
+
+    verify_framed_entries_range(framed, 1, last_idx);
+    REQUIRE(end.value() == last_idx + 1);
+
+    // Stream has ended
+    ledger.ack_stream(budget);
+    REQUIRE(read_streamed_entries().batches.empty());
+  }
+
+  INFO("Batches do not span files");
+  {
+    ledger.start_stream(1, purpose, 1024);
+    auto streamed = read_streamed_entries();
+    REQUIRE(streamed.batches.size() == chunk_count + 1);
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+      REQUIRE(
+        streamed.batches[i] ==
+        std::make_pair(
+          i * entries_per_chunk + 1, (i + 1) * entries_per_chunk));
+    }
+    verify_framed_entries_range(streamed.framed, 1, last_idx);
+    REQUIRE(streamed.end == last_idx + 1);
+  }
+
+  INFO("An entry larger than the budget is sent on its own");
+  {
+    ledger.start_stream(2, purpose, 1);
+    auto streamed = read_streamed_entries();
+    REQUIRE(streamed.batches == decltype(streamed.batches){{2, 2}});
+    REQUIRE_FALSE(streamed.end.has_value());
+
+    ledger.ack_stream(framed_entry_size);
+    streamed = read_streamed_entries();
+    REQUIRE(streamed.batches == decltype(streamed.batches){{3, 3}});
+  }
+
+  INFO("Stopped and replaced streams send nothing more");
+  {
+    ledger.start_stream(1, purpose, framed_entry_size);
+    ledger.start_stream(5, purpose, framed_entry_size);
+    auto streamed = read_streamed_entries();
+    REQUIRE(streamed.batches == decltype(streamed.batches){{1, 1}, {5, 5}});
+
+    ledger.stop_stream();
+    ledger.ack_stream(framed_entry_size);
+    REQUIRE(read_streamed_entries().batches.empty());
+  }
+
+  INFO("Streaming from past the end ends straight away");
+  {
+    ledger.start_stream(last_idx + 1, purpose, 1024);
+    auto streamed = read_streamed_entries();
+    REQUIRE(streamed.batches.empty());
+    REQUIRE(streamed.end == last_idx + 1);
+  }
+}
+
 TEST_CASE("Find latest snapshot with corresponding ledger chunk")
 {
   fs::remove_all(ledger_dir);
@@ -0,0 +1,429 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "host/ledger.h"
+
+#include <picobench/picobench.hpp>
+
+static constexpr auto ledger_dir = "ledger_bench_dir";
+static constexpr size_t chunk_threshold = 5'000'000;
+static constexpr size_t entry_size = 1024;
+
+auto in_buffer = std::make_unique<ringbuffer::TestBuffer>(1 << 16);
+auto out_buffer = std::make_unique<ringbuffer::TestBuffer>(1024);
+ringbuffer::Circuit eio(in_buffer->bd, out_buffer->bd);
+auto wf = ringbuffer::WriterFactory(eio);
+
+inline void do_not_optimize(const void* p)
+{
+  asm volatile("" : : "g"(p) : "memory");
+}
+
+static std::vector<uint8_t> make_entry()
+{
+  std::vector<uint8_t> entry(entry_size);
+  for (size_t i = 0; i < entry.size(); ++i)
+  {
+    entry[i] = rand();
+  }
+  return entry;
+}
+
+// Discards the persistence reports sent to the enclave
+static void drain_to_enclave()
+{
+  ringbuffer::Reader r(in_buffer->bd);
+  r.read(-1, [](ringbuffer::Message, const uint8_t*, size_t) {});
+}
+
+// Simulates a primary replicating each new entry to all followers: every
+// entry is written once, then read once per follower as it would be by
+// NodeConnections when sending append entries.
+template <size_t Followers, size_t MaxEntryCacheBytes>
+static void replicate(picobench::state& s)
+{
+  fs::remove_all(ledger_dir);
+
+  asynchost::Ledger ledger(
+    ledger_dir,
+    wf,
+    chunk_threshold,
+    asynchost::ledger_max_read_cache_files_default,
+    {},
+    MaxEntryCacheBytes);
+
+  auto entry = make_entry();
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    const auto idx = ledger.write_entry(entry.data(), entry.size(), true, false);
+    for (size_t f = 0; f < Followers; ++f)
+    {
+      auto framed = ledger.read_framed_entries(idx, idx);
+      do_not_optimize(framed->data());
+    }
+  }
+  s.stop_timer();
+
+  fs::remove_all(ledger_dir);
+}
+
+const std::vector<int> entry_counts = {1000, 10000};
+static constexpr size_t no_cache = 0;
+static constexpr size_t with_cache =
+  asynchost::ledger_max_entry_cache_bytes_default;
+
+PICOBENCH_SUITE("replicate_2_followers");
+auto files_2 = replicate<2, no_cache>;
+PICOBENCH(files_2).iterations(entry_counts).samples(10).baseline();
+auto cache_2 = replicate<2, with_cache>;
+PICOBENCH(cache_2).iterations(entry_counts).samples(10);
+
+PICOBENCH_SUITE("replicate_4_followers");
+auto files_4 = replicate<4, no_cache>;
+PICOBENCH(files_4).iterations(entry_counts).samples(10).baseline();
+auto cache_4 = replicate<4, with_cache>;
+PICOBENCH(cache_4).iterations(entry_counts).samples(10);
+
+PICOBENCH_SUITE("replicate_6_followers");
+auto files_6 = replicate<6, no_cache>;
+PICOBENCH(files_6).iterations(entry_counts).samples(10).baseline();
+auto cache_6 = replicate<6, with_cache>;
+PICOBENCH(cache_6).iterations(entry_counts).samples(10);
+
+enum class Durability
+{
+  None,
+  SyncOnWrite,
+  GroupCommit
+};
+
+// Writes committable entries to a durable ledger, syncing every
+// EntriesPerSync entries: this is equivalent to a group commit window in
+// which EntriesPerSync entries are written. Each iteration is one entry, so
+// the sync latency is (time per iteration * EntriesPerSync).
+template <Durability D, size_t EntriesPerSync = 1>
+static void durable_write(picobench::state& s)
+{
+  fs::remove_all(ledger_dir);
+
+  asynchost::Ledger ledger(ledger_dir, wf, chunk_threshold);
+  if (D != Durability::None)
+  {
+    ledger.set_durable(D == Durability::SyncOnWrite);
+  }
+
+  auto entry = make_entry();
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    ledger.write_entry(entry.data(), entry.size(), true, false);
+    if (D == Durability::GroupCommit && (i + 1) % EntriesPerSync == 0)
+    {
+      ledger.sync();
+    }
+    if (D != Durability::None && (i + 1) % EntriesPerSync == 0)
+    {
+      drain_to_enclave();
+    }
+  }
+  ledger.sync();
+  s.stop_timer();
+
+  drain_to_enclave();
+  fs::remove_all(ledger_dir);
+}
+
+const std::vector<int> durable_entry_counts = {1000};
+
+PICOBENCH_SUITE("durable_write");
+auto not_durable = durable_write<Durability::None>;
+PICOBENCH(not_durable).iterations(durable_entry_counts).samples(5).baseline();
+auto sync_each = durable_write<Durability::SyncOnWrite>;
+PICOBENCH(sync_each).iterations(durable_entry_counts).samples(5);
+auto group_10 = durable_write<Durability::GroupCommit, 10>;
+PICOBENCH(group_10).iterations(durable_entry_counts).samples(5);
+auto group_100 = durable_write<Durability::GroupCommit, 100>;
+PICOBENCH(group_100).iterations(durable_entry_counts).samples(5);
+auto group_1000 = durable_write<Durability::GroupCommit, 1000>;
+PICOBENCH(group_1000).iterations(durable_entry_counts).samples(5);
+
+// Measures the time spent by the caller (i.e. the uv loop) handling each
+// ledger append, during which the loop cannot process any other event. With
+// an I/O thread, the loop only queues the entry and processes completions.
+template <bool IOThread, Durability D>
+static void loop_stall(picobench::state& s)
+{
+  fs::remove_all(ledger_dir);
+
+  {
+    asynchost::Ledger ledger(ledger_dir, wf, chunk_threshold);
+    if (D != Durability::None)
+    {
+      ledger.set_durable(D == Durability::SyncOnWrite);
+    }
+    if (IOThread)
+    {
+      ledger.start_io_thread([]() {});
+    }
+
+    auto entry = make_entry();
+
+    s.start_timer();
+    for (size_t i = 0; i < s.iterations(); ++i)
+    {
+      ledger.write_entry(entry.data(), entry.size(), true, false);
+      if ((i + 1) % 100 == 0)
+      {
+        ledger.process_completions();
+        drain_to_enclave();
+      }
+    }
+    s.stop_timer();
+  }
+
+  drain_to_enclave();
+  fs::remove_all(ledger_dir);
+}
+
+PICOBENCH_SUITE("loop_stall");
+auto loop_write = loop_stall<false, Durability::None>;
+PICOBENCH(loop_write).iterations(durable_entry_counts).samples(5).baseline();
+auto io_thread_write = loop_stall<true, Durability::None>;
+PICOBENCH(io_thread_write).iterations(durable_entry_counts).samples(5);
+auto loop_sync_each = loop_stall<false, Durability::SyncOnWrite>;
+PICOBENCH(loop_sync_each).iterations(durable_entry_counts).samples(5);
+auto io_thread_sync_each = loop_stall<true, Durability::SyncOnWrite>;
+PICOBENCH(io_thread_sync_each).iterations(durable_entry_counts).samples(5);
+
+static constexpr auto catch_up_ledger_dir = "ledger_bench_catch_up_dir";
+
+// The catch-up ledger is small by default, so that the benchmark runs quickly
+// under ctest. Set LEDGER_BENCH_CATCH_UP_SIZE (in bytes) to read a ledger
+// larger than the page cache instead, e.g. 10GB.
+static size_t get_catch_up_ledger_size()
+{
+  static constexpr size_t default_size = 64ull * 1024 * 1024;
+  const auto size = getenv("LEDGER_BENCH_CATCH_UP_SIZE");
+  return size == nullptr ? default_size : std::stoull(size);
+}
+
+static const size_t catch_up_ledger_size = get_catch_up_ledger_size();
+static constexpr size_t catch_up_batch_entries = 1000;
+
+// Removes the catch-up ledger when the benchmarks exit
+struct CatchUpLedgerFiles
+{
+  std::vector<std::string> files;
+
+  ~CatchUpLedgerFiles()
+  {
+    fs::remove_all(catch_up_ledger_dir);
+  }
+};
+
+// Writes a fully committed ledger of catch_up_ledger_size bytes, once for all
+// catch-up benchmarks
+static std::vector<std::string> catch_up_ledger_files()
+{
+  static CatchUpLedgerFiles ledger_files;
+  auto& files = ledger_files.files;
+  if (!files.empty())
+  {
+    return files;
+  }
+
+  fs::remove_all(catch_up_ledger_dir);
+  {
+    asynchost::Ledger ledger(catch_up_ledger_dir, wf, chunk_threshold);
+    auto entry = make_entry();
+    size_t idx = 0;
+    for (size_t written = 0; written < catch_up_ledger_size;
+         written += entry.size())
+    {
+      idx = ledger.write_entry(entry.data(), entry.size(), true, false);
+    }
+    ledger.commit(idx);
+  }
+
+  for (auto const& f : fs::directory_iterator(catch_up_ledger_dir))
+  {
+    files.push_back(f.path().filename());
+  }
+  std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+    return asynchost::get_start_idx_from_file_name(a) <
+      asynchost::get_start_idx_from_file_name(b);
+  });
+  return files;
+}
+
+// Simulates a lagging follower catching up from the start of the ledger: each
+// iteration reads one append entries batch of committed entries and copies it
+// to an outbound buffer, as NodeConnections does when writing to the socket.
+template <bool Mapped>
+static void catch_up(picobench::state& s)
+{
+  const auto files = catch_up_ledger_files();
+  auto file_it = files.begin();
+  auto file =
+    std::make_unique<asynchost::LedgerFile>(catch_up_ledger_dir, *file_it);
+  size_t idx = file->get_start_idx();
+  std::vector<uint8_t> outbound;
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    if (idx > file->get_last_idx())
+    {
+      if (++file_it == files.end())
+      {
+        file_it = files.begin();
+      }
+      file =
+        std::make_unique<asynchost::LedgerFile>(catch_up_ledger_dir, *file_it);
+      idx = file->get_start_idx();
+    }
+
+    auto to = std::min(idx + catch_up_batch_entries - 1, file->get_last_idx());
+    if constexpr (Mapped)
+    {
+      auto view = file->read_framed_entries_view(idx, to);
+      outbound.assign(view->data, view->data + view->size);
+    }
+    else
+    {
+      auto framed = file->read_framed_entries(idx, to);
+      outbound.assign(framed->begin(), framed->end());
+    }
+    do_not_optimize(outbound.data());
+    idx = to + 1;
+  }
+  s.stop_timer();
+}
+
+// Enough batches to read the whole ledger once
+const std::vector<int> catch_up_batch_counts = {
+  catch_up_ledger_size / (entry_size * catch_up_batch_entries)};
+
+PICOBENCH_SUITE("catch_up");
+auto read_copy = catch_up<false>;
+PICOBENCH(read_copy).iterations(catch_up_batch_counts).samples(1).baseline();
+auto mapped_view = catch_up<true>;
+PICOBENCH(mapped_view).iterations(catch_up_batch_counts).samples(1);
+
+static constexpr size_t recovery_stream_max_bytes = 16 * 1024;
+
+// Simulates a recovering node reading the ledger from the start, each
+// iteration being one entry. The enclave either requests each entry in turn
+// (one round trip per entry) or streams them in batches. Requests from the
+// enclave are dispatched to the ledger's message handlers, as the host does,
+// and the enclave copies each entry out of the ringbuffer to apply it.
+template <bool Streamed>
+static void recovery_read(picobench::state& s)
+{
+  fs::remove_all(ledger_dir);
+
+  {
+    asynchost::Ledger ledger(ledger_dir, wf, chunk_threshold);
+    auto entry = make_entry();
+    for (size_t i = 0; i < s.iterations(); ++i)
+    {
+      ledger.write_entry(entry.data(), entry.size(), true, false);
+    }
+    ledger.commit(s.iterations());
+
+    messaging::Dispatcher<ringbuffer::Message> disp("ledger");
+    ledger.register_message_handlers(disp);
+    ringbuffer::Reader from_enclave(out_buffer->bd);
+    ringbuffer::Reader to_enclave(in_buffer->bd);
+    auto enclave = wf.create_writer_to_outside();
+    const auto purpose = consensus::LedgerRequestPurpose::Recovery;
+
+    bool end = false;
+    bool requested = true;
+    size_t idx = 1;
+    size_t consumed = 0;
+    const auto enclave_handler =
+      [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        if (m == consensus::ledger_no_entry)
+        {
+          end = true;
+        }
+        else if (m == consensus::ledger_entry)
+        {
+          auto [idx_, purpose_, entry] =
+            ringbuffer::read_message<consensus::ledger_entry>(data, size);
+          do_not_optimize(entry.data());
+          ++idx;
+          requested = false;
+        }
+        else if (m == consensus::ledger_entries)
+        {
+          auto [from, to, purpose_, framed] =
+            ringbuffer::read_message<consensus::ledger_entries>(data, size);
+          auto d = framed.data;
+          auto remaining = framed.size;
+          while (remaining > 0)
+          {
+            const auto entry_size = serialized::read<uint32_t>(d, remaining);
+            const std::vector<uint8_t> entry(d, d + entry_size);
+            do_not_optimize(entry.data());
+            serialized::skip(d, remaining, entry_size);
+          }
+          consumed += framed.size;
+        }
+      };
+    const auto host_handler =
+      [&disp](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        disp.dispatch(m, data, size);
+      };
+
+    s.start_timer();
+    if constexpr (Streamed)
+    {
+      RINGBUFFER_WRITE_MESSAGE(
+        consensus::ledger_stream_start,
+        enclave,
+        idx,
+        purpose,
+        recovery_stream_max_bytes);
+    }
+    else
+    {
+      RINGBUFFER_WRITE_MESSAGE(consensus::ledger_get, enclave, idx, purpose);
+    }
+
+    while (!end)
+    {
+      from_enclave.read(-1, host_handler);
+      to_enclave.read(-1, enclave_handler);
+
+      if constexpr (Streamed)
+      {
+        if (consumed > 0)
+        {
+          RINGBUFFER_WRITE_MESSAGE(
+            consensus::ledger_stream_ack, enclave, consumed);
+          consumed = 0;
+        }
+      }
+      else if (!end && !requested)
+      {
+        RINGBUFFER_WRITE_MESSAGE(consensus::ledger_get, enclave, idx, purpose);
+        requested = true;
+      }
+    }
+    s.stop_timer();
+  }
+
+  drain_to_enclave();
+  fs::remove_all(ledger_dir);
+}
+
+PICOBENCH_SUITE("recovery_read");
+auto entry_by_entry = recovery_read<false>;
+PICOBENCH(entry_by_entry).iterations(entry_counts).samples(10).baseline();
+auto streamed = recovery_read<true>;
+PICOBENCH(streamed).iterations(entry_counts).samples(10);
@@ -14,12 +14,32 @@ namespace asynchost
   public:
     Behaviour behaviour;
 
+    // (Re)starts the timer, which fires straight away and then repeats
+    void start()
+    {
+      int rc;
+
+      if ((rc = uv_timer_start(&uv_handle, on_timer, 0, repeat_ms.count())) < 0)
+      {
+        LOG_FAIL_FMT("uv_timer_start failed: {}", uv_strerror(rc));
+        throw std::logic_error("uv_timer_start failed");
+      }
+    }
+
+    void stop()
+    {
+      uv_timer_stop(&uv_handle);
+    }
+
   private:
     friend class close_ptr<Timer<Behaviour>>;
 
+    const std::chrono::milliseconds repeat_ms;
+
     template <typename... Args>
     Timer(std::chrono::milliseconds repeat_ms, Args&&... args) :
-      behaviour(std::forward<Args>(args)...)
+      behaviour(std::forward<Args>(args)...),
+      repeat_ms(repeat_ms)
     {
       int rc;
 
@@ -31,11 +51,7 @@ namespace asynchost
 
       uv_handle.data = this;
 
-      if ((rc = uv_timer_start(&uv_handle, on_timer, 0, repeat_ms.count())) < 0)
-      {
-        LOG_FAIL_FMT("uv_timer_start failed: {}", uv_strerror(rc));
-        throw std::logic_error("uv_timer_start failed");
-      }
+      start();
     }
 
     static void on_timer(uv_timer_t* handle)
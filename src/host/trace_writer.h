@@ -0,0 +1,52 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "../ds/messaging.h"
+#include "../ds/tracing.h"
+#include "../enclave/interface.h"
+
+#include <fstream>
+#include <string>
+
+namespace asynchost
+{
+  // Appends the spans of sampled request traces, sent by the enclave, to a
+  // file of tracing::Span records. python/ccf/trace.py converts the file to
+  // the Chrome trace format.
+  class TraceWriter
+  {
+  private:
+    std::ofstream file;
+
+  public:
+    TraceWriter(
+      messaging::Dispatcher<ringbuffer::Message>& disp,
+      const std::string& path) :
+      file(path, std::ofstream::binary | std::ofstream::trunc)
+    {
+      if (!file)
+      {
+        throw std::logic_error(
+          fmt::format("Could not open trace file {}", path));
+      }
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        AdminMessage::trace_spans,
+        [this](const uint8_t* data, size_t size) {
+          auto [spans] =
+            ringbuffer::read_message<AdminMessage::trace_spans>(data, size);
+
+          if (spans.size % sizeof(tracing::Span) != 0)
+          {
+            LOG_FAIL_FMT("Received malformed trace spans from enclave");
+            return;
+          }
+
+          file.write(reinterpret_cast<const char*>(spans.data), spans.size);
+          file.flush();
+        });
+    }
+  };
+}
@@ -2,10 +2,15 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "ds/spin_lock.h"
 #include "enclave/rpc_context.h"
 #include "kv/tx.h"
 
+#include <array>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace ccf
 {
@@ -39,6 +44,103 @@ namespace ccf
 
     virtual std::optional<OpenAPISecuritySchema> get_openapi_security_schema()
       const = 0;
+
+    // True if the identity this policy resolves depends only on the session
+    // (eg - its TLS certificate) and on the users and members tables, and
+    // not on the request itself, so that it may be cached for the session
+    virtual bool is_session_cacheable() const
+    {
+      return false;
+    }
+  };
+
+  // The latest version at which any of the tables that session-cacheable
+  // identities are resolved from has changed. This is kept up to date by KV
+  // map hooks on those tables, which call update() with the version of each
+  // change.
+  class AuthnTablesVersion
+  {
+  private:
+    std::atomic<kv::Version> version = 0;
+
+  public:
+    static constexpr std::array<const char*, 4> tables = {
+      Tables::USERS,
+      Tables::USER_CERT_DERS,
+      Tables::MEMBERS,
+      Tables::MEMBER_CERT_DERS};
+
+    void update(kv::Version v)
+    {
+      auto current = version.load();
+      while (current < v && !version.compare_exchange_weak(current, v))
+      {
+      }
+    }
+
+    kv::Version get() const
+    {
+      return version.load();
+    }
+  };
+
+  // Identities resolved for a session, by each session-cacheable policy, so
+  // that they need not be looked up again for every request on the session.
+  // Entries resolved before the tables last changed are no longer used, nor
+  // are those resolved in an earlier term, since rollbacks do not trigger map
+  // hooks.
+  class AuthnIdentityCache
+  {
+  private:
+    struct Entry
+    {
+      const AuthnPolicy* policy;
+      kv::Version version;
+      kv::Term term;
+      std::shared_ptr<AuthnIdentity> identity;
+    };
+
+    SpinLock lock;
+    std::vector<Entry> entries;
+
+  public:
+    std::shared_ptr<AuthnIdentity> get(
+      const AuthnPolicy* policy,
+      kv::Term current_term,
+      kv::Version tables_version)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      for (const auto& entry : entries)
+      {
+        if (entry.policy == policy)
+        {
+          if (entry.term == current_term && entry.version >= tables_version)
+          {
+            return entry.identity;
+          }
+          break;
+        }
+      }
+      return nullptr;
+    }
+
+    void put(
+      const AuthnPolicy* policy,
+      kv::Version version,
+      kv::Term term,
+      const std::shared_ptr<AuthnIdentity>& identity)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      for (auto& entry : entries)
+      {
+        if (entry.policy == policy)
+        {
+          entry = {policy, version, term, identity};
+          return;
+        }
+      }
+      entries.push_back({policy, version, term, identity});
+    }
   };
 
   // To make authentication _optional_, we list no-auth as one of several
@@ -68,6 +68,11 @@ namespace ccf
       // OpenAPI3.1: https://github.com/OAI/OpenAPI-Specification/pull/1764
       return std::nullopt;
     }
+
+    bool is_session_cacheable() const override
+    {
+      return true;
+    }
   };
 
   struct MemberCertAuthnIdentity : public AuthnIdentity
@@ -125,6 +130,11 @@ namespace ccf
       // OpenAPI3.1: https://github.com/OAI/OpenAPI-Specification/pull/1764
       return std::nullopt;
     }
+
+    bool is_session_cacheable() const override
+    {
+      return true;
+    }
   };
 
   struct NodeCertAuthnIdentity : public AuthnIdentity
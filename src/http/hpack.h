@@ -0,0 +1,688 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#define FMT_HEADER_ONLY
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <fmt/format.h>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// HPACK header compression for HTTP/2, as specified by RFC 7541
+namespace http2::hpack
+{
+  using HeaderField = std::pair<std::string, std::string>;
+  using HeaderList = std::vector<HeaderField>;
+
+  // Raised when a header block cannot be decoded. The decoder's dynamic table
+  // is then out of sync with the peer's, so this is a connection error.
+  class CompressionError : public std::runtime_error
+  {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  // Raised when a header block decodes to more than the decoder was asked to
+  // accept. The rest of the block is not decoded, so this is also a connection
+  // error.
+  class HeaderListTooLarge : public CompressionError
+  {
+  public:
+    using CompressionError::CompressionError;
+  };
+
+  // Size of a header field, as accounted for in the dynamic table and in
+  // SETTINGS_MAX_HEADER_LIST_SIZE (RFC 7541, section 4.1)
+  static constexpr size_t entry_overhead = 32;
+
+  inline size_t field_size(const HeaderField& f)
+  {
+    return f.first.size() + f.second.size() + entry_overhead;
+  }
+
+  inline size_t header_list_size(const HeaderList& headers)
+  {
+    size_t size = 0;
+    for (const auto& f : headers)
+    {
+      size += field_size(f);
+    }
+    return size;
+  }
+
+  // RFC 7541, Appendix A
+  static const std::array<std::pair<std::string_view, std::string_view>, 61>
+    static_table = {{{":authority", ""},
+                     {":method", "GET"},
+                     {":method", "POST"},
+                     {":path", "/"},
+                     {":path", "/index.html"},
+                     {":scheme", "http"},
+                     {":scheme", "https"},
+                     {":status", "200"},
+                     {":status", "204"},
+                     {":status", "206"},
+                     {":status", "304"},
+                     {":status", "400"},
+                     {":status", "404"},
+                     {":status", "500"},
+                     {"accept-charset", ""},
+                     {"accept-encoding", "gzip, deflate"},
+                     {"accept-language", ""},
+                     {"accept-ranges", ""},
+                     {"accept", ""},
+                     {"access-control-allow-origin", ""},
+                     {"age", ""},
+                     {"allow", ""},
+                     {"authorization", ""},
+                     {"cache-control", ""},
+                     {"content-disposition", ""},
+                     {"content-encoding", ""},
+                     {"content-language", ""},
+                     {"content-length", ""},
+                     {"content-location", ""},
+                     {"content-range", ""},
+                     {"content-type", ""},
+                     {"cookie", ""},
+                     {"date", ""},
+                     {"etag", ""},
+                     {"expect", ""},
+                     {"expires", ""},
+                     {"from", ""},
+                     {"host", ""},
+                     {"if-match", ""},
+                     {"if-modified-since", ""},
+                     {"if-none-match", ""},
+                     {"if-range", ""},
+                     {"if-unmodified-since", ""},
+                     {"last-modified", ""},
+                     {"link", ""},
+                     {"location", ""},
+                     {"max-forwards", ""},
+                     {"proxy-authenticate", ""},
+                     {"proxy-authorization", ""},
+                     {"range", ""},
+                     {"referer", ""},
+                     {"refresh", ""},
+                     {"retry-after", ""},
+                     {"server", ""},
+                     {"set-cookie", ""},
+                     {"strict-transport-security", ""},
+                     {"transfer-encoding", ""},
+                     {"user-agent", ""},
+                     {"vary", ""},
+                     {"via", ""},
+                     {"www-authenticate", ""}}};
+
+  // Integers are encoded in the low prefix_bits of a first byte, whose high
+  // bits hold the representation's flags, and continue in 7-bit groups if they
+  // do not fit (RFC 7541, section 5.1)
+  inline void encode_integer(
+    std::vector<uint8_t>& out, uint8_t flags, uint8_t prefix_bits, size_t value)
+  {
+    const size_t max_prefix = (1u << prefix_bits) - 1;
+    if (value < max_prefix)
+    {
+      out.push_back(flags | value);
+      return;
+    }
+
+    out.push_back(flags | max_prefix);
+    value -= max_prefix;
+    while (value >= 0x80)
+    {
+      out.push_back((value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+    out.push_back(value);
+  }
+
+  inline size_t decode_integer(
+    const uint8_t*& data, const uint8_t* end, uint8_t prefix_bits)
+  {
+    if (data == end)
+    {
+      throw CompressionError("Truncated integer");
+    }
+
+    const size_t max_prefix = (1u << prefix_bits) - 1;
+    size_t value = *data++ & max_prefix;
+    if (value < max_prefix)
+    {
+      return value;
+    }
+
+    for (size_t shift = 0;; shift += 7)
+    {
+      // Header blocks never legitimately hold integers beyond 32 bits
+      if (data == end || shift > 28)
+      {
+        throw CompressionError("Truncated or oversized integer");
+      }
+
+      const auto b = *data++;
+      value += (size_t)(b & 0x7f) << shift;
+      if ((b & 0x80) == 0)
+      {
+        return value;
+      }
+    }
+  }
+
+  namespace huffman
+  {
+    // Lengths of the codes of the 256 octets and EOS in the canonical Huffman
+    // code of RFC 7541, Appendix B. Codes of equal length are consecutive, in
+    // symbol order, so the codes themselves are derived from these.
+    static constexpr uint8_t code_lengths[257] = {
+      13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28, 28, 28,
+      28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28, 6,  10, 10, 12,
+      13, 6,  8,  11, 10, 10, 8,  11, 8,  6,  6,  6,  5,  5,  5,  6,  6,  6,
+      6,  6,  6,  6,  7,  8,  15, 6,  12, 10, 13, 6,  7,  7,  7,  7,  7,  7,
+      7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  8,  7,
+      8,  13, 19, 13, 14, 6,  15, 5,  6,  5,  6,  5,  6,  6,  6,  5,  7,  7,
+      6,  6,  6,  5,  6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7,  15, 11, 14,
+      13, 28, 20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+      24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24, 22, 21,
+      20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23, 21, 21, 22, 21,
+      23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23, 26, 26, 20, 19, 22, 23,
+      22, 25, 26, 26, 26, 27, 27, 26, 24, 25, 19, 21, 26, 27, 27, 26, 27, 24,
+      21, 21, 26, 26, 28, 27, 27, 27, 20, 24, 20, 21, 22, 21, 21, 23, 22, 22,
+      25, 25, 24, 24, 26, 23, 26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27,
+      27, 27, 27, 26, 30};
+
+    static constexpr size_t eos = 256;
+    static constexpr size_t max_code_length = 30;
+
+    struct Code
+    {
+      uint32_t bits;
+      uint8_t length;
+    };
+
+    struct Table
+    {
+      std::array<Code, 257> codes;
+
+      // For canonical decoding: the first code of each length, the number of
+      // codes of that length, and the offset of their symbols in symbols
+      std::array<uint32_t, max_code_length + 1> first_code = {};
+      std::array<uint32_t, max_code_length + 1> count = {};
+      std::array<uint32_t, max_code_length + 1> offset = {};
+      std::array<uint16_t, 257> symbols;
+
+      Table()
+      {
+        for (auto l : code_lengths)
+        {
+          count[l]++;
+        }
+
+        uint32_t code = 0;
+        uint32_t next_offset = 0;
+        for (size_t l = 1; l <= max_code_length; ++l)
+        {
+          code = (code + count[l - 1]) << 1;
+          first_code[l] = code;
+          offset[l] = next_offset;
+          next_offset += count[l];
+        }
+
+        auto next_code = first_code;
+        auto next_symbol = offset;
+        for (size_t s = 0; s < codes.size(); ++s)
+        {
+          const auto l = code_lengths[s];
+          codes[s] = {next_code[l]++, l};
+          symbols[next_symbol[l]++] = s;
+        }
+      }
+    };
+
+    inline const Table& table()
+    {
+      static const Table t;
+      return t;
+    }
+
+    inline size_t encoded_size(const std::string_view& s)
+    {
+      size_t bits = 0;
+      for (const auto c : s)
+      {
+        bits += code_lengths[(uint8_t)c];
+      }
+      return (bits + 7) / 8;
+    }
+
+    inline void encode(std::vector<uint8_t>& out, const std::string_view& s)
+    {
+      const auto& t = table();
+      uint64_t acc = 0;
+      size_t acc_bits = 0;
+      for (const auto c : s)
+      {
+        const auto& code = t.codes[(uint8_t)c];
+        acc = (acc << code.length) | code.bits;
+        acc_bits += code.length;
+        while (acc_bits >= 8)
+        {
+          acc_bits -= 8;
+          out.push_back(acc >> acc_bits);
+        }
+      }
+
+      // Padded with the most significant bits of EOS, i.e. ones
+      if (acc_bits > 0)
+      {
+        out.push_back((acc << (8 - acc_bits)) | (0xff >> acc_bits));
+      }
+    }
+
+    inline std::string decode(const uint8_t* data, size_t size)
+    {
+      const auto& t = table();
+      std::string s;
+      s.reserve(size * 8 / 5);
+
+      uint32_t code = 0;
+      size_t length = 0;
+      for (size_t i = 0; i < size; ++i)
+      {
+        for (int bit = 7; bit >= 0; --bit)
+        {
+          code = (code << 1) | ((data[i] >> bit) & 1);
+          ++length;
+
+          if (code - t.first_code[length] < t.count[length])
+          {
+            const auto symbol =
+              t.symbols[t.offset[length] + code - t.first_code[length]];
+            if (symbol == eos)
+            {
+              throw CompressionError("Huffman-encoded string contains EOS");
+            }
+            s.push_back(symbol);
+            code = 0;
+            length = 0;
+          }
+          else if (length == max_code_length)
+          {
+            throw CompressionError("Invalid Huffman code");
+          }
+        }
+      }
+
+      // Any remaining bits must be a prefix of EOS, shorter than an octet
+      if (length >= 8 || code != (1u << length) - 1)
+      {
+        throw CompressionError("Invalid Huffman padding");
+      }
+
+      return s;
+    }
+  }
+
+  // String literals are Huffman-encoded when that makes them shorter
+  inline void encode_string(
+    std::vector<uint8_t>& out, const std::string_view& s)
+  {
+    const auto huffman_size = huffman::encoded_size(s);
+    if (huffman_size < s.size())
+    {
+      encode_integer(out, 0x80, 7, huffman_size);
+      huffman::encode(out, s);
+    }
+    else
+    {
+      encode_integer(out, 0x00, 7, s.size());
+      out.insert(out.end(), s.begin(), s.end());
+    }
+  }
+
+  inline std::string decode_string(const uint8_t*& data, const uint8_t* end)
+  {
+    if (data == end)
+    {
+      throw CompressionError("Truncated string");
+    }
+
+    const bool is_huffman = *data & 0x80;
+    const auto size = decode_integer(data, end, 7);
+    if (size > (size_t)(end - data))
+    {
+      throw CompressionError("Truncated string");
+    }
+
+    const auto s = data;
+    data += size;
+    if (is_huffman)
+    {
+      return huffman::decode(s, size);
+    }
+    return std::string(s, s + size);
+  }
+
+  // Header fields most recently added to a header block, indexed after the
+  // static table, newest first (RFC 7541, section 2.3.2)
+  class DynamicTable
+  {
+  private:
+    std::deque<HeaderField> entries;
+    size_t size = 0;
+    size_t max_size;
+
+    void evict(size_t target)
+    {
+      while (size > target)
+      {
+        size -= field_size(entries.back());
+        entries.pop_back();
+      }
+    }
+
+  public:
+    DynamicTable(size_t max_size_) : max_size(max_size_) {}
+
+    void add(HeaderField field)
+    {
+      const auto s = field_size(field);
+      if (s > max_size)
+      {
+        // An entry larger than the table empties it, and is not added
+        evict(0);
+        return;
+      }
+
+      evict(max_size - s);
+      size += s;
+      entries.push_front(std::move(field));
+    }
+
+    void set_max_size(size_t max_size_)
+    {
+      max_size = max_size_;
+      evict(max_size);
+    }
+
+    size_t get_max_size() const
+    {
+      return max_size;
+    }
+
+    size_t get_size() const
+    {
+      return size;
+    }
+
+    size_t count() const
+    {
+      return entries.size();
+    }
+
+    const HeaderField& operator[](size_t i) const
+    {
+      return entries[i];
+    }
+  };
+
+  static constexpr size_t default_table_size = 4096;
+
+  class Decoder
+  {
+  private:
+    DynamicTable table;
+
+    // Bound on the size updates that the encoder may send, i.e. our
+    // SETTINGS_HEADER_TABLE_SIZE
+    size_t max_table_size;
+
+    HeaderField lookup(size_t index) const
+    {
+      if (index == 0)
+      {
+        throw CompressionError("Header field index 0");
+      }
+      else if (index <= static_table.size())
+      {
+        const auto& [name, value] = static_table[index - 1];
+        return {std::string(name), std::string(value)};
+      }
+      else if (index - static_table.size() <= table.count())
+      {
+        return table[index - static_table.size() - 1];
+      }
+
+      throw CompressionError(
+        fmt::format("Header field index {} is out of range", index));
+    }
+
+    HeaderField decode_literal(
+      const uint8_t*& data, const uint8_t* end, uint8_t prefix_bits)
+    {
+      const auto name_index = decode_integer(data, end, prefix_bits);
+      auto name =
+        name_index == 0 ? decode_string(data, end) : lookup(name_index).first;
+      auto value = decode_string(data, end);
+      return {std::move(name), std::move(value)};
+    }
+
+  public:
+    Decoder(size_t max_table_size_ = default_table_size) :
+      table(max_table_size_),
+      max_table_size(max_table_size_)
+    {}
+
+    /// Decodes a complete header block, appending its fields to headers.
+    /// Throws HeaderListTooLarge as soon as the fields decoded from the block
+    /// exceed max_list_size, as measured by header_list_size(), so that a
+    /// small block of repeated references cannot expand without bound.
+    void decode(
+      const uint8_t* data,
+      size_t size,
+      HeaderList& headers,
+      size_t max_list_size = std::numeric_limits<size_t>::max())
+    {
+      const auto end = data + size;
+      bool fields_seen = false;
+      size_t list_size = 0;
+
+      auto append = [&](HeaderField&& field) {
+        list_size += field_size(field);
+        if (list_size > max_list_size)
+        {
+          throw HeaderListTooLarge(fmt::format(
+            "Header list exceeds {} bytes once decoded", max_list_size));
+        }
+        headers.push_back(std::move(field));
+        fields_seen = true;
+      };
+
+      while (data != end)
+      {
+        const auto b = *data;
+        if (b & 0x80)
+        {
+          // Indexed header field
+          append(lookup(decode_integer(data, end, 7)));
+        }
+        else if ((b & 0xc0) == 0x40)
+        {
+          // Literal header field with incremental indexing
+          auto field = decode_literal(data, end, 6);
+          table.add(field);
+          append(std::move(field));
+        }
+        else if ((b & 0xe0) == 0x20)
+        {
+          // Dynamic table size update, only allowed at the start of a block
+          const auto new_size = decode_integer(data, end, 5);
+          if (fields_seen || new_size > max_table_size)
+          {
+            throw CompressionError(fmt::format(
+              "Invalid dynamic table size update to {}", new_size));
+          }
+          table.set_max_size(new_size);
+        }
+        else
+        {
+          // Literal header field without indexing (0000) or never indexed
+          // (0001)
+          append(decode_literal(data, end, 4));
+        }
+      }
+    }
+
+    HeaderList decode(const uint8_t* data, size_t size)
+    {
+      HeaderList headers;
+      decode(data, size, headers);
+      return headers;
+    }
+
+    const DynamicTable& get_table() const
+    {
+      return table;
+    }
+  };
+
+  class Encoder
+  {
+  private:
+    DynamicTable table;
+
+    // If false, no fields are added to the dynamic table, so that the blocks
+    // produced do not depend on the order in which they are sent
+    bool indexing;
+
+    // Set when the peer lowers SETTINGS_HEADER_TABLE_SIZE, so that the next
+    // block starts with a size update (RFC 7541, section 4.2)
+    std::optional<size_t> pending_size_update = std::nullopt;
+
+    // Values of these are not added to the dynamic table, nor by any
+    // intermediary (RFC 7541, section 7.1.3)
+    static bool is_sensitive(const std::string_view& name)
+    {
+      return name == "authorization" || name == "cookie" ||
+        name == "set-cookie" || name == "proxy-authorization";
+    }
+
+    // Returns the index of a matching field, and whether its value matches
+    std::pair<size_t, bool> find(const HeaderField& f) const
+    {
+      size_t name_index = 0;
+      for (size_t i = 0; i < static_table.size(); ++i)
+      {
+        const auto& [name, value] = static_table[i];
+        if (name == f.first)
+        {
+          if (value == f.second)
+          {
+            return {i + 1, true};
+          }
+          if (name_index == 0)
+          {
+            name_index = i + 1;
+          }
+        }
+      }
+
+      for (size_t i = 0; i < table.count(); ++i)
+      {
+        const auto& [name, value] = table[i];
+        if (name == f.first)
+        {
+          if (value == f.second)
+          {
+            return {static_table.size() + i + 1, true};
+          }
+          if (name_index == 0)
+          {
+            name_index = static_table.size() + i + 1;
+          }
+        }
+      }
+
+      return {name_index, false};
+    }
+
+  public:
+    Encoder(size_t max_table_size = default_table_size, bool indexing_ = true) :
+      table(max_table_size),
+      indexing(indexing_)
+    {}
+
+    /// Bounds the dynamic table by the peer's SETTINGS_HEADER_TABLE_SIZE
+    void set_max_table_size(size_t size)
+    {
+      const auto new_size = std::min(size, default_table_size);
+      if (new_size != table.get_max_size())
+      {
+        table.set_max_size(new_size);
+        pending_size_update = pending_size_update.has_value() ?
+          std::min(pending_size_update.value(), new_size) :
+          new_size;
+      }
+    }
+
+    /// Appends the header block encoding headers to out. Header names must
+    /// be lowercase.
+    void encode(std::vector<uint8_t>& out, const HeaderList& headers)
+    {
+      if (pending_size_update.has_value())
+      {
+        // If the table was lowered then raised again, both are signalled
+        if (pending_size_update.value() != table.get_max_size())
+        {
+          encode_integer(out, 0x20, 5, pending_size_update.value());
+        }
+        encode_integer(out, 0x20, 5, table.get_max_size());
+        pending_size_update = std::nullopt;
+      }
+
+      for (const auto& f : headers)
+      {
+        const auto sensitive = is_sensitive(f.first);
+        const auto [index, value_matches] = find(f);
+        if (value_matches && !sensitive)
+        {
+          encode_integer(out, 0x80, 7, index);
+          continue;
+        }
+
+        if (sensitive)
+        {
+          encode_integer(out, 0x10, 4, index);
+        }
+        else if (indexing && field_size(f) <= table.get_max_size() / 2)
+        {
+          encode_integer(out, 0x40, 6, index);
+          table.add(f);
+        }
+        else
+        {
+          encode_integer(out, 0x00, 4, index);
+        }
+
+        if (index == 0)
+        {
+          encode_string(out, f.first);
+        }
+        encode_string(out, f.second);
+      }
+    }
+
+    const DynamicTable& get_table() const
+    {
+      return table;
+    }
+  };
+}
@@ -0,0 +1,1391 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/logger.h"
+#include "hpack.h"
+
+#include <cstring>
+#include <limits>
+#include <map>
+
+// HTTP/2 framing and connection state, as specified by RFC 7540. Sessions are
+// independent of the transport: bytes received from the peer are passed to
+// recv(), and the bytes to send to the peer are collected with take_output().
+namespace http2
+{
+  // Sent by the client to start the connection (RFC 7540, section 3.5)
+  static constexpr std::string_view preface =
+    "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+  // Protocol identifier for HTTP/2 over TLS, negotiated via ALPN
+  static constexpr auto alpn_id = "h2";
+
+  enum class FrameType : uint8_t
+  {
+    DATA = 0x0,
+    HEADERS = 0x1,
+    PRIORITY = 0x2,
+    RST_STREAM = 0x3,
+    SETTINGS = 0x4,
+    PUSH_PROMISE = 0x5,
+    PING = 0x6,
+    GOAWAY = 0x7,
+    WINDOW_UPDATE = 0x8,
+    CONTINUATION = 0x9
+  };
+
+  namespace flags
+  {
+    static constexpr uint8_t END_STREAM = 0x1;
+    static constexpr uint8_t ACK = 0x1;
+    static constexpr uint8_t END_HEADERS = 0x4;
+    static constexpr uint8_t PADDED = 0x8;
+    static constexpr uint8_t PRIORITY = 0x20;
+  }
+
+  enum class ErrorCode : uint32_t
+  {
+    NO_ERROR = 0x0,
+    PROTOCOL_ERROR = 0x1,
+    INTERNAL_ERROR = 0x2,
+    FLOW_CONTROL_ERROR = 0x3,
+    SETTINGS_TIMEOUT = 0x4,
+    STREAM_CLOSED = 0x5,
+    FRAME_SIZE_ERROR = 0x6,
+    REFUSED_STREAM = 0x7,
+    CANCEL = 0x8,
+    COMPRESSION_ERROR = 0x9,
+    CONNECT_ERROR = 0xa,
+    ENHANCE_YOUR_CALM = 0xb,
+    INADEQUATE_SECURITY = 0xc,
+    HTTP_1_1_REQUIRED = 0xd
+  };
+
+  enum class SettingsId : uint16_t
+  {
+    HEADER_TABLE_SIZE = 0x1,
+    ENABLE_PUSH = 0x2,
+    MAX_CONCURRENT_STREAMS = 0x3,
+    INITIAL_WINDOW_SIZE = 0x4,
+    MAX_FRAME_SIZE = 0x5,
+    MAX_HEADER_LIST_SIZE = 0x6
+  };
+
+  static constexpr size_t frame_header_size = 9;
+  static constexpr size_t default_max_frame_size = 16384;
+  static constexpr size_t max_max_frame_size = (1 << 24) - 1;
+  static constexpr int64_t default_window_size = 65535;
+  static constexpr int64_t max_window_size = 0x7fffffff;
+
+  struct FrameHeader
+  {
+    size_t length;
+    FrameType type;
+    uint8_t flags;
+    uint32_t stream_id;
+  };
+
+  inline void write_frame_header(
+    std::vector<uint8_t>& out,
+    size_t length,
+    FrameType type,
+    uint8_t flags,
+    uint32_t stream_id)
+  {
+    out.push_back(length >> 16);
+    out.push_back(length >> 8);
+    out.push_back(length);
+    out.push_back((uint8_t)type);
+    out.push_back(flags);
+    out.push_back((stream_id >> 24) & 0x7f);
+    out.push_back(stream_id >> 16);
+    out.push_back(stream_id >> 8);
+    out.push_back(stream_id);
+  }
+
+  inline uint32_t read_u32(const uint8_t* data)
+  {
+    return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 |
+      (uint32_t)data[2] << 8 | data[3];
+  }
+
+  inline void write_u32(std::vector<uint8_t>& out, uint32_t v)
+  {
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+  }
+
+  inline FrameHeader read_frame_header(const uint8_t* data)
+  {
+    return {(size_t)data[0] << 16 | (size_t)data[1] << 8 | data[2],
+            FrameType(data[3]),
+            data[4],
+            read_u32(data + 5) & 0x7fffffff};
+  }
+
+  // A connection error: the session sends GOAWAY with this code and closes
+  class ProtocolError : public std::runtime_error
+  {
+  public:
+    const ErrorCode code;
+
+    ProtocolError(ErrorCode code_, const std::string& what) :
+      std::runtime_error(what),
+      code(code_)
+    {}
+  };
+
+  struct Settings
+  {
+    uint32_t header_table_size = hpack::default_table_size;
+    uint32_t enable_push = 1;
+    uint32_t max_concurrent_streams = std::numeric_limits<uint32_t>::max();
+    uint32_t initial_window_size = default_window_size;
+    uint32_t max_frame_size = default_max_frame_size;
+    uint32_t max_header_list_size = std::numeric_limits<uint32_t>::max();
+  };
+
+  class RequestProcessor
+  {
+  public:
+    virtual void handle_request(
+      uint32_t stream_id,
+      hpack::HeaderList&& headers,
+      std::vector<uint8_t>&& body) = 0;
+
+    /// Returns the number of requests handed over which have not completed
+    /// yet, including those on streams since reset by the client
+    virtual size_t pending_requests() const
+    {
+      return 0;
+    }
+  };
+
+  class ResponseProcessor
+  {
+  public:
+    virtual void handle_response(
+      uint32_t stream_id,
+      hpack::HeaderList&& headers,
+      std::vector<uint8_t>&& body) = 0;
+  };
+
+  // Headers which only apply to an HTTP/1.1 connection, and must not be sent
+  // in HTTP/2 (RFC 7540, section 8.1.2.2)
+  inline bool is_connection_specific(const std::string_view& name)
+  {
+    return name == "connection" || name == "keep-alive" ||
+      name == "proxy-connection" || name == "transfer-encoding" ||
+      name == "upgrade";
+  }
+
+  class Session
+  {
+  protected:
+    enum class StreamState
+    {
+      Open,
+      HalfClosedLocal,
+      HalfClosedRemote
+    };
+
+    // Streams are erased once closed in both directions, or reset
+    struct Stream
+    {
+      StreamState state = StreamState::Open;
+
+      // Message received on the stream
+      hpack::HeaderList headers = {};
+      std::vector<uint8_t> body = {};
+      bool headers_received = false;
+
+      // Remaining flow-control windows
+      int64_t send_window;
+      int64_t recv_window;
+
+      // Body to send, from pending_offset, as the send windows allow. The
+      // stream is closed locally once it is all sent.
+      std::vector<uint8_t> pending = {};
+      size_t pending_offset = 0;
+      bool sending = false;
+    };
+
+    const bool is_server;
+    Settings local;
+    Settings remote;
+    hpack::Encoder encoder;
+    hpack::Decoder decoder;
+
+    std::map<uint32_t, Stream> streams;
+    uint32_t last_peer_stream_id = 0;
+    uint32_t next_stream_id;
+
+    // Connection flow-control windows
+    int64_t send_window = default_window_size;
+    int64_t recv_window = default_window_size;
+
+    // Receive windows are replenished once half of them has been consumed
+    static constexpr int64_t connection_window_size = 1 << 24;
+
+    bool preface_received = false;
+    bool settings_received = false;
+    bool closed = false;
+
+    // Header block received in a HEADERS frame and CONTINUATION frames
+    uint32_t continuation_stream_id = 0;
+    bool continuation_end_stream = false;
+    std::vector<uint8_t> header_block;
+
+    // Bound on the compressed header block buffered across CONTINUATION
+    // frames. Its decoded size is bounded by local.max_header_list_size.
+    static constexpr size_t max_header_block_size = 1 << 16;
+
+    // Incomplete frame received from the peer
+    std::vector<uint8_t> input;
+
+    std::vector<uint8_t> output;
+
+    Session(bool is_server_) :
+      is_server(is_server_),
+      encoder(hpack::default_table_size),
+      decoder(local.header_table_size),
+      next_stream_id(is_server_ ? 2 : 1)
+    {
+      local.enable_push = 0;
+      local.initial_window_size = 1 << 20;
+      local.max_header_list_size = 1 << 16;
+    }
+
+    // Queues the connection preface, i.e. the client magic for clients, and
+    // the local settings
+    void start()
+    {
+      if (!is_server)
+      {
+        output.insert(output.end(), preface.begin(), preface.end());
+      }
+
+      std::vector<std::pair<SettingsId, uint32_t>> settings = {
+        {SettingsId::ENABLE_PUSH, local.enable_push},
+        {SettingsId::INITIAL_WINDOW_SIZE, local.initial_window_size},
+        {SettingsId::MAX_HEADER_LIST_SIZE, local.max_header_list_size}};
+      if (local.max_concurrent_streams != Settings().max_concurrent_streams)
+      {
+        settings.emplace_back(
+          SettingsId::MAX_CONCURRENT_STREAMS, local.max_concurrent_streams);
+      }
+      write_frame_header(
+        output, settings.size() * 6, FrameType::SETTINGS, 0, 0);
+      for (const auto& [id, value] : settings)
+      {
+        output.push_back((uint16_t)id >> 8);
+        output.push_back((uint16_t)id);
+        write_u32(output, value);
+      }
+
+      write_window_update(0, connection_window_size - recv_window);
+      recv_window = connection_window_size;
+    }
+
+    bool is_peer_stream(uint32_t stream_id) const
+    {
+      return (stream_id % 2 == 1) == is_server;
+    }
+
+    // True if the stream was opened at some point, and has since closed
+    bool is_closed_stream(uint32_t stream_id) const
+    {
+      return is_peer_stream(stream_id) ? stream_id <= last_peer_stream_id :
+                                         stream_id < next_stream_id;
+    }
+
+    void write_window_update(uint32_t stream_id, uint32_t increment)
+    {
+      write_frame_header(output, 4, FrameType::WINDOW_UPDATE, 0, stream_id);
+      write_u32(output, increment);
+    }
+
+    void reset_stream(uint32_t stream_id, ErrorCode code)
+    {
+      write_frame_header(output, 4, FrameType::RST_STREAM, 0, stream_id);
+      write_u32(output, (uint32_t)code);
+      streams.erase(stream_id);
+    }
+
+    Stream& open_stream(uint32_t stream_id)
+    {
+      auto& stream = streams[stream_id];
+      stream.send_window = remote.initial_window_size;
+      stream.recv_window = local.initial_window_size;
+      return stream;
+    }
+
+    void send_headers(
+      uint32_t stream_id, const hpack::HeaderList& headers, bool end_stream)
+    {
+      std::vector<uint8_t> block;
+      encoder.encode(block, headers);
+
+      // Split into a HEADERS frame and CONTINUATION frames, if necessary
+      size_t offset = 0;
+      auto type = FrameType::HEADERS;
+      do
+      {
+        const auto n = std::min<size_t>(
+          block.size() - offset, remote.max_frame_size);
+        uint8_t f = (type == FrameType::HEADERS && end_stream) ?
+          flags::END_STREAM :
+          0;
+        if (offset + n == block.size())
+        {
+          f |= flags::END_HEADERS;
+        }
+        write_frame_header(output, n, type, f, stream_id);
+        output.insert(
+          output.end(), block.begin() + offset, block.begin() + offset + n);
+        offset += n;
+        type = FrameType::CONTINUATION;
+      } while (offset < block.size());
+    }
+
+    // Sends the body of the stream's message, which ends the stream, once the
+    // flow-control windows allow it
+    void send_data(
+      uint32_t stream_id, Stream& stream, std::vector<uint8_t>&& body)
+    {
+      stream.pending = std::move(body);
+      stream.pending_offset = 0;
+      stream.sending = true;
+      flush_stream(stream_id, stream);
+    }
+
+    // Returns false if the stream was closed, and erased
+    bool flush_stream(uint32_t stream_id, Stream& stream)
+    {
+      while (stream.sending)
+      {
+        const auto remaining = stream.pending.size() - stream.pending_offset;
+        const auto n = std::min<int64_t>(
+          {(int64_t)remaining,
+           send_window,
+           stream.send_window,
+           remote.max_frame_size});
+        if (n <= 0 && remaining > 0)
+        {
+          return true;
+        }
+
+        const bool last = (size_t)n == remaining;
+        write_frame_header(
+          output,
+          n,
+          FrameType::DATA,
+          last ? flags::END_STREAM : 0,
+          stream_id);
+        const auto begin = stream.pending.begin() + stream.pending_offset;
+        output.insert(output.end(), begin, begin + n);
+        stream.pending_offset += n;
+        send_window -= n;
+        stream.send_window -= n;
+
+        if (last)
+        {
+          stream.sending = false;
+          stream.pending = {};
+          return !local_closed(stream_id, stream);
+        }
+      }
+      return true;
+    }
+
+    // Sends as much of the pending data as the windows allow, e.g. once they
+    // have been raised
+    void flush_streams()
+    {
+      for (auto it = streams.begin(); it != streams.end() && send_window > 0;)
+      {
+        auto next = std::next(it);
+        if (it->second.sending)
+        {
+          flush_stream(it->first, it->second);
+        }
+        it = next;
+      }
+    }
+
+    // Returns true if the stream was closed, and erased
+    bool local_closed(uint32_t stream_id, Stream& stream)
+    {
+      if (stream.state == StreamState::HalfClosedRemote)
+      {
+        streams.erase(stream_id);
+        return true;
+      }
+      stream.state = StreamState::HalfClosedLocal;
+      return false;
+    }
+
+    // Called when a complete message has been received on a stream. The
+    // stream's headers and body may be moved from.
+    virtual void handle_message(uint32_t stream_id, Stream& stream) = 0;
+
+    // Requests still being processed, which count towards the concurrent
+    // stream limit even once their stream has been reset
+    virtual size_t pending_requests() const
+    {
+      return 0;
+    }
+
+    void remote_closed(uint32_t stream_id, Stream& stream)
+    {
+      if (stream.state == StreamState::HalfClosedLocal)
+      {
+        auto headers = std::move(stream.headers);
+        auto body = std::move(stream.body);
+        streams.erase(stream_id);
+        Stream done;
+        done.headers = std::move(headers);
+        done.body = std::move(body);
+        handle_message(stream_id, done);
+        return;
+      }
+
+      stream.state = StreamState::HalfClosedRemote;
+      handle_message(stream_id, stream);
+    }
+
+    void handle_data(const FrameHeader& h, const uint8_t* payload)
+    {
+      if (h.stream_id == 0)
+      {
+        throw ProtocolError(ErrorCode::PROTOCOL_ERROR, "DATA on stream 0");
+      }
+
+      // The whole frame, including padding, counts against the windows
+      if ((int64_t)h.length > recv_window)
+      {
+        throw ProtocolError(
+          ErrorCode::FLOW_CONTROL_ERROR, "Connection window exceeded");
+      }
+      recv_window -= h.length;
+      if (recv_window <= connection_window_size / 2)
+      {
+        write_window_update(0, connection_window_size - recv_window);
+        recv_window = connection_window_size;
+      }
+
+      auto it = streams.find(h.stream_id);
+      if (it == streams.end())
+      {
+        if (!is_closed_stream(h.stream_id))
+        {
+          throw ProtocolError(ErrorCode::PROTOCOL_ERROR, "DATA on idle stream");
+        }
+        reset_stream(h.stream_id, ErrorCode::STREAM_CLOSED);
+        return;
+      }
+
+      auto& stream = it->second;
+      if (stream.state == StreamState::HalfClosedRemote)
+      {
+        reset_stream(h.stream_id, ErrorCode::STREAM_CLOSED);
+        return;
+      }
+      if (!stream.headers_received)
+      {
+        reset_stream(h.stream_id, ErrorCode::PROTOCOL_ERROR);
+        return;
+      }
+
+      if ((int64_t)h.length > stream.recv_window)
+      {
+        reset_stream(h.stream_id, ErrorCode::FLOW_CONTROL_ERROR);
+        return;
+      }
+      stream.recv_window -= h.length;
+
+      size_t size = h.length;
+      if (h.flags & flags::PADDED)
+      {
+        if (size == 0 || payload[0] >= size)
+        {
+          throw ProtocolError(ErrorCode::PROTOCOL_ERROR, "Invalid padding");
+        }
+        size -= payload[0] + 1;
+        payload++;
+      }
+      stream.body.insert(stream.body.end(), payload, payload + size);
+
+      if (h.flags & flags::END_STREAM)
+      {
+        remote_closed(h.stream_id, stream);
+      }
+      else if (stream.recv_window <= local.initial_window_size / 2)
+      {
+        write_window_update(
+          h.stream_id, local.initial_window_size - stream.recv_window);
+        stream.recv_window = local.initial_window_size;
+      }
+    }
+
+    void handle_headers(const FrameHeader& h, const uint8_t* payload)
+    {
+      if (h.stream_id == 0)
+      {
+        throw ProtocolError(ErrorCode::PROTOCOL_ERROR, "HEADERS on stream 0");
+      }
+
+      size_t size = h.length;
+      size_t padding = 0;
+      if (h.flags & flags::PADDED)
+      {
+        if (size == 0)
+        {
+          throw ProtocolError(ErrorCode::PROTOCOL_ERROR, "Invalid padding");
+        }
+        padding = payload[0];
+        payload++;
+        size--;
+      }
+      if (h.flags & flags::PRIORITY)
+      {
+        // Priorities are ignored
+        if (size < 5)
+        {
+          throw ProtocolError(
+            ErrorCode::FRAME_SIZE_ERROR, "HEADERS frame too short");
+        }
+        payload += 5;
+        size -= 5;
+      }
+      if (padding > size)
+      {
+        throw ProtocolError(ErrorCode::PROTOCOL_ERROR, "Invalid padding");
+      }
+      size -= padding;
+
+      header_block.assign(payload, payload + size);
+      continuation_end_stream = h.flags & flags::END_STREAM;
+      if (h.flags & flags::END_HEADERS)
+      {
+        handle_header_block(h.stream_id);
+      }
+      else
+      {
+        continuation_stream_id = h.stream_id;
+      }
+    }
+
+    void handle_continuation(const FrameHeader& h, const uint8_t* payload)
+    {
+      if (h.stream_id == 0 || h.stream_id != continuation_stream_id)
+      {
+        throw ProtocolError(
+          ErrorCode::PROTOCOL_ERROR, "Unexpected CONTINUATION frame");
+      }
+
+      if (header_block.size() + h.length > max_header_block_size)
+      {
+        throw ProtocolError(
+          ErrorCode::ENHANCE_YOUR_CALM, "Header block too large");
+      }
+      header_block.insert(header_block.end(), payload, payload + h.length);
+
+      if (h.flags & flags::END_HEADERS)
+      {
+        continuation_stream_id = 0;
+        handle_header_block(h.stream_id);
+      }
+    }
+
+    void handle_header_block(uint32_t stream_id)
+    {
+      // Every header block is decoded, even if the stream is then reset, to
+      // keep the decoder's dynamic table in sync with the peer's encoder
+      hpack::HeaderList headers;
+      decoder.decode(
+        header_block.data(),
+        header_block.size(),
+        headers,
+        local.max_header_list_size);
+      header_block.clear();
+
+      auto it = streams.find(stream_id);
+      if (it == streams.end())
+      {
+        // Only clients open streams
+        if (!is_server || !is_peer_stream(stream_id))
+        {
+          if (is_closed_stream(stream_id))
+          {
+            return;
+          }
+          throw ProtocolError(
+            ErrorCode::PROTOCOL_ERROR, "HEADERS on unexpected stream");
+        }
+
+        if (stream_id <= last_peer_stream_id)
+        {
+          reset_stream(stream_id, ErrorCode::STREAM_CLOSED);
+          return;
+        }
+
+        last_peer_stream_id = stream_id;
+        if (
+          streams.size() >= local.max_concurrent_streams ||
+          pending_requests() >= local.max_concurrent_streams)
+        {
+          reset_stream(stream_id, ErrorCode::REFUSED_STREAM);
+          return;
+        }
+
+        open_stream(stream_id);
+        it = streams.find(stream_id);
+      }
+
+      auto& stream = it->second;
+      if (stream.state == StreamState::HalfClosedRemote)
+      {
+        reset_stream(stream_id, ErrorCode::STREAM_CLOSED);
+        return;
+      }
+
+      if (!stream.headers_received)
+      {
+        // Informational responses are followed by the final response
+        if (
+          !is_server && !headers.empty() && headers[0].first == ":status" &&
+          headers[0].second.size() == 3 && headers[0].second[0] == '1')
+        {
+          return;
+        }
+
+        stream.headers = std::move(headers);
+        stream.headers_received = true;
+      }
+      else if (!continuation_end_stream)
+      {
+        // Trailers, which are ignored, must end the stream
+        reset_stream(stream_id, ErrorCode::PROTOCOL_ERROR);
+        return;
+      }
+
+      if (continuation_end_stream)
+      {
+        remote_closed(stream_id, stream);
+      }
+    }
+
+    void handle_settings(const FrameHeader& h, const uint8_t* payload)
+    {
+      if (h.stream_id != 0)
+      {
+        throw ProtocolError(
+          ErrorCode::PROTOCOL_ERROR, "SETTINGS on non-zero stream");
+      }
+
+      if (h.flags & flags::ACK)
+      {
+        if (h.length != 0)
+        {
+          throw ProtocolError(
+            ErrorCode::FRAME_SIZE_ERROR, "SETTINGS ACK with payload");
+        }
+        return;
+      }
+
+      if (h.length % 6 != 0)
+      {
+        throw ProtocolError(
+          ErrorCode::FRAME_SIZE_ERROR, "Invalid SETTINGS length");
+      }
+
+      for (size_t i = 0; i < h.length; i += 6)
+      {
+        const auto id = SettingsId((uint16_t)payload[i] << 8 | payload[i + 1]);
+        const auto value = read_u32(payload + i + 2);
+        switch (id)
+        {
+          case SettingsId::HEADER_TABLE_SIZE:
+          {
+            remote.header_table_size = value;
+            encoder.set_max_table_size(value);
+            break;
+          }
+
+          case SettingsId::ENABLE_PUSH:
+          {
+            if (value > 1)
+            {
+              throw ProtocolError(
+                ErrorCode::PROTOCOL_ERROR, "Invalid SETTINGS_ENABLE_PUSH");
+            }
+            remote.enable_push = value;
+            break;
+          }
+
+          case SettingsId::MAX_CONCURRENT_STREAMS:
+          {
+            remote.max_concurrent_streams = value;
+            break;
+          }
+
+          case SettingsId::INITIAL_WINDOW_SIZE:
+          {
+            if (value > max_window_size)
+            {
+              throw ProtocolError(
+                ErrorCode::FLOW_CONTROL_ERROR,
+                "Invalid SETTINGS_INITIAL_WINDOW_SIZE");
+            }
+
+            // Applies to the windows of all open streams
+            const int64_t delta = (int64_t)value - remote.initial_window_size;
+            for (auto& [_, stream] : streams)
+            {
+              stream.send_window += delta;
+              if (stream.send_window > max_window_size)
+              {
+                throw ProtocolError(
+                  ErrorCode::FLOW_CONTROL_ERROR, "Stream window overflow");
+              }
+            }
+            remote.initial_window_size = value;
+            break;
+          }
+
+          case SettingsId::MAX_FRAME_SIZE:
+          {
+            if (value < default_max_frame_size || value > max_max_frame_size)
+            {
+              throw ProtocolError(
+                ErrorCode::PROTOCOL_ERROR, "Invalid SETTINGS_MAX_FRAME_SIZE");
+            }
+            remote.max_frame_size = value;
+            break;
+          }
+
+          case SettingsId::MAX_HEADER_LIST_SIZE:
+          {
+            remote.max_header_list_size = value;
+            break;
+          }
+
+          default:
+          {
+            // Unknown settings are ignored
+            break;
+          }
+        }
+      }
+
+      settings_received = true;
+      write_frame_header(output, 0, FrameType::SETTINGS, flags::ACK, 0);
+      flush_streams();
+    }
+
+    void handle_window_update(const FrameHeader& h, const uint8_t* payload)
+    {
+      if (h.length != 4)
+      {
+        throw ProtocolError(
+          ErrorCode::FRAME_SIZE_ERROR, "Invalid WINDOW_UPDATE length");
+      }
+
+      const int64_t increment = read_u32(payload) & 0x7fffffff;
+      if (h.stream_id == 0)
+      {
+        if (increment == 0 || send_window + increment > max_window_size)
+        {
+          throw ProtocolError(
+            ErrorCode::FLOW_CONTROL_ERROR, "Invalid connection WINDOW_UPDATE");
+        }
+        send_window += increment;
+        flush_streams();
+        return;
+      }
+
+      auto it = streams.find(h.stream_id);
+      if (it == streams.end())
+      {
+        // May arrive after the stream is closed
+        return;
+      }
+
+      auto& stream = it->second;
+      if (increment == 0)
+      {
+        reset_stream(h.stream_id, ErrorCode::PROTOCOL_ERROR);
+        return;
+      }
+      if (stream.send_window + increment > max_window_size)
+      {
+        reset_stream(h.stream_id, ErrorCode::FLOW_CONTROL_ERROR);
+        return;
+      }
+      stream.send_window += increment;
+      flush_stream(h.stream_id, stream);
+    }
+
+    // Called on RST_STREAM for any stream that was opened, which may since
+    // have closed
+    virtual void handle_reset(uint32_t stream_id, ErrorCode)
+    {
+      streams.erase(stream_id);
+    }
+
+    void handle_frame(const FrameHeader& h, const uint8_t* payload)
+    {
+      if (continuation_stream_id != 0 && h.type != FrameType::CONTINUATION)
+      {
+        throw ProtocolError(
+          ErrorCode::PROTOCOL_ERROR, "Expected CONTINUATION frame");
+      }
+
+      if (!settings_received && h.type != FrameType::SETTINGS)
+      {
+        throw ProtocolError(
+          ErrorCode::PROTOCOL_ERROR, "Expected SETTINGS as first frame");
+      }
+
+      switch (h.type)
+      {
+        case FrameType::DATA:
+        {
+          handle_data(h, payload);
+          break;
+        }
+
+        case FrameType::HEADERS:
+        {
+          handle_headers(h, payload);
+          break;
+        }
+
+        case FrameType::CONTINUATION:
+        {
+          handle_continuation(h, payload);
+          break;
+        }
+
+        case FrameType::PRIORITY:
+        {
+          // Priorities are ignored
+          if (h.stream_id == 0 || h.length != 5)
+          {
+            throw ProtocolError(
+              ErrorCode::PROTOCOL_ERROR, "Invalid PRIORITY frame");
+          }
+          break;
+        }
+
+        case FrameType::RST_STREAM:
+        {
+          if (h.stream_id == 0 || h.length != 4)
+          {
+            throw ProtocolError(
+              ErrorCode::PROTOCOL_ERROR, "Invalid RST_STREAM frame");
+          }
+          if (!is_closed_stream(h.stream_id))
+          {
+            throw ProtocolError(
+              ErrorCode::PROTOCOL_ERROR, "RST_STREAM on idle stream");
+          }
+          handle_reset(h.stream_id, ErrorCode(read_u32(payload)));
+          break;
+        }
+
+        case FrameType::SETTINGS:
+        {
+          handle_settings(h, payload);
+          break;
+        }
+
+        case FrameType::PUSH_PROMISE:
+        {
+          // Push is disabled by our settings, and never sent by clients
+          throw ProtocolError(
+            ErrorCode::PROTOCOL_ERROR, "Unexpected PUSH_PROMISE");
+        }
+
+        case FrameType::PING:
+        {
+          if (h.stream_id != 0 || h.length != 8)
+          {
+            throw ProtocolError(
+              ErrorCode::PROTOCOL_ERROR, "Invalid PING frame");
+          }
+          if (!(h.flags & flags::ACK))
+          {
+            write_frame_header(output, 8, FrameType::PING, flags::ACK, 0);
+            output.insert(output.end(), payload, payload + 8);
+          }
+          break;
+        }
+
+        case FrameType::GOAWAY:
+        {
+          // The peer opens no new streams, but those in progress complete
+          if (h.stream_id != 0 || h.length < 8)
+          {
+            throw ProtocolError(
+              ErrorCode::PROTOCOL_ERROR, "Invalid GOAWAY frame");
+          }
+          break;
+        }
+
+        case FrameType::WINDOW_UPDATE:
+        {
+          handle_window_update(h, payload);
+          break;
+        }
+
+        default:
+        {
+          // Unknown frame types are ignored
+          break;
+        }
+      }
+    }
+
+    // Returns the number of bytes consumed
+    size_t consume(const uint8_t* data, size_t size)
+    {
+      size_t offset = 0;
+
+      if (is_server && !preface_received)
+      {
+        if (size < preface.size())
+        {
+          if (::memcmp(data, preface.data(), size) != 0)
+          {
+            throw ProtocolError(
+              ErrorCode::PROTOCOL_ERROR, "Invalid connection preface");
+          }
+          return 0;
+        }
+        if (::memcmp(data, preface.data(), preface.size()) != 0)
+        {
+          throw ProtocolError(
+            ErrorCode::PROTOCOL_ERROR, "Invalid connection preface");
+        }
+        preface_received = true;
+        offset = preface.size();
+      }
+
+      while (size - offset >= frame_header_size)
+      {
+        const auto h = read_frame_header(data + offset);
+        if (h.length > local.max_frame_size)
+        {
+          throw ProtocolError(
+            ErrorCode::FRAME_SIZE_ERROR,
+            fmt::format("Frame of {} bytes is too large", h.length));
+        }
+
+        if (size - offset - frame_header_size < h.length)
+        {
+          break;
+        }
+
+        handle_frame(h, data + offset + frame_header_size);
+        offset += frame_header_size + h.length;
+      }
+
+      return offset;
+    }
+
+  public:
+    virtual ~Session() {}
+
+    /// Processes the bytes received from the peer. On a connection error,
+    /// GOAWAY is queued and the session is closed, which the caller should
+    /// check for once it has sent the output.
+    void recv(const uint8_t* data, size_t size)
+    {
+      if (closed)
+      {
+        return;
+      }
+
+      try
+      {
+        if (input.empty())
+        {
+          const auto n = consume(data, size);
+          input.assign(data + n, data + size);
+        }
+        else
+        {
+          input.insert(input.end(), data, data + size);
+          const auto n = consume(input.data(), input.size());
+          input.erase(input.begin(), input.begin() + n);
+        }
+      }
+      catch (const ProtocolError& e)
+      {
+        LOG_DEBUG_FMT("HTTP/2 connection error: {}", e.what());
+        close(e.code);
+      }
+      catch (const hpack::HeaderListTooLarge& e)
+      {
+        LOG_DEBUG_FMT("HTTP/2 header list too large: {}", e.what());
+        close(ErrorCode::ENHANCE_YOUR_CALM);
+      }
+      catch (const hpack::CompressionError& e)
+      {
+        LOG_DEBUG_FMT("HTTP/2 compression error: {}", e.what());
+        close(ErrorCode::COMPRESSION_ERROR);
+      }
+    }
+
+    /// Queues GOAWAY, after which the session neither sends nor receives
+    /// frames
+    void close(ErrorCode code = ErrorCode::NO_ERROR)
+    {
+      if (closed)
+      {
+        return;
+      }
+
+      write_frame_header(output, 8, FrameType::GOAWAY, 0, 0);
+      write_u32(output, last_peer_stream_id);
+      write_u32(output, (uint32_t)code);
+      closed = true;
+    }
+
+    bool is_closed() const
+    {
+      return closed;
+    }
+
+    bool has_output() const
+    {
+      return !output.empty();
+    }
+
+    /// Returns the bytes to send to the peer
+    std::vector<uint8_t> take_output()
+    {
+      auto out = std::move(output);
+      output.clear();
+      return out;
+    }
+
+    size_t open_streams() const
+    {
+      return streams.size();
+    }
+  };
+
+  class ServerSession : public Session
+  {
+  private:
+    RequestProcessor& proc;
+
+    // Streams reset by the client, less the responses sent. Resetting streams
+    // leaves their requests to be processed (CVE-2023-44487), so connections
+    // that keep doing so are closed.
+    size_t peer_resets = 0;
+
+    // Checks the request is well-formed (RFC 7540, section 8.1.2)
+    static bool is_valid_request(const hpack::HeaderList& headers)
+    {
+      bool regular_seen = false;
+      bool method = false, path = false, scheme = false;
+      for (const auto& [name, value] : headers)
+      {
+        if (name.empty())
+        {
+          return false;
+        }
+
+        if (name[0] == ':')
+        {
+          if (regular_seen)
+          {
+            return false;
+          }
+
+          if (name == ":method")
+          {
+            method = true;
+          }
+          else if (name == ":path")
+          {
+            path = !value.empty();
+          }
+          else if (name == ":scheme")
+          {
+            scheme = true;
+          }
+          else if (name != ":authority")
+          {
+            return false;
+          }
+          continue;
+        }
+
+        regular_seen = true;
+        if (
+          std::any_of(
+            name.begin(), name.end(), [](char c) { return std::isupper(c); }) ||
+          is_connection_specific(name) || (name == "te" && value != "trailers"))
+        {
+          return false;
+        }
+      }
+      return method && path && scheme;
+    }
+
+  protected:
+    void handle_message(uint32_t stream_id, Stream& stream) override
+    {
+      if (!is_valid_request(stream.headers))
+      {
+        reset_stream(stream_id, ErrorCode::PROTOCOL_ERROR);
+        return;
+      }
+
+      proc.handle_request(
+        stream_id, std::move(stream.headers), std::move(stream.body));
+    }
+
+    size_t pending_requests() const override
+    {
+      return proc.pending_requests();
+    }
+
+    void handle_reset(uint32_t stream_id, ErrorCode) override
+    {
+      streams.erase(stream_id);
+      if (++peer_resets > max_peer_resets)
+      {
+        throw ProtocolError(
+          ErrorCode::ENHANCE_YOUR_CALM, "Too many streams reset");
+      }
+    }
+
+  public:
+    static constexpr uint32_t max_concurrent_streams = 128;
+    static constexpr size_t max_peer_resets = max_concurrent_streams;
+
+    ServerSession(RequestProcessor& proc_) : Session(true), proc(proc_)
+    {
+      local.max_concurrent_streams = max_concurrent_streams;
+      start();
+    }
+
+    /// Sends the response to the request received on the stream, unless it
+    /// has since been reset by the client. Connection-specific headers are
+    /// dropped.
+    void send_response(
+      uint32_t stream_id,
+      int status,
+      const hpack::HeaderList& headers,
+      std::vector<uint8_t>&& body)
+    {
+      if (closed)
+      {
+        return;
+      }
+
+      auto it = streams.find(stream_id);
+      if (
+        it == streams.end() ||
+        it->second.state != StreamState::HalfClosedRemote ||
+        it->second.sending)
+      {
+        return;
+      }
+
+      if (peer_resets > 0)
+      {
+        --peer_resets;
+      }
+
+      hpack::HeaderList h;
+      h.reserve(headers.size() + 1);
+      h.emplace_back(":status", std::to_string(status));
+      for (const auto& f : headers)
+      {
+        if (!is_connection_specific(f.first))
+        {
+          h.push_back(f);
+        }
+      }
+
+      if (body.empty())
+      {
+        send_headers(stream_id, h, true);
+        streams.erase(it);
+        return;
+      }
+
+      send_headers(stream_id, h, false);
+      send_data(stream_id, it->second, std::move(body));
+    }
+  };
+
+  /// Returns the frames of a request, encoded without the dynamic table and
+  /// with stream id 0, so that they can be prepared ahead of time and sent on
+  /// any stream of any connection (see ClientSession::send_prepared())
+  inline std::vector<uint8_t> prepare_request(
+    const hpack::HeaderList& headers, const uint8_t* body, size_t size)
+  {
+    std::vector<uint8_t> block;
+    hpack::Encoder(hpack::default_table_size, false).encode(block, headers);
+
+    std::vector<uint8_t> frames;
+    size_t offset = 0;
+    auto type = FrameType::HEADERS;
+    do
+    {
+      const auto n =
+        std::min<size_t>(block.size() - offset, default_max_frame_size);
+      uint8_t f = (type == FrameType::HEADERS && size == 0) ?
+        flags::END_STREAM :
+        0;
+      if (offset + n == block.size())
+      {
+        f |= flags::END_HEADERS;
+      }
+      write_frame_header(frames, n, type, f, 0);
+      frames.insert(
+        frames.end(), block.begin() + offset, block.begin() + offset + n);
+      offset += n;
+      type = FrameType::CONTINUATION;
+    } while (offset < block.size());
+
+    for (size_t i = 0; i < size; i += default_max_frame_size)
+    {
+      const auto n = std::min(size - i, default_max_frame_size);
+      write_frame_header(
+        frames,
+        n,
+        FrameType::DATA,
+        i + n == size ? flags::END_STREAM : 0,
+        0);
+      frames.insert(frames.end(), body + i, body + i + n);
+    }
+
+    return frames;
+  }
+
+  class ClientSession : public Session
+  {
+  private:
+    ResponseProcessor& proc;
+
+    Stream& new_stream(uint32_t& stream_id)
+    {
+      if (closed)
+      {
+        throw std::logic_error("Sending request on closed HTTP/2 session");
+      }
+      stream_id = next_stream_id;
+      next_stream_id += 2;
+      return open_stream(stream_id);
+    }
+
+    void end_headers(
+      uint32_t stream_id, Stream& stream, std::vector<uint8_t>&& body)
+    {
+      if (body.empty())
+      {
+        local_closed(stream_id, stream);
+      }
+      else
+      {
+        send_data(stream_id, stream, std::move(body));
+      }
+    }
+
+  protected:
+    void handle_message(uint32_t stream_id, Stream& stream) override
+    {
+      auto headers = std::move(stream.headers);
+      auto body = std::move(stream.body);
+
+      // The response may complete before the request has been sent
+      if (stream.sending)
+      {
+        streams.erase(stream_id);
+      }
+
+      proc.handle_response(stream_id, std::move(headers), std::move(body));
+    }
+
+    void handle_reset(uint32_t stream_id, ErrorCode code) override
+    {
+      if (streams.erase(stream_id) == 0)
+      {
+        return;
+      }
+      throw std::runtime_error(fmt::format(
+        "HTTP/2 stream {} was reset by the server (error {})",
+        stream_id,
+        (uint32_t)code));
+    }
+
+  public:
+    // Until the server's settings are received, assume it allows as many
+    // concurrent streams as it should at least (RFC 7540, section 6.5.2)
+    static constexpr uint32_t initial_max_concurrent_streams = 100;
+
+    ClientSession(ResponseProcessor& proc_) : Session(false), proc(proc_)
+    {
+      remote.max_concurrent_streams = initial_max_concurrent_streams;
+      start();
+    }
+
+    /// True if the server allows another stream to be opened now
+    bool can_send_request() const
+    {
+      return streams.size() < remote.max_concurrent_streams;
+    }
+
+    /// Sends a request on a new stream, returning its id. Header names must
+    /// be lowercase, and the pseudo-headers (:method, :scheme, :path) first.
+    uint32_t send_request(
+      const hpack::HeaderList& headers, std::vector<uint8_t>&& body)
+    {
+      uint32_t stream_id;
+      auto& stream = new_stream(stream_id);
+      send_headers(stream_id, headers, body.empty());
+      end_headers(stream_id, stream, std::move(body));
+      return stream_id;
+    }
+
+    /// Sends a request returned by prepare_request() on a new stream,
+    /// returning its id
+    uint32_t send_prepared(const std::vector<uint8_t>& frames)
+    {
+      uint32_t stream_id;
+      auto& stream = new_stream(stream_id);
+
+      std::vector<uint8_t> body;
+      for (size_t offset = 0; offset < frames.size();)
+      {
+        const auto h = read_frame_header(frames.data() + offset);
+        const auto payload = frames.begin() + offset + frame_header_size;
+        if (h.type == FrameType::DATA)
+        {
+          body.insert(body.end(), payload, payload + h.length);
+        }
+        else
+        {
+          write_frame_header(output, h.length, h.type, h.flags, stream_id);
+          output.insert(output.end(), payload, payload + h.length);
+        }
+        offset += frame_header_size + h.length;
+      }
+
+      end_headers(stream_id, stream, std::move(body));
+      return stream_id;
+    }
+  };
+}
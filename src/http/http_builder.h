@@ -204,6 +204,18 @@ namespace http
   public:
     Response(http_status s = HTTP_STATUS_OK) : status(s) {}
 
+    // Without a Content-Length, the body is sent afterwards, in chunks (see
+    // build_chunk_header())
+    void set_chunked_body()
+    {
+      body = nullptr;
+      body_size = 0;
+
+      headers.erase(headers::CONTENT_LENGTH);
+      headers[headers::TRANSFER_ENCODING] =
+        headervalues::transferencoding::CHUNKED;
+    }
+
     std::vector<uint8_t> build_response(bool header_only = false) const
     {
       const auto body_view = (header_only || body == nullptr) ?
@@ -225,6 +237,17 @@ namespace http
     }
   };
 
+  // With chunked transfer encoding, each chunk of the body is preceded by
+  // its size, in hex, and followed by CRLF. An empty chunk ends the body.
+  inline std::vector<uint8_t> build_chunk_header(size_t size)
+  {
+    const auto s = fmt::format("{:x}\r\n", size);
+    return std::vector<uint8_t>(s.begin(), s.end());
+  }
+
+  static constexpr std::string_view chunk_trailer = "\r\n";
+  static constexpr std::string_view last_chunk = "0\r\n\r\n";
+
 // Most builder function are unused from enclave
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-function"
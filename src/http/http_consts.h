@@ -17,6 +17,7 @@ namespace http
     static constexpr auto HOST = "host";
     static constexpr auto LOCATION = "location";
     static constexpr auto RETRY_AFTER = "retry-after";
+    static constexpr auto TRANSFER_ENCODING = "transfer-encoding";
     static constexpr auto WWW_AUTHENTICATE = "www-authenticate";
 
     static constexpr auto CCF_TX_SEQNO = "x-ccf-tx-seqno";
@@ -32,6 +33,11 @@ namespace http
       static constexpr auto TEXT = "text/plain";
       static constexpr auto OCTET_STREAM = "application/octet-stream";
     }
+
+    namespace transferencoding
+    {
+      static constexpr auto CHUNKED = "chunked";
+    }
   }
 
   namespace auth
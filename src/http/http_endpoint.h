@@ -2,15 +2,21 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "authentication/authentication_types.h"
 #include "ds/logger.h"
+#include "ds/tracing.h"
 #include "enclave/client_endpoint.h"
+#include "enclave/forwarder_types.h"
 #include "enclave/rpc_map.h"
+#include "http2.h"
 #include "http_parser.h"
 #include "http_rpc_context.h"
 #include "ws_parser.h"
 #include "ws_rpc_context.h"
 #include "ws_upgrade.h"
 
+#include <deque>
+
 namespace http
 {
   class HTTPEndpoint : public enclave::TLSEndpoint
@@ -32,11 +38,16 @@ namespace http
       wp(wp_)
     {}
 
+    virtual void parse(const uint8_t* data, size_t size)
+    {
+      p.execute(data, size);
+    }
+
   public:
     static void recv_cb(std::unique_ptr<threading::Tmsg<SendRecvMsg>> msg)
     {
       reinterpret_cast<HTTPEndpoint*>(msg->data.self.get())
-        ->recv_(msg->data.data.data(), msg->data.data.size());
+        ->recv_(std::move(msg->data.data));
     }
 
     void recv(const uint8_t* data, size_t size) override
@@ -46,14 +57,15 @@ namespace http
       msg->data.data.assign(data, data + size);
 
       threading::ThreadMessaging::thread_messaging.add_task(
-        execution_thread, std::move(msg));
+        strand, std::move(msg));
     }
 
-    void recv_(const uint8_t* data_, size_t size_)
+    void recv_(std::vector<uint8_t>&& data_)
     {
-      recv_buffered(data_, size_);
+      LOG_TRACE_FMT("recv called with {} bytes", data_.size());
 
-      LOG_TRACE_FMT("recv called with {} bytes", size_);
+      // The chunk copied from the ringbuffer is buffered without another copy
+      recv_buffered(std::move(data_));
 
       if (is_websocket)
       {
@@ -99,7 +111,10 @@ namespace http
 
           try
           {
-            p.execute(data, n_read);
+            {
+              tracing::SpanTimer span(tracing::SpanKind::HttpParse);
+              parse(data, n_read);
+            }
 
             // Used all provided bytes - check if more are available
             n_read = read(buf.data(), buf.size(), false);
@@ -116,24 +131,373 @@ namespace http
     }
   };
 
-  class HTTPServerEndpoint : public HTTPEndpoint, public http::RequestProcessor
+  inline std::optional<llhttp_method> method_from_str(const std::string& s)
+  {
+#define XX(num, name, string) \
+  if (s == #string) \
+  { \
+    return HTTP_##name; \
+  }
+    HTTP_METHOD_MAP(XX)
+#undef XX
+    return std::nullopt;
+  }
+
+  class HTTPServerEndpoint : public HTTPEndpoint,
+                             public http::RequestProcessor,
+                             public http2::RequestProcessor
   {
   private:
     http::RequestParser request_parser;
     ws::RequestParser ws_request_parser;
 
     std::shared_ptr<enclave::RPCMap> rpc_map;
+    enclave::AbstractRPCResponder& rpc_responder;
     std::shared_ptr<enclave::RpcHandler> handler;
     std::shared_ptr<enclave::SessionContext> session_ctx;
     size_t session_id;
     size_t request_index = 0;
 
+    // If HTTP/2 is negotiated via ALPN, the requests received on each stream
+    // are executed concurrently on the worker threads, and their responses
+    // are sent as they complete, in any order. The responses produced by the
+    // frontends are HTTP/1.1, and are converted on the session strand.
+    bool protocol_selected = false;
+    std::unique_ptr<http2::ServerSession> h2;
+
+    struct ActiveStream
+    {
+      size_t reply_id;
+      std::shared_ptr<enclave::SessionContext> session_ctx;
+    };
+    std::unordered_map<uint32_t, ActiveStream> active_streams;
+    size_t next_worker = 0;
+
+    struct StreamRequestMsg
+    {
+      std::shared_ptr<Endpoint> self;
+      std::shared_ptr<enclave::RpcContext> rpc_ctx;
+      uint32_t stream_id;
+    };
+
+    struct StreamResponseMsg
+    {
+      std::shared_ptr<Endpoint> self;
+      uint32_t stream_id;
+      std::vector<uint8_t> data;
+    };
+
+    // While the body of a response is streamed, in chunks, the responses to
+    // later requests on the connection are held, to be sent in order after
+    // it. Chunks are only produced while the session's pending writes are
+    // below max_pending_stream_bytes, otherwise the stream is resumed once the
+    // host has had time to consume them.
+    static constexpr size_t max_pending_stream_bytes = 1024 * 1024;
+    static constexpr std::chrono::milliseconds stream_resume_delay{1};
+
+    struct HeldResponse
+    {
+      std::vector<uint8_t> head;
+      enclave::ResponseBodyStream body_stream;
+    };
+    bool streaming_body = false;
+    std::deque<HeldResponse> held_responses;
+
+    struct BodyStreamMsg
+    {
+      std::shared_ptr<Endpoint> self;
+      enclave::ResponseBodyStream body_stream;
+    };
+
+    // Dispatches the request to the frontend of its actor, returning the
+    // serialised response, or nothing if the response is pending
+    std::optional<std::vector<uint8_t>> process(
+      std::shared_ptr<enclave::RpcContext> rpc_ctx)
+    {
+      const auto actor_opt = http::extract_actor(*rpc_ctx);
+      if (!actor_opt.has_value())
+      {
+        rpc_ctx->set_error(
+          HTTP_STATUS_NOT_FOUND,
+          ccf::errors::ResourceNotFound,
+          fmt::format(
+            "Request path must contain '/[actor]/[method]'. Unable to parse "
+            "'{}'.",
+            rpc_ctx->get_method()));
+        return rpc_ctx->serialise_response();
+      }
+
+      const auto& actor_s = actor_opt.value();
+      auto actor = rpc_map->resolve(actor_s);
+      auto search = rpc_map->find(actor);
+      if (actor == ccf::ActorsType::unknown || !search.has_value())
+      {
+        rpc_ctx->set_error(
+          HTTP_STATUS_NOT_FOUND,
+          ccf::errors::ResourceNotFound,
+          fmt::format("Unknown actor '{}'.", actor_s));
+        return rpc_ctx->serialise_response();
+      }
+
+      return search.value()->process(rpc_ctx);
+    }
+
+    uint16_t next_worker_thread()
+    {
+      const auto thread_count = threading::ThreadMessaging::thread_count.load();
+      if (thread_count <= 1)
+      {
+        return threading::MAIN_THREAD_ID;
+      }
+
+      return (next_worker++ % (thread_count - 1)) + 1;
+    }
+
+    static void process_stream_cb(
+      std::unique_ptr<threading::Tmsg<StreamRequestMsg>> msg)
+    {
+      auto self = reinterpret_cast<HTTPServerEndpoint*>(msg->data.self.get());
+
+      std::optional<std::vector<uint8_t>> response;
+      try
+      {
+        response = self->process(msg->data.rpc_ctx);
+      }
+      catch (const std::exception& e)
+      {
+        response = http::error(
+          HTTP_STATUS_INTERNAL_SERVER_ERROR,
+          ccf::errors::InternalError,
+          fmt::format("Exception: {}", e.what()));
+      }
+
+      // If the RPC is pending, the response is sent via the stream's reply id
+      if (response.has_value())
+      {
+        self->send_stream(msg->data.stream_id, std::move(response.value()));
+      }
+    }
+
+    static void send_stream_cb(
+      std::unique_ptr<threading::Tmsg<StreamResponseMsg>> msg)
+    {
+      reinterpret_cast<HTTPServerEndpoint*>(msg->data.self.get())
+        ->send_stream_thread(msg->data.stream_id, std::move(msg->data.data));
+    }
+
+    void send_stream_thread(uint32_t stream_id, std::vector<uint8_t>&& data)
+    {
+      auto it = active_streams.find(stream_id);
+      if (it == active_streams.end())
+      {
+        return;
+      }
+
+      // Once a request has been forwarded, later requests on this connection
+      // are forwarded too
+      if (it->second.session_ctx->is_forwarding)
+      {
+        session_ctx->is_forwarding = true;
+      }
+      rpc_responder.remove_stream(it->second.reply_id);
+      active_streams.erase(it);
+
+      http::SimpleResponseProcessor processor;
+      http::ResponseParser parser(processor);
+      try
+      {
+        parser.execute(data.data(), data.size());
+      }
+      catch (const std::exception& e)
+      {
+        LOG_FAIL_FMT("Error parsing response on stream {}", stream_id);
+        LOG_DEBUG_FMT("Error parsing response: {}", e.what());
+      }
+
+      if (processor.received.empty())
+      {
+        h2->send_response(
+          stream_id, HTTP_STATUS_INTERNAL_SERVER_ERROR, {}, {});
+      }
+      else
+      {
+        auto& response = processor.received.front();
+        http2::hpack::HeaderList headers(
+          response.headers.begin(), response.headers.end());
+        h2->send_response(
+          stream_id, response.status, headers, std::move(response.body));
+      }
+
+      flush_h2();
+    }
+
+    static void send_response_cb(
+      std::unique_ptr<threading::Tmsg<SendRecvMsg>> msg)
+    {
+      reinterpret_cast<HTTPServerEndpoint*>(msg->data.self.get())
+        ->send_response(std::move(msg->data.data), nullptr);
+    }
+
+    void send_response(
+      std::vector<uint8_t>&& head, enclave::ResponseBodyStream&& body_stream)
+    {
+      if (streaming_body)
+      {
+        held_responses.push_back({std::move(head), std::move(body_stream)});
+        return;
+      }
+
+      send_raw_thread(std::move(head));
+
+      if (body_stream != nullptr)
+      {
+        streaming_body = true;
+        send_body_stream(std::move(body_stream));
+      }
+    }
+
+    static void send_body_stream_cb(
+      std::unique_ptr<threading::Tmsg<BodyStreamMsg>> msg)
+    {
+      reinterpret_cast<HTTPServerEndpoint*>(msg->data.self.get())
+        ->send_body_stream(std::move(msg->data.body_stream));
+    }
+
+    // Runs on the thread which set the timer, and moves the stream back to
+    // the session strand
+    static void resume_body_stream_cb(
+      std::unique_ptr<threading::Tmsg<BodyStreamMsg>> msg)
+    {
+      auto self = reinterpret_cast<HTTPServerEndpoint*>(msg->data.self.get());
+
+      auto resume =
+        std::make_unique<threading::Tmsg<BodyStreamMsg>>(&send_body_stream_cb);
+      resume->data = std::move(msg->data);
+
+      threading::ThreadMessaging::thread_messaging.add_task(
+        self->strand, std::move(resume));
+    }
+
+    void send_body_stream(enclave::ResponseBodyStream&& body_stream)
+    {
+      flush();
+
+      while (true)
+      {
+        if (get_status() != ready)
+        {
+          // The connection is gone, and so is any response held for it
+          streaming_body = false;
+          held_responses.clear();
+          return;
+        }
+
+        if (pending_write_size() >= max_pending_stream_bytes)
+        {
+          break;
+        }
+
+        std::optional<std::vector<uint8_t>> chunk;
+        try
+        {
+          chunk = body_stream();
+        }
+        catch (const std::exception& e)
+        {
+          // The response head has been sent, so the only way to report the
+          // error is to end the connection before the body is complete
+          LOG_FAIL_FMT("Error streaming response body");
+          LOG_DEBUG_FMT("Error streaming response body: {}", e.what());
+          streaming_body = false;
+          held_responses.clear();
+          close();
+          return;
+        }
+
+        if (!chunk.has_value())
+        {
+          send_buffered(std::vector<uint8_t>(
+            http::last_chunk.begin(), http::last_chunk.end()));
+          flush();
+
+          streaming_body = false;
+          while (!streaming_body && !held_responses.empty())
+          {
+            auto held = std::move(held_responses.front());
+            held_responses.pop_front();
+            send_response(std::move(held.head), std::move(held.body_stream));
+          }
+          return;
+        }
+
+        // An empty chunk would end the body
+        if (chunk->empty())
+        {
+          continue;
+        }
+
+        send_buffered(http::build_chunk_header(chunk->size()));
+        send_buffered(std::move(chunk.value()));
+        send_buffered(std::vector<uint8_t>(
+          http::chunk_trailer.begin(), http::chunk_trailer.end()));
+        flush();
+      }
+
+      auto msg = std::make_unique<threading::Tmsg<BodyStreamMsg>>(
+        &resume_body_stream_cb);
+      msg->data.self = this->shared_from_this();
+      msg->data.body_stream = std::move(body_stream);
+
+      threading::ThreadMessaging::thread_messaging.add_task_after(
+        std::move(msg), stream_resume_delay);
+    }
+
+    void flush_h2()
+    {
+      if (h2->has_output())
+      {
+        send_raw_thread(h2->take_output());
+      }
+
+      if (h2->is_closed())
+      {
+        close();
+      }
+    }
+
+    void parse(const uint8_t* data, size_t size) override
+    {
+      if (!protocol_selected)
+      {
+        protocol_selected = true;
+        if (alpn_protocol() == http2::alpn_id)
+        {
+          LOG_TRACE_FMT("Session {} uses HTTP/2", session_id);
+          h2 = std::make_unique<http2::ServerSession>(*this);
+          session_ctx =
+            std::make_shared<enclave::SessionContext>(session_id, peer_cert());
+          session_ctx->authn_cache =
+            std::make_shared<ccf::AuthnIdentityCache>();
+        }
+      }
+
+      if (h2 == nullptr)
+      {
+        HTTPEndpoint::parse(data, size);
+        return;
+      }
+
+      h2->recv(data, size);
+      flush_h2();
+    }
+
   public:
     HTTPServerEndpoint(
       std::shared_ptr<enclave::RPCMap> rpc_map,
       size_t session_id,
       ringbuffer::AbstractWriterFactory& writer_factory,
-      std::unique_ptr<tls::Context> ctx) :
+      std::unique_ptr<tls::Context> ctx,
+      enclave::AbstractRPCResponder& rpc_responder) :
       HTTPEndpoint(
         request_parser,
         ws_request_parser,
@@ -143,12 +507,126 @@ namespace http
       request_parser(*this),
       ws_request_parser(*this),
       rpc_map(rpc_map),
+      rpc_responder(rpc_responder),
       session_id(session_id)
     {}
 
     void send(std::vector<uint8_t>&& data) override
     {
-      send_raw(std::move(data));
+      auto msg =
+        std::make_unique<threading::Tmsg<SendRecvMsg>>(&send_response_cb);
+      msg->data.self = this->shared_from_this();
+      msg->data.data = std::move(data);
+
+      threading::ThreadMessaging::thread_messaging.add_task(
+        strand, std::move(msg));
+    }
+
+    void send_stream(uint32_t stream_id, std::vector<uint8_t>&& data) override
+    {
+      auto msg =
+        std::make_unique<threading::Tmsg<StreamResponseMsg>>(&send_stream_cb);
+      msg->data.self = this->shared_from_this();
+      msg->data.stream_id = stream_id;
+      msg->data.data = std::move(data);
+
+      threading::ThreadMessaging::thread_messaging.add_task(
+        strand, std::move(msg));
+    }
+
+    // Requests dispatched to the worker threads stay active until their
+    // response is sent, even if the client resets their stream
+    size_t pending_requests() const override
+    {
+      return active_streams.size();
+    }
+
+    void handle_request(
+      uint32_t stream_id,
+      http2::hpack::HeaderList&& fields,
+      std::vector<uint8_t>&& body) override
+    {
+      std::optional<llhttp_method> verb;
+      std::string url;
+      http::HeaderMap headers;
+      for (auto& [name, value] : fields)
+      {
+        if (name == ":method")
+        {
+          verb = method_from_str(value);
+        }
+        else if (name == ":path")
+        {
+          url = std::move(value);
+        }
+        else if (name[0] != ':')
+        {
+          // Repeated fields (eg. cookie, split by HTTP/2) are combined
+          auto [it, inserted] = headers.emplace(name, value);
+          if (!inserted)
+          {
+            it->second += name == "cookie" ? "; " : ", ";
+            it->second += value;
+          }
+        }
+      }
+
+      LOG_TRACE_FMT(
+        "Processing msg on stream {} ({}, [{} bytes])",
+        stream_id,
+        url,
+        body.size());
+
+      const auto reply_id = rpc_responder.add_stream(session_id, stream_id);
+      auto stream_ctx = std::make_shared<enclave::SessionContext>(
+        reply_id, session_ctx->caller_cert);
+      stream_ctx->is_forwarding = session_ctx->is_forwarding;
+      stream_ctx->authn_cache = session_ctx->authn_cache;
+      active_streams.emplace(stream_id, ActiveStream{reply_id, stream_ctx});
+
+      if (!verb.has_value())
+      {
+        send_stream(
+          stream_id,
+          http::error(
+            HTTP_STATUS_METHOD_NOT_ALLOWED,
+            ccf::errors::InvalidInput,
+            "Unsupported method"));
+        return;
+      }
+
+      std::shared_ptr<enclave::RpcContext> rpc_ctx = nullptr;
+      try
+      {
+        const auto [path, query, fragment] = http::split_url_path(url);
+        rpc_ctx = std::make_shared<HttpRpcContext>(
+          request_index++,
+          stream_ctx,
+          verb.value(),
+          path,
+          http::url_decode(query),
+          std::move(headers),
+          std::move(body));
+      }
+      catch (const std::exception& e)
+      {
+        send_stream(
+          stream_id,
+          http::error(
+            HTTP_STATUS_INTERNAL_SERVER_ERROR,
+            ccf::errors::InternalError,
+            e.what()));
+        return;
+      }
+
+      auto msg = std::make_unique<threading::Tmsg<StreamRequestMsg>>(
+        &process_stream_cb);
+      msg->data.self = this->shared_from_this();
+      msg->data.rpc_ctx = rpc_ctx;
+      msg->data.stream_id = stream_id;
+
+      threading::ThreadMessaging::thread_messaging.add_task(
+        next_worker_thread(), std::move(msg));
     }
 
     void handle_request(
@@ -184,6 +662,8 @@ namespace http
         {
           session_ctx =
             std::make_shared<enclave::SessionContext>(session_id, peer_cert());
+          session_ctx->authn_cache =
+            std::make_shared<ccf::AuthnIdentityCache>();
         }
 
         std::shared_ptr<enclave::RpcContext> rpc_ctx = nullptr;
@@ -196,7 +676,7 @@ namespace http
           }
           else
           {
-            rpc_ctx = std::make_shared<HttpRpcContext>(
+            auto http_ctx = std::make_shared<HttpRpcContext>(
               request_index++,
               session_ctx,
               verb,
@@ -204,6 +684,8 @@ namespace http
               query,
               std::move(headers),
               std::move(body));
+            http_ctx->enable_response_streaming();
+            rpc_ctx = http_ctx;
           }
         }
         catch (std::exception& e)
@@ -224,34 +706,7 @@ namespace http
           }
         }
 
-        const auto actor_opt = http::extract_actor(*rpc_ctx);
-        if (!actor_opt.has_value())
-        {
-          rpc_ctx->set_error(
-            HTTP_STATUS_NOT_FOUND,
-            ccf::errors::ResourceNotFound,
-            fmt::format(
-              "Request path must contain '/[actor]/[method]'. Unable to parse "
-              "'{}'.",
-              rpc_ctx->get_method()));
-          send_raw(rpc_ctx->serialise_response());
-          return;
-        }
-
-        const auto& actor_s = actor_opt.value();
-        auto actor = rpc_map->resolve(actor_s);
-        auto search = rpc_map->find(actor);
-        if (actor == ccf::ActorsType::unknown || !search.has_value())
-        {
-          rpc_ctx->set_error(
-            HTTP_STATUS_NOT_FOUND,
-            ccf::errors::ResourceNotFound,
-            fmt::format("Unknown actor '{}'.", actor_s));
-          send_raw(rpc_ctx->serialise_response());
-          return;
-        }
-
-        auto response = search.value()->process(rpc_ctx);
+        auto response = process(rpc_ctx);
 
         if (!response.has_value())
         {
@@ -261,8 +716,8 @@ namespace http
         }
         else
         {
-          send_buffered(response.value());
-          flush();
+          send_response(
+            std::move(response.value()), rpc_ctx->take_response_body_stream());
         }
       }
       catch (const std::exception& e)
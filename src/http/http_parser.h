@@ -96,8 +96,8 @@ namespace http
                                std::string(path),
                                std::string(query),
                                std::string(fragment),
-                               headers,
-                               body});
+                               std::move(headers),
+                               std::move(body)});
     }
   };
 
@@ -118,7 +118,7 @@ namespace http
       http::HeaderMap&& headers,
       std::vector<uint8_t>&& body) override
     {
-      received.emplace(Response{status, headers, body});
+      received.emplace(Response{status, std::move(headers), std::move(body)});
     }
   };
 
@@ -207,16 +207,50 @@ namespace http
     llhttp_settings_t settings;
     State state = DONE;
 
+    // The head of the current message (URL, header names and values) is
+    // accumulated in head_buf, which is retained from one message to the
+    // next, and is referred to by offset until the message is complete. Only
+    // the resulting HeaderMap, and a body buffer reserved from the
+    // Content-Length, are allocated per message.
+    struct Span
+    {
+      size_t offset = 0;
+      size_t size = 0;
+    };
+
+    std::string head_buf;
+    std::vector<std::pair<Span, Span>> header_spans;
+    bool parsing_header_value = false;
+
     std::vector<uint8_t> body_buf;
     HeaderMap headers;
 
-    std::pair<std::string, std::string> partial_parsed_header = {};
+    // Bodies announced as larger than this are grown as they arrive, rather
+    // than reserved up-front on the word of a peer
+    static constexpr size_t max_body_reserve = 1 << 20;
+
+    Span append_head(Span span, const char* at, size_t length)
+    {
+      if (span.size == 0)
+      {
+        span.offset = head_buf.size();
+      }
+      head_buf.append(at, length);
+      span.size += length;
+      return span;
+    }
+
+    std::string_view head_view(const Span& span) const
+    {
+      return std::string_view(head_buf).substr(span.offset, span.size);
+    }
 
-    void complete_header()
+    void build_headers()
     {
-      headers.emplace(partial_parsed_header);
-      partial_parsed_header.first.clear();
-      partial_parsed_header.second.clear();
+      for (const auto& [field, value] : header_spans)
+      {
+        headers.emplace(head_view(field), head_view(value));
+      }
     }
 
     Parser(llhttp_type_t type)
@@ -260,7 +294,7 @@ namespace http
       if (state == IN_MESSAGE)
       {
         LOG_TRACE_FMT("Appending chunk [{} bytes]", length);
-        std::copy(at, at + length, std::back_inserter(body_buf));
+        body_buf.insert(body_buf.end(), at, at + length);
       }
       else
       {
@@ -274,7 +308,10 @@ namespace http
       {
         LOG_TRACE_FMT("Entering new message");
         state = IN_MESSAGE;
-        body_buf.clear();
+        head_buf.clear();
+        header_spans.clear();
+        parsing_header_value = false;
+        body_buf = {};
         headers.clear();
       }
       else
@@ -291,6 +328,7 @@ namespace http
       if (state == IN_MESSAGE)
       {
         LOG_TRACE_FMT("Done with message");
+        build_headers();
         handle_completed_message();
         state = DONE;
       }
@@ -302,26 +340,37 @@ namespace http
 
     void header_field(const char* at, size_t length)
     {
-      if (!partial_parsed_header.second.empty())
+      if (header_spans.empty() || parsing_header_value)
       {
-        complete_header();
+        header_spans.emplace_back();
+        parsing_header_value = false;
       }
 
       // HTTP headers are stored lowercase as it is easier to verify HTTP
       // signatures later on
-      auto f = std::string(at, length);
-      nonstd::to_lower(f);
-      partial_parsed_header.first.append(f);
+      auto& field = header_spans.back().first;
+      field = append_head(field, at, length);
+      std::transform(
+        head_buf.end() - length,
+        head_buf.end(),
+        head_buf.end() - length,
+        [](unsigned char c) { return std::tolower(c); });
     }
 
     void header_value(const char* at, size_t length)
     {
-      partial_parsed_header.second.append(at, length);
+      parsing_header_value = true;
+      auto& value = header_spans.back().second;
+      value = append_head(value, at, length);
     }
 
     void headers_complete()
     {
-      complete_header();
+      if (parser.flags & F_CONTENT_LENGTH)
+      {
+        body_buf.reserve(std::min<uint64_t>(
+          parser.content_length, max_body_reserve));
+      }
     }
   };
 
@@ -373,7 +422,7 @@ namespace http
   private:
     RequestProcessor& proc;
 
-    std::string url = "";
+    Span url;
 
   public:
     RequestParser(RequestProcessor& proc_) : Parser(HTTP_REQUEST), proc(proc_)
@@ -383,18 +432,18 @@ namespace http
 
     void append_url(const char* at, size_t length)
     {
-      url.append(at, length);
+      url = append_head(url, at, length);
     }
 
     void new_message() override
     {
       Parser::new_message();
-      url.clear();
+      url = {};
     }
 
     void handle_completed_message() override
     {
-      if (url.empty())
+      if (url.size == 0)
       {
         proc.handle_request(
           llhttp_method(parser.method),
@@ -406,7 +455,7 @@ namespace http
       }
       else
       {
-        const auto [path, query, fragment] = split_url_path(url);
+        const auto [path, query, fragment] = split_url_path(head_view(url));
         const std::string decoded_query = url_decode(query);
         const std::string decoded_fragment = url_decode(fragment);
         proc.handle_request(
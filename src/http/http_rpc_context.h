@@ -79,6 +79,10 @@ namespace http
     std::vector<uint8_t> response_body = {};
     http_status response_status = HTTP_STATUS_OK;
 
+    // Only set by sessions which can send the body after the response head
+    bool response_streaming = false;
+    enclave::ResponseBodyStream response_body_stream = nullptr;
+
     bool canonicalised = false;
 
     std::optional<bool> explicit_apply_writes = std::nullopt;
@@ -162,8 +166,8 @@ namespace http
       llhttp_method verb_,
       const std::string_view& path_,
       const std::string_view& query_,
-      const http::HeaderMap& headers_,
-      const std::vector<uint8_t>& body_,
+      http::HeaderMap headers_,
+      std::vector<uint8_t> body_,
       const std::vector<uint8_t>& raw_request_ = {},
       const std::vector<uint8_t>& raw_bft_ = {}) :
       RpcContext(s, raw_bft_),
@@ -171,8 +175,8 @@ namespace http
       verb(verb_),
       path(path_),
       query(query_),
-      request_headers(headers_),
-      request_body(body_),
+      request_headers(std::move(headers_)),
+      request_body(std::move(body_)),
       serialised_request(raw_request_)
     {
       whole_path = path;
@@ -261,23 +265,51 @@ namespace http
       return std::nullopt;
     }
 
+    void enable_response_streaming()
+    {
+      response_streaming = true;
+    }
+
     virtual void set_response_body(const std::vector<uint8_t>& body) override
     {
       response_body = body;
+      response_body_stream = nullptr;
     }
 
     virtual void set_response_body(std::vector<uint8_t>&& body) override
     {
       response_body = std::move(body);
+      response_body_stream = nullptr;
     }
 
     virtual void set_response_body(std::string&& body) override
     {
       response_body = std::vector<uint8_t>(body.begin(), body.end());
+      response_body_stream = nullptr;
       set_response_header(
         http::headers::CONTENT_TYPE, http::headervalues::contenttype::TEXT);
     }
 
+    virtual void set_response_body_stream(
+      enclave::ResponseBodyStream&& stream) override
+    {
+      if (!response_streaming)
+      {
+        RpcContext::set_response_body_stream(std::move(stream));
+        return;
+      }
+
+      response_body.clear();
+      response_body_stream = std::move(stream);
+    }
+
+    virtual enclave::ResponseBodyStream take_response_body_stream() override
+    {
+      auto stream = std::move(response_body_stream);
+      response_body_stream = nullptr;
+      return stream;
+    }
+
     virtual void set_response_status(int status) override
     {
       response_status = (http_status)status;
@@ -288,6 +320,16 @@ namespace http
       return response_status;
     }
 
+    const http::HeaderMap& get_response_headers() const
+    {
+      return response_headers;
+    }
+
+    const std::vector<uint8_t>& get_response_body() const
+    {
+      return response_body;
+    }
+
     virtual void set_response_header(
       const std::string_view& name, const std::string_view& value) override
     {
@@ -319,7 +361,14 @@ namespace http
         http_response.set_header(k, v);
       }
 
-      http_response.set_body(&response_body);
+      if (response_body_stream != nullptr)
+      {
+        http_response.set_chunked_body();
+      }
+      else
+      {
+        http_response.set_body(&response_body);
+      }
       return http_response.build_response();
     }
   };
@@ -346,7 +395,7 @@ namespace enclave
         processor.received.size()));
     }
 
-    const auto& msg = processor.received.front();
+    auto& msg = processor.received.front();
 
     return std::make_shared<http::HttpRpcContext>(
       0,
@@ -354,12 +403,33 @@ namespace enclave
       msg.method,
       msg.path,
       msg.query,
-      msg.headers,
-      msg.body,
+      std::move(msg.headers),
+      std::move(msg.body),
       packed,
       raw_bft);
   }
 
+  // Creates the context of a request which was not received as a serialised
+  // message, e.g. one of a batch, from its parts
+  inline std::shared_ptr<RpcContext> make_rpc_context(
+    std::shared_ptr<enclave::SessionContext> s,
+    size_t request_index,
+    llhttp_method verb,
+    const std::string_view& url,
+    http::HeaderMap&& headers,
+    std::vector<uint8_t>&& body)
+  {
+    const auto [path, query, fragment] = http::split_url_path(url);
+    return std::make_shared<http::HttpRpcContext>(
+      request_index,
+      s,
+      verb,
+      path,
+      http::url_decode(query),
+      std::move(headers),
+      std::move(body));
+  }
+
   inline std::shared_ptr<enclave::RpcContext> make_fwd_rpc_context(
     std::shared_ptr<enclave::SessionContext> s,
     const std::vector<uint8_t>& packed,
@@ -0,0 +1,657 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#define DOCTEST_CONFIG_NO_SHORT_MACRO_NAMES
+#include "../hpack.h"
+#include "../http2.h"
+
+#include <doctest/doctest.h>
+#include <random>
+#include <string>
+
+using namespace http2;
+
+std::vector<uint8_t> from_hex(const std::string& s)
+{
+  std::vector<uint8_t> v;
+  for (size_t i = 0; i < s.size(); i += 2)
+  {
+    v.push_back(std::stoi(s.substr(i, 2), nullptr, 16));
+  }
+  return v;
+}
+
+DOCTEST_TEST_CASE("HPACK integers")
+{
+  // RFC 7541, C.1
+  std::vector<uint8_t> out;
+  hpack::encode_integer(out, 0, 5, 10);
+  DOCTEST_CHECK(out == std::vector<uint8_t>{0x0a});
+
+  out.clear();
+  hpack::encode_integer(out, 0, 5, 1337);
+  DOCTEST_CHECK(out == std::vector<uint8_t>{0x1f, 0x9a, 0x0a});
+
+  out.clear();
+  hpack::encode_integer(out, 0, 8, 42);
+  DOCTEST_CHECK(out == std::vector<uint8_t>{0x2a});
+
+  for (uint8_t prefix = 1; prefix <= 8; ++prefix)
+  {
+    for (size_t v : {0ul, 1ul, 30ul, 31ul, 127ul, 128ul, 1337ul, 1ul << 31})
+    {
+      out.clear();
+      hpack::encode_integer(out, 0, prefix, v);
+      const uint8_t* p = out.data();
+      DOCTEST_CHECK(hpack::decode_integer(p, p + out.size(), prefix) == v);
+      DOCTEST_CHECK(p == out.data() + out.size());
+    }
+  }
+
+  const auto truncated = from_hex("1f9a");
+  const uint8_t* p = truncated.data();
+  DOCTEST_CHECK_THROWS_AS(
+    hpack::decode_integer(p, p + truncated.size(), 5),
+    hpack::CompressionError);
+}
+
+DOCTEST_TEST_CASE("HPACK Huffman code")
+{
+  // RFC 7541, C.4.1
+  const std::string s = "www.example.com";
+  std::vector<uint8_t> out;
+  hpack::huffman::encode(out, s);
+  DOCTEST_CHECK(out == from_hex("f1e3c2e5f23a6ba0ab90f4ff"));
+  DOCTEST_CHECK(hpack::huffman::encoded_size(s) == out.size());
+  DOCTEST_CHECK(hpack::huffman::decode(out.data(), out.size()) == s);
+
+  // All octets round trip
+  std::string all;
+  for (size_t i = 0; i < 256; ++i)
+  {
+    all.push_back(i);
+    all.push_back(255 - i);
+  }
+  out.clear();
+  hpack::huffman::encode(out, all);
+  DOCTEST_CHECK(hpack::huffman::encoded_size(all) == out.size());
+  DOCTEST_CHECK(hpack::huffman::decode(out.data(), out.size()) == all);
+
+  // Padding must be short, and a prefix of EOS
+  const auto long_padding = from_hex("f1e3c2e5f23a6ba0ab90f4ffff");
+  DOCTEST_CHECK_THROWS_AS(
+    hpack::huffman::decode(long_padding.data(), long_padding.size()),
+    hpack::CompressionError);
+  const auto zero_padding = from_hex("f1e3c2e5f23a6ba0ab90f4fe");
+  DOCTEST_CHECK_THROWS_AS(
+    hpack::huffman::decode(zero_padding.data(), zero_padding.size()),
+    hpack::CompressionError);
+
+  // EOS itself must not be decoded
+  const auto eos = from_hex("ffffffff");
+  DOCTEST_CHECK_THROWS_AS(
+    hpack::huffman::decode(eos.data(), eos.size()), hpack::CompressionError);
+}
+
+DOCTEST_TEST_CASE("HPACK decoding")
+{
+  const hpack::HeaderList first = {{":method", "GET"},
+                                   {":scheme", "http"},
+                                   {":path", "/"},
+                                   {":authority", "www.example.com"}};
+  auto second = first;
+  second.emplace_back("cache-control", "no-cache");
+  const hpack::HeaderList third = {{":method", "GET"},
+                                   {":scheme", "https"},
+                                   {":path", "/index.html"},
+                                   {":authority", "www.example.com"},
+                                   {"custom-key", "custom-value"}};
+
+  DOCTEST_SUBCASE("Requests without Huffman coding (RFC 7541, C.3)")
+  {
+    hpack::Decoder d;
+    auto block = from_hex("828684410f7777772e6578616d706c652e636f6d");
+    DOCTEST_CHECK(d.decode(block.data(), block.size()) == first);
+    DOCTEST_CHECK(d.get_table().get_size() == 57);
+
+    block = from_hex("828684be58086e6f2d6361636865");
+    DOCTEST_CHECK(d.decode(block.data(), block.size()) == second);
+    DOCTEST_CHECK(d.get_table().get_size() == 110);
+
+    block = from_hex(
+      "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565");
+    DOCTEST_CHECK(d.decode(block.data(), block.size()) == third);
+    DOCTEST_CHECK(d.get_table().get_size() == 164);
+    DOCTEST_CHECK(d.get_table()[0].first == "custom-key");
+  }
+
+  DOCTEST_SUBCASE("Requests with Huffman coding (RFC 7541, C.4)")
+  {
+    hpack::Decoder d;
+    auto block = from_hex("828684418cf1e3c2e5f23a6ba0ab90f4ff");
+    DOCTEST_CHECK(d.decode(block.data(), block.size()) == first);
+
+    block = from_hex("828684be5886a8eb10649cbf");
+    DOCTEST_CHECK(d.decode(block.data(), block.size()) == second);
+
+    block = from_hex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf");
+    DOCTEST_CHECK(d.decode(block.data(), block.size()) == third);
+    DOCTEST_CHECK(d.get_table().get_size() == 164);
+  }
+
+  DOCTEST_SUBCASE("Responses with eviction (RFC 7541, C.6)")
+  {
+    hpack::Decoder d(256);
+    auto block = from_hex(
+      "488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1bff6e"
+      "919d29ad171863c78f0b97c8e9ae82ae43d3");
+    const hpack::HeaderList r1 = {{":status", "302"},
+                                  {"cache-control", "private"},
+                                  {"date", "Mon, 21 Oct 2013 20:13:21 GMT"},
+                                  {"location", "https://www.example.com"}};
+    DOCTEST_CHECK(d.decode(block.data(), block.size()) == r1);
+    DOCTEST_CHECK(d.get_table().get_size() == 222);
+
+    block = from_hex("4883640effc1c0bf");
+    auto r2 = r1;
+    r2[0].second = "307";
+    DOCTEST_CHECK(d.decode(block.data(), block.size()) == r2);
+    DOCTEST_CHECK(d.get_table().get_size() == 222);
+
+    block = from_hex(
+      "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad94e7"
+      "821dd7f2e6c7b335dfdfcd5b3960d5af27087f3672c1ab270fb5291f9587316065c003ed"
+      "4ee5b1063d5007");
+    const hpack::HeaderList r3 = {
+      {":status", "200"},
+      {"cache-control", "private"},
+      {"date", "Mon, 21 Oct 2013 20:13:22 GMT"},
+      {"location", "https://www.example.com"},
+      {"content-encoding", "gzip"},
+      {"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1"}};
+    DOCTEST_CHECK(d.decode(block.data(), block.size()) == r3);
+    DOCTEST_CHECK(d.get_table().get_size() == 215);
+    DOCTEST_CHECK(d.get_table().count() == 3);
+  }
+
+  DOCTEST_SUBCASE("Invalid blocks")
+  {
+    hpack::Decoder d;
+    for (const auto& hex : {"80", "ff00", "8286844110", "20823f00"})
+    {
+      const auto block = from_hex(hex);
+      DOCTEST_CHECK_THROWS_AS(
+        d.decode(block.data(), block.size()), hpack::CompressionError);
+    }
+  }
+
+  DOCTEST_SUBCASE("Decoded size limit")
+  {
+    // One large field added to the dynamic table, then referenced repeatedly
+    // by its one-byte index
+    std::vector<uint8_t> block;
+    hpack::Encoder(hpack::default_table_size)
+      .encode(block, {{"a", std::string(2000, 'x')}});
+    block.insert(block.end(), 1000, 0xbe);
+
+    hpack::Decoder d;
+    hpack::HeaderList headers;
+    DOCTEST_CHECK_THROWS_AS(
+      d.decode(block.data(), block.size(), headers, 1 << 16),
+      hpack::HeaderListTooLarge);
+    DOCTEST_CHECK(hpack::header_list_size(headers) <= 1 << 16);
+
+    hpack::Decoder unlimited;
+    DOCTEST_CHECK(unlimited.decode(block.data(), block.size()).size() == 1001);
+  }
+}
+
+DOCTEST_TEST_CASE("HPACK encoding")
+{
+  std::mt19937 rng(42);
+  const std::vector<std::string> names = {
+    "content-type", "x-ccf-tx-seqno", "x-ccf-tx-view", "authorization", "x-a"};
+
+  hpack::Encoder e;
+  hpack::Decoder d;
+  size_t total_size = 0;
+  size_t encoded_size = 0;
+  for (size_t i = 0; i < 1000; ++i)
+  {
+    hpack::HeaderList headers = {{":status", "200"}};
+    for (size_t j = 0; j < rng() % 8; ++j)
+    {
+      headers.emplace_back(
+        names[rng() % names.size()], std::to_string(rng() % 20));
+    }
+    total_size += hpack::header_list_size(headers);
+
+    // The peer's table size changes from time to time
+    if (rng() % 100 == 0)
+    {
+      e.set_max_table_size(rng() % 2 ? 0 : 4096);
+    }
+
+    std::vector<uint8_t> block;
+    e.encode(block, headers);
+    encoded_size += block.size();
+    DOCTEST_CHECK(d.decode(block.data(), block.size()) == headers);
+    DOCTEST_CHECK(d.get_table().get_size() == e.get_table().get_size());
+  }
+
+  // Repeated fields are mostly indexed
+  DOCTEST_CHECK(encoded_size * 5 < total_size);
+
+  // Sensitive values are never added to the table
+  hpack::Encoder sensitive;
+  std::vector<uint8_t> block;
+  sensitive.encode(block, {{"authorization", "Bearer secret"}});
+  DOCTEST_CHECK(sensitive.get_table().count() == 0);
+  DOCTEST_CHECK((block[0] & 0xf0) == 0x10);
+
+  // Without indexing, blocks do not depend on previous ones
+  hpack::Encoder stateless(hpack::default_table_size, false);
+  const hpack::HeaderList headers = {{"x-custom", "value"}};
+  std::vector<uint8_t> a, b;
+  stateless.encode(a, headers);
+  stateless.encode(b, headers);
+  DOCTEST_CHECK(a == b);
+  DOCTEST_CHECK(stateless.get_table().count() == 0);
+}
+
+struct TestServer : public RequestProcessor
+{
+  struct Request
+  {
+    uint32_t stream_id;
+    hpack::HeaderList headers;
+    std::vector<uint8_t> body;
+  };
+
+  ServerSession session;
+  std::vector<Request> requests;
+
+  TestServer() : session(*this) {}
+
+  void handle_request(
+    uint32_t stream_id,
+    hpack::HeaderList&& headers,
+    std::vector<uint8_t>&& body) override
+  {
+    requests.push_back({stream_id, std::move(headers), std::move(body)});
+  }
+};
+
+struct TestClient : public ResponseProcessor
+{
+  ClientSession session;
+  std::map<uint32_t, std::pair<hpack::HeaderList, std::vector<uint8_t>>>
+    responses;
+
+  TestClient() : session(*this) {}
+
+  void handle_response(
+    uint32_t stream_id,
+    hpack::HeaderList&& headers,
+    std::vector<uint8_t>&& body) override
+  {
+    responses[stream_id] = {std::move(headers), std::move(body)};
+  }
+};
+
+// Delivers the pending output of each session to the other, until neither
+// has anything to send. Returns the number of bytes exchanged.
+size_t exchange(TestClient& client, TestServer& server)
+{
+  size_t bytes = 0;
+  while (client.session.has_output() || server.session.has_output())
+  {
+    auto c = client.session.take_output();
+    server.session.recv(c.data(), c.size());
+    auto s = server.session.take_output();
+    client.session.recv(s.data(), s.size());
+    bytes += c.size() + s.size();
+  }
+  return bytes;
+}
+
+hpack::HeaderList make_request(const std::string& path)
+{
+  return {{":method", "POST"},
+          {":scheme", "https"},
+          {":path", path},
+          {"content-type", "application/json"}};
+}
+
+std::vector<uint8_t> make_body(size_t size, uint8_t seed)
+{
+  std::vector<uint8_t> body(size);
+  for (size_t i = 0; i < size; ++i)
+  {
+    body[i] = seed + i;
+  }
+  return body;
+}
+
+DOCTEST_TEST_CASE("Concurrent streams")
+{
+  TestClient client;
+  TestServer server;
+
+  // Requests are all sent before any response, and are answered out of order
+  constexpr size_t n = 20;
+  std::vector<uint32_t> ids;
+  for (size_t i = 0; i < n; ++i)
+  {
+    ids.push_back(client.session.send_request(
+      make_request(fmt::format("/app/{}", i)), make_body(i * 10, i)));
+  }
+  exchange(client, server);
+  DOCTEST_REQUIRE(server.requests.size() == n);
+  DOCTEST_CHECK(client.session.open_streams() == n);
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    const auto& r = server.requests[i];
+    DOCTEST_CHECK(r.stream_id == ids[i]);
+    DOCTEST_CHECK(r.headers == make_request(fmt::format("/app/{}", i)));
+    DOCTEST_CHECK(r.body == make_body(i * 10, i));
+  }
+
+  for (size_t i = n; i-- > 0;)
+  {
+    const auto& r = server.requests[i];
+    server.session.send_response(
+      r.stream_id,
+      200,
+      {{"content-type", "application/json"},
+       {"connection", "close"},
+       {"x-ccf-tx-seqno", std::to_string(i)}},
+      make_body(i, i));
+  }
+  exchange(client, server);
+
+  DOCTEST_REQUIRE(client.responses.size() == n);
+  for (size_t i = 0; i < n; ++i)
+  {
+    const auto& [headers, body] = client.responses[ids[i]];
+    const hpack::HeaderList expected = {{":status", "200"},
+                                        {"content-type", "application/json"},
+                                        {"x-ccf-tx-seqno", std::to_string(i)}};
+    DOCTEST_CHECK(headers == expected);
+    DOCTEST_CHECK(body == make_body(i, i));
+  }
+  DOCTEST_CHECK(client.session.open_streams() == 0);
+  DOCTEST_CHECK(server.session.open_streams() == 0);
+  DOCTEST_CHECK(!client.session.is_closed());
+  DOCTEST_CHECK(!server.session.is_closed());
+}
+
+DOCTEST_TEST_CASE("Flow control")
+{
+  TestClient client;
+  TestServer server;
+
+  // Larger than the client's stream window, and than the connection window
+  // that the client advertises for the first exchange
+  const auto request_body = make_body(3 << 20, 1);
+  const auto response_body = make_body(5 << 20, 2);
+
+  const auto id =
+    client.session.send_request(
+    make_request("/app/big"), std::vector(request_body));
+  exchange(client, server);
+  DOCTEST_REQUIRE(server.requests.size() == 1);
+  DOCTEST_CHECK(server.requests[0].body == request_body);
+
+  // The response is sent as the client raises the windows
+  server.session.send_response(id, 200, {}, std::vector(response_body));
+  const auto sent = server.session.take_output();
+  DOCTEST_CHECK(sent.size() < response_body.size());
+  client.session.recv(sent.data(), sent.size());
+  exchange(client, server);
+
+  DOCTEST_REQUIRE(client.responses.size() == 1);
+  DOCTEST_CHECK(client.responses[id].second == response_body);
+  DOCTEST_CHECK(server.session.open_streams() == 0);
+}
+
+DOCTEST_TEST_CASE("Prepared requests")
+{
+  TestClient client;
+  TestServer server;
+
+  const auto body = make_body(40000, 3);
+  const auto prepared =
+    prepare_request(make_request("/app/log"), body.data(), body.size());
+  const auto empty = prepare_request(make_request("/app/empty"), nullptr, 0);
+
+  std::vector<uint32_t> ids;
+  for (size_t i = 0; i < 5; ++i)
+  {
+    ids.push_back(client.session.send_prepared(prepared));
+    ids.push_back(client.session.send_prepared(empty));
+  }
+  exchange(client, server);
+
+  // Requests with bodies complete later, as the client waits for the server
+  // to raise the connection window
+  DOCTEST_REQUIRE(server.requests.size() == ids.size());
+  std::map<uint32_t, TestServer::Request> requests;
+  for (auto& r : server.requests)
+  {
+    requests[r.stream_id] = std::move(r);
+  }
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    const auto& r = requests[ids[i]];
+    if (i % 2 == 0)
+    {
+      DOCTEST_CHECK(r.headers == make_request("/app/log"));
+      DOCTEST_CHECK(r.body == body);
+    }
+    else
+    {
+      DOCTEST_CHECK(r.headers == make_request("/app/empty"));
+      DOCTEST_CHECK(r.body.empty());
+    }
+  }
+}
+
+DOCTEST_TEST_CASE("Concurrent stream limit")
+{
+  TestClient client;
+  TestServer server;
+
+  // Until the server's settings arrive, the client assumes the minimum
+  size_t sent = 0;
+  while (client.session.can_send_request())
+  {
+    client.session.send_request(make_request("/app/a"), {});
+    ++sent;
+  }
+  DOCTEST_CHECK(sent == ClientSession::initial_max_concurrent_streams);
+  exchange(client, server);
+
+  while (client.session.can_send_request())
+  {
+    client.session.send_request(make_request("/app/a"), {});
+    ++sent;
+  }
+  DOCTEST_CHECK(sent == ServerSession::max_concurrent_streams);
+  exchange(client, server);
+  DOCTEST_CHECK(server.requests.size() == sent);
+
+  // Streams beyond the limit are refused
+  client.session.send_request(make_request("/app/a"), {});
+  auto out = client.session.take_output();
+  server.session.recv(out.data(), out.size());
+  out = server.session.take_output();
+  DOCTEST_CHECK_THROWS_AS(
+    client.session.recv(out.data(), out.size()), std::runtime_error);
+
+  // Once a response completes, another stream can be opened
+  server.session.send_response(server.requests[0].stream_id, 204, {}, {});
+  out = server.session.take_output();
+  client.session.recv(out.data(), out.size());
+  DOCTEST_CHECK(client.session.can_send_request());
+}
+
+DOCTEST_TEST_CASE("Connection errors")
+{
+  DOCTEST_SUBCASE("Invalid preface")
+  {
+    TestServer server;
+    server.session.take_output();
+    const std::string request = "GET / HTTP/1.1\r\nHost: a\r\n\r\n";
+    server.session.recv((const uint8_t*)request.data(), request.size());
+    DOCTEST_CHECK(server.session.is_closed());
+
+    const auto out = server.session.take_output();
+    DOCTEST_REQUIRE(out.size() == frame_header_size + 8);
+    DOCTEST_CHECK(read_frame_header(out.data()).type == FrameType::GOAWAY);
+    DOCTEST_CHECK(
+      read_u32(out.data() + frame_header_size + 4) ==
+      (uint32_t)ErrorCode::PROTOCOL_ERROR);
+  }
+
+  DOCTEST_SUBCASE("Invalid header block")
+  {
+    TestClient client;
+    TestServer server;
+    exchange(client, server);
+
+    std::vector<uint8_t> frame;
+    write_frame_header(
+      frame,
+      1,
+      FrameType::HEADERS,
+      flags::END_HEADERS | flags::END_STREAM,
+      1);
+    frame.push_back(0x80);
+    server.session.recv(frame.data(), frame.size());
+    DOCTEST_CHECK(server.session.is_closed());
+    DOCTEST_CHECK(server.requests.empty());
+  }
+
+  DOCTEST_SUBCASE("Header list bomb")
+  {
+    TestClient client;
+    TestServer server;
+    exchange(client, server);
+
+    std::vector<uint8_t> block;
+    hpack::Encoder(hpack::default_table_size)
+      .encode(block, {{"a", std::string(2000, 'x')}});
+    block.insert(block.end(), 1000, 0xbe);
+
+    std::vector<uint8_t> frame;
+    write_frame_header(
+      frame,
+      block.size(),
+      FrameType::HEADERS,
+      flags::END_HEADERS | flags::END_STREAM,
+      1);
+    frame.insert(frame.end(), block.begin(), block.end());
+    server.session.recv(frame.data(), frame.size());
+    DOCTEST_CHECK(server.session.is_closed());
+    DOCTEST_CHECK(server.requests.empty());
+
+    const auto out = server.session.take_output();
+    DOCTEST_REQUIRE(out.size() == frame_header_size + 8);
+    DOCTEST_CHECK(read_frame_header(out.data()).type == FrameType::GOAWAY);
+    DOCTEST_CHECK(
+      read_u32(out.data() + frame_header_size + 4) ==
+      (uint32_t)ErrorCode::ENHANCE_YOUR_CALM);
+  }
+
+  DOCTEST_SUBCASE("Oversized header block")
+  {
+    TestClient client;
+    TestServer server;
+    exchange(client, server);
+
+    // Exceeds the bound on buffered blocks before it is ever decoded
+    std::vector<uint8_t> frame;
+    write_frame_header(frame, 0, FrameType::HEADERS, 0, 1);
+    const std::vector<uint8_t> padding(1 << 14, 0);
+    for (size_t i = 0; i < 5 && !server.session.is_closed(); ++i)
+    {
+      write_frame_header(
+        frame, padding.size(), FrameType::CONTINUATION, 0, 1);
+      frame.insert(frame.end(), padding.begin(), padding.end());
+      server.session.recv(frame.data(), frame.size());
+      frame.clear();
+    }
+    DOCTEST_CHECK(server.session.is_closed());
+  }
+
+  DOCTEST_SUBCASE("Rapid reset")
+  {
+    // None of the requests complete, as if still processed by the workers
+    struct BusyServer : public TestServer
+    {
+      size_t pending_requests() const override
+      {
+        return requests.size();
+      }
+    };
+
+    TestClient client;
+    BusyServer server;
+    exchange(client, server);
+
+    std::vector<uint8_t> frames;
+    const auto n = ServerSession::max_concurrent_streams * 2;
+    for (uint32_t stream_id = 1; stream_id < n * 2; stream_id += 2)
+    {
+      client.session.send_request(make_request("/app/a"), {});
+      auto out = client.session.take_output();
+      frames.insert(frames.end(), out.begin(), out.end());
+      write_frame_header(frames, 4, FrameType::RST_STREAM, 0, stream_id);
+      write_u32(frames, (uint32_t)ErrorCode::CANCEL);
+    }
+    server.session.recv(frames.data(), frames.size());
+
+    // Reset streams still count towards the limit, so no more work is
+    // accepted, and the connection is closed
+    DOCTEST_CHECK(
+      server.requests.size() == ServerSession::max_concurrent_streams);
+    DOCTEST_CHECK(server.session.is_closed());
+
+    const auto out = server.session.take_output();
+    DOCTEST_REQUIRE(out.size() >= frame_header_size + 8);
+    const auto goaway = out.data() + out.size() - frame_header_size - 8;
+    DOCTEST_CHECK(read_frame_header(goaway).type == FrameType::GOAWAY);
+    DOCTEST_CHECK(
+      read_u32(goaway + frame_header_size + 4) ==
+      (uint32_t)ErrorCode::ENHANCE_YOUR_CALM);
+  }
+
+  DOCTEST_SUBCASE("Malformed request")
+  {
+    TestClient client;
+    TestServer server;
+    client.session.send_request({{":method", "GET"}, {"Upper", "a"}}, {});
+
+    // The stream is reset
+    DOCTEST_CHECK_THROWS_AS(exchange(client, server), std::runtime_error);
+    DOCTEST_CHECK(server.requests.empty());
+    DOCTEST_CHECK(!server.session.is_closed());
+  }
+
+  DOCTEST_SUBCASE("Frames split across reads")
+  {
+    TestClient client;
+    TestServer server;
+    const auto body = make_body(50000, 4);
+    client.session.send_request(make_request("/app/split"), std::vector(body));
+    const auto out = client.session.take_output();
+    for (size_t i = 0; i < out.size(); i += 7)
+    {
+      server.session.recv(out.data() + i, std::min<size_t>(7, out.size() - i));
+    }
+    DOCTEST_REQUIRE(server.requests.size() == 1);
+    DOCTEST_CHECK(server.requests[0].body == body);
+  }
+}
@@ -0,0 +1,128 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "http/http_parser.h"
+#include "http/http_rpc_context.h"
+
+#include <iostream>
+#include <picobench/picobench.hpp>
+
+// Parses s.iterations() pipelined requests, read from the session in blocks
+// of 4KB as HTTPEndpoint::recv_() does, and creates the RpcContext of each,
+// as HTTPServerEndpoint::handle_request() does. Reports the number of heap
+// allocations per request.
+
+static std::atomic<size_t> heap_allocations = 0;
+
+void* operator new(size_t size)
+{
+  ++heap_allocations;
+  if (auto p = std::malloc(size))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+static constexpr size_t read_block_size = 4096;
+
+struct ContextProcessor : public http::RequestProcessor
+{
+  std::shared_ptr<enclave::SessionContext> session =
+    std::make_shared<enclave::SessionContext>(0, std::vector<uint8_t>());
+  size_t request_index = 0;
+
+  void handle_request(
+    llhttp_method verb,
+    const std::string_view& path,
+    const std::string& query,
+    const std::string&,
+    http::HeaderMap&& headers,
+    std::vector<uint8_t>&& body) override
+  {
+    auto rpc_ctx = std::make_shared<http::HttpRpcContext>(
+      request_index++,
+      session,
+      verb,
+      path,
+      query,
+      std::move(headers),
+      std::move(body));
+    if (rpc_ctx->get_request_body().empty() && verb == HTTP_POST)
+    {
+      throw std::logic_error("Missing body");
+    }
+  }
+};
+
+static std::vector<uint8_t> make_request(size_t body_size)
+{
+  const std::vector<uint8_t> body(body_size, 'x');
+  http::Request request("/app/log/private", HTTP_POST);
+  request.set_header(
+    http::headers::CONTENT_TYPE, http::headervalues::contenttype::JSON);
+  request.set_header(http::headers::HOST, "ccf.example.com:443");
+  request.set_header(http::headers::ACCEPT, "*/*");
+  request.set_header("user-agent", "perf_client/1.0");
+  request.set_header(
+    http::headers::DIGEST,
+    "SHA-256=X48E9qOokqqrvdts8nOJRJN3OWDUoyWxBf7kbu9DBPE=");
+  request.set_body(&body);
+  return request.build_request();
+}
+
+template <size_t body_size>
+static void parse(picobench::state& s)
+{
+  const auto one_request = make_request(body_size);
+  std::vector<uint8_t> stream;
+  for (auto i = 0; i < s.iterations(); ++i)
+  {
+    stream.insert(stream.end(), one_request.begin(), one_request.end());
+  }
+
+  ContextProcessor processor;
+  http::RequestParser parser(processor);
+
+  const auto allocations_before = heap_allocations.load();
+  s.start_timer();
+  for (size_t offset = 0; offset < stream.size(); offset += read_block_size)
+  {
+    parser.execute(
+      stream.data() + offset,
+      std::min(read_block_size, stream.size() - offset));
+  }
+  s.stop_timer();
+  const auto allocations = heap_allocations.load() - allocations_before;
+
+  if (processor.request_index != (size_t)s.iterations())
+  {
+    throw std::logic_error("Requests were not all parsed");
+  }
+
+  std::cout << fmt::format(
+                 "{} requests with {} byte bodies: {:.2f} allocations per "
+                 "request",
+                 s.iterations(),
+                 body_size,
+                 (double)allocations / s.iterations())
+            << std::endl;
+}
+
+const std::vector<int> request_counts = {1000, 10000};
+
+PICOBENCH_SUITE("parse_requests");
+auto parse_small = parse<100>;
+PICOBENCH(parse_small).iterations(request_counts).samples(3);
+auto parse_large = parse<64 * 1024>;
+PICOBENCH(parse_large).iterations(request_counts).samples(3);
@@ -425,6 +425,31 @@ DOCTEST_TEST_CASE("URL parser")
   }
 }
 
+DOCTEST_TEST_CASE("Empty and repeated headers")
+{
+  http::SimpleRequestProcessor sp;
+  http::RequestParser p(sp);
+
+  const std::string req =
+    "GET /path HTTP/1.1\r\n"
+    "X-Empty:\r\n"
+    "X-Next: next\r\n"
+    "X-Repeated: first\r\n"
+    "x-repeated: second\r\n"
+    "Content-Length: 2\r\n"
+    "\r\n"
+    "{}";
+  p.execute((const uint8_t*)req.data(), req.size());
+
+  DOCTEST_REQUIRE(sp.received.size() == 1);
+  const auto& m = sp.received.front();
+  DOCTEST_CHECK(m.headers.size() == 4);
+  DOCTEST_CHECK(m.headers.at("x-empty").empty());
+  DOCTEST_CHECK(m.headers.at("x-next") == "next");
+  DOCTEST_CHECK(m.headers.at("x-repeated") == "first");
+  DOCTEST_CHECK(m.body == s_to_v("{}"));
+}
+
 struct SignedRequestProcessor : public http::SimpleRequestProcessor
 {
   std::queue<ccf::SignedReq> signed_reqs;
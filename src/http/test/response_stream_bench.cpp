@@ -0,0 +1,194 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "ds/chained_buffer.h"
+#include "http/http_rpc_context.h"
+
+#include <chrono>
+#include <iostream>
+#include <malloc.h>
+#include <picobench/picobench.hpp>
+
+// Simulates the sending of a response body of s.iterations() MB, produced by
+// an endpoint handler 1MB at a time, from the handler to the host. The TLS
+// processing itself (mbedtls) is not included: the session's pending writes
+// are consumed a record at a time, as they would be by TLSEndpoint::flush().
+// Reports the time to the first byte of the response, and the peak heap
+// usage above that of the start of the run.
+
+static constexpr size_t mb = 1024 * 1024;
+static constexpr size_t record_size = 16384;
+
+// See HTTPServerEndpoint::max_pending_stream_bytes
+static constexpr size_t max_pending_stream_bytes = 1024 * 1024;
+
+static size_t live_bytes = 0;
+static size_t peak_bytes = 0;
+
+void* operator new(size_t size)
+{
+  if (auto p = std::malloc(size))
+  {
+    live_bytes += malloc_usable_size(p);
+    peak_bytes = std::max(peak_bytes, live_bytes);
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  live_bytes -= malloc_usable_size(p);
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  operator delete(p);
+}
+
+inline void do_not_optimize(const void* p)
+{
+  asm volatile("" : : "g"(p) : "memory");
+}
+
+static std::vector<uint8_t> produce_chunk()
+{
+  return std::vector<uint8_t>(mb, 42);
+}
+
+static void write_records(ds::ChainedBuffer& pending_write)
+{
+  while (!pending_write.empty())
+  {
+    const auto front = pending_write.front();
+    const auto n = std::min(record_size, front.size);
+    do_not_optimize(front.data);
+    pending_write.consume(n);
+  }
+}
+
+static std::shared_ptr<http::HttpRpcContext> make_context()
+{
+  auto session =
+    std::make_shared<enclave::SessionContext>(0, std::vector<uint8_t>());
+  return std::make_shared<http::HttpRpcContext>(
+    0,
+    session,
+    HTTP_GET,
+    "/app/export",
+    "",
+    http::HeaderMap(),
+    std::vector<uint8_t>());
+}
+
+static void report(
+  const char* name,
+  picobench::state& s,
+  std::chrono::steady_clock::time_point start,
+  std::chrono::steady_clock::time_point first_byte,
+  size_t base_bytes)
+{
+  std::cout << fmt::format(
+                 "{}: {}MB response, first byte after {:.3f}ms, peak heap "
+                 "{:.1f}MB",
+                 name,
+                 s.iterations(),
+                 std::chrono::duration<double, std::milli>(first_byte - start)
+                   .count(),
+                 (double)(peak_bytes - base_bytes) / mb)
+            << std::endl;
+}
+
+// The handler builds the whole body, which is then serialised with the
+// response head, and written once complete
+static void buffered(picobench::state& s)
+{
+  const auto base_bytes = live_bytes;
+  peak_bytes = live_bytes;
+
+  s.start_timer();
+  const auto start = std::chrono::steady_clock::now();
+  {
+    auto ctx = make_context();
+    ds::ChainedBuffer pending_write;
+
+    std::vector<uint8_t> body;
+    for (size_t i = 0; i < (size_t)s.iterations(); ++i)
+    {
+      const auto chunk = produce_chunk();
+      body.insert(body.end(), chunk.begin(), chunk.end());
+    }
+    ctx->set_response_body(std::move(body));
+
+    pending_write.append(ctx->serialise_response());
+    const auto first_byte = std::chrono::steady_clock::now();
+
+    write_records(pending_write);
+    s.stop_timer();
+
+    report("buffered", s, start, first_byte, base_bytes);
+  }
+}
+
+// The head is written as soon as the handler returns, followed by the body
+// in chunks, produced as long as the pending writes stay below the limit
+static void streamed(picobench::state& s)
+{
+  const auto base_bytes = live_bytes;
+  peak_bytes = live_bytes;
+
+  s.start_timer();
+  const auto start = std::chrono::steady_clock::now();
+  {
+    auto ctx = make_context();
+    ctx->enable_response_streaming();
+    ds::ChainedBuffer pending_write;
+
+    ctx->set_response_body_stream(
+      [i = 0, n = s.iterations()]() mutable
+      -> std::optional<std::vector<uint8_t>> {
+        if (i++ == n)
+        {
+          return std::nullopt;
+        }
+        return produce_chunk();
+      });
+
+    pending_write.append(ctx->serialise_response());
+    const auto first_byte = std::chrono::steady_clock::now();
+
+    auto stream = ctx->take_response_body_stream();
+    bool complete = false;
+    while (!complete)
+    {
+      while (!complete && pending_write.size() < max_pending_stream_bytes)
+      {
+        auto chunk = stream();
+        if (!chunk.has_value())
+        {
+          const auto& last = http::last_chunk;
+          pending_write.append((const uint8_t*)last.data(), last.size());
+          complete = true;
+          break;
+        }
+
+        pending_write.append(http::build_chunk_header(chunk->size()));
+        pending_write.append(std::move(chunk.value()));
+        const auto& trailer = http::chunk_trailer;
+        pending_write.append((const uint8_t*)trailer.data(), trailer.size());
+      }
+
+      write_records(pending_write);
+    }
+    s.stop_timer();
+
+    report("streamed", s, start, first_byte, base_bytes);
+  }
+}
+
+const std::vector<int> body_sizes_mb = {10, 100};
+
+PICOBENCH_SUITE("response_body");
+PICOBENCH(buffered).iterations(body_sizes_mb).samples(3).baseline();
+PICOBENCH(streamed).iterations(body_sizes_mb).samples(3);
@@ -345,6 +345,7 @@ namespace kv
 
     virtual void periodic(std::chrono::milliseconds) {}
     virtual void periodic_end() {}
+    virtual void ledger_persisted(SeqNo, size_t) {}
 
     struct Statistics
     {
@@ -5,6 +5,7 @@
 #include "apply_changes.h"
 #include "deserialise.h"
 #include "ds/ccf_exception.h"
+#include "ds/tracing.h"
 #include "kv_serialiser.h"
 #include "kv_types.h"
 #include "map.h"
@@ -66,8 +67,11 @@ namespace kv
   private:
     using Hooks = std::map<std::string, kv::untyped::Map::CommitHook>;
     using MapHooks = std::map<std::string, kv::untyped::Map::MapHook>;
+    using MapObservers =
+      std::map<std::string, std::vector<kv::untyped::Map::CommitHook>>;
     Hooks global_hooks;
     MapHooks map_hooks;
+    MapObservers map_observers;
 
     std::shared_ptr<Consensus> consensus = nullptr;
     std::shared_ptr<TxHistory> history = nullptr;
@@ -249,10 +253,10 @@ namespace kv
           map->set_global_hook(global_it->second);
         }
 
-        const auto map_it = map_hooks.find(map_name);
-        if (map_it != map_hooks.end())
+        const auto map_hook = get_map_hook(map_name);
+        if (map_hook != nullptr)
         {
-          map->set_map_hook(map_it->second);
+          map->set_map_hook(map_hook);
         }
       }
     }
@@ -526,6 +530,8 @@ namespace kv
         auto& [_, map] = it.second;
         map->post_compact();
       }
+
+      tracing::Tracer::global_commit(v);
     }
 
     void rollback(Version v, std::optional<Term> t = std::nullopt) override
@@ -559,6 +565,8 @@ namespace kv
           h->rollback(v, term);
         }
 
+        tracing::Tracer::rollback(v);
+
         if (v >= version)
         {
           return;
@@ -883,6 +891,8 @@ namespace kv
       std::unique_ptr<PendingTx> pending_tx,
       bool globally_committable) override
     {
+      tracing::SpanTimer span(tracing::SpanKind::Commit);
+
       auto c = get_consensus();
       if (!c)
       {
@@ -918,6 +928,7 @@ namespace kv
         pending_txs.insert(
           {txid.version,
            std::make_pair(std::move(pending_tx), globally_committable)});
+        tracing::Tracer::await_global_commit(txid.version);
 
         auto h = get_history();
         auto c = get_consensus();
@@ -1117,27 +1128,70 @@ namespace kv
       }
     }
 
-    void set_map_hook(
-      const std::string& map_name, const kv::untyped::Map::MapHook& hook)
+    // Returns the hook run on writes to map_name, which calls its observers
+    // before the hook set with set_map_hook(), if any
+    kv::untyped::Map::MapHook get_map_hook(const std::string& map_name)
     {
-      map_hooks[map_name] = hook;
+      const auto map_it = map_hooks.find(map_name);
+      kv::untyped::Map::MapHook hook =
+        map_it != map_hooks.end() ? map_it->second : nullptr;
+
+      const auto observers_it = map_observers.find(map_name);
+      if (observers_it == map_observers.end())
+      {
+        return hook;
+      }
+
+      return [observers = observers_it->second, hook](
+               Version version,
+               const kv::untyped::Write& writes) -> ConsensusHookPtr {
+        for (const auto& observer : observers)
+        {
+          observer(version, writes);
+        }
+        return hook != nullptr ? hook(version, writes) : nullptr;
+      };
+    }
 
+    void update_map_hook(const std::string& map_name)
+    {
       const auto it = maps.find(map_name);
       if (it != maps.end())
       {
-        it->second.second->set_map_hook(hook);
+        const auto hook = get_map_hook(map_name);
+        if (hook != nullptr)
+        {
+          it->second.second->set_map_hook(hook);
+        }
+        else
+        {
+          it->second.second->unset_map_hook();
+        }
       }
     }
 
+    void set_map_hook(
+      const std::string& map_name, const kv::untyped::Map::MapHook& hook)
+    {
+      map_hooks[map_name] = hook;
+      update_map_hook(map_name);
+    }
+
     void unset_map_hook(const std::string& map_name)
     {
       map_hooks.erase(map_name);
+      update_map_hook(map_name);
+    }
 
-      const auto it = maps.find(map_name);
-      if (it != maps.end())
-      {
-        it->second.second->unset_map_hook();
-      }
+    // Observers are called on writes to the map, as its map hook is, but are
+    // neither replaced nor removed by set_map_hook() and unset_map_hook(), so
+    // that several components can follow changes to the same map
+    void add_map_observer(
+      const std::string& map_name,
+      const kv::untyped::Map::CommitHook& observer)
+    {
+      map_observers[map_name].push_back(observer);
+      update_map_hook(map_name);
     }
 
     void set_global_hook(
@@ -935,6 +935,55 @@ TEST_CASE("Local commit hooks")
   }
 }
 
+TEST_CASE("Map observers")
+{
+  using Write = MapTypes::StringString::Write;
+  size_t hook_calls = 0;
+  std::vector<kv::Version> observed;
+
+  auto map_hook = [&](kv::Version v, const Write& w) -> kv::ConsensusHookPtr {
+    hook_calls++;
+    return kv::ConsensusHookPtr(nullptr);
+  };
+  auto observer = [&](kv::Version v, const Write& w) {
+    observed.push_back(v);
+  };
+
+  kv::Store kv_store;
+  constexpr auto map_name = "public:map";
+  MapTypes::StringString map(map_name);
+  kv_store.set_map_hook(map_name, map.wrap_map_hook(map_hook));
+  kv_store.add_map_observer(map_name, map.wrap_commit_hook(observer));
+  kv_store.add_map_observer(map_name, map.wrap_commit_hook(observer));
+
+  auto write = [&]() {
+    auto tx = kv_store.create_tx();
+    auto handle = tx.rw(map);
+    handle->put("key", "value");
+    REQUIRE(tx.commit() == kv::CommitResult::SUCCESS);
+    return kv_store.current_version();
+  };
+
+  INFO("Observers run alongside the map hook");
+  auto version = write();
+  REQUIRE(hook_calls == 1);
+  REQUIRE(observed == std::vector<kv::Version>{version, version});
+
+  INFO("Observers are not replaced by another map hook");
+  observed.clear();
+  kv_store.set_map_hook(map_name, map.wrap_map_hook(map_hook));
+  version = write();
+  REQUIRE(hook_calls == 2);
+  REQUIRE(observed == std::vector<kv::Version>{version, version});
+
+  INFO("Observers are not removed with the map hook");
+  observed.clear();
+  kv_store.unset_map_hook(map_name);
+  version = write();
+  REQUIRE(hook_calls == 2);
+  REQUIRE(observed == std::vector<kv::Version>{version, version});
+}
+
 TEST_CASE("Global commit hooks")
 {
   using Write = MapTypes::StringString::Write;
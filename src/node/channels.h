@@ -373,6 +373,8 @@ namespace ccf
       GcmHdr hdr;
       hdr.set_iv_seq(nonce.get_val());
 
+      // Encrypted in enclave memory, since the ringbuffer is writable by the
+      // host, and encryption reads back the ciphertext to compute the tag
       std::vector<uint8_t> cipher(plain.n);
       key->encrypt(hdr.get_iv(), plain, aad, cipher.data(), hdr.tag);
 
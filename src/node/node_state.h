@@ -39,6 +39,7 @@
 #include <chrono>
 #define FMT_HEADER_ONLY
 #include <fmt/format.h>
+#include <functional>
 #include <nlohmann/json.hpp>
 #include <stdexcept>
 #include <unordered_set>
@@ -134,6 +135,9 @@ namespace ccf
     ringbuffer::AbstractWriterFactory& writer_factory;
     ringbuffer::WriterPtr to_host;
     consensus::Configuration consensus_config;
+    // Number of ledger_truncate messages sent to the host, so that persistence
+    // reports from the host can be matched against the current ledger
+    size_t ledger_truncations = 0;
     size_t sig_tx_interval;
     size_t sig_ms_interval;
 
@@ -153,6 +157,14 @@ namespace ccf
     ShareManager& share_manager;
     std::shared_ptr<Snapshotter> snapshotter;
 
+    // Reports the occupancy of the ringbuffers between the enclave and the
+    // host, which are owned by the enclave
+    std::function<std::map<std::string, ringbuffer::BufferStats>()>
+      ringbuffer_stats = nullptr;
+
+    // Shared by the frontends, to shed requests while the node is overloaded
+    std::shared_ptr<AdmissionController> admission = nullptr;
+
     //
     // recovery
     //
@@ -166,8 +178,14 @@ namespace ccf
     std::vector<kv::Version> view_history;
     consensus::Index last_recovered_signed_idx = 1;
     RecoveredEncryptedLedgerSecrets recovery_ledger_secrets;
+    // Index of the next ledger entry to recover
     consensus::Index ledger_idx = 0;
 
+    // The ledger is recovered from a stream of batches of entries, which the
+    // host sends ahead of them being applied, up to this many bytes
+    static constexpr size_t ledger_stream_max_bytes = 4 * 1024 * 1024;
+    bool ledger_stream_active = false;
+
     struct StartupSnapshotInfo
     {
       std::vector<uint8_t>& raw;
@@ -699,7 +717,7 @@ namespace ccf
       }
 
       LOG_INFO_FMT("Starting public recovery");
-      read_ledger_idx(++ledger_idx);
+      start_ledger_stream(++ledger_idx);
     }
 
     void recover_public_ledger_entry(const std::vector<uint8_t>& ledger_entry)
@@ -813,7 +831,7 @@ namespace ccf
         }
       }
 
-      read_ledger_idx(++ledger_idx);
+      ++ledger_idx;
     }
 
     void verify_snapshot_end(CCFConfig& config)
@@ -828,6 +846,7 @@ namespace ccf
         throw std::logic_error("Snapshot evidence was not committed in ledger");
       }
 
+      stop_ledger_stream();
       network.tables->clear();
       ledger_truncate(startup_snapshot_info->seqno);
 
@@ -838,6 +857,7 @@ namespace ccf
     void recover_public_ledger_end_unsafe()
     {
       sm.expect(State::readingPublicLedger);
+      stop_ledger_stream();
 
       if (startup_snapshot_info)
       {
@@ -976,7 +996,7 @@ namespace ccf
       }
       else
       {
-        read_ledger_idx(++ledger_idx);
+        ++ledger_idx;
       }
     }
 
@@ -986,6 +1006,7 @@ namespace ccf
       // ledger has been read and swap in private state
 
       sm.expect(State::readingPrivateLedger);
+      stop_ledger_stream();
 
       if (recovery_v != recovery_store->current_version())
       {
@@ -1079,8 +1100,59 @@ namespace ccf
     }
 
     //
-    // funcs in state "readingPublicLedger" or "readingPrivateLedger"
+    // funcs in state "readingPublicLedger", "verifyingSnapshot" or
+    // "readingPrivateLedger"
     //
+    bool expects_ledger_entry(consensus::Index idx)
+    {
+      // Batches and ends of stream already sent by the host when the stream
+      // is stopped are ignored
+      std::lock_guard<SpinLock> guard(lock);
+      return ledger_stream_active && idx == ledger_idx;
+    }
+
+    void recover_ledger_entries(
+      consensus::Index from, const uint8_t* data, size_t size)
+    {
+      const auto batch_size = size;
+      auto idx = from;
+      while (size > 0)
+      {
+        // Recovery may end part-way through a batch
+        if (!expects_ledger_entry(idx))
+        {
+          LOG_DEBUG_FMT("Ignoring streamed ledger entries from {}", idx);
+          return;
+        }
+
+        const auto entry_size = serialized::read<uint32_t>(data, size);
+        const std::vector<uint8_t> entry(data, data + entry_size);
+        serialized::skip(data, size, entry_size);
+
+        if (is_reading_public_ledger() || is_verifying_snapshot())
+        {
+          recover_public_ledger_entry(entry);
+        }
+        else if (is_reading_private_ledger())
+        {
+          recover_private_ledger_entry(entry);
+        }
+        else
+        {
+          throw std::logic_error(
+            "Cannot recover ledger entry if not reading public or private "
+            "ledger");
+        }
+        ++idx;
+      }
+
+      if (expects_ledger_entry(idx))
+      {
+        RINGBUFFER_WRITE_MESSAGE(
+          consensus::ledger_stream_ack, to_host, batch_size);
+      }
+    }
+
     void recover_ledger_end()
     {
       std::lock_guard<SpinLock> guard(lock);
@@ -1193,7 +1265,7 @@ namespace ccf
 
       // Start reading private security domain of ledger
       ledger_idx = recovery_store->current_version();
-      read_ledger_idx(++ledger_idx);
+      start_ledger_stream(++ledger_idx);
 
       sm.advance(State::readingPrivateLedger);
     }
@@ -1227,6 +1299,19 @@ namespace ccf
       consensus->periodic_end();
     }
 
+    void ledger_persisted(consensus::Index idx, size_t truncations)
+    {
+      if (
+        !sm.check(State::partOfNetwork) &&
+        !sm.check(State::partOfPublicNetwork) &&
+        !sm.check(State::readingPrivateLedger))
+      {
+        return;
+      }
+
+      consensus->ledger_persisted(idx, truncations);
+    }
+
     void node_msg(const std::vector<uint8_t>& data)
     {
       // Only process messages once part of network
@@ -1312,6 +1397,49 @@ namespace ccf
       }
     }
 
+    void set_ringbuffer_stats_source(
+      std::function<std::map<std::string, ringbuffer::BufferStats>()> source)
+    {
+      ringbuffer_stats = source;
+    }
+
+    void set_admission_controller(
+      std::shared_ptr<AdmissionController> admission_)
+    {
+      admission = admission_;
+    }
+
+    GetQueues::Out get_queue_stats() override
+    {
+      GetQueues::Out out;
+      if (ringbuffer_stats != nullptr)
+      {
+        out.ringbuffers = ringbuffer_stats();
+      }
+      out.thread_queue_depths =
+        threading::ThreadMessaging::thread_messaging.get_queue_depths();
+      if (admission != nullptr)
+      {
+        out.admission = admission->get_stats();
+      }
+      return out;
+    }
+
+    GetTlsSessions::Out get_tls_session_stats() override
+    {
+      const auto stats = rpcsessions->get_session_ticket_stats();
+
+      GetTlsSessions::Out out;
+      out.handshakes = stats.handshakes;
+      out.resumed_handshakes = stats.resumed_handshakes;
+      if (stats.handshakes != 0)
+      {
+        out.resumption_rate =
+          (double)stats.resumed_handshakes / stats.handshakes;
+      }
+      return out;
+    }
+
     bool rekey_ledger(kv::Tx& tx) override
     {
       std::lock_guard<SpinLock> guard(lock);
@@ -1561,7 +1689,7 @@ namespace ccf
 
       // Start reading private security domain of ledger
       ledger_idx = recovery_store->current_version();
-      read_ledger_idx(++ledger_idx);
+      start_ledger_stream(++ledger_idx);
 
       sm.advance(State::readingPrivateLedger);
     }
@@ -1755,6 +1883,11 @@ namespace ccf
         sig_tx_interval,
         public_only);
 
+      if (consensus_config.durable_ledger)
+      {
+        raft->enable_ledger_persistence(ledger_truncations);
+      }
+
       consensus = std::make_shared<RaftConsensusType>(
         std::move(raft), network.consensus_type);
 
@@ -1833,18 +1966,30 @@ namespace ccf
       }
     }
 
-    void read_ledger_idx(consensus::Index idx)
+    void start_ledger_stream(consensus::Index idx)
     {
+      ledger_stream_active = true;
       RINGBUFFER_WRITE_MESSAGE(
-        consensus::ledger_get,
+        consensus::ledger_stream_start,
         to_host,
         idx,
-        consensus::LedgerRequestPurpose::Recovery);
+        consensus::LedgerRequestPurpose::Recovery,
+        ledger_stream_max_bytes);
+    }
+
+    void stop_ledger_stream()
+    {
+      if (ledger_stream_active)
+      {
+        ledger_stream_active = false;
+        RINGBUFFER_WRITE_MESSAGE(consensus::ledger_stream_stop, to_host);
+      }
     }
 
     void ledger_truncate(consensus::Index idx)
     {
       RINGBUFFER_WRITE_MESSAGE(consensus::ledger_truncate, to_host, idx);
+      ledger_truncations++;
     }
   };
 }
@@ -0,0 +1,158 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/json.h"
+#include "endpoint.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace ccf
+{
+  // Decides which requests a node executes while it is overloaded, so that
+  // excess requests are rejected as they arrive (503, with a Retry-After)
+  // rather than queued until their latency is unbounded.
+  //
+  // The load is sampled on each tick, from the mean number of tasks queued
+  // for each worker thread and from the number of transactions not yet
+  // committed, each relative to its limit. While the load is above 1, the
+  // fraction of requests admitted is decreased multiplicatively, low
+  // priority requests first. Once it is back under 1, the fraction is
+  // increased additively, normal priority requests first. Critical requests
+  // are always admitted.
+  class AdmissionController
+  {
+  public:
+    struct Config
+    {
+      // Mean tasks queued per worker thread, or 0 to ignore queue depth
+      size_t max_queue_depth = 64;
+
+      // Transactions executed but not yet committed, or 0 to ignore
+      size_t max_commit_lag = 10000;
+
+      // Suggested to clients whose requests are shed
+      std::chrono::seconds retry_after = std::chrono::seconds(1);
+    };
+
+    struct Stats
+    {
+      double load = 0.0;
+
+      // Fraction of requests currently admitted, for each priority class
+      // that can be shed
+      double normal_admitted = 1.0;
+      double low_admitted = 1.0;
+
+      // Requests shed since the node started
+      size_t normal_shed = 0;
+      size_t low_shed = 0;
+    };
+
+  private:
+    // Admitted fractions are fixed-point, out of full
+    static constexpr uint64_t full = 1 << 16;
+    static constexpr uint64_t min_admitted = full / 100;
+    static constexpr uint64_t admitted_increase = full / 20;
+    static constexpr double admitted_decrease = 0.75;
+
+    static constexpr size_t classes = 2;
+
+    static size_t class_index(endpoints::AdmissionPriority priority)
+    {
+      return priority == endpoints::AdmissionPriority::Low ? 0 : 1;
+    }
+
+    const Config config;
+
+    std::atomic<double> load = 0.0;
+    std::atomic<uint64_t> admitted[classes] = {full, full};
+    std::atomic<uint64_t> seen[classes] = {0, 0};
+    std::atomic<size_t> shed[classes] = {0, 0};
+
+  public:
+    AdmissionController(const Config& config_) : config(config_) {}
+
+    std::chrono::seconds get_retry_after() const
+    {
+      return config.retry_after;
+    }
+
+    // Called on each tick, with the current measurements
+    void update(size_t queue_depth, size_t commit_lag)
+    {
+      double l = 0.0;
+      if (config.max_queue_depth != 0)
+      {
+        l = std::max(l, (double)queue_depth / config.max_queue_depth);
+      }
+      if (config.max_commit_lag != 0)
+      {
+        l = std::max(l, (double)commit_lag / config.max_commit_lag);
+      }
+      load.store(l, std::memory_order_relaxed);
+
+      auto& low = admitted[0];
+      auto& normal = admitted[1];
+      if (l > 1.0)
+      {
+        auto& target = low.load() > min_admitted ? low : normal;
+        target.store(std::max(
+          (uint64_t)(target.load() * admitted_decrease), min_admitted));
+      }
+      else
+      {
+        auto& target = normal.load() < full ? normal : low;
+        target.store(std::min(target.load() + admitted_increase, full));
+      }
+    }
+
+    // Called for each request, on any thread. Of every run of requests of a
+    // class, the admitted fraction are admitted, evenly spread over the run.
+    bool admit(endpoints::AdmissionPriority priority)
+    {
+      if (priority == endpoints::AdmissionPriority::Critical)
+      {
+        return true;
+      }
+
+      const auto i = class_index(priority);
+      const auto fraction = admitted[i].load(std::memory_order_relaxed);
+      if (fraction == full)
+      {
+        return true;
+      }
+
+      const auto n = seen[i].fetch_add(1, std::memory_order_relaxed);
+      if ((n + 1) * fraction / full != n * fraction / full)
+      {
+        return true;
+      }
+
+      shed[i].fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    Stats get_stats() const
+    {
+      Stats stats;
+      stats.load = load.load();
+      stats.low_admitted = (double)admitted[0].load() / full;
+      stats.normal_admitted = (double)admitted[1].load() / full;
+      stats.low_shed = shed[0].load();
+      stats.normal_shed = shed[1].load();
+      return stats;
+    }
+  };
+
+  DECLARE_JSON_TYPE(AdmissionController::Stats)
+  DECLARE_JSON_REQUIRED_FIELDS(
+    AdmissionController::Stats,
+    load,
+    normal_admitted,
+    low_admitted,
+    normal_shed,
+    low_shed)
+}
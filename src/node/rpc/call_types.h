@@ -39,6 +39,24 @@ namespace ccf
     };
   };
 
+  struct SubscribeCommit
+  {
+    struct In
+    {
+      // Push the commit watermark each time it advances
+      bool watermark = false;
+
+      // Push the status of each of these once it is committed or invalid
+      std::vector<GetTxStatus::In> txs = {};
+    };
+
+    struct Out
+    {
+      // Transactions this session is still waiting on
+      size_t pending;
+    };
+  };
+
   struct GetCode
   {
     struct Version
@@ -125,6 +143,8 @@ namespace ccf
       size_t errors = 0;
       size_t failures = 0;
       size_t retries = 0;
+      // Requests rejected because the node was overloaded
+      size_t shed = 0;
     };
 
     struct Out
@@ -133,6 +153,41 @@ namespace ccf
     };
   };
 
+  struct Batch
+  {
+    // Bodies are given as JSON (body) or as base64-encoded bytes
+    // (body_base64). Requests without a Content-Type header are sent with a
+    // JSON body.
+    struct Request
+    {
+      std::string verb = "POST";
+      std::string path;
+      std::map<std::string, std::string> headers = {};
+      nlohmann::json body = nullptr;
+      std::string body_base64 = {};
+    };
+
+    struct In
+    {
+      std::vector<Request> requests;
+    };
+
+    // Responses with a JSON body are returned as JSON (body), others as
+    // base64-encoded bytes (body_base64)
+    struct Response
+    {
+      int status = 0;
+      std::map<std::string, std::string> headers = {};
+      nlohmann::json body = nullptr;
+      std::string body_base64 = {};
+    };
+
+    struct Out
+    {
+      std::vector<Response> responses;
+    };
+  };
+
   struct GetReceipt
   {
     struct In
@@ -0,0 +1,238 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/json.h"
+#include "ds/logger.h"
+#include "ds/spin_lock.h"
+#include "tx_status.h"
+
+#include <functional>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace ccf
+{
+  // Pushed to a subscribed session when the commit watermark advances. Lists
+  // the session's transactions whose status has become final (committed or
+  // invalid) since the last notification.
+  struct CommitNotification
+  {
+    struct Tx
+    {
+      int64_t view;
+      int64_t seqno;
+      TxStatus status;
+    };
+
+    // The commit watermark
+    int64_t view;
+    int64_t seqno;
+
+    std::vector<Tx> txs = {};
+  };
+
+  DECLARE_JSON_TYPE(CommitNotification::Tx)
+  DECLARE_JSON_REQUIRED_FIELDS(CommitNotification::Tx, view, seqno, status)
+  DECLARE_JSON_TYPE(CommitNotification)
+  DECLARE_JSON_REQUIRED_FIELDS(CommitNotification, view, seqno, txs)
+
+  // Tracks the transactions that websocket sessions are waiting on, so that
+  // their status can be pushed when they are committed, instead of each
+  // client polling GET /tx.
+  //
+  // Sessions subscribe from any thread. On each tick, update() is called
+  // with the commit watermark, and returns at most one notification per
+  // session, covering all of its transactions that have become final since
+  // the previous tick, and the watermark itself for sessions subscribed to
+  // it.
+  class CommitNotifier
+  {
+  public:
+    using TxID = std::pair<int64_t, int64_t>;
+
+    // Returns this node's view for the given seqno
+    using GetView = std::function<int64_t(int64_t)>;
+
+    // Sends a notification to a session, returning false if the session is
+    // no longer open
+    using Deliver = std::function<bool(size_t, const CommitNotification&)>;
+
+    // Transactions a single session may be waiting on at once
+    static constexpr size_t max_pending_txs = 10000;
+
+  private:
+    struct Subscription
+    {
+      bool watermark = false;
+
+      // Subscribed since the last update, so not yet compared against the
+      // current watermark
+      bool fresh = true;
+
+      // Ordered by seqno, then view, so that those committed are a prefix
+      std::set<std::pair<int64_t, int64_t>> pending;
+    };
+
+    SpinLock lock;
+    std::unordered_map<size_t, Subscription> subscriptions;
+
+    int64_t last_view = VIEW_UNKNOWN;
+    int64_t last_seqno = 0;
+
+    static CommitNotification::Tx evaluate(
+      int64_t target_view,
+      int64_t target_seqno,
+      int64_t view,
+      int64_t seqno,
+      const GetView& get_view)
+    {
+      TxStatus status;
+      try
+      {
+        status = evaluate_tx_status(
+          target_view, target_seqno, get_view(target_seqno), view, seqno);
+      }
+      catch (const std::exception& e)
+      {
+        LOG_FAIL_FMT(
+          "Unable to evaluate status of {}.{}: {}",
+          target_view,
+          target_seqno,
+          e.what());
+        status = TxStatus::Unknown;
+      }
+      return {target_view, target_seqno, status};
+    }
+
+  public:
+    // Adds to the transactions the session is waiting on, and subscribes it
+    // to the watermark if requested. Returns false, without subscribing, if
+    // the session would be waiting on more than max_pending_txs.
+    bool subscribe(
+      size_t session_id, bool watermark, const std::vector<TxID>& txs)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      auto& subscription = subscriptions[session_id];
+      if (subscription.pending.size() + txs.size() > max_pending_txs)
+      {
+        if (!subscription.watermark && subscription.pending.empty())
+        {
+          subscriptions.erase(session_id);
+        }
+        return false;
+      }
+
+      subscription.watermark |= watermark;
+      subscription.fresh = true;
+      for (const auto& [view, seqno] : txs)
+      {
+        subscription.pending.emplace(seqno, view);
+      }
+      return true;
+    }
+
+    void unsubscribe(size_t session_id)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      subscriptions.erase(session_id);
+    }
+
+    size_t pending_txs(size_t session_id)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      const auto it = subscriptions.find(session_id);
+      return it == subscriptions.end() ? 0 : it->second.pending.size();
+    }
+
+    std::vector<std::pair<size_t, CommitNotification>> update(
+      int64_t view, int64_t seqno, const GetView& get_view)
+    {
+      std::vector<std::pair<size_t, CommitNotification>> notifications;
+
+      std::lock_guard<SpinLock> guard(lock);
+      const bool advanced = seqno != last_seqno;
+      const bool view_changed = view != last_view;
+      last_view = view;
+      last_seqno = seqno;
+
+      for (auto it = subscriptions.begin(); it != subscriptions.end();)
+      {
+        auto& [session_id, subscription] = *it;
+        CommitNotification notification{view, seqno};
+        auto& pending = subscription.pending;
+
+        // Everything up to the watermark is either committed or invalid
+        while (!pending.empty() && pending.begin()->first <= seqno)
+        {
+          const auto [tx_seqno, tx_view] = *pending.begin();
+          notification.txs.push_back(
+            evaluate(tx_view, tx_seqno, view, seqno, get_view));
+          pending.erase(pending.begin());
+        }
+
+        // Beyond the watermark, transactions from earlier views may have
+        // been rolled back. This is only re-examined when the view changes.
+        if (view_changed || subscription.fresh)
+        {
+          for (auto p = pending.begin(); p != pending.end();)
+          {
+            const auto [tx_seqno, tx_view] = *p;
+            if (tx_view < view)
+            {
+              auto tx = evaluate(tx_view, tx_seqno, view, seqno, get_view);
+              if (tx.status == TxStatus::Invalid)
+              {
+                notification.txs.push_back(tx);
+                p = pending.erase(p);
+                continue;
+              }
+            }
+            ++p;
+          }
+        }
+
+        if (
+          !notification.txs.empty() ||
+          (subscription.watermark && (advanced || subscription.fresh)))
+        {
+          notifications.emplace_back(session_id, std::move(notification));
+        }
+        subscription.fresh = false;
+
+        if (!subscription.watermark && pending.empty())
+        {
+          it = subscriptions.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+
+      return notifications;
+    }
+
+    // Updates the watermark and delivers the resulting notifications. A
+    // session may subscribe on a worker thread after it has been closed, and
+    // unsubscribed, so sessions to which delivery fails are unsubscribed
+    // here instead.
+    void notify(
+      int64_t view,
+      int64_t seqno,
+      const GetView& get_view,
+      const Deliver& deliver)
+    {
+      for (const auto& [session_id, notification] :
+           update(view, seqno, get_view))
+      {
+        if (!deliver(session_id, notification))
+        {
+          unsubscribe(session_id);
+        }
+      }
+    }
+  };
+}
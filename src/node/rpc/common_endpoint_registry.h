@@ -54,6 +54,7 @@ namespace ccf
         "commit", HTTP_GET, json_command_adapter(get_commit), no_auth_required)
         .set_execute_outside_consensus(
           ccf::endpoints::ExecuteOutsideConsensus::Locally)
+        .set_admission_priority(ccf::endpoints::AdmissionPriority::Critical)
         .set_auto_schema<void, GetCommit::Out>()
         .install();
 
@@ -90,6 +91,61 @@ namespace ccf
           ccf::endpoints::ExecuteOutsideConsensus::Locally)
         .install();
 
+      // Rather than polling /tx, websocket sessions may subscribe to have the
+      // status of their transactions pushed to them once it is final, and
+      // the commit watermark each time it advances. Notifications are sent
+      // on this node's tick, at most one per session, and may arrive before
+      // the response to the subscription itself.
+      auto subscribe_commit = [this](auto& args, nlohmann::json&& params) {
+        if (args.rpc_ctx->frame_format() != enclave::FrameFormat::ws)
+        {
+          return make_error(
+            HTTP_STATUS_BAD_REQUEST,
+            ccf::errors::InvalidInput,
+            "Commit notifications can only be sent to websocket sessions.");
+        }
+
+        if (commit_notifier == nullptr)
+        {
+          return make_error(
+            HTTP_STATUS_NOT_IMPLEMENTED,
+            ccf::errors::InternalError,
+            "Commit notifications are not available on this node.");
+        }
+
+        const auto in = params.get<SubscribeCommit::In>();
+        std::vector<CommitNotifier::TxID> txs;
+        for (const auto& tx : in.txs)
+        {
+          txs.emplace_back(tx.view, tx.seqno);
+        }
+
+        const auto session_id = args.rpc_ctx->session->client_session_id;
+        if (!commit_notifier->subscribe(session_id, in.watermark, txs))
+        {
+          return make_error(
+            HTTP_STATUS_BAD_REQUEST,
+            ccf::errors::InvalidInput,
+            fmt::format(
+              "A session may wait on at most {} transactions.",
+              CommitNotifier::max_pending_txs));
+        }
+
+        SubscribeCommit::Out out;
+        out.pending = commit_notifier->pending_txs(session_id);
+        return make_success(out);
+      };
+      make_command_endpoint(
+        "tx/subscribe",
+        HTTP_POST,
+        json_command_adapter(subscribe_commit),
+        no_auth_required)
+        .set_forwarding_required(ccf::endpoints::ForwardingRequired::Never)
+        .set_execute_outside_consensus(
+          ccf::endpoints::ExecuteOutsideConsensus::Locally)
+        .set_auto_schema<SubscribeCommit>()
+        .install();
+
       auto get_caller_id = [this](auto& args, nlohmann::json&& params) {
         GetCallerId::Out out;
 
@@ -202,6 +258,7 @@ namespace ccf
         HTTP_GET,
         json_command_adapter(endpoint_metrics_fn),
         no_auth_required)
+        .set_admission_priority(ccf::endpoints::AdmissionPriority::Critical)
         .set_auto_schema<void, EndpointMetrics::Out>()
         .install();
 
@@ -39,11 +39,19 @@ namespace ccf
       Locally,
       Primary
     };
+
+    enum class AdmissionPriority
+    {
+      Low,
+      Normal,
+      Critical
+    };
   }
 }
 
 MSGPACK_ADD_ENUM(ccf::endpoints::ForwardingRequired);
 MSGPACK_ADD_ENUM(ccf::endpoints::ExecuteOutsideConsensus);
+MSGPACK_ADD_ENUM(ccf::endpoints::AdmissionPriority);
 
 namespace ccf
 {
@@ -61,6 +69,12 @@ namespace ccf
        {ExecuteOutsideConsensus::Locally, "locally"},
        {ExecuteOutsideConsensus::Primary, "primary"}});
 
+    DECLARE_JSON_ENUM(
+      AdmissionPriority,
+      {{AdmissionPriority::Low, "low"},
+       {AdmissionPriority::Normal, "normal"},
+       {AdmissionPriority::Critical, "critical"}});
+
     using AuthnPolicies = std::vector<std::shared_ptr<AuthnPolicy>>;
 
     struct EndpointProperties
@@ -73,18 +87,22 @@ namespace ccf
       nlohmann::json openapi;
       bool openapi_hidden = false;
 
+      AdmissionPriority admission_priority = AdmissionPriority::Normal;
+
       MSGPACK_DEFINE(
         forwarding_required,
         execute_outside_consensus,
         authn_policies,
         openapi,
-        openapi_hidden);
+        openapi_hidden,
+        admission_priority);
     };
 
     DECLARE_JSON_TYPE_WITH_OPTIONAL_FIELDS(EndpointProperties);
     DECLARE_JSON_REQUIRED_FIELDS(
       EndpointProperties, forwarding_required, authn_policies);
-    DECLARE_JSON_OPTIONAL_FIELDS(EndpointProperties, openapi, openapi_hidden);
+    DECLARE_JSON_OPTIONAL_FIELDS(
+      EndpointProperties, openapi, openapi_hidden, admission_priority);
 
     struct EndpointDefinition
     {
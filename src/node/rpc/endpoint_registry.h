@@ -2,9 +2,11 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "commit_notifier.h"
 #include "ds/ccf_deprecated.h"
 #include "ds/json_schema.h"
 #include "ds/openapi.h"
+#include "ds/path_trie.h"
 #include "enclave/rpc_context.h"
 #include "endpoint.h"
 #include "http/authentication/cert_auth.h"
@@ -32,13 +34,13 @@ namespace ccf
   {
     CommandEndpointContext(
       const std::shared_ptr<enclave::RpcContext>& r,
-      std::unique_ptr<AuthnIdentity>&& c) :
+      std::shared_ptr<AuthnIdentity>&& c) :
       rpc_ctx(r),
       caller(std::move(c))
     {}
 
     std::shared_ptr<enclave::RpcContext> rpc_ctx;
-    std::unique_ptr<AuthnIdentity> caller;
+    std::shared_ptr<AuthnIdentity> caller;
 
     template <typename T>
     const T* try_get_caller()
@@ -64,7 +66,7 @@ namespace ccf
   {
     EndpointContext(
       const std::shared_ptr<enclave::RpcContext>& r,
-      std::unique_ptr<AuthnIdentity>&& c,
+      std::shared_ptr<AuthnIdentity>&& c,
       kv::Tx& t) :
       CommandEndpointContext(r, std::move(c)),
       tx(t)
@@ -79,7 +81,7 @@ namespace ccf
   {
     ReadOnlyEndpointContext(
       const std::shared_ptr<enclave::RpcContext>& r,
-      std::unique_ptr<AuthnIdentity>&& c,
+      std::shared_ptr<AuthnIdentity>&& c,
       kv::ReadOnlyTx& t) :
       CommandEndpointContext(r, std::move(c)),
       tx(t)
@@ -146,6 +148,7 @@ namespace ccf
       size_t errors = 0;
       size_t failures = 0;
       size_t retries = 0;
+      size_t shed = 0;
     };
 
     struct Endpoint;
@@ -410,6 +413,24 @@ namespace ccf
         return *this;
       }
 
+      /** Sets the priority with which requests to this Endpoint are admitted
+       * while the node is overloaded.
+       *
+       * Low priority requests are shed first, then normal priority requests.
+       * Critical requests are always admitted. By default, endpoints have
+       * the default priority of their registry, which is normal for
+       * application endpoints.
+       *
+       * @param p Enum value with desired priority
+       * @return This Endpoint for further modification
+       * @see ccf::AdmissionController
+       */
+      Endpoint& set_admission_priority(AdmissionPriority p)
+      {
+        properties.admission_priority = p;
+        return *this;
+      }
+
       /** Finalise and install this endpoint
        */
       void install()
@@ -532,12 +553,21 @@ namespace ccf
       std::string,
       std::map<RESTVerb, std::shared_ptr<PathTemplatedEndpoint>>>
       templated_endpoints;
+    // The same endpoints, indexed by path segment, to resolve request paths
+    // to templates without matching every template's regex in turn
+    ds::PathTrie<std::map<RESTVerb, std::shared_ptr<PathTemplatedEndpoint>>>
+      templated_paths;
 
     SpinLock metrics_lock;
     std::map<std::string, std::map<std::string, Metrics>> metrics;
 
     kv::Consensus* consensus = nullptr;
     kv::TxHistory* history = nullptr;
+    std::shared_ptr<CommitNotifier> commit_notifier = nullptr;
+
+    // Priority of the endpoints made by this registry, unless they set their
+    // own
+    AdmissionPriority default_admission_priority = AdmissionPriority::Normal;
 
     static void add_query_parameters(
       nlohmann::json& document,
@@ -599,6 +629,7 @@ namespace ccf
       endpoint.authn_policies = ap;
       // By default, all write transactions are forwarded
       endpoint.properties.forwarding_required = ForwardingRequired::Always;
+      endpoint.properties.admission_priority = default_admission_priority;
       endpoint.registry = this;
       return endpoint;
     }
@@ -667,6 +698,9 @@ namespace ccf
         templated_endpoint->spec = std::move(template_spec.value());
         templated_endpoints[endpoint.dispatch.uri_path]
                            [endpoint.dispatch.verb] = templated_endpoint;
+        templated_paths.insert(
+          endpoint.dispatch.uri_path)[endpoint.dispatch.verb] =
+          templated_endpoint;
       }
       else
       {
@@ -807,7 +841,8 @@ namespace ccf
                                  metric.calls,
                                  metric.errors,
                                  metric.failures,
-                                 metric.retries});
+                                 metric.retries,
+                                 metric.shed});
         }
       }
     }
@@ -844,35 +879,31 @@ namespace ccf
       {
         std::vector<EndpointDefinitionPtr> matches;
 
-        std::smatch match;
-        for (auto& [original_method, verb_endpoints] : templated_endpoints)
+        for (const auto& match : templated_paths.find(method))
         {
           auto templated_endpoints_for_verb =
-            verb_endpoints.find(rpc_ctx.get_request_verb());
-          if (templated_endpoints_for_verb != verb_endpoints.end())
+            match.value->find(rpc_ctx.get_request_verb());
+          if (templated_endpoints_for_verb != match.value->end())
           {
             auto& endpoint = templated_endpoints_for_verb->second;
-            if (std::regex_match(method, match, endpoint->spec.template_regex))
+
+            // Populate the request_path_params the first-time through. If we
+            // get a second match, we're just building up a list for
+            // error-reporting
+            if (matches.size() == 0)
             {
-              // Populate the request_path_params the first-time through. If we
-              // get a second match, we're just building up a list for
-              // error-reporting
-              if (matches.size() == 0)
+              auto& path_params = rpc_ctx.get_request_path_params();
+              for (size_t i = 0;
+                   i < endpoint->spec.template_component_names.size();
+                   ++i)
               {
-                auto& path_params = rpc_ctx.get_request_path_params();
-                for (size_t i = 0;
-                     i < endpoint->spec.template_component_names.size();
-                     ++i)
-                {
-                  const auto& template_name =
-                    endpoint->spec.template_component_names[i];
-                  const auto& template_value = match[i + 1].str();
-                  path_params[template_name] = template_value;
-                }
+                const auto& template_name =
+                  endpoint->spec.template_component_names[i];
+                path_params[template_name] = std::string(match.params[i]);
               }
-
-              matches.push_back(endpoint);
             }
+
+            matches.push_back(endpoint);
           }
         }
 
@@ -925,15 +956,11 @@ namespace ccf
         }
       }
 
-      std::smatch match;
-      for (const auto& [original_method, verb_endpoints] : templated_endpoints)
+      for (const auto& match : templated_paths.find(method))
       {
-        for (const auto& [verb, endpoint] : verb_endpoints)
+        for (const auto& [verb, endpoint] : *match.value)
         {
-          if (std::regex_match(method, match, endpoint->spec.template_regex))
-          {
-            verbs.insert(verb);
-          }
+          verbs.insert(verb);
         }
       }
 
@@ -973,5 +1000,10 @@ namespace ccf
     {
       history = h;
     }
+
+    void set_commit_notifier(std::shared_ptr<CommitNotifier> n)
+    {
+      commit_notifier = n;
+    }
   };
 }
\ No newline at end of file
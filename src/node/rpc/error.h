@@ -60,6 +60,7 @@ namespace ccf
     ERROR(ProposalNotOpen)
     ERROR(ProposalNotFound)
     ERROR(ServiceNotWaitingForRecoveryShares)
+    ERROR(ServiceOverloaded)
     ERROR(StateDigestMismatch)
     ERROR(TransactionNotFound)
     ERROR(TransactionCommitAttemptsExceedLimit)
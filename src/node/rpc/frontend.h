@@ -1,10 +1,12 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
 #pragma once
+#include "admission_control.h"
 #include "common_endpoint_registry.h"
 #include "consensus/aft/request.h"
 #include "ds/buffer.h"
 #include "ds/spin_lock.h"
+#include "ds/tracing.h"
 #include "enclave/rpc_handler.h"
 #include "forwarder.h"
 #include "http/http_jwt.h"
@@ -13,6 +15,7 @@
 #include "node/nodes.h"
 #include "node/service.h"
 #include "rpc_exception.h"
+#include "tls/base64.h"
 #include "tls/verifier.h"
 
 #define FMT_HEADER_ONLY
@@ -23,6 +26,22 @@
 
 namespace ccf
 {
+  // Installs the KV map observers which keep tables_version up to date, so
+  // that frontends given it may cache caller identities for each session.
+  // Map hooks set on the same tables, e.g. by the application, still run.
+  inline void track_authn_tables(
+    kv::Store& store, const std::shared_ptr<AuthnTablesVersion>& tables_version)
+  {
+    for (const auto& map_name : AuthnTablesVersion::tables)
+    {
+      store.add_map_observer(
+        map_name,
+        [tables_version](kv::Version version, const kv::untyped::Write&) {
+          tables_version->update(version);
+        });
+    }
+  }
+
   class RpcFrontend : public enclave::RpcHandler, public ForwardedRpcHandler
   {
   protected:
@@ -35,6 +54,8 @@ namespace ccf
 
     kv::Consensus* consensus;
     std::shared_ptr<enclave::AbstractForwarder> cmd_forwarder;
+    std::shared_ptr<AdmissionController> admission;
+    std::shared_ptr<AuthnTablesVersion> authn_tables_version;
     kv::TxHistory* history;
 
     size_t sig_tx_interval = 5000;
@@ -45,6 +66,11 @@ namespace ccf
 
     using PreExec = std::function<void(kv::Tx& tx, enclave::RpcContext& ctx)>;
 
+    // Every frontend accepts batches of requests, POSTed to this path, unless
+    // it has an endpoint of its own there
+    static constexpr auto batch_path = "batch";
+    static constexpr size_t max_batch_size = 1000;
+
     void update_consensus()
     {
       auto c = tables.get_consensus().get();
@@ -62,6 +88,39 @@ namespace ccf
       endpoints.set_history(history);
     }
 
+    // Identities resolved by session-cacheable policies are reused for later
+    // requests on the same session, until the tables they were resolved from
+    // change
+    std::shared_ptr<AuthnIdentity> authenticate(
+      const std::shared_ptr<AuthnPolicy>& policy,
+      kv::ReadOnlyTx& tx,
+      const std::shared_ptr<enclave::RpcContext>& ctx,
+      std::string& error_reason)
+    {
+      const auto& cache = ctx->session->authn_cache;
+      if (
+        cache == nullptr || authn_tables_version == nullptr ||
+        !policy->is_session_cacheable())
+      {
+        return policy->authenticate(tx, ctx, error_reason);
+      }
+
+      std::shared_ptr<AuthnIdentity> identity = cache->get(
+        policy.get(),
+        tables.current_txid().term,
+        authn_tables_version->get());
+      if (identity == nullptr)
+      {
+        identity = policy->authenticate(tx, ctx, error_reason);
+        if (identity != nullptr)
+        {
+          cache->put(
+            policy.get(), tx.get_read_version(), tx.get_term(), identity);
+        }
+      }
+      return identity;
+    }
+
     void update_metrics(
       const std::shared_ptr<enclave::RpcContext> ctx,
       EndpointRegistry::Metrics& m)
@@ -82,7 +141,10 @@ namespace ccf
       std::shared_ptr<enclave::RpcContext> ctx,
       const EndpointDefinitionPtr& endpoint)
     {
-      auto& metrics = endpoints.get_metrics(endpoint);
+      // Batches have no endpoint, so are not counted against any
+      EndpointRegistry::Metrics batch_metrics;
+      auto& metrics =
+        endpoint != nullptr ? endpoints.get_metrics(endpoint) : batch_metrics;
 
       if (cmd_forwarder && !ctx->session->is_forwarded)
       {
@@ -95,8 +157,9 @@ namespace ccf
             cmd_forwarder->forward_command(
               ctx,
               primary_id,
-              endpoint->properties.execute_outside_consensus ==
-                  ExecuteOutsideConsensus::Never ?
+              endpoint == nullptr ||
+                  endpoint->properties.execute_outside_consensus ==
+                    ExecuteOutsideConsensus::Never ?
                 consensus->active_nodes() :
                 std::set<NodeId>(),
               ctx->session->caller_cert))
@@ -138,11 +201,262 @@ namespace ccf
       }
     }
 
+    // Sets an error response, and returns true, if the request should be
+    // shed because the node is overloaded
+    bool shed(
+      const std::shared_ptr<enclave::RpcContext>& ctx,
+      const EndpointDefinitionPtr& endpoint)
+    {
+      if (
+        endpoint == nullptr || admission == nullptr ||
+        admission->admit(endpoint->properties.admission_priority))
+      {
+        return false;
+      }
+
+      endpoints.get_metrics(endpoint).shed++;
+      ctx->set_error(
+        HTTP_STATUS_SERVICE_UNAVAILABLE,
+        ccf::errors::ServiceOverloaded,
+        "Node is overloaded. Retry later.");
+      ctx->set_response_header(
+        http::headers::RETRY_AFTER,
+        (size_t)admission->get_retry_after().count());
+      return true;
+    }
+
+    bool is_batch(
+      const enclave::RpcContext& ctx, const EndpointDefinitionPtr& endpoint)
+    {
+      if (endpoint != nullptr || ctx.get_request_verb() != HTTP_POST)
+      {
+        return false;
+      }
+
+      const auto method = ctx.get_method();
+      const auto start = method.find_first_not_of('/');
+      return start != std::string::npos && method.substr(start) == batch_path;
+    }
+
+    static Batch::Response make_batch_error(
+      http_status status, const std::string& code, std::string&& msg)
+    {
+      Batch::Response response;
+      response.status = status;
+      response.headers[http::headers::CONTENT_TYPE] =
+        http::headervalues::contenttype::JSON;
+      response.body = ODataErrorResponse{ODataError{code, std::move(msg)}};
+      return response;
+    }
+
+    // Executes one request of a batch, in its own transaction, as though it
+    // had been sent to this frontend on the batch's session
+    Batch::Response process_batched(
+      const std::shared_ptr<enclave::RpcContext>& batch_ctx,
+      const std::string& prefix,
+      const Batch::Request& request)
+    {
+      const auto verb = nlohmann::json(request.verb).get<RESTVerb>();
+      if (!verb.get_http_method().has_value())
+      {
+        return make_batch_error(
+          HTTP_STATUS_BAD_REQUEST,
+          ccf::errors::UnsupportedHttpVerb,
+          fmt::format("Cannot batch {} requests.", request.verb));
+      }
+
+      if (request.path.rfind(prefix, 0) != 0)
+      {
+        return make_batch_error(
+          HTTP_STATUS_BAD_REQUEST,
+          ccf::errors::InvalidResourceName,
+          fmt::format(
+            "Batched request path {} is not under {}.",
+            request.path,
+            prefix));
+      }
+
+      http::HeaderMap headers;
+      for (const auto& [k, v] : request.headers)
+      {
+        auto name = k;
+        nonstd::to_lower(name);
+        headers[name] = v;
+      }
+
+      std::vector<uint8_t> body;
+      if (!request.body_base64.empty())
+      {
+        body = tls::raw_from_b64(request.body_base64);
+      }
+      else if (!request.body.is_null())
+      {
+        const auto s = request.body.dump();
+        body.assign(s.begin(), s.end());
+        headers.emplace(
+          http::headers::CONTENT_TYPE, http::headervalues::contenttype::JSON);
+      }
+
+      // The request runs on a copy of the batch's session, marked as
+      // forwarded so that if it cannot be executed here it is redirected,
+      // rather than forwarded and answered separately from the batch
+      auto session =
+        std::make_shared<enclave::SessionContext>(*batch_ctx->session);
+      session->is_forwarded = true;
+
+      auto ctx = enclave::make_rpc_context(
+        session,
+        batch_ctx->get_request_index(),
+        verb.get_http_method().value(),
+        request.path,
+        std::move(headers),
+        std::move(body));
+      ctx->set_method(ctx->get_request_path().substr(prefix.size()));
+
+      auto tx = tables.create_tx();
+      set_root_on_proposals(*ctx, tx);
+      if (!shed(ctx, endpoints.find_endpoint(tx, *ctx)))
+      {
+        process_command(ctx, tx);
+      }
+
+      Batch::Response response;
+      response.status = ctx->get_response_status();
+      const auto& response_headers = ctx->get_response_headers();
+      response.headers = {response_headers.begin(), response_headers.end()};
+
+      // The request has been executed by now, so a body which cannot be
+      // parsed as JSON is returned as it is, rather than as an error
+      const auto& response_body = ctx->get_response_body();
+      const auto content_type =
+        response_headers.find(http::headers::CONTENT_TYPE);
+      if (
+        content_type != response_headers.end() &&
+        content_type->second == http::headervalues::contenttype::JSON &&
+        !response_body.empty())
+      {
+        response.body = nlohmann::json::parse(response_body, nullptr, false);
+      }
+      if (response.body.is_discarded() || response.body.is_null())
+      {
+        response.body = nullptr;
+        if (!response_body.empty())
+        {
+          response.body_base64 = tls::b64_from_raw(response_body);
+        }
+      }
+      return response;
+    }
+
+    /** Process a batch of requests, each executed in its own transaction
+     *
+     * The batch is answered with a 207 (Multi-Status) response, listing the
+     * response to each request in turn. Its transaction ID is the highest of
+     * those of its requests, so that once it is committed, all of them are.
+     * On a backup, the whole batch is forwarded to the primary.
+     */
+    std::optional<std::vector<uint8_t>> process_batch(
+      std::shared_ptr<enclave::RpcContext> ctx)
+    {
+      if (consensus != nullptr && consensus->type() != ConsensusType::CFT)
+      {
+        ctx->set_error(
+          HTTP_STATUS_NOT_IMPLEMENTED,
+          ccf::errors::InvalidInput,
+          "Batches are only supported with CFT consensus.");
+        return ctx->serialise_response();
+      }
+
+      if (consensus != nullptr && !consensus->is_primary())
+      {
+        ctx->session->is_forwarding = true;
+        return forward_or_redirect_json(ctx, nullptr);
+      }
+
+      Batch::In in;
+      try
+      {
+        in = nlohmann::json::parse(ctx->get_request_body()).get<Batch::In>();
+      }
+      catch (const std::exception& e)
+      {
+        ctx->set_error(
+          HTTP_STATUS_BAD_REQUEST,
+          ccf::errors::InvalidInput,
+          fmt::format("Invalid batch: {}", e.what()));
+        return ctx->serialise_response();
+      }
+
+      if (in.requests.size() > max_batch_size)
+      {
+        ctx->set_error(
+          HTTP_STATUS_BAD_REQUEST,
+          ccf::errors::InvalidInput,
+          fmt::format(
+            "Batch of {} requests exceeds the maximum of {}.",
+            in.requests.size(),
+            max_batch_size));
+        return ctx->serialise_response();
+      }
+
+      // Batched requests are addressed by their whole path, which must be
+      // to this frontend (e.g. /app/ for a batch POSTed to /app/batch)
+      const auto whole_path = ctx->get_request_path();
+      const auto method = ctx->get_method();
+      const auto prefix =
+        whole_path.substr(0, whole_path.size() - method.size());
+
+      Batch::Out out;
+      std::optional<std::pair<kv::Consensus::View, kv::Version>> last_txid;
+      for (const auto& request : in.requests)
+      {
+        Batch::Response response;
+        try
+        {
+          response = process_batched(ctx, prefix, request);
+        }
+        catch (const std::exception& e)
+        {
+          response = make_batch_error(
+            HTTP_STATUS_BAD_REQUEST, ccf::errors::InvalidInput, e.what());
+        }
+
+        const auto view = response.headers.find(http::headers::CCF_TX_VIEW);
+        const auto seqno = response.headers.find(http::headers::CCF_TX_SEQNO);
+        if (view != response.headers.end() && seqno != response.headers.end())
+        {
+          const std::pair<kv::Consensus::View, kv::Version> txid = {
+            std::stoll(view->second), std::stoll(seqno->second)};
+          if (!last_txid.has_value() || last_txid.value() < txid)
+          {
+            last_txid = txid;
+          }
+        }
+
+        out.responses.push_back(std::move(response));
+      }
+
+      if (last_txid.has_value())
+      {
+        ctx->set_view(last_txid->first);
+        ctx->set_seqno(last_txid->second);
+      }
+
+      ctx->set_response_status(HTTP_STATUS_MULTI_STATUS);
+      const auto body = nlohmann::json(out).dump();
+      ctx->set_response_body(std::vector<uint8_t>(body.begin(), body.end()));
+      ctx->set_response_header(
+        http::headers::CONTENT_TYPE, http::headervalues::contenttype::JSON);
+      return ctx->serialise_response();
+    }
+
     std::optional<std::vector<uint8_t>> process_command(
       std::shared_ptr<enclave::RpcContext> ctx,
       kv::Tx& tx,
       const PreExec& pre_exec = {})
     {
+      tracing::SpanTimer span(tracing::SpanKind::Execute);
+
       const auto endpoint = endpoints.find_endpoint(tx, *ctx);
       if (endpoint == nullptr)
       {
@@ -184,7 +498,7 @@ namespace ccf
       auto& metrics = endpoints.get_metrics(endpoint);
       metrics.calls++;
 
-      std::unique_ptr<AuthnIdentity> identity = nullptr;
+      std::shared_ptr<AuthnIdentity> identity = nullptr;
 
       // If any auth policy was required, check that at least one is accepted
       if (!endpoint->authn_policies.empty())
@@ -192,7 +506,7 @@ namespace ccf
         std::string auth_error_reason;
         for (const auto& policy : endpoint->authn_policies)
         {
-          identity = policy->authenticate(tx, ctx, auth_error_reason);
+          identity = authenticate(policy, tx, ctx, auth_error_reason);
           if (identity != nullptr)
           {
             break;
@@ -418,6 +732,24 @@ namespace ccf
       cmd_forwarder = cmd_forwarder_;
     }
 
+    void set_admission_controller(
+      std::shared_ptr<AdmissionController> admission_) override
+    {
+      admission = admission_;
+    }
+
+    void set_authn_tables_version(
+      std::shared_ptr<AuthnTablesVersion> authn_tables_version_) override
+    {
+      authn_tables_version = authn_tables_version_;
+    }
+
+    void set_commit_notifier(
+      std::shared_ptr<CommitNotifier> commit_notifier) override
+    {
+      endpoints.set_commit_notifier(commit_notifier);
+    }
+
     void open(std::optional<tls::Pem*> identity = std::nullopt) override
     {
       std::lock_guard<SpinLock> mguard(open_lock);
@@ -502,6 +834,19 @@ namespace ccf
 
       auto endpoint = endpoints.find_endpoint(tx, *ctx);
 
+      if (is_batch(*ctx, endpoint))
+      {
+        return process_batch(ctx);
+      }
+
+      // Requests are shed before they are executed (or forwarded), while the
+      // node is overloaded. Unknown endpoints are cheap enough to reject as
+      // usual.
+      if (shed(ctx, endpoint))
+      {
+        return ctx->serialise_response();
+      }
+
       const bool is_bft =
         consensus != nullptr && consensus->type() == ConsensusType::BFT;
       const bool is_local = endpoint != nullptr &&
@@ -617,6 +962,22 @@ namespace ccf
       auto tx = tables.create_tx();
 
       const auto endpoint = endpoints.find_endpoint(tx, *ctx);
+      if (is_batch(*ctx, endpoint))
+      {
+        auto rep = process_batch(ctx);
+        if (!rep.has_value())
+        {
+          // Batches on forwarded sessions are redirected rather than
+          // forwarded again, so this should never happen
+          ctx->set_error(
+            HTTP_STATUS_INTERNAL_SERVER_ERROR,
+            ccf::errors::InternalError,
+            "Forwarded batch could not be processed.");
+          return ctx->serialise_response();
+        }
+        return rep.value();
+      }
+
       if (
         consensus->type() == ConsensusType::CFT ||
         (endpoint != nullptr &&
@@ -1204,6 +1204,9 @@ namespace ccf
       share_manager(share_manager),
       tsr(network)
     {
+      // Governance must remain possible while the node is overloaded
+      default_admission_priority = ccf::endpoints::AdmissionPriority::Critical;
+
       openapi_info.title = "CCF Governance API";
       openapi_info.description =
         "This API is used to submit and query proposals which affect CCF's "
@@ -2,11 +2,13 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 #include "ds/json_schema.h"
+#include "ds/ring_buffer_types.h"
 #include "node/config.h"
 #include "node/identity.h"
 #include "node/ledger_secrets.h"
 #include "node/members.h"
 #include "node/node_info_network.h"
+#include "node/rpc/admission_control.h"
 
 #include <nlohmann/json.hpp>
 #include <openenclave/advanced/mallinfo.h>
@@ -119,4 +121,38 @@ namespace ccf
       size_t peak_allocated_heap_size = 0;
     };
   };
-}
\ No newline at end of file
+
+  struct GetQueues
+  {
+    using In = void;
+
+    struct Out
+    {
+      // Ringbuffers between the enclave and the host, by direction. The time
+      // writers spend blocked (blocked_ns) is only measured outside SGX
+      // enclaves, which cannot read the time: in SGX builds, writes from the
+      // enclave to the host are counted in blocked_writes, but add no time.
+      std::map<std::string, ringbuffer::BufferStats> ringbuffers;
+
+      // Tasks queued for each enclave thread, the main thread first
+      std::vector<size_t> thread_queue_depths;
+
+      // Requests admitted and shed by the RPC interfaces
+      AdmissionController::Stats admission;
+    };
+  };
+
+  struct GetTlsSessions
+  {
+    using In = void;
+
+    struct Out
+    {
+      // TLS handshakes completed by clients of the node's RPC interfaces, and
+      // how many of those resumed a session from a session ticket
+      size_t handshakes = 0;
+      size_t resumed_handshakes = 0;
+      double resumption_rate = 0.0;
+    };
+  };
+}
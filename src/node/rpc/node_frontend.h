@@ -169,6 +169,10 @@ namespace ccf
       CommonEndpointRegistry(get_actor_prefix(ActorsType::nodes), node_state),
       network(network)
     {
+      // Joining nodes and operators must be served while the node is
+      // overloaded
+      default_admission_priority = ccf::endpoints::AdmissionPriority::Critical;
+
       openapi_info.title = "CCF Public Node API";
       openapi_info.description =
         "This API provides public, uncredentialed access to service and node "
@@ -665,6 +669,33 @@ namespace ccf
         .set_forwarding_required(ForwardingRequired::Never)
         .set_auto_schema<MemoryUsage>()
         .install();
+
+      auto queues = [this](CommandEndpointContext& args) {
+        const auto stats = this->node.get_queue_stats();
+        args.rpc_ctx->set_response_status(HTTP_STATUS_OK);
+        args.rpc_ctx->set_response_header(
+          http::headers::CONTENT_TYPE, http::headervalues::contenttype::JSON);
+        args.rpc_ctx->set_response_body(nlohmann::json(stats).dump());
+      };
+
+      make_command_endpoint("queues", HTTP_GET, queues, no_auth_required)
+        .set_forwarding_required(ForwardingRequired::Never)
+        .set_auto_schema<GetQueues>()
+        .install();
+
+      auto tls_sessions = [this](CommandEndpointContext& args) {
+        const auto stats = this->node.get_tls_session_stats();
+        args.rpc_ctx->set_response_status(HTTP_STATUS_OK);
+        args.rpc_ctx->set_response_header(
+          http::headers::CONTENT_TYPE, http::headervalues::contenttype::JSON);
+        args.rpc_ctx->set_response_body(nlohmann::json(stats).dump());
+      };
+
+      make_command_endpoint(
+        "tls_sessions", HTTP_GET, tls_sessions, no_auth_required)
+        .set_forwarding_required(ForwardingRequired::Never)
+        .set_auto_schema<GetTlsSessions>()
+        .install();
     }
   };
 
@@ -36,6 +36,8 @@ namespace ccf
     virtual kv::Version get_last_recovered_signed_idx() = 0;
     virtual void initiate_private_recovery(kv::Tx& tx) = 0;
     virtual ExtendedState state() = 0;
+    virtual GetQueues::Out get_queue_stats() = 0;
+    virtual GetTlsSessions::Out get_tls_session_stats() = 0;
     virtual void open_user_frontend() = 0;
     virtual QuoteVerificationResult verify_quote(
       kv::ReadOnlyTx& tx,
@@ -68,6 +68,12 @@ namespace ccf
   DECLARE_JSON_TYPE(GetTxStatus::Out)
   DECLARE_JSON_REQUIRED_FIELDS(GetTxStatus::Out, status)
 
+  DECLARE_JSON_TYPE_WITH_OPTIONAL_FIELDS(SubscribeCommit::In)
+  DECLARE_JSON_REQUIRED_FIELDS(SubscribeCommit::In)
+  DECLARE_JSON_OPTIONAL_FIELDS(SubscribeCommit::In, watermark, txs)
+  DECLARE_JSON_TYPE(SubscribeCommit::Out)
+  DECLARE_JSON_REQUIRED_FIELDS(SubscribeCommit::Out, pending)
+
   DECLARE_JSON_TYPE(GetNetworkInfo::Out)
   DECLARE_JSON_REQUIRED_FIELDS(
     GetNetworkInfo::Out,
@@ -108,10 +114,29 @@ namespace ccf
 
   DECLARE_JSON_TYPE(EndpointMetrics::Entry)
   DECLARE_JSON_REQUIRED_FIELDS(
-    EndpointMetrics::Entry, path, method, calls, errors, failures, retries)
+    EndpointMetrics::Entry,
+    path,
+    method,
+    calls,
+    errors,
+    failures,
+    retries,
+    shed)
   DECLARE_JSON_TYPE(EndpointMetrics::Out)
   DECLARE_JSON_REQUIRED_FIELDS(EndpointMetrics::Out, metrics)
 
+  DECLARE_JSON_TYPE_WITH_OPTIONAL_FIELDS(Batch::Request)
+  DECLARE_JSON_REQUIRED_FIELDS(Batch::Request, path)
+  DECLARE_JSON_OPTIONAL_FIELDS(
+    Batch::Request, verb, headers, body, body_base64)
+  DECLARE_JSON_TYPE(Batch::In)
+  DECLARE_JSON_REQUIRED_FIELDS(Batch::In, requests)
+  DECLARE_JSON_TYPE_WITH_OPTIONAL_FIELDS(Batch::Response)
+  DECLARE_JSON_REQUIRED_FIELDS(Batch::Response, status, headers)
+  DECLARE_JSON_OPTIONAL_FIELDS(Batch::Response, body, body_base64)
+  DECLARE_JSON_TYPE(Batch::Out)
+  DECLARE_JSON_REQUIRED_FIELDS(Batch::Out, responses)
+
   DECLARE_JSON_TYPE(GetReceipt::In)
   DECLARE_JSON_REQUIRED_FIELDS(GetReceipt::In, commit)
   DECLARE_JSON_TYPE(GetReceipt::Out)
@@ -141,4 +166,12 @@ namespace ccf
     max_total_heap_size,
     current_allocated_heap_size,
     peak_allocated_heap_size)
+
+  DECLARE_JSON_TYPE(GetQueues::Out)
+  DECLARE_JSON_REQUIRED_FIELDS(
+    GetQueues::Out, ringbuffers, thread_queue_depths, admission)
+
+  DECLARE_JSON_TYPE(GetTlsSessions::Out)
+  DECLARE_JSON_REQUIRED_FIELDS(
+    GetTlsSessions::Out, handshakes, resumed_handshakes, resumption_rate)
 }
\ No newline at end of file
@@ -0,0 +1,99 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "node/rpc/admission_control.h"
+
+#include <deque>
+#include <iostream>
+#include <picobench/picobench.hpp>
+#include <random>
+
+// Simulates a node offered twice the requests it can execute, for
+// s.iterations() ticks. Each tick, the node executes capacity requests from
+// its queue, and the admission controller (if any) is updated with the
+// queue depth. Requests which complete after the client has given up on them
+// are not counted towards goodput. Reports goodput and the p99 latency of
+// completed requests, in ticks.
+
+using Priority = ccf::endpoints::AdmissionPriority;
+
+static constexpr size_t capacity = 100;
+static constexpr size_t offered = 2 * capacity;
+static constexpr size_t client_timeout = 50;
+
+struct Request
+{
+  size_t arrival;
+  Priority priority;
+};
+
+template <bool with_admission>
+static void overload(picobench::state& s)
+{
+  ccf::AdmissionController::Config config;
+  config.max_queue_depth = 2 * capacity;
+  config.max_commit_lag = 0;
+  ccf::AdmissionController admission(config);
+
+  std::mt19937 rng(42);
+  std::deque<Request> queue;
+  std::vector<size_t> latencies;
+  size_t good = 0;
+  size_t shed = 0;
+
+  s.start_timer();
+  for (size_t tick = 0; tick < (size_t)s.iterations(); ++tick)
+  {
+    for (size_t i = 0; i < offered; ++i)
+    {
+      const auto priority = rng() % 5 == 0 ? Priority::Low : Priority::Normal;
+      if (!with_admission || admission.admit(priority))
+      {
+        queue.push_back({tick, priority});
+      }
+      else
+      {
+        ++shed;
+      }
+    }
+
+    for (size_t i = 0; i < capacity && !queue.empty(); ++i)
+    {
+      const auto latency = tick - queue.front().arrival;
+      queue.pop_front();
+      latencies.push_back(latency);
+      if (latency <= client_timeout)
+      {
+        ++good;
+      }
+    }
+
+    if (with_admission)
+    {
+      admission.update(queue.size(), 0);
+    }
+  }
+  s.stop_timer();
+
+  std::sort(latencies.begin(), latencies.end());
+  const auto p99 =
+    latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+
+  std::cout << fmt::format(
+                 "{} ticks {} admission control: goodput {:.1f}% of "
+                 "capacity, p99 latency {} ticks, {} shed",
+                 s.iterations(),
+                 with_admission ? "with" : "without",
+                 100.0 * good / (capacity * s.iterations()),
+                 p99,
+                 shed)
+            << std::endl;
+}
+
+const std::vector<int> tick_counts = {1000, 10000};
+
+PICOBENCH_SUITE("overload_2x");
+auto unbounded = overload<false>;
+PICOBENCH(unbounded).iterations(tick_counts).samples(1).baseline();
+auto admission = overload<true>;
+PICOBENCH(admission).iterations(tick_counts).samples(1);
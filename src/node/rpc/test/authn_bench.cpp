@@ -0,0 +1,166 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "kv/test/null_encryptor.h"
+#include "kv/test/stub_consensus.h"
+#include "node/genesis_gen.h"
+#include "node/network_state.h"
+#include "node/rpc/frontend.h"
+#include "tls/base64.h"
+
+#include <picobench/picobench.hpp>
+
+// Processes s.iterations() requests on a single session, each to a command
+// endpoint which does nothing, authenticated by one of the policies. The
+// difference from the no_auth baseline is the authentication overhead of
+// each request.
+
+threading::ThreadMessaging threading::ThreadMessaging::thread_messaging;
+std::atomic<uint16_t> threading::ThreadMessaging::thread_count = 0;
+
+using namespace ccf;
+
+class AuthnFrontend : public RpcFrontend
+{
+  EndpointRegistry endpoints;
+
+public:
+  AuthnFrontend(kv::Store& tables) :
+    RpcFrontend(tables, endpoints),
+    endpoints("bench")
+  {
+    open();
+
+    auto empty = [](auto& args) {
+      args.rpc_ctx->set_response_status(HTTP_STATUS_OK);
+    };
+    endpoints
+      .make_command_endpoint("no_auth", HTTP_POST, empty, no_auth_required)
+      .install();
+    endpoints
+      .make_command_endpoint("cert", HTTP_POST, empty, {user_cert_auth_policy})
+      .install();
+    endpoints
+      .make_command_endpoint(
+        "signature", HTTP_POST, empty, {user_signature_auth_policy})
+      .install();
+    endpoints.make_command_endpoint("jwt", HTTP_POST, empty, {jwt_auth_policy})
+      .install();
+  }
+};
+
+static auto encryptor = std::make_shared<kv::NullTxEncryptor>();
+static auto user_kp = tls::make_key_pair();
+static auto user_cert = user_kp->self_sign("CN=user");
+static auto user_cert_der = tls::make_verifier(user_cert)->cert_der();
+
+static constexpr auto jwt_key_id = "bench_key";
+
+static const std::string no_auth_path = "no_auth";
+static const std::string cert_path = "cert";
+static const std::string signature_path = "signature";
+static const std::string jwt_path = "jwt";
+
+static void create_service(NetworkState& network)
+{
+  network.tables->set_consensus(std::make_shared<kv::PrimaryStubConsensus>());
+  network.tables->set_encryptor(encryptor);
+
+  auto tx = network.tables->create_tx();
+  GenesisGenerator g(network, tx);
+  g.init_values();
+  g.create_service({});
+  g.add_user({user_cert});
+
+  // The JWT signing key is the user's
+  tx.rw<JwtPublicSigningKeys>(Tables::JWT_PUBLIC_SIGNING_KEYS)
+    ->put(jwt_key_id, user_cert_der);
+  tx.rw<JwtPublicSigningKeyIssuer>(Tables::JWT_PUBLIC_SIGNING_KEY_ISSUER)
+    ->put(jwt_key_id, "https://issuer.example.com");
+
+  if (g.finalize() != kv::CommitResult::SUCCESS)
+  {
+    throw std::logic_error("Could not create service");
+  }
+}
+
+// Signed with the user's EC key, despite the RS256 header that JwtHeader
+// requires, since signatures are verified with whichever key the signing
+// key certificate holds
+static std::string make_jwt()
+{
+  const auto header =
+    nlohmann::json{{"alg", "RS256"}, {"kid", jwt_key_id}}.dump();
+  const auto payload = nlohmann::json{{"sub", "user"}}.dump();
+  const auto signed_content = fmt::format(
+    "{}.{}",
+    tls::b64_from_raw((const uint8_t*)header.data(), header.size()),
+    tls::b64_from_raw((const uint8_t*)payload.data(), payload.size()));
+  const auto sig = user_kp->sign(signed_content, crypto::MDType::SHA256);
+  return fmt::format("{}.{}", signed_content, tls::b64_from_raw(sig));
+}
+
+static std::vector<uint8_t> make_request(const std::string& path)
+{
+  http::Request request(path);
+  if (path == signature_path)
+  {
+    const auto contents = user_cert.contents();
+    crypto::Sha256Hash hash({contents.data(), contents.size()});
+    http::sign_request(request, user_kp, hash.hex_str());
+  }
+  else if (path == jwt_path)
+  {
+    request.set_header(
+      http::headers::AUTHORIZATION, fmt::format("Bearer {}", make_jwt()));
+  }
+  return request.build_request();
+}
+
+template <const std::string& path, bool session_cache>
+static void authenticate(picobench::state& s)
+{
+  logger::config::level() = logger::INFO;
+
+  NetworkState network;
+  create_service(network);
+  AuthnFrontend frontend(*network.tables);
+
+  auto tables_version = std::make_shared<AuthnTablesVersion>();
+  track_authn_tables(*network.tables, tables_version);
+  frontend.set_authn_tables_version(tables_version);
+
+  auto session = std::make_shared<enclave::SessionContext>(0, user_cert_der);
+  if (session_cache)
+  {
+    session->authn_cache = std::make_shared<AuthnIdentityCache>();
+  }
+
+  const auto request = make_request(path);
+
+  s.start_timer();
+  for (size_t i = 0; i < (size_t)s.iterations(); ++i)
+  {
+    auto ctx = enclave::make_rpc_context(session, request);
+    const auto response = frontend.process(ctx);
+    if (!response.has_value() || ctx->get_response_status() != HTTP_STATUS_OK)
+    {
+      throw std::logic_error(fmt::format("Request to {} failed", path));
+    }
+  }
+  s.stop_timer();
+}
+
+const std::vector<int> request_counts = {1000, 10000};
+
+PICOBENCH_SUITE("authn");
+auto none = authenticate<no_auth_path, false>;
+PICOBENCH(none).iterations(request_counts).baseline();
+auto cert_uncached = authenticate<cert_path, false>;
+PICOBENCH(cert_uncached).iterations(request_counts);
+auto cert_cached = authenticate<cert_path, true>;
+PICOBENCH(cert_cached).iterations(request_counts);
+auto signature = authenticate<signature_path, false>;
+PICOBENCH(signature).iterations(request_counts);
+auto jwt = authenticate<jwt_path, false>;
+PICOBENCH(jwt).iterations(request_counts);
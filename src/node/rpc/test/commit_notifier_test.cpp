@@ -0,0 +1,161 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+
+#include "node/rpc/commit_notifier.h"
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+using namespace ccf;
+
+// Seqnos up to 10 were in view 2, and later seqnos are in view 3
+static int64_t get_view(int64_t seqno)
+{
+  return seqno <= 10 ? 2 : 3;
+}
+
+TEST_CASE("Transactions are notified once final")
+{
+  CommitNotifier notifier;
+  constexpr size_t session = 1;
+
+  REQUIRE(notifier.subscribe(session, false, {{3, 12}, {3, 14}, {2, 5}}));
+  CHECK(notifier.pending_txs(session) == 3);
+
+  INFO("Transactions up to the watermark are notified in seqno order");
+  auto notifications = notifier.update(3, 12, get_view);
+  REQUIRE(notifications.size() == 1);
+  {
+    const auto& [id, n] = notifications[0];
+    CHECK(id == session);
+    CHECK(n.view == 3);
+    CHECK(n.seqno == 12);
+    REQUIRE(n.txs.size() == 2);
+    CHECK(n.txs[0].seqno == 5);
+    CHECK(n.txs[0].status == TxStatus::Committed);
+    CHECK(n.txs[1].seqno == 12);
+    CHECK(n.txs[1].status == TxStatus::Committed);
+  }
+  CHECK(notifier.pending_txs(session) == 1);
+
+  INFO("Nothing is notified until the watermark passes the next");
+  CHECK(notifier.update(3, 13, get_view).empty());
+
+  notifications = notifier.update(3, 20, get_view);
+  REQUIRE(notifications.size() == 1);
+  REQUIRE(notifications[0].second.txs.size() == 1);
+  CHECK(notifications[0].second.txs[0].seqno == 14);
+
+  INFO("Sessions with nothing pending are unsubscribed");
+  CHECK(notifier.pending_txs(session) == 0);
+  CHECK(notifier.update(3, 21, get_view).empty());
+}
+
+TEST_CASE("Transactions from a rolled back view are invalid")
+{
+  CommitNotifier notifier;
+  constexpr size_t session = 1;
+
+  notifier.update(2, 8, get_view);
+
+  // 2.12 was never committed, and 12 is now in view 3
+  REQUIRE(notifier.subscribe(session, false, {{2, 9}, {2, 12}, {3, 15}}));
+
+  INFO("Once the view changes, invalid transactions are notified early");
+  auto notifications = notifier.update(3, 11, get_view);
+  REQUIRE(notifications.size() == 1);
+  const auto& txs = notifications[0].second.txs;
+  REQUIRE(txs.size() == 2);
+  CHECK(txs[0].seqno == 9);
+  CHECK(txs[0].status == TxStatus::Committed);
+  CHECK(txs[1].seqno == 12);
+  CHECK(txs[1].status == TxStatus::Invalid);
+  CHECK(notifier.pending_txs(session) == 1);
+}
+
+TEST_CASE("Watermark subscriptions")
+{
+  CommitNotifier notifier;
+  constexpr size_t watcher = 1;
+  constexpr size_t waiter = 2;
+
+  notifier.update(3, 11, get_view);
+  REQUIRE(notifier.subscribe(watcher, true, {}));
+  REQUIRE(notifier.subscribe(waiter, false, {{3, 13}}));
+
+  INFO("New watermark subscribers are sent the current watermark");
+  auto notifications = notifier.update(3, 11, get_view);
+  REQUIRE(notifications.size() == 1);
+  CHECK(notifications[0].first == watcher);
+  CHECK(notifications[0].second.seqno == 11);
+  CHECK(notifications[0].second.txs.empty());
+
+  INFO("Then only when it advances");
+  CHECK(notifier.update(3, 11, get_view).empty());
+
+  notifications = notifier.update(3, 12, get_view);
+  REQUIRE(notifications.size() == 1);
+  CHECK(notifications[0].first == watcher);
+
+  INFO("Each session is sent at most one notification per update");
+  REQUIRE(notifier.subscribe(watcher, false, {{3, 13}, {3, 14}}));
+  notifications = notifier.update(3, 14, get_view);
+  REQUIRE(notifications.size() == 2);
+  for (const auto& [id, n] : notifications)
+  {
+    CHECK(n.seqno == 14);
+    CHECK(n.txs.size() == (id == watcher ? 2 : 1));
+  }
+
+  INFO("Unsubscribed sessions are not notified");
+  notifier.unsubscribe(watcher);
+  CHECK(notifier.update(3, 15, get_view).empty());
+}
+
+TEST_CASE("Sessions that subscribe once closed are dropped")
+{
+  CommitNotifier notifier;
+  constexpr size_t open = 1;
+  constexpr size_t closed = 2;
+
+  // The subscription of the closed session arrives after it was unsubscribed
+  // on close
+  notifier.unsubscribe(closed);
+  REQUIRE(notifier.subscribe(closed, true, {{3, 20}}));
+  REQUIRE(notifier.subscribe(open, true, {}));
+
+  std::vector<size_t> delivered;
+  const auto deliver = [&](size_t id, const CommitNotification&) {
+    delivered.push_back(id);
+    return id != closed;
+  };
+
+  notifier.notify(3, 11, get_view, deliver);
+  CHECK(delivered.size() == 2);
+  CHECK(notifier.pending_txs(closed) == 0);
+
+  INFO("Once delivery fails, the session is no longer notified");
+  delivered.clear();
+  notifier.notify(3, 12, get_view, deliver);
+  REQUIRE(delivered.size() == 1);
+  CHECK(delivered[0] == open);
+}
+
+TEST_CASE("Pending transactions are bounded per session")
+{
+  CommitNotifier notifier;
+  constexpr size_t session = 1;
+
+  std::vector<CommitNotifier::TxID> txs;
+  for (size_t i = 0; i < CommitNotifier::max_pending_txs; ++i)
+  {
+    txs.emplace_back(3, 100 + i);
+  }
+  REQUIRE(notifier.subscribe(session, false, txs));
+  CHECK_FALSE(notifier.subscribe(session, false, {{3, 99}}));
+  CHECK(notifier.pending_txs(session) == CommitNotifier::max_pending_txs);
+
+  txs.emplace_back(3, 99);
+  CHECK_FALSE(notifier.subscribe(session + 1, false, txs));
+  CHECK(notifier.pending_txs(session + 1) == 0);
+}
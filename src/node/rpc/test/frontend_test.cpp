@@ -229,6 +229,123 @@ public:
   }
 };
 
+class TestStreamedResponses : public BaseTestFrontend
+{
+public:
+  static constexpr size_t chunk_count = 10;
+
+  static std::string chunk(size_t i)
+  {
+    return fmt::format("Chunk {}\n", i);
+  }
+
+  TestStreamedResponses(kv::Store& tables) : BaseTestFrontend(tables)
+  {
+    open();
+
+    auto stream = [this](auto& args) {
+      args.rpc_ctx->set_response_status(HTTP_STATUS_OK);
+      args.rpc_ctx->set_response_body_stream(
+        [i = size_t(0)]() mutable -> std::optional<std::vector<uint8_t>> {
+          if (i == chunk_count)
+          {
+            return std::nullopt;
+          }
+          const auto s = chunk(i++);
+          return std::vector<uint8_t>(s.begin(), s.end());
+        });
+    };
+    make_endpoint("stream", HTTP_GET, stream).install();
+
+    auto stream_then_fail = [this](auto& args) {
+      args.rpc_ctx->set_response_body_stream(
+        []() -> std::optional<std::vector<uint8_t>> {
+          throw std::logic_error("Stream should not be read");
+        });
+      args.rpc_ctx->set_error(
+        HTTP_STATUS_BAD_REQUEST, ccf::errors::InvalidInput, "Failed");
+    };
+    make_endpoint("stream_then_fail", HTTP_GET, stream_then_fail).install();
+  }
+};
+
+class TestPrioritisedFrontend : public BaseTestFrontend
+{
+public:
+  TestPrioritisedFrontend(kv::Store& tables) : BaseTestFrontend(tables)
+  {
+    open();
+
+    auto ok = [this](auto& args) {
+      args.rpc_ctx->set_response_status(HTTP_STATUS_OK);
+    };
+    make_endpoint("normal", HTTP_POST, ok).install();
+    make_endpoint("low", HTTP_POST, ok)
+      .set_admission_priority(ccf::endpoints::AdmissionPriority::Low)
+      .install();
+    make_endpoint("critical", HTTP_POST, ok)
+      .set_admission_priority(ccf::endpoints::AdmissionPriority::Critical)
+      .install();
+  }
+
+  size_t get_shed(const std::string& path)
+  {
+    EndpointMetrics::Out out;
+    endpoints.endpoint_metrics(out);
+    for (const auto& entry : out.metrics)
+    {
+      if (entry.path == path)
+      {
+        return entry.shed;
+      }
+    }
+    return 0;
+  }
+};
+
+class TestBatchFrontend : public BaseTestFrontend
+{
+public:
+  kv::Map<size_t, size_t> values;
+
+  TestBatchFrontend(kv::Store& tables) :
+    BaseTestFrontend(tables),
+    values("test_values")
+  {
+    open();
+
+    auto put = [this](kv::Tx& tx, nlohmann::json&& params) {
+      tx.rw(values)->put(params["key"], params["value"]);
+      return make_success(true);
+    };
+    make_endpoint("put", HTTP_POST, json_adapter(put)).install();
+
+    auto fail = [this](kv::Tx& tx, nlohmann::json&& params) {
+      return make_error(HTTP_STATUS_BAD_REQUEST, "Error", "Failed");
+    };
+    make_endpoint("fail", HTTP_POST, json_adapter(fail)).install();
+  }
+};
+
+class TestCachedCallerFrontend : public BaseTestFrontend
+{
+public:
+  std::shared_ptr<AuthnIdentity> last_caller = nullptr;
+
+  TestCachedCallerFrontend(kv::Store& tables) : BaseTestFrontend(tables)
+  {
+    open();
+
+    auto record_caller = [this](auto& args) {
+      last_caller = args.caller;
+      args.rpc_ctx->set_response_status(HTTP_STATUS_OK);
+    };
+    make_endpoint(
+      "record_caller", HTTP_POST, record_caller, {user_cert_auth_policy})
+      .install();
+  }
+};
+
 class TestMemberFrontend : public MemberRpcFrontend
 {
 public:
@@ -715,6 +832,56 @@ TEST_CASE("process with caller")
   }
 }
 
+TEST_CASE("Cached caller identity")
+{
+  NetworkState network;
+  prepare_callers(network);
+  TestCachedCallerFrontend frontend(*network.tables);
+
+  auto tables_version = std::make_shared<AuthnTablesVersion>();
+  track_authn_tables(*network.tables, tables_version);
+  frontend.set_authn_tables_version(tables_version);
+
+  auto session = std::make_shared<enclave::SessionContext>(
+    enclave::InvalidSessionId, user_caller_der);
+  session->authn_cache = std::make_shared<AuthnIdentityCache>();
+
+  const auto serialized_call =
+    create_simple_request("record_caller").build_request();
+  auto call = [&](const std::shared_ptr<enclave::SessionContext>& s) {
+    auto ctx = enclave::make_rpc_context(s, serialized_call);
+    return parse_response(frontend.process(ctx).value()).status;
+  };
+
+  INFO("The caller is resolved once per session");
+  REQUIRE(call(session) == HTTP_STATUS_OK);
+  const auto caller = frontend.last_caller;
+  REQUIRE(caller != nullptr);
+  REQUIRE(call(session) == HTTP_STATUS_OK);
+  CHECK(frontend.last_caller == caller);
+
+  INFO("Sessions without a cache resolve the caller for each request");
+  REQUIRE(call(user_session) == HTTP_STATUS_OK);
+  CHECK(frontend.last_caller != caller);
+
+  INFO("A new term discards cached callers");
+  network.tables->set_term(network.tables->current_txid().term + 1);
+  REQUIRE(call(session) == HTTP_STATUS_OK);
+  CHECK(frontend.last_caller != caller);
+  const auto new_term_caller = frontend.last_caller;
+  REQUIRE(call(session) == HTTP_STATUS_OK);
+  CHECK(frontend.last_caller == new_term_caller);
+
+  INFO("Changes to the users table discard cached callers");
+  {
+    auto tx = network.tables->create_tx();
+    GenesisGenerator g(network, tx);
+    REQUIRE(g.remove_user(user_id));
+    REQUIRE(tx.commit() == kv::CommitResult::SUCCESS);
+  }
+  CHECK(call(session) == HTTP_STATUS_UNAUTHORIZED);
+}
+
 TEST_CASE("No certs table")
 {
   NetworkState network;
@@ -1120,6 +1287,271 @@ TEST_CASE("Templated paths")
   }
 }
 
+TEST_CASE("Streamed responses")
+{
+  NetworkState network;
+  prepare_callers(network);
+  TestStreamedResponses frontend(*network.tables);
+
+  std::string expected_body;
+  for (size_t i = 0; i < TestStreamedResponses::chunk_count; ++i)
+  {
+    expected_body += TestStreamedResponses::chunk(i);
+  }
+
+  const auto serialized_request =
+    http::Request("stream", HTTP_GET).build_request();
+
+  {
+    INFO("Without streaming, the whole body is read from the stream at once");
+    auto rpc_ctx = enclave::make_rpc_context(user_session, serialized_request);
+    auto response = parse_response(frontend.process(rpc_ctx).value());
+    CHECK(response.status == HTTP_STATUS_OK);
+    CHECK(std::string(response.body.begin(), response.body.end()) ==
+          expected_body);
+    CHECK(rpc_ctx->take_response_body_stream() == nullptr);
+  }
+
+  {
+    INFO("With streaming, the body follows the head in chunks");
+    auto rpc_ctx = enclave::make_rpc_context(user_session, serialized_request);
+    std::dynamic_pointer_cast<http::HttpRpcContext>(rpc_ctx)
+      ->enable_response_streaming();
+
+    auto response = frontend.process(rpc_ctx).value();
+    auto stream = rpc_ctx->take_response_body_stream();
+    REQUIRE(stream != nullptr);
+
+    {
+      http::SimpleResponseProcessor processor;
+      http::ResponseParser parser(processor);
+      parser.execute(response.data(), response.size());
+      CHECK(processor.received.empty());
+    }
+
+    size_t chunks = 0;
+    for (auto chunk = stream(); chunk.has_value(); chunk = stream())
+    {
+      const auto header = http::build_chunk_header(chunk->size());
+      response.insert(response.end(), header.begin(), header.end());
+      response.insert(response.end(), chunk->begin(), chunk->end());
+      response.insert(
+        response.end(), http::chunk_trailer.begin(), http::chunk_trailer.end());
+      ++chunks;
+    }
+    CHECK(chunks == TestStreamedResponses::chunk_count);
+    response.insert(
+      response.end(), http::last_chunk.begin(), http::last_chunk.end());
+
+    const auto parsed = parse_response(response);
+    CHECK(parsed.status == HTTP_STATUS_OK);
+    CHECK(
+      parsed.headers.at(http::headers::TRANSFER_ENCODING) ==
+      http::headervalues::transferencoding::CHUNKED);
+    CHECK(parsed.headers.find(http::headers::CONTENT_LENGTH) ==
+          parsed.headers.end());
+    CHECK(std::string(parsed.body.begin(), parsed.body.end()) == expected_body);
+  }
+
+  {
+    INFO("A body set after the stream replaces it");
+    auto rpc_ctx = enclave::make_rpc_context(
+      user_session,
+      http::Request("stream_then_fail", HTTP_GET).build_request());
+    std::dynamic_pointer_cast<http::HttpRpcContext>(rpc_ctx)
+      ->enable_response_streaming();
+
+    auto response = parse_response(frontend.process(rpc_ctx).value());
+    CHECK(response.status == HTTP_STATUS_BAD_REQUEST);
+    CHECK(rpc_ctx->take_response_body_stream() == nullptr);
+  }
+}
+
+TEST_CASE("Admission control")
+{
+  NetworkState network;
+  prepare_callers(network);
+  TestPrioritisedFrontend frontend(*network.tables);
+
+  ccf::AdmissionController::Config config;
+  config.max_queue_depth = 10;
+  config.max_commit_lag = 100;
+  config.retry_after = std::chrono::seconds(5);
+  auto admission = std::make_shared<ccf::AdmissionController>(config);
+  frontend.set_admission_controller(admission);
+
+  // Returns the number of requests to path, out of count, that are admitted
+  auto send = [&](const std::string& path, llhttp_method verb, size_t count) {
+    const auto request = http::Request(path, verb).build_request();
+    size_t admitted = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      auto rpc_ctx = enclave::make_rpc_context(user_session, request);
+      auto response = parse_response(frontend.process(rpc_ctx).value());
+      if (response.status == HTTP_STATUS_OK)
+      {
+        ++admitted;
+      }
+      else
+      {
+        REQUIRE(response.status == HTTP_STATUS_SERVICE_UNAVAILABLE);
+        CHECK(response.headers.at(http::headers::RETRY_AFTER) == "5");
+        const auto body = nlohmann::json::parse(response.body);
+        CHECK(body["error"]["code"] == ccf::errors::ServiceOverloaded);
+      }
+    }
+    return admitted;
+  };
+
+  {
+    INFO("Below the limits, all requests are admitted");
+    admission->update(10, 100);
+    CHECK(send("low", HTTP_POST, 100) == 100);
+    CHECK(send("normal", HTTP_POST, 100) == 100);
+  }
+
+  {
+    INFO("Low priority requests are shed first");
+    admission->update(11, 0);
+    const auto stats = admission->get_stats();
+    CHECK(stats.load > 1.0);
+    CHECK(stats.low_admitted == doctest::Approx(0.75).epsilon(0.01));
+    CHECK(stats.normal_admitted == 1.0);
+
+    CHECK(send("low", HTTP_POST, 100) == 75);
+    CHECK(send("normal", HTTP_POST, 100) == 100);
+    CHECK(frontend.get_shed("low") == 25);
+    CHECK(frontend.get_shed("normal") == 0);
+  }
+
+  {
+    INFO("Commit lag also counts towards the load");
+    for (size_t i = 0; i < 50; ++i)
+    {
+      admission->update(0, 1000);
+    }
+    const auto stats = admission->get_stats();
+    CHECK(stats.low_admitted == doctest::Approx(0.01).epsilon(0.01));
+    CHECK(stats.normal_admitted == doctest::Approx(0.01).epsilon(0.01));
+
+    CHECK(send("normal", HTTP_POST, 1000) < 20);
+    CHECK(send("low", HTTP_POST, 1000) < 20);
+    CHECK(admission->get_stats().normal_shed > 980);
+  }
+
+  {
+    INFO("Critical requests, and /commit, are always admitted");
+    CHECK(send("critical", HTTP_POST, 100) == 100);
+    CHECK(send("commit", HTTP_GET, 100) == 100);
+    CHECK(frontend.get_shed("critical") == 0);
+  }
+
+  {
+    INFO("Once the load drops, requests are admitted again");
+    for (size_t i = 0; i < 50; ++i)
+    {
+      admission->update(0, 0);
+    }
+    const auto stats = admission->get_stats();
+    CHECK(stats.load == 0.0);
+    CHECK(stats.normal_admitted == 1.0);
+    CHECK(stats.low_admitted == 1.0);
+    CHECK(send("low", HTTP_POST, 100) == 100);
+    CHECK(send("normal", HTTP_POST, 100) == 100);
+  }
+}
+
+TEST_CASE("Batch requests")
+{
+  NetworkState network;
+  prepare_callers(network);
+  TestBatchFrontend frontend(*network.tables);
+
+  auto send_batch = [&](const nlohmann::json& batch) {
+    http::Request request("batch", HTTP_POST);
+    const auto body = batch.dump();
+    request.set_header(
+      http::headers::CONTENT_TYPE, http::headervalues::contenttype::JSON);
+    request.set_body((const uint8_t*)body.data(), body.size());
+    auto rpc_ctx =
+      enclave::make_rpc_context(user_session, request.build_request());
+    return parse_response(frontend.process(rpc_ctx).value());
+  };
+
+  auto get_seqno = [](const Batch::Response& r) {
+    return std::stoll(r.headers.at(http::headers::CCF_TX_SEQNO));
+  };
+
+  {
+    INFO("Each request is executed in its own transaction");
+    const auto packed =
+      serdes::pack({{"key", 2}, {"value", 20}}, serdes::Pack::MsgPack);
+    nlohmann::json batch;
+    batch["requests"] = {
+      {{"path", "/put"}, {"body", {{"key", 1}, {"value", 10}}}},
+      {{"path", "/put"},
+       {"headers",
+        {{"Content-Type", http::headervalues::contenttype::MSGPACK}}},
+       {"body_base64", tls::b64_from_raw(packed)}},
+      {{"path", "/fail"}},
+      {{"path", "/unknown"}},
+      {{"verb", "GET"}, {"path", "/put"}}};
+
+    auto response = send_batch(batch);
+    CHECK(response.status == HTTP_STATUS_MULTI_STATUS);
+
+    const auto out = nlohmann::json::parse(response.body).get<Batch::Out>();
+    REQUIRE(out.responses.size() == 5);
+    CHECK(out.responses[0].status == HTTP_STATUS_OK);
+    CHECK(out.responses[0].body == true);
+    CHECK(out.responses[1].status == HTTP_STATUS_OK);
+    CHECK(!out.responses[1].body_base64.empty());
+    CHECK(out.responses[2].status == HTTP_STATUS_BAD_REQUEST);
+    CHECK(out.responses[2].body["error"]["message"] == "Failed");
+    CHECK(out.responses[3].status == HTTP_STATUS_NOT_FOUND);
+    CHECK(out.responses[4].status == HTTP_STATUS_METHOD_NOT_ALLOWED);
+
+    INFO("The batch's transaction ID is that of its last transaction");
+    CHECK(get_seqno(out.responses[0]) < get_seqno(out.responses[1]));
+    CHECK(
+      response.headers[http::headers::CCF_TX_SEQNO] ==
+      out.responses[1].headers.at(http::headers::CCF_TX_SEQNO));
+
+    auto tx = network.tables->create_tx();
+    auto values = tx.ro(frontend.values);
+    CHECK(values->get(1).value() == 10);
+    CHECK(values->get(2).value() == 20);
+  }
+
+  {
+    INFO("Batches cannot be nested");
+    nlohmann::json batch;
+    batch["requests"] = {
+      {{"path", "/batch"}, {"body", {{"requests", nlohmann::json::array()}}}}};
+
+    auto response = send_batch(batch);
+    CHECK(response.status == HTTP_STATUS_MULTI_STATUS);
+    const auto out = nlohmann::json::parse(response.body).get<Batch::Out>();
+    REQUIRE(out.responses.size() == 1);
+    CHECK(out.responses[0].status == HTTP_STATUS_NOT_FOUND);
+  }
+
+  {
+    INFO("Invalid and oversized batches are rejected");
+    CHECK(
+      send_batch({{"requests", "not a list"}}).status ==
+      HTTP_STATUS_BAD_REQUEST);
+
+    nlohmann::json batch;
+    batch["requests"] = nlohmann::json::array();
+    for (size_t i = 0; i < 1001; ++i)
+    {
+      batch["requests"].push_back({{"path", "/fail"}});
+    }
+    CHECK(send_batch(batch).status == HTTP_STATUS_BAD_REQUEST);
+  }
+}
+
 TEST_CASE("Signed read requests can be executed on backup")
 {
   NetworkState network;
@@ -78,6 +78,16 @@ namespace ccf
       return {State::partOfNetwork, {}, {}};
     }
 
+    GetQueues::Out get_queue_stats() override
+    {
+      return {};
+    }
+
+    GetTlsSessions::Out get_tls_session_stats() override
+    {
+      return {};
+    }
+
     void open_user_frontend() override{};
 
     QuoteVerificationResult verify_quote(
@@ -64,6 +64,7 @@ namespace client
     size_t latency_rounds = 1;
     size_t generator_seed = 42u;
     size_t transactions_per_s = 0;
+    size_t batch_size = 1;
 
     bool sign = false;
     bool no_create = false;
@@ -73,6 +74,8 @@ namespace client
     bool check_responses = false;
     bool relax_commit_target = false;
     bool websockets = false;
+    bool http2 = false;
+    bool subscribe_commit = false;
     ///@}
 
     PerfOptions(
@@ -153,6 +156,14 @@ namespace client
         ->capture_default_str();
 
       app.add_option("--latency-rounds", latency_rounds)->capture_default_str();
+      app
+        .add_option(
+          "--batch-size",
+          batch_size,
+          "How many transactions to send in each request, to the batch "
+          "endpoint. 1 sends each transaction in a request of its own")
+        ->check(CLI::PositiveNumber)
+        ->capture_default_str();
 
       // Boolean flags
       app.add_flag("--sign", sign, "Send client-signed transactions")
@@ -188,6 +199,20 @@ namespace client
         .add_flag(
           "--use-websockets", websockets, "Use websockets to send transactions")
         ->capture_default_str();
+      app
+        .add_flag(
+          "--use-http2",
+          http2,
+          "Use HTTP/2 to send transactions, with concurrent streams on a "
+          "single connection")
+        ->capture_default_str();
+      app
+        .add_flag(
+          "--subscribe-commit",
+          subscribe_commit,
+          "Wait for global commit by subscribing to notifications on a "
+          "websocket, rather than polling GET /tx")
+        ->capture_default_str();
     }
   };
 
@@ -203,6 +228,12 @@ namespace client
       RpcTlsClient::PreparedRpc rpc;
       std::string method;
       bool expects_commit;
+
+      // Number of transactions sent by this request
+      size_t tx_count = 1;
+
+      // Until it is batched, a transaction to be sent in a batch
+      nlohmann::json batched = nullptr;
     };
 
   private:
@@ -222,7 +253,10 @@ namespace client
         }
       }
 
-      if (response_times.is_timing_active() && reply.status == HTTP_STATUS_OK)
+      if (
+        response_times.is_timing_active() &&
+        (reply.status == HTTP_STATUS_OK ||
+         reply.status == HTTP_STATUS_MULTI_STATUS))
       {
         const auto tx_id = timing::extract_transaction_id(reply);
 
@@ -254,7 +288,13 @@ namespace client
             tx_id->seqno));
         }
 
-        last_response_tx_id = tx_id.value();
+        // Over HTTP/2, responses may arrive out of order
+        if (
+          tx_id->view > last_response_tx_id.view ||
+          tx_id->seqno > last_response_tx_id.seqno)
+        {
+          last_response_tx_id = tx_id.value();
+        }
       }
     }
 
@@ -291,7 +331,7 @@ namespace client
     std::chrono::nanoseconds write_delay_ns = std::chrono::nanoseconds::zero();
 
     std::shared_ptr<RpcTlsClient> create_connection(
-      bool force_unsigned = false, bool upgrade = false)
+      bool force_unsigned = false, bool upgrade = false, bool http2 = false)
     {
       // Create a cert if this is our first rpc_connection
       const bool is_first_time = tls_cert == nullptr;
@@ -335,26 +375,47 @@ namespace client
 
       if (upgrade)
         conn->upgrade_to_ws();
+      else if (http2)
+        conn->use_http2();
 
       return conn;
     }
 
+    PreparedTx prepare_tx(
+      const std::string& method,
+      const CBuffer params,
+      const std::string& content_type,
+      bool expects_commit,
+      const char* auth_token)
+    {
+      if (options.batch_size > 1)
+      {
+        // Sent later, by batch_prepared_transactions()
+        PreparedTx tx{{}, method, expects_commit};
+        tx.batched = rpc_connection->gen_batched_request(
+          method, params, content_type, HTTP_POST, auth_token);
+        return tx;
+      }
+
+      return {rpc_connection->gen_request(
+                method, params, content_type, HTTP_POST, auth_token),
+              method,
+              expects_commit};
+    }
+
     void add_prepared_tx(
       const std::string& method,
       const CBuffer params,
       bool expects_commit,
       const std::optional<size_t>& index)
     {
-      const PreparedTx tx{rpc_connection->gen_request(
-                            method,
-                            params,
-                            http::headervalues::contenttype::JSON,
-                            HTTP_POST,
-                            options.bearer_token.size() == 0 ?
-                              nullptr :
-                              options.bearer_token.c_str()),
-                          method,
-                          expects_commit};
+      const auto tx = prepare_tx(
+        method,
+        params,
+        http::headervalues::contenttype::JSON,
+        expects_commit,
+        options.bearer_token.size() == 0 ? nullptr :
+                                           options.bearer_token.c_str());
 
       append_prepared_tx(tx, index);
     }
@@ -368,18 +429,14 @@ namespace client
     {
       auto body = serdes::pack(params, serdes);
 
-      const PreparedTx tx{rpc_connection->gen_request(
-                            method,
-                            body,
-                            serdes == serdes::Pack::Text ?
-                              http::headervalues::contenttype::JSON :
-                              http::headervalues::contenttype::MSGPACK,
-                            HTTP_POST,
-                            options.bearer_token.size() == 0 ?
-                              nullptr :
-                              options.bearer_token.c_str()),
-                          method,
-                          expects_commit};
+      const auto tx = prepare_tx(
+        method,
+        body,
+        serdes == serdes::Pack::Text ? http::headervalues::contenttype::JSON :
+                                       http::headervalues::contenttype::MSGPACK,
+        expects_commit,
+        options.bearer_token.size() == 0 ? nullptr :
+                                           options.bearer_token.c_str());
 
       append_prepared_tx(tx, index);
     }
@@ -390,11 +447,65 @@ namespace client
       bool expects_commit,
       const std::optional<size_t>& index)
     {
-      const PreparedTx tx{
-        rpc_connection->gen_request(method, params), method, expects_commit};
+      std::vector<uint8_t> body;
+      if (!params.is_null())
+      {
+        body = serdes::pack(params, serdes::Pack::MsgPack);
+      }
+
+      const auto tx = prepare_tx(
+        method,
+        body,
+        http::headervalues::contenttype::MSGPACK,
+        expects_commit,
+        nullptr);
       append_prepared_tx(tx, index);
     }
 
+    // Replaces the prepared transactions with requests to the batch endpoint,
+    // each sending up to batch_size of them
+    void batch_prepared_transactions()
+    {
+      if (options.websockets)
+      {
+        throw std::logic_error(
+          "Transactions cannot be batched over websockets");
+      }
+
+      PreparedTxs batches;
+      for (size_t begin = 0; begin < prepared_txs.size();
+           begin += options.batch_size)
+      {
+        const auto end =
+          std::min(begin + options.batch_size, prepared_txs.size());
+
+        auto requests = nlohmann::json::array();
+        bool expects_commit = false;
+        for (auto i = begin; i < end; ++i)
+        {
+          requests.push_back(std::move(prepared_txs[i].batched));
+          expects_commit |= prepared_txs[i].expects_commit;
+        }
+
+        const auto s = nlohmann::json{{"requests", requests}}.dump();
+        const std::vector<uint8_t> body(s.begin(), s.end());
+        PreparedTx batch{rpc_connection->gen_request(
+                           "batch",
+                           body,
+                           http::headervalues::contenttype::JSON,
+                           HTTP_POST,
+                           options.bearer_token.size() == 0 ?
+                             nullptr :
+                             options.bearer_token.c_str()),
+                         "batch",
+                         expects_commit};
+        batch.tx_count = end - begin;
+        batches.push_back(std::move(batch));
+      }
+
+      prepared_txs = std::move(batches);
+    }
+
     static size_t total_byte_size(const PreparedTxs& txs)
     {
       return std::accumulate(
@@ -403,6 +514,14 @@ namespace client
         });
     }
 
+    static size_t total_tx_count(const PreparedTxs& txs)
+    {
+      return std::accumulate(
+        txs.begin(), txs.end(), 0, [](size_t n, const PreparedTx& tx) {
+          return n + tx.tx_count;
+        });
+    }
+
     // Everything else has empty stubs and can optionally be overridden. This
     // must be provided by derived class
     virtual void prepare_transactions() = 0;
@@ -414,6 +533,20 @@ namespace client
 
     virtual bool check_response(const RpcTlsClient::Response& r)
     {
+      // Batches are accepted if each of their responses would be
+      if (r.status == HTTP_STATUS_MULTI_STATUS)
+      {
+        const auto body = nlohmann::json::parse(r.body);
+        for (const auto& response : body["responses"])
+        {
+          if (response["status"].get<int>() != HTTP_STATUS_OK)
+          {
+            return false;
+          }
+        }
+        return true;
+      }
+
       // Default behaviour is to accept anything that doesn't contain an error
       return r.status == HTTP_STATUS_OK;
     }
@@ -497,7 +630,7 @@ namespace client
         response_times.record_send(tx.method, tx.rpc.id, tx.expects_commit);
       }
 
-      connection->write(tx.rpc.encoded);
+      connection->send_request(tx.rpc);
       last_write_time = std::chrono::high_resolution_clock::now();
 
       ++written;
@@ -640,14 +773,20 @@ namespace client
       // timing gets its own new connection for any requests it wants to send -
       // these are never signed
       response_times(create_connection(true, false))
-    {}
+    {
+      if (options.subscribe_commit)
+      {
+        response_times.set_commit_subscriber(create_connection(true, true));
+      }
+    }
 
     void init_connection()
     {
       // Make sure the connection we're about to use has been initialised
       if (!rpc_connection)
       {
-        rpc_connection = create_connection(false, options.websockets);
+        rpc_connection =
+          create_connection(false, options.websockets, options.http2);
       }
     }
 
@@ -688,6 +827,11 @@ namespace client
       try
       {
         prepare_transactions();
+
+        if (options.batch_size > 1)
+        {
+          batch_prepared_transactions();
+        }
       }
       catch (std::exception& e)
       {
@@ -777,8 +921,11 @@ namespace client
       using namespace std;
       using namespace chrono;
 
-      // Write tx/s to std out
-      const auto total_txs = timing_results.total_sends;
+      // Write tx/s to std out. Each request to the batch endpoint sends
+      // several transactions
+      const auto total_txs = timing_results.total_sends +
+        options.session_count *
+          (total_tx_count(prepared_txs) - prepared_txs.size());
       const auto dur_ms =
         duration_cast<milliseconds>(timing_results.duration).count();
       const auto duration = dur_ms / 1000.0;
@@ -184,6 +184,10 @@ namespace timing
     const shared_ptr<RpcTlsClient> net_client;
     time_point<Clock> start_time;
 
+    // If set, a websocket session on which commits are pushed, rather than
+    // polled for with net_client
+    shared_ptr<RpcTlsClient> commit_subscriber = nullptr;
+
     vector<SentRequest> sends;
     vector<ReceivedReply> receives;
 
@@ -213,6 +217,11 @@ namespace timing
       active = false;
     }
 
+    void set_commit_subscriber(const shared_ptr<RpcTlsClient>& subscriber)
+    {
+      commit_subscriber = subscriber;
+    }
+
     auto get_start_time() const
     {
       return start_time;
@@ -240,6 +249,12 @@ namespace timing
     // Throws on errors, or if target is rolled back
     void wait_for_global_commit(const TransactionID& target, bool record = true)
     {
+      if (commit_subscriber != nullptr)
+      {
+        wait_for_pushed_commit(target, record);
+        return;
+      }
+
       auto params = nlohmann::json::object();
       params["view"] = target.view;
       params["seqno"] = target.seqno;
@@ -324,6 +339,77 @@ namespace timing
       }
     }
 
+    // Subscribes to the target on the commit_subscriber session, and waits
+    // for its status to be pushed. Calls record_[send/response] for the
+    // subscription, if record is true. Throws on errors, or if target is
+    // rolled back
+    void wait_for_pushed_commit(const TransactionID& target, bool record)
+    {
+      nlohmann::json tx;
+      tx["view"] = target.view;
+      tx["seqno"] = target.seqno;
+      nlohmann::json params;
+      params["txs"].push_back(tx);
+      const auto s = params.dump();
+
+      constexpr auto subscribe = "tx/subscribe";
+
+      LOG_INFO_FMT(
+        "Subscribing to transaction ID {}.{}", target.view, target.seqno);
+
+      auto response = commit_subscriber->call(subscribe, CBuffer(s));
+      const auto subscribe_id = response.id;
+      if (record)
+      {
+        record_send(subscribe, subscribe_id, false);
+      }
+
+      // Notifications may arrive before the response to the subscription, so
+      // every frame is searched for the target
+      while (true)
+      {
+        if (response.status != HTTP_STATUS_OK)
+        {
+          throw runtime_error(fmt::format(
+            "{} failed with status {}: {}",
+            subscribe,
+            http_status_str(response.status),
+            commit_subscriber->get_error(response)));
+        }
+
+        const auto body = nlohmann::json::parse(response.body);
+        const auto pushed_txs = body.value("txs", nlohmann::json::array());
+        for (const auto& pushed : pushed_txs)
+        {
+          if (
+            pushed["view"].get<size_t>() != target.view ||
+            pushed["seqno"].get<size_t>() != target.seqno)
+          {
+            continue;
+          }
+
+          const auto tx_status = pushed["status"].get<std::string>();
+          if (tx_status != "COMMITTED")
+          {
+            throw std::logic_error(fmt::format(
+              "Transaction {}.{} is now marked as {}",
+              target.view,
+              target.seqno,
+              tx_status));
+          }
+
+          LOG_INFO_FMT("Found global commit {}.{}", target.view, target.seqno);
+          if (record)
+          {
+            record_receive(subscribe_id, target, target.seqno);
+          }
+          return;
+        }
+
+        response = commit_subscriber->read_response();
+      }
+    }
+
     Results produce_results(
       bool allow_pending,
       size_t highest_local_commit,
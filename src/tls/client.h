@@ -18,5 +18,31 @@ namespace tls
     {
       cert->use(ssl.get(), cfg.get());
     }
+
+    // Offers to resume a session saved from an earlier connection to the same
+    // server, with an abbreviated handshake
+    void resume(const mbedtls_ssl_session* session)
+    {
+      int rc = mbedtls_ssl_set_session(ssl.get(), session);
+      if (rc != 0)
+      {
+        throw std::logic_error(fmt::format(
+          "mbedtls_ssl_set_session failed: {}", error_string(rc)));
+      }
+    }
+
+    // Returns the established session, which includes the session ticket
+    // issued by the server, if any
+    mbedtls::SSLSession get_session()
+    {
+      auto session = mbedtls::make_unique<mbedtls::SSLSession>();
+      int rc = mbedtls_ssl_get_session(ssl.get(), session.get());
+      if (rc != 0)
+      {
+        throw std::logic_error(fmt::format(
+          "mbedtls_ssl_get_session failed: {}", error_string(rc)));
+      }
+      return session;
+    }
   };
 }
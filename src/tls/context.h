@@ -78,7 +78,7 @@ namespace tls
       mbedtls_ssl_set_bio(ssl.get(), enclave, send, recv, nullptr);
     }
 
-    int handshake()
+    virtual int handshake()
     {
       return mbedtls_ssl_handshake(ssl.get());
     }
@@ -118,6 +118,17 @@ namespace tls
       return mbedtls_ssl_get_peer_cert(ssl.get());
     }
 
+    std::string alpn_protocol()
+    {
+      const auto protocol = mbedtls_ssl_get_alpn_protocol(ssl.get());
+      if (protocol == nullptr)
+      {
+        return {};
+      }
+
+      return protocol;
+    }
+
     void set_require_auth(bool state)
     {
       mbedtls_ssl_conf_authmode(
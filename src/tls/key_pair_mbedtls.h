@@ -118,7 +118,7 @@ namespace tls
       {
         md_type = get_md_for_ec(get_curve_id());
       }
-      MBedHashProvider hp;
+      HashProvider hp;
       bytes = hp.Hash(contents, contents_size, md_type);
       return verify_hash(bytes.data(), bytes.size(), sig, sig_size, md_type);
     }
@@ -289,7 +289,7 @@ namespace tls
       {
         md_type = get_md_for_ec(get_curve_id());
       }
-      MBedHashProvider hp;
+      HashProvider hp;
       HashBytes hash = hp.Hash(d.p, d.rawSize(), md_type);
       return sign_hash(hash.data(), hash.size());
     }
@@ -316,7 +316,7 @@ namespace tls
       {
         md_type = get_md_for_ec(get_curve_id());
       }
-      MBedHashProvider hp;
+      HashProvider hp;
       HashBytes hash = hp.Hash(d.p, d.rawSize(), md_type);
       return sign_hash(hash.data(), hash.size(), sig_size, sig);
     }
@@ -8,6 +8,7 @@
 #include <mbedtls/net_sockets.h>
 #include <mbedtls/sha256.h>
 #include <mbedtls/ssl.h>
+#include <mbedtls/ssl_ticket.h>
 #include <mbedtls/x509.h>
 #include <mbedtls/x509_crt.h>
 #include <mbedtls/x509_csr.h>
@@ -63,6 +64,16 @@ namespace mbedtls
     mbedtls_ssl_config_free);
   DEFINE_MBEDTLS_WRAPPER(
     SSLContext, mbedtls_ssl_context, mbedtls_ssl_init, mbedtls_ssl_free);
+  DEFINE_MBEDTLS_WRAPPER(
+    SSLSession,
+    mbedtls_ssl_session,
+    mbedtls_ssl_session_init,
+    mbedtls_ssl_session_free);
+  DEFINE_MBEDTLS_WRAPPER(
+    SSLTicket,
+    mbedtls_ssl_ticket_context,
+    mbedtls_ssl_ticket_init,
+    mbedtls_ssl_ticket_free);
   DEFINE_MBEDTLS_WRAPPER(
     X509Crl, mbedtls_x509_crl, mbedtls_x509_crl_init, mbedtls_x509_crl_free);
   DEFINE_MBEDTLS_WRAPPER(
@@ -19,7 +19,8 @@ namespace tls
     /// Request for a new connection to a remote peer. Enclave -> Host
     DEFINE_RINGBUFFER_MSG_TYPE(tls_connect),
 
-    /// Data read from socket, to be read inside enclave. Host -> Enclave
+    /// Data read from socket, to be read inside enclave, with the time at
+    /// which it was read (see tracing::Tracer::now()). Host -> Enclave
     DEFINE_RINGBUFFER_MSG_TYPE(tls_inbound),
 
     /// Data sent from the enclave, to be written to socket. Enclave -> Host
@@ -43,7 +44,7 @@ DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(tls::tls_start, tls::ConnID);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   tls::tls_connect, tls::ConnID, std::string, std::string);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
-  tls::tls_inbound, tls::ConnID, serializer::ByteRange);
+  tls::tls_inbound, tls::ConnID, uint64_t, serializer::ByteRange);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   tls::tls_outbound, tls::ConnID, serializer::ByteRange);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(tls::tls_stop, tls::ConnID, std::string);
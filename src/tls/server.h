@@ -3,6 +3,7 @@
 #pragma once
 
 #include "context.h"
+#include "session_tickets.h"
 
 namespace tls
 {
@@ -10,13 +11,38 @@ namespace tls
   {
   private:
     std::shared_ptr<Cert> cert;
+    std::shared_ptr<SessionTickets> tickets;
+
+    // Application protocols offered to clients, in order of preference.
+    // Clients which do not use ALPN get HTTP/1.1.
+    static inline const char* alpn_protocols[] = {"h2", "http/1.1", nullptr};
 
   public:
-    Server(std::shared_ptr<Cert> cert_, bool dtls = false) :
+    Server(
+      std::shared_ptr<Cert> cert_,
+      bool dtls = false,
+      std::shared_ptr<SessionTickets> tickets_ = nullptr) :
       Context(false, dtls),
-      cert(cert_)
+      cert(cert_),
+      tickets(tickets_)
     {
       cert->use(ssl.get(), cfg.get());
+      mbedtls_ssl_conf_alpn_protocols(cfg.get(), alpn_protocols);
+
+      if (tickets != nullptr)
+      {
+        tickets->use(cfg.get());
+      }
+    }
+
+    int handshake() override
+    {
+      const auto rc = Context::handshake();
+      if (rc == 0 && tickets != nullptr)
+      {
+        tickets->record_handshake();
+      }
+      return rc;
     }
   };
 }
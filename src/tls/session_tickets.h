@@ -0,0 +1,138 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "../ds/spin_lock.h"
+#include "entropy.h"
+#include "error_string.h"
+#include "mbedtls_wrappers.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace tls
+{
+  // Issues and accepts the session tickets (RFC 5077) of a set of server
+  // sessions, so that returning clients resume their session with an
+  // abbreviated handshake, rather than a full ECDHE exchange and certificate
+  // verification. Tickets are encrypted with keys generated in the enclave,
+  // which are replaced on each call to rotate(). Tickets issued under the
+  // previous keys are still accepted, until the next rotation.
+  class SessionTickets
+  {
+  public:
+    struct Stats
+    {
+      size_t handshakes = 0;
+      size_t resumed_handshakes = 0;
+    };
+
+  private:
+    EntropyPtr entropy;
+    uint32_t lifetime_s;
+
+    // mbedtls does not synchronise access to ticket keys (without
+    // MBEDTLS_THREADING_C), and sessions handshake on all worker threads
+    SpinLock lock;
+    mbedtls::SSLTicket current = nullptr;
+    mbedtls::SSLTicket previous = nullptr;
+
+    std::atomic<size_t> handshakes = 0;
+    std::atomic<size_t> resumed_handshakes = 0;
+
+    mbedtls::SSLTicket make_keys()
+    {
+      auto keys = mbedtls::make_unique<mbedtls::SSLTicket>();
+      int rc = mbedtls_ssl_ticket_setup(
+        keys.get(),
+        entropy->get_rng(),
+        entropy->get_data(),
+        MBEDTLS_CIPHER_AES_256_GCM,
+        lifetime_s);
+      if (rc != 0)
+      {
+        throw std::logic_error(fmt::format(
+          "mbedtls_ssl_ticket_setup failed: {}", error_string(rc)));
+      }
+      return keys;
+    }
+
+    static int write_ticket(
+      void* ctx,
+      const mbedtls_ssl_session* session,
+      unsigned char* start,
+      const unsigned char* end,
+      size_t* tlen,
+      uint32_t* lifetime)
+    {
+      auto self = static_cast<SessionTickets*>(ctx);
+      std::lock_guard<SpinLock> guard(self->lock);
+      return mbedtls_ssl_ticket_write(
+        self->current.get(), session, start, end, tlen, lifetime);
+    }
+
+    static int parse_ticket(
+      void* ctx, mbedtls_ssl_session* session, unsigned char* buf, size_t len)
+    {
+      auto self = static_cast<SessionTickets*>(ctx);
+      std::lock_guard<SpinLock> guard(self->lock);
+
+      // The ticket names its key, and is only decrypted (in place) by the
+      // context which holds it
+      int rc = mbedtls_ssl_ticket_parse(self->current.get(), session, buf, len);
+      if (
+        rc == MBEDTLS_ERR_SSL_SESSION_TICKET_EXPIRED &&
+        self->previous != nullptr)
+      {
+        rc = mbedtls_ssl_ticket_parse(self->previous.get(), session, buf, len);
+      }
+
+      if (rc == 0)
+      {
+        ++self->resumed_handshakes;
+      }
+      return rc;
+    }
+
+  public:
+    // Tickets are valid for up to two rotation intervals
+    SessionTickets(std::chrono::seconds rotation_interval) :
+      entropy(create_entropy()),
+      lifetime_s(2 * rotation_interval.count()),
+      current(make_keys())
+    {}
+
+    void use(mbedtls_ssl_config* cfg)
+    {
+      mbedtls_ssl_conf_session_tickets_cb(
+        cfg, write_ticket, parse_ticket, this);
+    }
+
+    void rotate()
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      previous = std::move(current);
+      current = make_keys();
+    }
+
+    // Discards all keys, so that no ticket issued so far is accepted, eg. when
+    // the certificate presented by the server changes
+    void reset()
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      previous = nullptr;
+      current = make_keys();
+    }
+
+    void record_handshake()
+    {
+      ++handshakes;
+    }
+
+    Stats get_stats() const
+    {
+      return {handshakes.load(), resumed_handshakes.load()};
+    }
+  };
+}
@@ -1,6 +1,8 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
 #include "../key_pair.h"
+#include "../session_tickets.h"
+#include "loopback.h"
 
 #define PICOBENCH_IMPLEMENT_WITH_MAIN
 #include <picobench/picobench.hpp>
@@ -286,4 +288,64 @@ namespace Hashes
   auto sha_512_ossl_100k =
     benchmark_hash<OpenSSLHashProvider, MDType::SHA512, 102400>;
   PICOBENCH(sha_512_ossl_100k).PICO_HASH_SUFFIX();
-}
\ No newline at end of file
+}
+// Handshakes between a new client and server session, with the server
+// configured as for RPC sessions. Resumed handshakes offer the session (and
+// ticket) established by an earlier handshake.
+template <bool Resume>
+static void benchmark_handshake(picobench::state& s)
+{
+  auto kp = make_key_pair();
+  auto server_cert = make_shared<Cert>(
+    nullptr,
+    kp->self_sign("CN=server"),
+    kp->private_key_pem(),
+    nullb,
+    auth_optional);
+  auto client_cert =
+    make_shared<Cert>(nullptr, nullopt, nullopt, nullb, auth_none);
+  auto tickets = make_shared<SessionTickets>(chrono::seconds(3600));
+
+  mbedtls::SSLSession session = nullptr;
+  if constexpr (Resume)
+  {
+    Client client(client_cert);
+    Server server(server_cert, false, tickets);
+    Loopback(client, server).handshake();
+    session = client.get_session();
+  }
+
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    Client client(client_cert);
+    Server server(server_cert, false, tickets);
+    if constexpr (Resume)
+    {
+      client.resume(session.get());
+    }
+    Loopback(client, server).handshake();
+    clobber_memory();
+  }
+  s.stop_timer();
+
+  if constexpr (Resume)
+  {
+    if (tickets->get_stats().resumed_handshakes < (size_t)s.iterations())
+    {
+      throw logic_error("Handshakes were not resumed");
+    }
+  }
+}
+
+const std::vector<int> handshake_iterations = {10, 100};
+
+PICOBENCH_SUITE("handshake");
+auto handshake_full = benchmark_handshake<false>;
+PICOBENCH(handshake_full)
+  .iterations(handshake_iterations)
+  .samples(10)
+  .baseline();
+auto handshake_resumed = benchmark_handshake<true>;
+PICOBENCH(handshake_resumed).iterations(handshake_iterations).samples(10);
@@ -0,0 +1,96 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "../client.h"
+#include "../server.h"
+
+#include <deque>
+
+namespace tls
+{
+  // Connects a client and a server context in memory
+  class Loopback
+  {
+  private:
+    struct Pipe
+    {
+      std::deque<uint8_t> in;
+      std::deque<uint8_t>* out;
+    };
+
+    Pipe client_end;
+    Pipe server_end;
+
+    static int send(void* ctx, const unsigned char* buf, size_t len)
+    {
+      auto pipe = static_cast<Pipe*>(ctx);
+      pipe->out->insert(pipe->out->end(), buf, buf + len);
+      return len;
+    }
+
+    static int recv(void* ctx, unsigned char* buf, size_t len)
+    {
+      auto pipe = static_cast<Pipe*>(ctx);
+      if (pipe->in.empty())
+      {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+      }
+
+      const auto n = std::min(len, pipe->in.size());
+      std::copy(pipe->in.begin(), pipe->in.begin() + n, buf);
+      pipe->in.erase(pipe->in.begin(), pipe->in.begin() + n);
+      return n;
+    }
+
+    static bool in_progress(int rc)
+    {
+      return rc == MBEDTLS_ERR_SSL_WANT_READ ||
+        rc == MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+
+  public:
+    Client& client;
+    Server& server;
+
+    Loopback(Client& client_, Server& server_) :
+      client(client_),
+      server(server_)
+    {
+      client_end.out = &server_end.in;
+      server_end.out = &client_end.in;
+      client.set_bio(&client_end, send, recv, nullptr);
+      server.set_bio(&server_end, send, recv, nullptr);
+    }
+
+    void handshake()
+    {
+      bool client_done = false;
+      bool server_done = false;
+      while (!client_done || !server_done)
+      {
+        if (!client_done)
+        {
+          const auto rc = client.handshake();
+          if (rc != 0 && !in_progress(rc))
+          {
+            throw std::logic_error(
+              fmt::format("Client handshake failed: {}", error_string(rc)));
+          }
+          client_done = rc == 0;
+        }
+
+        if (!server_done)
+        {
+          const auto rc = server.handshake();
+          if (rc != 0 && !in_progress(rc))
+          {
+            throw std::logic_error(
+              fmt::format("Server handshake failed: {}", error_string(rc)));
+          }
+          server_done = rc == 0;
+        }
+      }
+    }
+  };
+}
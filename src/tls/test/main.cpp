@@ -4,6 +4,8 @@
 #include "tls/base64.h"
 #include "tls/key_pair.h"
 #include "tls/rsa_key_pair.h"
+#include "tls/session_tickets.h"
+#include "tls/test/loopback.h"
 #include "tls/verifier.h"
 
 #include <chrono>
@@ -363,4 +365,71 @@ TEST_CASE("Create, sign & verify certificates")
   run_csr<KeyPair_mbedTLS, Verifier_OpenSSL>();
   run_csr<KeyPair_OpenSSL, Verifier_mbedTLS>();
   run_csr<KeyPair_OpenSSL, Verifier_OpenSSL>();
-}
\ No newline at end of file
+}
+TEST_CASE("Resume sessions with session tickets")
+{
+  auto kp = make_key_pair();
+  auto server_cert = std::make_shared<Cert>(
+    nullptr,
+    kp->self_sign("CN=server"),
+    kp->private_key_pem(),
+    nullb,
+    auth_optional);
+  auto client_cert = std::make_shared<Cert>(
+    nullptr, std::nullopt, std::nullopt, nullb, auth_none);
+  auto tickets = std::make_shared<SessionTickets>(std::chrono::seconds(60));
+
+  // Connects a new client, offering to resume the given session, and returns
+  // the session it establishes
+  auto connect = [&](const mbedtls_ssl_session* session) {
+    Client client(client_cert);
+    Server server(server_cert, false, tickets);
+    if (session != nullptr)
+    {
+      client.resume(session);
+    }
+
+    Loopback loopback(client, server);
+    loopback.handshake();
+
+    std::vector<uint8_t> buf(contents_.size());
+    REQUIRE(
+      client.write((const uint8_t*)contents_.data(), contents_.size()) ==
+      (int)contents_.size());
+    REQUIRE(server.read(buf.data(), buf.size()) == (int)contents_.size());
+    REQUIRE(std::string(buf.begin(), buf.end()) == contents_);
+
+    return client.get_session();
+  };
+
+  auto check_stats = [&](size_t handshakes, size_t resumed_handshakes) {
+    const auto stats = tickets->get_stats();
+    REQUIRE(stats.handshakes == handshakes);
+    REQUIRE(stats.resumed_handshakes == resumed_handshakes);
+  };
+
+  auto first = connect(nullptr);
+  check_stats(1, 0);
+
+  INFO("Returning client resumes its session");
+  connect(first.get());
+  check_stats(2, 1);
+
+  INFO("Tickets are accepted until the second rotation");
+  tickets->rotate();
+  connect(first.get());
+  check_stats(3, 2);
+  auto second = connect(nullptr);
+  check_stats(4, 2);
+
+  tickets->rotate();
+  connect(first.get());
+  check_stats(5, 2);
+  connect(second.get());
+  check_stats(6, 3);
+
+  INFO("No ticket is accepted after a reset");
+  tickets->reset();
+  connect(second.get());
+  check_stats(7, 3);
+}